@@ -20,7 +20,8 @@ const leafletMap = L.map('map', {
 });
 
 // Layer switcher
-L.control.layers({ "OpenStreetMap": osm, "Satellite": esriSat }, null, { collapsed: false }).addTo(leafletMap);
+const layerControl = L.control.layers({ "OpenStreetMap": osm, "Satellite": esriSat }, null, { collapsed: false })
+    .addTo(leafletMap);
 
 const markersLayer = L.layerGroup();
 markersLayer.addTo(leafletMap);
@@ -34,11 +35,22 @@ const palette = [
 ];
 
 const fmt = (n, d = 5) => Number(n).toFixed(d);
+// Coach Mode summary: minutes per HR zone and training load
+const coachHTML = (c) => (
+    `<div>Zones (min): ${c.zones.map(z => fmt(z, 0)).join(' / ')}</div>
+    <div>TRIMP: ${c.trimp} (acute ${fmt(c.acute, 1)}, chronic ${fmt(c.chronic, 1)}/h)</div>
+    <div>HR rest/median/max: ${c.rest}/${c.median}/${c.max}</div>`
+);
 const tooltipHTML = (p) => (
     `<div>
     <div><b>${p.id}</b></div>
     <div>Lat: ${fmt(p.lat)}, Lon: ${fmt(p.lon)}</div>
     <div>HR: ${p.hr} bpm</div>
+    ${p.risk !== undefined ? `<div>Risk: ${p.risk}/100</div>` : ''}
+    ${p.ele !== undefined ? `<div>Elevation: ${p.ele} m</div>` : ''}
+    ${p.grade !== undefined ? `<div>Grade: ${fmt(p.grade, 1)}%</div>` : ''}
+    ${p.climb !== undefined ? `<div>Climb: ${p.climb} m/h</div>` : ''}
+    ${p.coach !== undefined ? coachHTML(p.coach) : ''}
     </div>`
 );
 
@@ -85,7 +97,154 @@ function upsertMarkers(pointers) {
     }
 }
 
+// Heatmap: density/risk tiles published by ingest (ground/HeatmapPyramid.h).
+// Each 256 px tile carries only its occupied cells, so the whole field draws
+// at any zoom without the per-athlete records.
+const HEAT_DIR = './tiles';
+let heatIndex = null;
+let heatLayerName = 'live';
+
+async function fetchHeatIndex() {
+    try {
+        const r = await fetch(`${HEAT_DIR}/index.json`, { cache: 'no-cache' });
+        if (!r.ok) throw new Error('HTTP ' + r.status);
+        return await r.json();
+    } catch (e) {
+        console.warn('Heatmap index unavailable:', e);
+        return null;
+    }
+}
+
+// Green (low risk) to red (high risk); opacity from the cell count on a log
+// scale shared by every tile of the zoom level
+function heatColor(risk, count, maxCount) {
+    const hue = 120 * (1 - Math.min(risk, 100) / 100);
+    const a = 0.25 + 0.6 * Math.log1p(count) / Math.log1p(Math.max(maxCount, 1));
+    return `hsla(${hue}, 90%, 45%, ${a.toFixed(3)})`;
+}
+
+function drawHeatTile(canvas, buf, maxCount) {
+    const v = new DataView(buf);
+    // "HMT1" z cellBits cells x y start, then 8-byte cells
+    if (buf.byteLength < 20 || v.getUint32(0, false) !== 0x484d5431) return;
+    const side = 1 << v.getUint8(5);
+    const cells = v.getUint16(6, true);
+    const px = canvas.width / side;
+    const ctx = canvas.getContext('2d');
+    for (let i = 0, o = 20; i < cells && o + 8 <= buf.byteLength; i++, o += 8) {
+        const index = v.getUint16(o, true);
+        const risk = v.getUint8(o + 2);
+        const alerts = v.getUint8(o + 3);
+        const count = v.getUint32(o + 4, true);
+        const x = (index % side) * px, y = Math.floor(index / side) * px;
+        ctx.fillStyle = heatColor(risk, count, maxCount);
+        ctx.fillRect(x, y, px, px);
+        if (alerts) {
+            ctx.strokeStyle = '#b00000';
+            ctx.lineWidth = 2;
+            ctx.strokeRect(x + 1, y + 1, px - 2, px - 2);
+        }
+    }
+}
+
+const HeatLayer = L.GridLayer.extend({
+    createTile(coords, done) {
+        const canvas = L.DomUtil.create('canvas', 'heat-tile');
+        const size = this.getTileSize();
+        canvas.width = size.x;
+        canvas.height = size.y;
+        const layer = heatIndex && heatIndex.layers.find((l) => l.name === heatLayerName);
+        if (!layer) {
+            setTimeout(() => done(null, canvas), 0);
+            return canvas;
+        }
+        const maxCount = layer.maxCount[coords.z - heatIndex.minZoom] || 1;
+        // Tiles without athletes are not published: a 404 is an empty tile
+        fetch(`${HEAT_DIR}/${layer.name}/${coords.z}_${coords.x}_${coords.y}.bin`, { cache: 'no-cache' })
+            .then((r) => (r.ok ? r.arrayBuffer() : null))
+            .then((buf) => {
+                if (buf) drawHeatTile(canvas, buf, maxCount);
+                done(null, canvas);
+            })
+            .catch(() => done(null, canvas));
+        return canvas;
+    }
+});
+
+let heatLayer = null;
+
+function fillHeatSelect() {
+    const sel = document.getElementById('heat-layer');
+    if (!sel || !heatIndex) return;
+    const fmtTime = (s) => new Date(s * 1000).toLocaleTimeString([], { hour: '2-digit', minute: '2-digit' });
+    sel.innerHTML = heatIndex.layers.map((l) => (
+        `<option value="${l.name}">${l.start ? 'Traffic ' + fmtTime(l.start) : 'Live'}</option>`
+    )).join('');
+    if (!heatIndex.layers.some((l) => l.name === heatLayerName)) heatLayerName = 'live';
+    sel.value = heatLayerName;
+}
+
+async function refreshHeatmap() {
+    const index = await fetchHeatIndex();
+    if (!index) return;
+    const changed = !heatIndex || index.version !== heatIndex.version;
+    heatIndex = index;
+    if (!heatLayer) {
+        // Native tiles stop at maxZoom; Leaflet scales them beyond it
+        heatLayer = new HeatLayer({
+            minZoom: Math.max(index.minZoom - 2, 0),
+            minNativeZoom: index.minZoom,
+            maxNativeZoom: index.maxZoom,
+            opacity: 0.85,
+            zIndex: 5
+        }).addTo(leafletMap);
+        layerControl.addOverlay(heatLayer, 'Heatmap');
+        layerControl.addOverlay(markersLayer, 'Participants');
+    } else if (changed) {
+        heatLayer.redraw();
+    }
+    fillHeatSelect();
+}
+
+document.getElementById('heat-layer')?.addEventListener('change', (e) => {
+    heatLayerName = e.target.value;
+    if (heatLayer) heatLayer.redraw();
+});
+
+// Triage list: the head of ingest's priority queue (ground/TriageQueue.h),
+// alerts first with the longest-standing at the top, then by risk score
+async function refreshTriage() {
+    const list = document.getElementById('triage-list');
+    if (!list) return;
+    let t;
+    try {
+        const r = await fetch('./triage.json', { cache: 'no-cache' });
+        if (!r.ok) throw new Error('HTTP ' + r.status);
+        t = await r.json();
+    } catch (e) {
+        console.warn('Triage list unavailable:', e);
+        return;
+    }
+    const age = (s) => (s < 120 ? `${s} s` : `${Math.round(s / 60)} min`);
+    document.getElementById('triage-count').textContent = `${t.alerts} alerting / ${t.athletes}`;
+    list.innerHTML = t.top.map((a) => (
+        `<li class="${a.alert ? 'alert' : ''}" data-lat="${a.lat}" data-lon="${a.lon}">
+        <b>${a.id}</b> risk ${a.risk}, HR ${a.hr}${a.alert ? ` <span>ALERT ${age(a.alert_s)}</span>` : ''}
+        ${a.seen_s > 60 ? `<small>seen ${age(a.seen_s)} ago</small>` : ''}
+        </li>`
+    )).join('');
+}
+
+document.getElementById('triage-list')?.addEventListener('click', (e) => {
+    const li = e.target.closest('li');
+    if (li && li.dataset.lat !== 'null') leafletMap.setView([Number(li.dataset.lat), Number(li.dataset.lon)], Math.max(leafletMap.getZoom(), 15));
+});
+
 (async () => {
     const pointers = await fetchPointers();
-    upsertMarkers(pointers);
+    upsertMarkers(pointers || []);
+    await refreshHeatmap();
+    await refreshTriage();
+    setInterval(refreshHeatmap, 5000);
+    setInterval(refreshTriage, 2000);
 })();
\ No newline at end of file
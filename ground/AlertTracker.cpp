@@ -0,0 +1,70 @@
+#include "AlertTracker.h"
+#include <string.h>
+
+// 8N1: 10 bits on the wire per byte
+static const double EVENT_AIRTIME_MS = FRAME_EVENT_SIZE * 10.0 * 1000.0 / ALERT_LINK_BAUD;
+
+AlertTracker::AlertTracker(double pathDelay_ms) {
+  _pathDelay_ms = pathDelay_ms;
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool AlertTracker::onFrame(const AthleteFrame &f, double recv_ms, AlertReceipt &out) {
+  _stats.frames++;
+
+  // Minimum-delay filter on the clock offset; every copy is a sample
+  double sample = recv_ms - f.sentMs - EVENT_AIRTIME_MS - _pathDelay_ms;
+
+  auto it = _devices.find(f.id);
+  if (it == _devices.end()) {
+    Device d;
+    d.boot = f.boot;
+    d.offset_ms = sample;
+    d.seqCount = 0;
+    d.seqHead = 0;
+    it = _devices.emplace(f.id, d).first;
+  }
+  Device &d = it->second;
+
+  // Reset device: new event numbers, new clock
+  if (f.boot != d.boot) {
+    d.boot = f.boot;
+    d.offset_ms = sample;
+    d.seqCount = 0;
+    d.seqHead = 0;
+    _stats.reboots++;
+  }
+
+  if (sample < d.offset_ms) d.offset_ms = sample;
+
+  for (size_t i = 0; i < d.seqCount; i++) {
+    if (d.seqs[i] == f.seq) {
+      _stats.duplicates++;
+      return false;
+    }
+  }
+  d.seqs[d.seqHead] = f.seq;
+  d.seqHead = (d.seqHead + 1) % ALERT_SEQ_HISTORY;
+  if (d.seqCount < ALERT_SEQ_HISTORY) d.seqCount++;
+
+  out.id = f.id;
+  out.seq = f.seq;
+  out.kind = f.kind;
+  out.attempt = f.attempt;
+  out.queue_ms = (double)(uint32_t)(f.sentMs - f.eventMs);
+  out.latency_ms = recv_ms - (f.eventMs + d.offset_ms);
+
+  _stats.events++;
+  _stats.firstCopy[f.attempt < 3 ? f.attempt : 3]++;
+  _stats.sumLatency_ms += out.latency_ms;
+  if (_stats.events == 1 || out.latency_ms < _stats.minLatency_ms) _stats.minLatency_ms = out.latency_ms;
+  if (out.latency_ms > _stats.maxLatency_ms) _stats.maxLatency_ms = out.latency_ms;
+  return true;
+}
+
+bool AlertTracker::offset(int32_t id, double &offset_ms) const {
+  auto it = _devices.find(id);
+  if (it == _devices.end()) return false;
+  offset_ms = it->second.offset_ms;
+  return true;
+}
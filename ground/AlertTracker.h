@@ -0,0 +1,75 @@
+#ifndef ALERT_TRACKER_H
+#define ALERT_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "frame.h"
+
+// Receipt side of the priority alert path ('e' frames).
+// Every alert is sent several times (no downlink acknowledgement), so repeats
+// are folded into one event per (device, boot, seq). A frame with a new boot
+// id means the device was reset: its event numbers and millis() started over,
+// so the remembered numbers and the clock offset of that device are dropped.
+//
+// Latency: the device stamps event_ms and sent_ms with its own millis(). Per
+// device the clock offset is estimated as the minimum over all event copies of
+// (receive - sent_ms - airtime - path delay): the fastest copy bounds the link
+// delay from below. A one-way link cannot observe its constant propagation
+// delay, so that part comes from configuration (pathDelay_ms). Trigger-to-
+// receipt latency is then receive - (event_ms + offset): exact on-device
+// queueing, plus airtime and path delay, plus link delay in excess of the
+// fastest copy seen so far.
+
+#define ALERT_LINK_BAUD 9600
+#define ALERT_SEQ_HISTORY 64 // recent event numbers remembered per device
+
+struct AlertReceipt {
+  int32_t id;
+  uint16_t seq;
+  uint8_t kind;
+  uint8_t attempt;    // copy that arrived first (0 = original)
+  double latency_ms;  // trigger to receipt, estimated
+  double queue_ms;    // trigger to transmission, device clock
+};
+
+struct AlertStats {
+  uint32_t events;
+  uint32_t frames;      // event frames received, repeats included
+  uint32_t duplicates;
+  uint32_t reboots;     // devices seen again with a new boot id
+  uint32_t firstCopy[4]; // events whose first received copy was attempt 0, 1, 2, 3+
+  double sumLatency_ms;
+  double minLatency_ms;
+  double maxLatency_ms;
+};
+
+class AlertTracker {
+public:
+  explicit AlertTracker(double pathDelay_ms = 0.0);
+
+  // Feed one 'e' frame received at recv_ms (ground clock). Returns true and
+  // fills `out` for the first copy of an event, false for repeats.
+  bool onFrame(const AthleteFrame &f, double recv_ms, AlertReceipt &out);
+
+  const AlertStats &stats() const { return _stats; }
+
+  // Estimated ground-minus-device clock offset (ms); false if unknown.
+  bool offset(int32_t id, double &offset_ms) const;
+
+private:
+  struct Device {
+    double offset_ms;
+    uint16_t boot;
+    uint16_t seqs[ALERT_SEQ_HISTORY];
+    size_t seqCount;
+    size_t seqHead;
+  };
+
+  double _pathDelay_ms;
+  std::unordered_map<int32_t, Device> _devices;
+  AlertStats _stats;
+};
+
+#endif // ALERT_TRACKER_H
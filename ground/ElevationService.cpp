@@ -0,0 +1,261 @@
+#include "ElevationService.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const double METERS_PER_DEG = 111320.0;
+static const double DEG2RAD = M_PI / 180.0;
+
+ElevationService::ElevationService(const std::string &dir, size_t maxTiles)
+    : _dir(dir), _maxTiles(std::max<size_t>(maxTiles, 1)), _last(nullptr), _clock(0), _stats() {
+  _tiles.reserve(_maxTiles); // never grows past this: _last stays valid
+}
+
+ElevationService::~ElevationService() {
+  for (Tile &t : _tiles) unmapTile(t);
+}
+
+void ElevationService::setDirectory(const std::string &dir) {
+  for (Tile &t : _tiles) unmapTile(t);
+  _tiles.clear();
+  _last = nullptr;
+  _dir = dir;
+}
+
+size_t ElevationService::tilesMapped() const {
+  size_t n = 0;
+  for (const Tile &t : _tiles) n += t.format != FORMAT_NONE;
+  return n;
+}
+
+bool ElevationService::mapTile(Tile &t, int lat, int lon) {
+  char name[24];
+  snprintf(name, sizeof(name), "%c%02d%c%03d", lat >= 0 ? 'N' : 'S', abs(lat), lon >= 0 ? 'E' : 'W', abs(lon));
+
+  static const struct {
+    const char *ext;
+    Format format;
+  } KINDS[] = {{".hgt", FORMAT_HGT}, {".f32", FORMAT_F32}};
+  for (const auto &k : KINDS) {
+    std::string path = _dir + "/" + name + k.ext;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) continue;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      continue;
+    }
+    const size_t len = (size_t)st.st_size;
+
+    uint32_t rows, cols;
+    if (k.format == FORMAT_HGT) {
+      rows = cols = (uint32_t)lround(sqrt(len / 2.0));
+      if ((size_t)rows * cols * 2 != len || rows < 2) {
+        fprintf(stderr, "[dem] %s: not a square int16 grid\n", path.c_str());
+        close(fd);
+        continue;
+      }
+    } else {
+      rows = ELEVATION_F32_ROWS;
+      cols = (uint32_t)(len / (4 * (size_t)rows));
+      if ((size_t)rows * cols * 4 != len || cols < 2) {
+        fprintf(stderr, "[dem] %s: size is not %u rows of float32\n", path.c_str(), rows);
+        close(fd);
+        continue;
+      }
+    }
+
+    void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      perror(path.c_str());
+      continue;
+    }
+    // Fixes land anywhere in the tile; do not read ahead around each one
+    madvise(map, len, MADV_RANDOM);
+
+    t.format = k.format;
+    t.data = (const uint8_t *)map;
+    t.length = len;
+    t.rows = rows;
+    t.cols = cols;
+    // .hgt shares its edges with the neighbours (n posts span n - 1 gaps);
+    // .f32 stops one post short of the southern and eastern edges
+    t.rowScale = k.format == FORMAT_HGT ? rows - 1 : rows;
+    t.colScale = k.format == FORMAT_HGT ? cols - 1 : cols;
+    return true;
+  }
+  return false;
+}
+
+void ElevationService::unmapTile(Tile &t) {
+  if (t.format != FORMAT_NONE && t.data) munmap((void *)t.data, t.length);
+  t.format = FORMAT_NONE;
+  t.data = nullptr;
+  t.length = 0;
+}
+
+ElevationService::Tile *ElevationService::tile(int lat, int lon) {
+  const int32_t key = tileKey(lat, lon);
+  _clock++;
+  if (_last && _last->key == key) {
+    _last->lastUse = _clock;
+    _stats.tileHits++;
+    return _last;
+  }
+  for (Tile &t : _tiles) {
+    if (t.key == key) {
+      t.lastUse = _clock;
+      _stats.tileHits++;
+      return _last = &t;
+    }
+  }
+
+  // Not cached: take a free slot or evict the least recently used
+  Tile *slot;
+  if (_tiles.size() < _maxTiles) {
+    _tiles.push_back(Tile());
+    slot = &_tiles.back();
+  } else {
+    slot = &_tiles[0];
+    for (Tile &t : _tiles) {
+      if (t.lastUse < slot->lastUse) slot = &t;
+    }
+    unmapTile(*slot);
+    _stats.evictions++;
+  }
+  *slot = Tile();
+  slot->key = key;
+  slot->format = FORMAT_NONE;
+  slot->lastUse = _clock;
+  if (mapTile(*slot, lat, lon)) _stats.tileLoads++;
+  return _last = slot;
+}
+
+float ElevationService::post(const Tile &t, uint32_t row, uint32_t col) const {
+  const size_t i = (size_t)row * t.cols + col;
+  float v;
+  if (t.format == FORMAT_HGT) {
+    const uint8_t *p = t.data + 2 * i;
+    v = (float)(int16_t)((p[0] << 8) | p[1]);
+  } else {
+    memcpy(&v, t.data + 4 * i, sizeof(v));
+  }
+  return v < ELEVATION_VOID_BELOW ? NAN : v;
+}
+
+TerrainSample ElevationService::sampleTile(const Tile &t, int lat, int lon, double lat_deg, double lon_deg) {
+  TerrainSample s = {NAN, NAN, NAN, false};
+  if (t.format == FORMAT_NONE) {
+    _stats.noData++;
+    return s;
+  }
+
+  // Row 0 is the northern edge
+  const double y = (lat + 1 - lat_deg) * t.rowScale;
+  const double x = (lon_deg - lon) * t.colScale;
+  const uint32_t r0 = std::min((uint32_t)y, t.rows - 1), c0 = std::min((uint32_t)x, t.cols - 1);
+  // .f32 has no post on the southern/eastern edge: repeat the last one there
+  const uint32_t r1 = std::min(r0 + 1, t.rows - 1), c1 = std::min(c0 + 1, t.cols - 1);
+  const float fy = (float)(y - r0), fx = (float)(x - c0);
+
+  float z00 = post(t, r0, c0), z01 = post(t, r0, c1);
+  float z10 = post(t, r1, c0), z11 = post(t, r1, c1);
+
+  // Voids: fill from the valid corners
+  if (isnan(z00) || isnan(z01) || isnan(z10) || isnan(z11)) {
+    float sum = 0;
+    int n = 0;
+    for (float z : {z00, z01, z10, z11}) {
+      if (!isnan(z)) {
+        sum += z;
+        n++;
+      }
+    }
+    if (n == 0) {
+      _stats.noData++;
+      return s;
+    }
+    const float fill = sum / n;
+    if (isnan(z00)) z00 = fill;
+    if (isnan(z01)) z01 = fill;
+    if (isnan(z10)) z10 = fill;
+    if (isnan(z11)) z11 = fill;
+  }
+
+  const float north = z00 + (z01 - z00) * fx; // interpolated along the upper row
+  const float south = z10 + (z11 - z10) * fx;
+  s.elevation_m = north + (south - north) * fy;
+
+  // Gradient of the bilinear patch, per metre east and north
+  const double postE_m = METERS_PER_DEG * cos(lat_deg * DEG2RAD) / t.colScale;
+  const double postN_m = METERS_PER_DEG / t.rowScale;
+  const double dzdx = ((z01 - z00) * (1 - fy) + (z11 - z10) * fy) / postE_m;
+  const double dzdy = -(south - north) / postN_m; // rows run south
+  s.slope_deg = (float)(atan(sqrt(dzdx * dzdx + dzdy * dzdy)) / DEG2RAD);
+  double aspect = atan2(-dzdx, -dzdy) / DEG2RAD;
+  s.aspect_deg = (float)(aspect < 0 ? aspect + 360.0 : aspect + 0.0); // + 0.0: no "-0"
+  s.valid = true;
+  return s;
+}
+
+TerrainSample ElevationService::sample(double lat_deg, double lon_deg) {
+  _stats.queries++;
+  if (!enabled() || !(lat_deg >= -90 && lat_deg < 90 && lon_deg >= -180 && lon_deg < 180)) {
+    _stats.noData++;
+    return TerrainSample{NAN, NAN, NAN, false};
+  }
+  const int lat = (int)floor(lat_deg), lon = (int)floor(lon_deg);
+  return sampleTile(*tile(lat, lon), lat, lon, lat_deg, lon_deg);
+}
+
+float ElevationService::elevation(double lat_deg, double lon_deg) {
+  return sample(lat_deg, lon_deg).elevation_m;
+}
+
+size_t ElevationService::sampleBatch(const double *lat_deg, const double *lon_deg, size_t n, TerrainSample *out) {
+  // Sort key: tile, then 1/4096 degree latitude band from the north, then
+  // input index
+  _order.resize(n);
+  size_t valid = 0;
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    const double la = lat_deg[i], lo = lon_deg[i];
+    if (!enabled() || !(la >= -90 && la < 90 && lo >= -180 && lo < 180)) {
+      _stats.queries++;
+      _stats.noData++;
+      out[i] = TerrainSample{NAN, NAN, NAN, false};
+      continue;
+    }
+    const int lat = (int)floor(la), lon = (int)floor(lo);
+    const uint64_t band = std::min<uint64_t>((uint64_t)((lat + 1 - la) * 4096.0), 4095);
+    _order[m++] = ((uint64_t)tileKey(lat, lon) << 44) | (band << 32) | i;
+  }
+  std::sort(_order.begin(), _order.begin() + m);
+
+  const Tile *t = nullptr;
+  int32_t key = -1;
+  int lat = 0, lon = 0;
+  for (size_t k = 0; k < m; k++) {
+    const size_t i = (size_t)(_order[k] & 0xFFFFFFFFu);
+    const int32_t tk = (int32_t)(_order[k] >> 44);
+    if (tk != key) {
+      key = tk;
+      lat = (int)floor(lat_deg[i]);
+      lon = (int)floor(lon_deg[i]);
+      t = tile(lat, lon);
+    } else {
+      _stats.tileHits++;
+    }
+    _stats.queries++;
+    out[i] = sampleTile(*t, lat, lon, lat_deg[i], lon_deg[i]);
+    valid += out[i].valid;
+  }
+  return valid;
+}
@@ -0,0 +1,99 @@
+#ifndef ELEVATION_SERVICE_H
+#define ELEVATION_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Terrain elevation from 1x1 degree DEM tiles on local disk.
+//
+// Tiles are memory-mapped and sampled in place, so a query touches the four
+// posts around the point (one or two pages) instead of reading the tile. An
+// LRU of ELEVATION_MAX_TILES mappings bounds address space and open tiles;
+// tiles that are not on disk are remembered too, so fixes over a gap do not
+// probe the file system each time.
+//
+// Tile files are named after their south-west corner, e.g. N45E006:
+//   N45E006.hgt  SRTM: big-endian int16 metres, n x n posts (1201 or 3601),
+//                edges shared with the neighbours, -32768 = void
+//   N45E006.f32  raw little-endian float32 metres, north to south, 3600 rows,
+//                first post on the north-west corner; columns from the size.
+//                This is Copernicus GLO-30 converted from its GeoTIFF, e.g.
+//                gdal_translate -of ENVI -ot Float32 Copernicus_DSM_COG_10_N45_00_E006_00_DEM.tif N45E006.f32
+// Elevation is bilinear between posts; slope and aspect come from the
+// gradient of the same bilinear patch.
+
+#define ELEVATION_MAX_TILES 16
+#define ELEVATION_F32_ROWS 3600
+#define ELEVATION_VOID_BELOW -1000.0f // values below this are no-data
+
+struct TerrainSample {
+  float elevation_m; // NaN without data
+  float slope_deg;   // 0 = flat
+  float aspect_deg;  // compass direction the slope faces (downhill), 0 = north
+  bool valid;
+};
+
+struct ElevationStats {
+  uint64_t queries;
+  uint64_t tileHits;   // answered by an already mapped (or known missing) tile
+  uint64_t tileLoads;  // tiles mapped
+  uint64_t evictions;
+  uint64_t noData;     // no tile or void posts
+};
+
+class ElevationService {
+public:
+  explicit ElevationService(const std::string &dir = "", size_t maxTiles = ELEVATION_MAX_TILES);
+  ~ElevationService();
+  ElevationService(const ElevationService &) = delete;
+  ElevationService &operator=(const ElevationService &) = delete;
+
+  void setDirectory(const std::string &dir);
+  bool enabled() const { return !_dir.empty(); }
+
+  // Elevation (m) at a point; NaN without data
+  float elevation(double lat_deg, double lon_deg);
+  TerrainSample sample(double lat_deg, double lon_deg);
+
+  // Many points at once. Points are visited grouped by tile and row, so each
+  // tile is looked up once and neighbouring points share pages. out has n
+  // entries in input order. Returns the number of valid samples.
+  size_t sampleBatch(const double *lat_deg, const double *lon_deg, size_t n, TerrainSample *out);
+
+  const ElevationStats &stats() const { return _stats; }
+  size_t tilesMapped() const;
+
+private:
+  enum Format { FORMAT_NONE, FORMAT_HGT, FORMAT_F32 };
+
+  struct Tile {
+    int32_t key;        // tileKey() of the south-west corner
+    Format format;      // FORMAT_NONE: no file for this tile
+    const uint8_t *data;
+    size_t length;
+    uint32_t rows;
+    uint32_t cols;
+    double rowScale;    // posts per degree
+    double colScale;
+    uint64_t lastUse;
+  };
+
+  static int32_t tileKey(int lat, int lon) { return (lat + 90) * 360 + (lon + 180); }
+  Tile *tile(int lat, int lon);
+  bool mapTile(Tile &t, int lat, int lon);
+  void unmapTile(Tile &t);
+  TerrainSample sampleTile(const Tile &t, int lat, int lon, double lat_deg, double lon_deg);
+  float post(const Tile &t, uint32_t row, uint32_t col) const;
+
+  std::string _dir;
+  size_t _maxTiles;
+  std::vector<Tile> _tiles;
+  Tile *_last;          // tile of the previous query
+  uint64_t _clock;
+  ElevationStats _stats;
+  std::vector<uint64_t> _order; // batch scratch: (tile, row) key << 32 | index
+};
+
+#endif // ELEVATION_SERVICE_H
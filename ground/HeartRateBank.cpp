@@ -0,0 +1,458 @@
+#include "HeartRateBank.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HRB_X86 1
+#include <immintrin.h>
+#else
+#define HRB_X86 0
+#endif
+
+typedef HeartRateBank::BlockStats BlockStats;
+typedef HeartRateBank::BlockScore BlockScore;
+typedef void (*StatsKernel)(const uint32_t *red, const uint32_t *ir, BlockStats &st);
+typedef void (*ScoreKernel)(const BlockStats &st, const BlockScore &s);
+
+// ======= Window statistics kernels =======
+// One block: red/ir point at [HRB_WINDOW][HRB_LANES]. Every lane runs over
+// window positions 0..HRB_WINDOW-1 in order, as the device does, so the float
+// variance sums round the same way in every kernel.
+
+static void statsScalar(const uint32_t *red, const uint32_t *ir, BlockStats &st) {
+  for (int l = 0; l < HRB_LANES; l++) {
+    uint64_t irSum = 0, redSum = 0;
+    uint32_t irMax = 0, irMin = 0xFFFFFFFF, redMax = 0, redMin = 0xFFFFFFFF;
+    for (int i = 0; i < HRB_WINDOW; i++) {
+      const uint32_t x = ir[i * HRB_LANES + l], y = red[i * HRB_LANES + l];
+      irSum += x;
+      redSum += y;
+      if (x > irMax) irMax = x;
+      if (x < irMin) irMin = x;
+      if (y > redMax) redMax = y;
+      if (y < redMin) redMin = y;
+    }
+    st.irAvg[l] = (uint32_t)(irSum / HRB_WINDOW);
+    st.redAvg[l] = (uint32_t)(redSum / HRB_WINDOW);
+    st.irMax[l] = irMax;
+    st.irMin[l] = irMin;
+    st.redMax[l] = redMax;
+    st.redMin[l] = redMin;
+
+    float variance = 0;
+    const float mean = (float)st.irAvg[l];
+    for (int i = 0; i < HRB_WINDOW; i++) {
+      float diff = (float)ir[i * HRB_LANES + l] - mean;
+      variance += diff * diff;
+    }
+    st.irVar[l] = variance;
+  }
+}
+
+#if HRB_X86
+
+// uint32 -> float, rounded like a scalar conversion: both halves convert
+// exactly, so the one rounding is in the add. (cvtepi32 alone is signed.)
+__attribute__((target("avx2"))) static inline __m256 u32ToFloat8(__m256i v) {
+  __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16)), _mm256_set1_ps(65536.0f));
+  return _mm256_add_ps(hi, _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF))));
+}
+
+__attribute__((target("avx2"))) static void statsAvx2(const uint32_t *red, const uint32_t *ir, BlockStats &st) {
+  const __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi32(-1);
+  __m256i irMax = zero, irMin = ones, redMax = zero, redMin = ones;
+  __m256i irLo = zero, irHi = zero, redLo = zero, redHi = zero; // 64-bit sums, lanes 0-3 / 4-7
+  for (int i = 0; i < HRB_WINDOW; i++) {
+    const __m256i x = _mm256_loadu_si256((const __m256i *)(ir + i * HRB_LANES));
+    const __m256i y = _mm256_loadu_si256((const __m256i *)(red + i * HRB_LANES));
+    irMax = _mm256_max_epu32(irMax, x);
+    irMin = _mm256_min_epu32(irMin, x);
+    redMax = _mm256_max_epu32(redMax, y);
+    redMin = _mm256_min_epu32(redMin, y);
+    irLo = _mm256_add_epi64(irLo, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)));
+    irHi = _mm256_add_epi64(irHi, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)));
+    redLo = _mm256_add_epi64(redLo, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(y)));
+    redHi = _mm256_add_epi64(redHi, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(y, 1)));
+  }
+  _mm256_storeu_si256((__m256i *)st.irMax, irMax);
+  _mm256_storeu_si256((__m256i *)st.irMin, irMin);
+  _mm256_storeu_si256((__m256i *)st.redMax, redMax);
+  _mm256_storeu_si256((__m256i *)st.redMin, redMin);
+
+  uint64_t irSum[HRB_LANES], redSum[HRB_LANES];
+  _mm256_storeu_si256((__m256i *)(irSum + 0), irLo);
+  _mm256_storeu_si256((__m256i *)(irSum + 4), irHi);
+  _mm256_storeu_si256((__m256i *)(redSum + 0), redLo);
+  _mm256_storeu_si256((__m256i *)(redSum + 4), redHi);
+  for (int l = 0; l < HRB_LANES; l++) {
+    st.irAvg[l] = (uint32_t)(irSum[l] / HRB_WINDOW);
+    st.redAvg[l] = (uint32_t)(redSum[l] / HRB_WINDOW);
+  }
+
+  const __m256 mean = u32ToFloat8(_mm256_loadu_si256((const __m256i *)st.irAvg));
+  __m256 variance = _mm256_setzero_ps();
+  for (int i = 0; i < HRB_WINDOW; i++) {
+    __m256 diff = _mm256_sub_ps(u32ToFloat8(_mm256_loadu_si256((const __m256i *)(ir + i * HRB_LANES))), mean);
+    variance = _mm256_add_ps(variance, _mm256_mul_ps(diff, diff));
+  }
+  _mm256_storeu_ps(st.irVar, variance);
+}
+
+__attribute__((target("sse4.1"))) static inline __m128 u32ToFloat4(__m128i v) {
+  __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(v, 16)), _mm_set1_ps(65536.0f));
+  return _mm_add_ps(hi, _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xFFFF))));
+}
+
+__attribute__((target("sse4.1"))) static void statsSse41(const uint32_t *red, const uint32_t *ir, BlockStats &st) {
+  const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi32(-1);
+  for (int h = 0; h < HRB_LANES; h += 4) {
+    __m128i irMax = zero, irMin = ones, redMax = zero, redMin = ones;
+    __m128i irLo = zero, irHi = zero, redLo = zero, redHi = zero;
+    for (int i = 0; i < HRB_WINDOW; i++) {
+      const __m128i x = _mm_loadu_si128((const __m128i *)(ir + i * HRB_LANES + h));
+      const __m128i y = _mm_loadu_si128((const __m128i *)(red + i * HRB_LANES + h));
+      irMax = _mm_max_epu32(irMax, x);
+      irMin = _mm_min_epu32(irMin, x);
+      redMax = _mm_max_epu32(redMax, y);
+      redMin = _mm_min_epu32(redMin, y);
+      irLo = _mm_add_epi64(irLo, _mm_cvtepu32_epi64(x));
+      irHi = _mm_add_epi64(irHi, _mm_cvtepu32_epi64(_mm_srli_si128(x, 8)));
+      redLo = _mm_add_epi64(redLo, _mm_cvtepu32_epi64(y));
+      redHi = _mm_add_epi64(redHi, _mm_cvtepu32_epi64(_mm_srli_si128(y, 8)));
+    }
+    _mm_storeu_si128((__m128i *)(st.irMax + h), irMax);
+    _mm_storeu_si128((__m128i *)(st.irMin + h), irMin);
+    _mm_storeu_si128((__m128i *)(st.redMax + h), redMax);
+    _mm_storeu_si128((__m128i *)(st.redMin + h), redMin);
+
+    uint64_t irSum[4], redSum[4];
+    _mm_storeu_si128((__m128i *)(irSum + 0), irLo);
+    _mm_storeu_si128((__m128i *)(irSum + 2), irHi);
+    _mm_storeu_si128((__m128i *)(redSum + 0), redLo);
+    _mm_storeu_si128((__m128i *)(redSum + 2), redHi);
+    for (int l = 0; l < 4; l++) {
+      st.irAvg[h + l] = (uint32_t)(irSum[l] / HRB_WINDOW);
+      st.redAvg[h + l] = (uint32_t)(redSum[l] / HRB_WINDOW);
+    }
+
+    const __m128 mean = u32ToFloat4(_mm_loadu_si128((const __m128i *)(st.irAvg + h)));
+    __m128 variance = _mm_setzero_ps();
+    for (int i = 0; i < HRB_WINDOW; i++) {
+      __m128 diff = _mm_sub_ps(u32ToFloat4(_mm_loadu_si128((const __m128i *)(ir + i * HRB_LANES + h))), mean);
+      variance = _mm_add_ps(variance, _mm_mul_ps(diff, diff));
+    }
+    _mm_storeu_ps(st.irVar + h, variance);
+  }
+}
+
+#endif // HRB_X86
+
+// ======= Scoring kernels =======
+// HeartRate_Service::calculateSpO2() and calculateSignalQuality() for the
+// channels of a block whose window is full. Keep the expressions, and their
+// float/double promotions, as they are on the device.
+
+static void scoreScalar(const BlockStats &st, const BlockScore &s) {
+  for (int l = 0; l < HRB_LANES; l++) {
+    if (!s.full[l]) continue;
+
+    // SpO2
+    s.redDC[l] = st.redAvg[l];
+    s.irDC[l] = st.irAvg[l];
+    s.redAC[l] = (float)(st.redMax[l] - st.redMin[l]);
+    s.irAC[l] = (float)(st.irMax[l] - st.irMin[l]);
+    if (s.redDC[l] != 0 && s.irDC[l] != 0 && s.irAC[l] != 0) {
+      float R = (s.redAC[l] / s.redDC[l]) / (s.irAC[l] / s.irDC[l]);
+      if (!std::isnan(s.temperature[l])) {
+        R *= 1.0 - HRB_SPO2_R_TEMP_COEF * (s.temperature[l] - HRB_SPO2_REF_TEMP);
+      }
+      float spO2 = 110.0 - 25.0 * R;
+      if (spO2 < HRB_SPO2_MIN) spO2 = HRB_SPO2_MIN;
+      if (spO2 > HRB_SPO2_MAX) spO2 = HRB_SPO2_MAX;
+      if (s.lastSpO2[l] > 0) spO2 = (s.lastSpO2[l] * 0.8) + (spO2 * 0.2);
+      s.lastSpO2[l] = spO2;
+    }
+
+    // Signal quality
+    float variance = st.irVar[l];
+    variance /= HRB_WINDOW;
+    const float irStdDev = std::sqrt(variance);
+
+    float strengthScore = 0;
+    if (st.irAvg[l] > HRB_FINGER_THRESHOLD) strengthScore = std::min(100.0, (float)st.irAvg[l] / 2000.0);
+    float variationScore = 0;
+    if (s.irAC[l] > 100) variationScore = std::min(100.0, s.irAC[l] / 100.0);
+    float stabilityScore = 100.0 - std::min(100.0, irStdDev / 100.0);
+    s.signalQuality[l] = (strengthScore * 0.5) + (variationScore * 0.3) + (stabilityScore * 0.2);
+  }
+}
+
+#if HRB_X86
+
+// float lanes 0-3 / 4-7 widened to double, and back (rounded to nearest, as
+// a scalar double -> float assignment). min_pd(x, c) is x < c ? x : c, the
+// same as std::min(c, x).
+__attribute__((target("avx2"))) static inline __m256d lo4(__m256 v) {
+  return _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+}
+
+__attribute__((target("avx2"))) static inline __m256d hi4(__m256 v) {
+  return _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+}
+
+__attribute__((target("avx2"))) static inline __m256 join(__m256d lo, __m256d hi) {
+  return _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo));
+}
+
+// (float)(100.0 - min(100.0, x / 100.0)) style pieces, one half at a time
+__attribute__((target("avx2"))) static inline __m256d capped(__m256d x, double div) {
+  return _mm256_min_pd(_mm256_div_pd(x, _mm256_set1_pd(div)), _mm256_set1_pd(100.0));
+}
+
+__attribute__((target("avx2"))) static void scoreAvx2(const BlockStats &st, const BlockScore &s) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256i full8 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)s.full));
+  const __m256 full = _mm256_castsi256_ps(_mm256_cmpgt_epi32(full8, _mm256_setzero_si256()));
+
+  // SpO2
+  const __m256i irAvg = _mm256_loadu_si256((const __m256i *)st.irAvg);
+  const __m256 redDC = u32ToFloat8(_mm256_loadu_si256((const __m256i *)st.redAvg));
+  const __m256 irDC = u32ToFloat8(irAvg);
+  const __m256 redAC = u32ToFloat8(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)st.redMax),
+                                                    _mm256_loadu_si256((const __m256i *)st.redMin)));
+  const __m256 irAC = u32ToFloat8(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)st.irMax),
+                                                   _mm256_loadu_si256((const __m256i *)st.irMin)));
+  _mm256_storeu_ps(s.redDC, _mm256_blendv_ps(_mm256_loadu_ps(s.redDC), redDC, full));
+  _mm256_storeu_ps(s.irDC, _mm256_blendv_ps(_mm256_loadu_ps(s.irDC), irDC, full));
+  _mm256_storeu_ps(s.redAC, _mm256_blendv_ps(_mm256_loadu_ps(s.redAC), redAC, full));
+  _mm256_storeu_ps(s.irAC, _mm256_blendv_ps(_mm256_loadu_ps(s.irAC), irAC, full));
+
+  __m256 ok = _mm256_and_ps(_mm256_cmp_ps(redDC, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(irDC, zero, _CMP_NEQ_UQ));
+  ok = _mm256_and_ps(_mm256_and_ps(ok, _mm256_cmp_ps(irAC, zero, _CMP_NEQ_UQ)), full);
+
+  __m256 R = _mm256_div_ps(_mm256_div_ps(redAC, redDC), _mm256_div_ps(irAC, irDC));
+  const __m256 temp = _mm256_loadu_ps(s.temperature);
+  const __m256d coef = _mm256_set1_pd(HRB_SPO2_R_TEMP_COEF), ref = _mm256_set1_pd(HRB_SPO2_REF_TEMP);
+  const __m256d one = _mm256_set1_pd(1.0);
+  __m256d c0 = _mm256_sub_pd(one, _mm256_mul_pd(coef, _mm256_sub_pd(lo4(temp), ref)));
+  __m256d c1 = _mm256_sub_pd(one, _mm256_mul_pd(coef, _mm256_sub_pd(hi4(temp), ref)));
+  __m256 Rt = join(_mm256_mul_pd(lo4(R), c0), _mm256_mul_pd(hi4(R), c1));
+  R = _mm256_blendv_ps(R, Rt, _mm256_cmp_ps(temp, temp, _CMP_ORD_Q));
+
+  const __m256d k110 = _mm256_set1_pd(110.0), k25 = _mm256_set1_pd(25.0);
+  __m256 spO2 = join(_mm256_sub_pd(k110, _mm256_mul_pd(k25, lo4(R))), _mm256_sub_pd(k110, _mm256_mul_pd(k25, hi4(R))));
+  const __m256 lo = _mm256_set1_ps(HRB_SPO2_MIN), hi = _mm256_set1_ps(HRB_SPO2_MAX);
+  spO2 = _mm256_blendv_ps(spO2, lo, _mm256_cmp_ps(spO2, lo, _CMP_LT_OQ));
+  spO2 = _mm256_blendv_ps(spO2, hi, _mm256_cmp_ps(spO2, hi, _CMP_GT_OQ));
+
+  const __m256 last = _mm256_loadu_ps(s.lastSpO2);
+  const __m256d k08 = _mm256_set1_pd(0.8), k02 = _mm256_set1_pd(0.2);
+  __m256 smooth = join(_mm256_add_pd(_mm256_mul_pd(lo4(last), k08), _mm256_mul_pd(lo4(spO2), k02)),
+                       _mm256_add_pd(_mm256_mul_pd(hi4(last), k08), _mm256_mul_pd(hi4(spO2), k02)));
+  spO2 = _mm256_blendv_ps(spO2, smooth, _mm256_cmp_ps(last, zero, _CMP_GT_OQ));
+  _mm256_storeu_ps(s.lastSpO2, _mm256_blendv_ps(last, spO2, ok));
+
+  // Signal quality
+  const __m256 irStdDev = _mm256_sqrt_ps(_mm256_div_ps(_mm256_loadu_ps(st.irVar), _mm256_set1_ps(HRB_WINDOW)));
+  const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+  const __m256 finger = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+      _mm256_xor_si256(irAvg, sign), _mm256_xor_si256(_mm256_set1_epi32(HRB_FINGER_THRESHOLD), sign)));
+  __m256 strength = _mm256_and_ps(join(capped(lo4(irDC), 2000.0), capped(hi4(irDC), 2000.0)), finger);
+  __m256 variation = _mm256_and_ps(join(capped(lo4(irAC), 100.0), capped(hi4(irAC), 100.0)),
+                                   _mm256_cmp_ps(irAC, _mm256_set1_ps(100.0f), _CMP_GT_OQ));
+  const __m256d k100 = _mm256_set1_pd(100.0);
+  __m256 stability = join(_mm256_sub_pd(k100, capped(lo4(irStdDev), 100.0)),
+                          _mm256_sub_pd(k100, capped(hi4(irStdDev), 100.0)));
+
+  const __m256d k05 = _mm256_set1_pd(0.5), k03 = _mm256_set1_pd(0.3);
+  __m256d q0 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(lo4(strength), k05), _mm256_mul_pd(lo4(variation), k03)),
+                             _mm256_mul_pd(lo4(stability), k02));
+  __m256d q1 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(hi4(strength), k05), _mm256_mul_pd(hi4(variation), k03)),
+                             _mm256_mul_pd(hi4(stability), k02));
+  _mm256_storeu_ps(s.signalQuality, _mm256_blendv_ps(_mm256_loadu_ps(s.signalQuality), join(q0, q1), full));
+}
+
+#endif // HRB_X86
+
+struct Kernels {
+  StatsKernel stats;
+  ScoreKernel score;
+};
+
+static const Kernels &kernelFns(HeartRateKernel k) {
+  static const Kernels scalar = {statsScalar, scoreScalar};
+#if HRB_X86
+  static const Kernels sse41 = {statsSse41, scoreScalar};
+  static const Kernels avx2 = {statsAvx2, scoreAvx2};
+  if (k == HRB_KERNEL_AVX2) return avx2;
+  if (k == HRB_KERNEL_SSE41) return sse41;
+#endif
+  (void)k;
+  return scalar;
+}
+
+bool HeartRateBank::kernelSupported(HeartRateKernel k) {
+  switch (k) {
+    case HRB_KERNEL_SCALAR:
+      return true;
+#if HRB_X86
+    case HRB_KERNEL_SSE41:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.1");
+    case HRB_KERNEL_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+HeartRateKernel HeartRateBank::bestKernel() {
+  if (kernelSupported(HRB_KERNEL_AVX2)) return HRB_KERNEL_AVX2;
+  if (kernelSupported(HRB_KERNEL_SSE41)) return HRB_KERNEL_SSE41;
+  return HRB_KERNEL_SCALAR;
+}
+
+const char *HeartRateBank::kernelName(HeartRateKernel k) {
+  switch (k) {
+    case HRB_KERNEL_SSE41:
+      return "sse4.1";
+    case HRB_KERNEL_AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+// ======= Bank =======
+
+HeartRateBank::HeartRateBank(size_t channels) {
+  _channels = channels;
+  _blocks = (channels + HRB_LANES - 1) / HRB_LANES;
+  _kernel = bestKernel();
+
+  const size_t padded = _blocks * HRB_LANES;
+  _red.assign(_blocks * HRB_WINDOW * HRB_LANES, 0);
+  _ir.assign(_blocks * HRB_WINDOW * HRB_LANES, 0);
+  _index.assign(padded, 0);
+  _full.assign(padded, 0);
+  _lastHeartRate.assign(padded, 0.0f);
+  _lastBeatTime.assign(padded, 0);
+  _beatInterval.assign(padded, 0);
+  _peakDetected.assign(padded, 0);
+  _lastSpO2.assign(padded, 0.0f);
+  _redAC.assign(padded, 0.0f);
+  _redDC.assign(padded, 0.0f);
+  _irAC.assign(padded, 0.0f);
+  _irDC.assign(padded, 0.0f);
+  _signalQuality.assign(padded, 0.0f);
+  _temperature.assign(padded, NAN);
+  _irAvg.assign(padded, 0);
+}
+
+bool HeartRateBank::setKernel(HeartRateKernel k) {
+  if (!kernelSupported(k)) return false;
+  _kernel = k;
+  return true;
+}
+
+void HeartRateBank::reset(size_t ch) {
+  const size_t b = ch / HRB_LANES, l = ch % HRB_LANES;
+  for (int i = 0; i < HRB_WINDOW; i++) {
+    _red[(b * HRB_WINDOW + i) * HRB_LANES + l] = 0;
+    _ir[(b * HRB_WINDOW + i) * HRB_LANES + l] = 0;
+  }
+  _index[ch] = 0;
+  _full[ch] = 0;
+  _lastHeartRate[ch] = 0;
+  _lastBeatTime[ch] = 0;
+  _beatInterval[ch] = 0;
+  _peakDetected[ch] = 0;
+  _lastSpO2[ch] = 0;
+  _signalQuality[ch] = 0;
+}
+
+void HeartRateBank::markDiscontinuity(size_t ch) {
+  _index[ch] = 0;
+  _full[ch] = 0;
+  _lastBeatTime[ch] = 0;
+  _beatInterval[ch] = 0;
+  _peakDetected[ch] = 0;
+}
+
+void HeartRateBank::setTemperature(size_t ch, float celsius) {
+  _temperature[ch] = celsius;
+}
+
+void HeartRateBank::addSamples(uint32_t now_ms, const uint32_t *red, const uint32_t *ir) {
+  // Each channel writes at its own position, as its HeartRate_Service would
+  for (size_t ch = 0; ch < _channels; ch++) {
+    const size_t at = ((ch / HRB_LANES) * HRB_WINDOW + _index[ch]) * HRB_LANES + ch % HRB_LANES;
+    _red[at] = red[ch];
+    _ir[at] = ir[ch];
+    if (++_index[ch] >= HRB_WINDOW) {
+      _index[ch] = 0;
+      _full[ch] = 1;
+    }
+  }
+
+  const Kernels &k = kernelFns(_kernel);
+  BlockStats st;
+  for (size_t b = 0; b < _blocks; b++) {
+    const size_t first = b * HRB_LANES;
+    const size_t n = std::min((size_t)HRB_LANES, _channels - first);
+    bool any = false;
+    for (size_t l = 0; l < n; l++) any |= (_full[first + l] != 0);
+    if (!any) continue;
+
+    k.stats(redRow(b), irRow(b), st);
+    for (size_t l = 0; l < n; l++) {
+      if (_full[first + l]) detectBeat(first + l, now_ms, st.irAvg[l], l);
+    }
+    BlockScore s = {&_full[first], &_temperature[first], &_lastSpO2[first], &_redAC[first],
+                    &_redDC[first],  &_irAC[first],        &_irDC[first],     &_signalQuality[first]};
+    k.score(st, s);
+  }
+}
+
+// HeartRate_Service::detectPeak() and calculateHeartRate()
+void HeartRateBank::detectBeat(size_t ch, uint32_t now_ms, uint32_t irAvg, size_t l) {
+  const uint32_t *w = irRow(ch / HRB_LANES) + l;
+  const int idx = _index[ch];
+  _irAvg[ch] = irAvg;
+
+  uint32_t currentValue = w[((idx - 1 + HRB_WINDOW) % HRB_WINDOW) * HRB_LANES];
+  uint32_t previousValue = w[((idx - 2 + HRB_WINDOW) % HRB_WINDOW) * HRB_LANES];
+  uint32_t beforePrevious = w[((idx - 3 + HRB_WINDOW) % HRB_WINDOW) * HRB_LANES];
+  uint32_t threshold = irAvg * 1.05;
+
+  if (previousValue > currentValue && previousValue > beforePrevious && previousValue > threshold) {
+    if (_peakDetected[ch]) return;
+    _peakDetected[ch] = 1;
+    if (_lastBeatTime[ch] > 0) _beatInterval[ch] = now_ms - _lastBeatTime[ch];
+    _lastBeatTime[ch] = now_ms;
+  } else {
+    _peakDetected[ch] = 0;
+    return;
+  }
+
+  const uint32_t interval = _beatInterval[ch];
+  if (interval < 300 || interval > 1500) return;
+  float bpm = 60000.0 / (float)interval;
+  if (bpm < HRB_MIN_BPM || bpm > HRB_MAX_BPM) return;
+  if (_lastHeartRate[ch] > 0) bpm = (_lastHeartRate[ch] * 0.7) + (bpm * 0.3);
+  _lastHeartRate[ch] = bpm;
+}
+
+HeartRateReading HeartRateBank::reading(size_t ch) const {
+  HeartRateReading r;
+  r.fingerDetected = _full[ch] && _irAvg[ch] > HRB_FINGER_THRESHOLD;
+  r.validReading = _full[ch] && r.fingerDetected && (_signalQuality[ch] > 30);
+  r.heartRate = _lastHeartRate[ch];
+  r.spO2 = _lastSpO2[ch];
+  r.lastBeatTime = _lastBeatTime[ch];
+  r.signalQuality = _signalQuality[ch];
+  return r;
+}
@@ -0,0 +1,122 @@
+#ifndef HEART_RATE_BANK_H
+#define HEART_RATE_BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Many HeartRate_Service chains (main/HeartRate_Service.cpp) advanced in
+// lockstep, for reprocessing uplinked PPG windows on the ground.
+//
+// Sample windows are stored structure-of-arrays in blocks of 8 channels:
+// [block][window position][lane], so one window position of 8 channels is a
+// single 32-byte row. The per-sample window statistics (sums, min/max and the
+// IR variance) run 8 (AVX2) or 4 (SSE4.1) channels per instruction, and with
+// AVX2 so do SpO2, its smoothing and the quality score; the kernel is picked
+// at run time from what the CPU supports, with a plain scalar fallback. Peak
+// detection and the beat interval are a few compares per sample and stay
+// per channel.
+//
+// Every channel's buffer positions and summation order match the device
+// class, so readings are bit-identical to one HeartRate_Service per channel
+// fed the same samples (tools/hr_bank_bench checks this). That needs plain
+// IEEE arithmetic: do not build with -ffast-math or with FMA contraction
+// (-mfma / -march=native without -ffp-contract=off).
+
+// Same window and limits as main/HeartRate_Service.h
+#define HRB_WINDOW 100
+#define HRB_MIN_BPM 40
+#define HRB_MAX_BPM 200
+#define HRB_FINGER_THRESHOLD 50000
+#define HRB_SPO2_MIN 70
+#define HRB_SPO2_MAX 100
+#define HRB_SPO2_REF_TEMP 25.0
+#define HRB_SPO2_R_TEMP_COEF 0.002
+
+#define HRB_LANES 8 // channels per storage block
+
+enum HeartRateKernel {
+  HRB_KERNEL_SCALAR,
+  HRB_KERNEL_SSE41,
+  HRB_KERNEL_AVX2,
+};
+
+// Same fields as HeartRateData on the device
+struct HeartRateReading {
+  float heartRate;
+  float spO2;
+  bool fingerDetected;
+  bool validReading;
+  uint32_t lastBeatTime;
+  float signalQuality;
+};
+
+class HeartRateBank {
+public:
+  explicit HeartRateBank(size_t channels);
+
+  size_t channels() const { return _channels; }
+
+  // One sample for every channel, taken at now_ms (what millis() returns on
+  // the device when the sample is processed). red and ir hold channels() values.
+  void addSamples(uint32_t now_ms, const uint32_t *red, const uint32_t *ir);
+
+  HeartRateReading reading(size_t ch) const;
+  bool isReady(size_t ch) const { return _full[ch] != 0; }
+
+  // HeartRate_Service::reset(), markDiscontinuity(), setTemperature()
+  void reset(size_t ch);
+  void markDiscontinuity(size_t ch);
+  void setTemperature(size_t ch, float celsius);
+
+  // Kernel for the window statistics and scoring; defaults to the best supported.
+  // Returns false (and keeps the current one) if the CPU lacks it.
+  bool setKernel(HeartRateKernel k);
+  HeartRateKernel kernel() const { return _kernel; }
+  static bool kernelSupported(HeartRateKernel k);
+  static HeartRateKernel bestKernel();
+  static const char *kernelName(HeartRateKernel k);
+
+  // Window statistics of one block of HRB_LANES channels
+  struct BlockStats {
+    uint32_t irAvg[HRB_LANES], redAvg[HRB_LANES];
+    uint32_t irMax[HRB_LANES], irMin[HRB_LANES];
+    uint32_t redMax[HRB_LANES], redMin[HRB_LANES];
+    float irVar[HRB_LANES]; // sum of squared deviations from irAvg
+  };
+
+  // Per-channel state the scoring kernels update, HRB_LANES entries each
+  struct BlockScore {
+    const uint8_t *full;
+    const float *temperature;
+    float *lastSpO2, *redAC, *redDC, *irAC, *irDC, *signalQuality;
+  };
+
+private:
+  void detectBeat(size_t ch, uint32_t now_ms, uint32_t irAvg, size_t lane);
+  const uint32_t *irRow(size_t block) const { return &_ir[block * HRB_WINDOW * HRB_LANES]; }
+  const uint32_t *redRow(size_t block) const { return &_red[block * HRB_WINDOW * HRB_LANES]; }
+
+  size_t _channels;
+  size_t _blocks;
+  HeartRateKernel _kernel;
+
+  // Windows, [block][HRB_WINDOW][HRB_LANES]
+  std::vector<uint32_t> _red;
+  std::vector<uint32_t> _ir;
+
+  // Per-channel state, one array per HeartRate_Service member
+  std::vector<uint8_t> _index;
+  std::vector<uint8_t> _full;
+  std::vector<float> _lastHeartRate;
+  std::vector<uint32_t> _lastBeatTime;
+  std::vector<uint32_t> _beatInterval;
+  std::vector<uint8_t> _peakDetected;
+  std::vector<float> _lastSpO2;
+  std::vector<float> _redAC, _redDC, _irAC, _irDC;
+  std::vector<float> _signalQuality;
+  std::vector<float> _temperature;
+  std::vector<uint32_t> _irAvg; // window mean at the last sample (finger check)
+};
+
+#endif // HEART_RATE_BANK_H
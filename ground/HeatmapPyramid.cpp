@@ -0,0 +1,306 @@
+#include "HeatmapPyramid.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(HEATMAP_MAX_ZOOM + HEATMAP_CELL_BITS <= 31, "cell coordinates must fit uint32_t");
+static_assert(HEATMAP_MAX_ZOOM <= 20, "tile coordinates must fit tileKey()");
+
+static const uint32_t SIDE = 1u << HEATMAP_CELL_BITS;
+static const double MAX_MERCATOR_LAT = 85.05112878;
+
+HeatmapPyramid::HeatmapPyramid(const std::string &dir) : _dir(dir), _version(0), _stats() {
+  for (Layer &l : _layers) l.start = 0;
+}
+
+void HeatmapPyramid::setDirectory(const std::string &dir) {
+  _dir = dir;
+  // Everything goes out again to the new place
+  for (Layer &l : _layers) {
+    l.dirty.clear();
+    for (auto &kv : l.tiles) {
+      kv.second.dirty = true;
+      kv.second.onDisk = false;
+      l.dirty.push_back(kv.first);
+    }
+  }
+}
+
+void HeatmapPyramid::cellOf(double lat_deg, double lon_deg, uint32_t &cx, uint32_t &cy) {
+  const double n = (double)(1u << (HEATMAP_MAX_ZOOM + HEATMAP_CELL_BITS));
+  const double lat = std::max(-MAX_MERCATOR_LAT, std::min(MAX_MERCATOR_LAT, lat_deg)) * M_PI / 180.0;
+  const double x = (lon_deg + 180.0) / 360.0 * n;
+  const double y = (1.0 - log(tan(lat) + 1.0 / cos(lat)) / M_PI) / 2.0 * n;
+  cx = (uint32_t)std::max(0.0, std::min(n - 1, x));
+  cy = (uint32_t)std::max(0.0, std::min(n - 1, y));
+}
+
+void HeatmapPyramid::apply(int slot, uint32_t cx, uint32_t cy, int32_t count, int32_t risk, int32_t alerts) {
+  Layer &l = _layers[slot];
+  for (int z = HEATMAP_MAX_ZOOM; z >= HEATMAP_MIN_ZOOM; z--) {
+    const int shift = HEATMAP_MAX_ZOOM - z;
+    const uint32_t x = cx >> shift, y = cy >> shift;
+    const uint64_t key = tileKey(z, x >> HEATMAP_CELL_BITS, y >> HEATMAP_CELL_BITS);
+    Tile &t = l.tiles[key];
+    const uint16_t index = (uint16_t)((y & (SIDE - 1)) * SIDE + (x & (SIDE - 1)));
+
+    auto it = std::lower_bound(t.cells.begin(), t.cells.end(), index,
+                               [](const Cell &c, uint16_t i) { return c.index < i; });
+    if (it == t.cells.end() || it->index != index) it = t.cells.insert(it, Cell{index, 0, 0, 0});
+    it->count += count;
+    it->riskSum += risk;
+    it->alerts += alerts;
+    if (it->count == 0) t.cells.erase(it);
+
+    if (!t.dirty) {
+      t.dirty = true;
+      l.dirty.push_back(key);
+    }
+    _stats.cellUpdates++;
+  }
+}
+
+int HeatmapPyramid::bucketSlot(double t_s) {
+  const uint64_t bucket = (uint64_t)(t_s / HEATMAP_BUCKET_S);
+  const uint32_t start = (uint32_t)(bucket * HEATMAP_BUCKET_S);
+  const int slot = 1 + (int)(bucket % HEATMAP_BUCKETS);
+  Layer &l = _layers[slot];
+  if (l.start == start) return slot;
+  if (l.start > start) return -1; // older than everything kept
+  if (l.start != 0) dropLayer(slot);
+  l.start = start;
+  return slot;
+}
+
+void HeatmapPyramid::dropLayer(int slot) {
+  Layer &l = _layers[slot];
+  if (!_dir.empty()) {
+    const std::string base = _dir + "/" + layerName(slot) + "/";
+    for (const auto &kv : l.tiles) {
+      if (!kv.second.onDisk) continue;
+      char name[48];
+      snprintf(name, sizeof(name), "%u_%u_%u.bin", (unsigned)(kv.first >> 40), (unsigned)((kv.first >> 20) & 0xFFFFF),
+               (unsigned)(kv.first & 0xFFFFF));
+      _stale.push_back(base + name);
+    }
+    _staleDirs.push_back(_dir + "/" + layerName(slot));
+  }
+  l.tiles.clear();
+  l.dirty.clear();
+  l.start = 0;
+}
+
+std::string HeatmapPyramid::layerName(int slot) const {
+  return slot == 0 ? std::string("live") : std::to_string(_layers[slot].start);
+}
+
+int HeatmapPyramid::slotOf(uint32_t layer) const {
+  if (layer == 0) return 0;
+  for (int s = 1; s < SLOTS; s++) {
+    if (_layers[s].start == layer) return s;
+  }
+  return -1;
+}
+
+void HeatmapPyramid::update(int32_t id, double lat_deg, double lon_deg, uint8_t risk, bool alert, double t_s) {
+  if (!isfinite(lat_deg) || !isfinite(lon_deg)) return;
+  uint32_t cx, cy;
+  cellOf(lat_deg, lon_deg, cx, cy);
+  _stats.updates++;
+
+  auto it = _live.find(id);
+  if (it == _live.end()) {
+    _live[id] = Presence{cx, cy, risk, alert};
+    apply(0, cx, cy, 1, risk, alert);
+  } else {
+    Presence &p = it->second;
+    if (p.cx != cx || p.cy != cy || p.risk != risk || p.alert != alert) {
+      apply(0, p.cx, p.cy, -1, -(int32_t)p.risk, -(int32_t)p.alert);
+      apply(0, cx, cy, 1, risk, alert);
+      p = Presence{cx, cy, risk, alert};
+    }
+  }
+
+  const int slot = bucketSlot(t_s);
+  if (slot > 0) apply(slot, cx, cy, 1, risk, alert);
+}
+
+void HeatmapPyramid::remove(int32_t id) {
+  auto it = _live.find(id);
+  if (it == _live.end()) return;
+  const Presence &p = it->second;
+  apply(0, p.cx, p.cy, -1, -(int32_t)p.risk, -(int32_t)p.alert);
+  _live.erase(it);
+}
+
+void HeatmapPyramid::encode(const Tile &t, int z, uint32_t x, uint32_t y, uint32_t start, std::vector<uint8_t> &out) {
+  out.resize(HEATMAP_TILE_HEADER + t.cells.size() * HEATMAP_CELL_BYTES);
+  uint8_t *p = out.data();
+  auto put16 = [&p](uint32_t v) {
+    *p++ = (uint8_t)v;
+    *p++ = (uint8_t)(v >> 8);
+  };
+  auto put32 = [&p](uint32_t v) {
+    for (int i = 0; i < 4; i++) *p++ = (uint8_t)(v >> (8 * i));
+  };
+  *p++ = 'H';
+  *p++ = 'M';
+  *p++ = 'T';
+  *p++ = '1';
+  *p++ = (uint8_t)z;
+  *p++ = HEATMAP_CELL_BITS;
+  put16((uint32_t)t.cells.size());
+  put32(x);
+  put32(y);
+  put32(start);
+  for (const Cell &c : t.cells) {
+    put16(c.index);
+    *p++ = (uint8_t)((c.riskSum + c.count / 2) / c.count);
+    *p++ = (uint8_t)std::min<uint32_t>(c.alerts, 255);
+    put32(c.count);
+  }
+}
+
+bool HeatmapPyramid::encodeTile(uint32_t layer, int z, uint32_t x, uint32_t y, std::vector<uint8_t> &out) const {
+  const int slot = slotOf(layer);
+  if (slot < 0) return false;
+  auto it = _layers[slot].tiles.find(tileKey(z, x, y));
+  if (it == _layers[slot].tiles.end() || it->second.cells.empty()) return false;
+  encode(it->second, z, x, y, _layers[slot].start, out);
+  return true;
+}
+
+size_t HeatmapPyramid::tileCount(uint32_t layer, int z, size_t *bytes) const {
+  const int slot = slotOf(layer);
+  size_t n = 0, b = 0;
+  if (slot >= 0) {
+    for (const auto &kv : _layers[slot].tiles) {
+      if ((int)(kv.first >> 40) != z || kv.second.cells.empty()) continue;
+      n++;
+      b += HEATMAP_TILE_HEADER + kv.second.cells.size() * HEATMAP_CELL_BYTES;
+    }
+  }
+  if (bytes) *bytes = b;
+  return n;
+}
+
+size_t HeatmapPyramid::cells() const {
+  size_t n = 0;
+  for (const Layer &l : _layers) {
+    for (const auto &kv : l.tiles) n += kv.second.cells.size();
+  }
+  return n;
+}
+
+bool HeatmapPyramid::writeTile(int slot, uint64_t key, const Tile &t) {
+  const int z = (int)(key >> 40);
+  const uint32_t x = (uint32_t)((key >> 20) & 0xFFFFF), y = (uint32_t)(key & 0xFFFFF);
+  char name[48];
+  snprintf(name, sizeof(name), "/%d_%u_%u.bin", z, x, y);
+  const std::string path = _dir + "/" + layerName(slot) + name;
+
+  if (t.cells.empty()) {
+    if (t.onDisk && unlink(path.c_str()) == 0) _stats.tilesRemoved++;
+    return false;
+  }
+  encode(t, z, x, y, _layers[slot].start, _buf);
+  // Same as the snapshot: the browser never sees a half-written tile
+  const std::string tmp = path + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if (!fp) {
+    perror(tmp.c_str());
+    return false;
+  }
+  const bool ok = fwrite(_buf.data(), 1, _buf.size(), fp) == _buf.size();
+  fclose(fp);
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    perror(path.c_str());
+    unlink(tmp.c_str());
+    return false;
+  }
+  _stats.tilesWritten++;
+  _stats.bytesWritten += _buf.size();
+  return true;
+}
+
+void HeatmapPyramid::writeIndex() {
+  const std::string path = _dir + "/index.json", tmp = path + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    perror(tmp.c_str());
+    return;
+  }
+  fprintf(fp, "{\n  \"version\": %u, \"minZoom\": %d, \"maxZoom\": %d, \"cellBits\": %d, \"bucketSeconds\": %d,\n",
+          _version, HEATMAP_MIN_ZOOM, HEATMAP_MAX_ZOOM, HEATMAP_CELL_BITS, HEATMAP_BUCKET_S);
+  fprintf(fp, "  \"layers\": [\n");
+
+  // Live first, then buckets from the newest
+  std::vector<int> order = {0};
+  for (int s = 1; s < SLOTS; s++) {
+    if (_layers[s].start != 0) order.push_back(s);
+  }
+  std::sort(order.begin() + 1, order.end(), [this](int a, int b) { return _layers[a].start > _layers[b].start; });
+
+  for (size_t i = 0; i < order.size(); i++) {
+    const Layer &l = _layers[order[i]];
+    uint32_t maxCount[HEATMAP_MAX_ZOOM + 1] = {0};
+    for (const auto &kv : l.tiles) {
+      const int z = (int)(kv.first >> 40);
+      for (const Cell &c : kv.second.cells) maxCount[z] = std::max(maxCount[z], c.count);
+    }
+    fprintf(fp, "    { \"name\": \"%s\", \"start\": %u, \"maxCount\": [", layerName(order[i]).c_str(), l.start);
+    for (int z = HEATMAP_MIN_ZOOM; z <= HEATMAP_MAX_ZOOM; z++) {
+      fprintf(fp, "%u%s", maxCount[z], z < HEATMAP_MAX_ZOOM ? ", " : "");
+    }
+    fprintf(fp, "] }%s\n", i + 1 < order.size() ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+  fclose(fp);
+  rename(tmp.c_str(), path.c_str());
+}
+
+size_t HeatmapPyramid::publish() {
+  const bool files = !_dir.empty();
+  bool changed = !_stale.empty() || !_staleDirs.empty();
+
+  if (files) {
+    for (const std::string &f : _stale) {
+      if (unlink(f.c_str()) == 0) _stats.tilesRemoved++;
+    }
+    for (const std::string &d : _staleDirs) rmdir(d.c_str());
+    mkdir(_dir.c_str(), 0755);
+  }
+  _stale.clear();
+  _staleDirs.clear();
+
+  size_t written = 0;
+  for (int s = 0; s < SLOTS; s++) {
+    Layer &l = _layers[s];
+    if (l.dirty.empty()) continue;
+    changed = true;
+    if (files) mkdir((_dir + "/" + layerName(s)).c_str(), 0755);
+    for (uint64_t key : l.dirty) {
+      auto it = l.tiles.find(key);
+      if (it == l.tiles.end()) continue;
+      Tile &t = it->second;
+      if (files) {
+        if (writeTile(s, key, t)) {
+          t.onDisk = true;
+          written++;
+        }
+      }
+      t.dirty = false;
+      if (t.cells.empty()) l.tiles.erase(it);
+    }
+    l.dirty.clear();
+  }
+
+  if (changed) {
+    _version++;
+    if (files) writeIndex();
+  }
+  return written;
+}
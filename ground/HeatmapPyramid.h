@@ -0,0 +1,125 @@
+#ifndef HEATMAP_PYRAMID_H
+#define HEATMAP_PYRAMID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Density and risk aggregates over the field on a tile pyramid, for the
+// dashboard's heatmap layer.
+//
+// Tiles follow the web map scheme (Web Mercator z/x/y, as Leaflet and OSM),
+// each split into 2^HEATMAP_CELL_BITS x 2^HEATMAP_CELL_BITS cells. A cell at
+// zoom z is the union of its four children at z + 1, so one position maps to
+// one cell per zoom by shifting its finest-level cell coordinates; each frame
+// updates those few cells in place and the pyramid is never rebuilt.
+//
+// Layers:
+//   live        athletes currently in the cell: count, risk sum, in alert.
+//               Moving athletes leave their old cells.
+//   <start>     traffic in one HEATMAP_BUCKET_S bucket starting at <start>
+//               (unix seconds): frames received, risk sum, frames in alert.
+//               The newest HEATMAP_BUCKETS buckets are kept.
+// Cells are stored sparsely, so empty parts of the world cost nothing.
+//
+// publish() writes the tiles changed since the last call to
+//   <dir>/<layer>/<z>_<x>_<y>.bin
+// and removes tiles that became empty, then <dir>/index.json with the zoom
+// range, the layers and the busiest cell per zoom (for a common colour scale).
+// Tile file, little-endian:
+//   "HMT1"  u8 z  u8 cellBits  u16 cells  u32 x  u32 y  u32 layer start (0 = live)
+//   cells x { u16 row * side + col, u8 mean risk, u8 alerts (saturated), u32 count }
+
+#define HEATMAP_MIN_ZOOM 8
+#define HEATMAP_MAX_ZOOM 16
+#define HEATMAP_CELL_BITS 5   // 32 x 32 cells of 8 px per 256 px tile
+#define HEATMAP_BUCKET_S 300  // traffic buckets of 5 minutes
+#define HEATMAP_BUCKETS 12    // one hour of traffic
+#define HEATMAP_TILE_HEADER 20
+#define HEATMAP_CELL_BYTES 8
+
+struct HeatmapStats {
+  uint64_t updates;      // frames added
+  uint64_t cellUpdates;
+  uint64_t tilesWritten;
+  uint64_t tilesRemoved;
+  uint64_t bytesWritten;
+};
+
+class HeatmapPyramid {
+public:
+  explicit HeatmapPyramid(const std::string &dir = "");
+
+  // Output directory for publish(); empty keeps the pyramid in memory only
+  void setDirectory(const std::string &dir);
+
+  // One frame from athlete id at t_s (unix seconds)
+  void update(int32_t id, double lat_deg, double lon_deg, uint8_t risk, bool alert, double t_s);
+  // Take an athlete out of the live layer (traffic stays)
+  void remove(int32_t id);
+
+  // Write changed tiles and index.json. Returns the number of tiles written.
+  size_t publish();
+
+  // Tile in the file format above; false if the tile is empty. layer 0 is
+  // live, otherwise a bucket start.
+  bool encodeTile(uint32_t layer, int z, uint32_t x, uint32_t y, std::vector<uint8_t> &out) const;
+
+  // Tiles of a layer at one zoom and their encoded size
+  size_t tileCount(uint32_t layer, int z, size_t *bytes = nullptr) const;
+  size_t cells() const;
+  const HeatmapStats &stats() const { return _stats; }
+
+private:
+  struct Cell {
+    uint16_t index; // row * side + col inside the tile
+    uint32_t count;
+    uint32_t riskSum;
+    uint32_t alerts;
+  };
+
+  struct Tile {
+    std::vector<Cell> cells; // sorted by index
+    bool dirty;
+    bool onDisk;
+  };
+
+  struct Presence {
+    uint32_t cx; // cell at HEATMAP_MAX_ZOOM
+    uint32_t cy;
+    uint8_t risk;
+    bool alert;
+  };
+
+  // Slot 0 is the live layer, 1..HEATMAP_BUCKETS the bucket ring
+  static const int SLOTS = 1 + HEATMAP_BUCKETS;
+  struct Layer {
+    uint32_t start; // bucket start, 0 for live or an unused slot
+    std::unordered_map<uint64_t, Tile> tiles; // tileKey() -> tile
+    std::vector<uint64_t> dirty;
+  };
+
+  static uint64_t tileKey(int z, uint32_t x, uint32_t y) { return ((uint64_t)z << 40) | ((uint64_t)x << 20) | y; }
+  static void cellOf(double lat_deg, double lon_deg, uint32_t &cx, uint32_t &cy);
+  void apply(int slot, uint32_t cx, uint32_t cy, int32_t count, int32_t risk, int32_t alerts);
+  int bucketSlot(double t_s);
+  void dropLayer(int slot);
+  std::string layerName(int slot) const;
+  int slotOf(uint32_t layer) const;
+  static void encode(const Tile &t, int z, uint32_t x, uint32_t y, uint32_t start, std::vector<uint8_t> &out);
+  bool writeTile(int slot, uint64_t key, const Tile &t);
+  void writeIndex();
+
+  std::string _dir;
+  Layer _layers[SLOTS];
+  std::unordered_map<int32_t, Presence> _live;
+  std::vector<std::string> _stale;     // files of dropped layers, removed on publish
+  std::vector<std::string> _staleDirs;
+  std::vector<uint8_t> _buf;
+  uint32_t _version;
+  HeatmapStats _stats;
+};
+
+#endif // HEATMAP_PYRAMID_H
@@ -0,0 +1,313 @@
+#include "RuleEngine.h"
+
+#include <math.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "SpatialIndex.h"
+#include "frame.h"
+
+// Term mask bits: the value compares below, equal to, above the threshold
+static const uint8_t CMP_LT = 1;
+static const uint8_t CMP_EQ = 2;
+static const uint8_t CMP_GT = 4;
+
+static const char *FIELD_NAMES[RULE_FIELDS] = {"hr", "risk", "speed", "alert", "event", "ele", "grade", "climb"};
+
+static bool parseNumber(const std::string &s, double &out) {
+  char *end = nullptr;
+  out = strtod(s.c_str(), &end);
+  return !s.empty() && *end == '\0' && isfinite(out);
+}
+
+// Right-hand side of a condition: a number, or a name for event and alert
+static bool parseValue(uint8_t field, const std::string &s, double &out) {
+  if (field == RULE_EVENT) {
+    for (uint8_t k = ALERT_SOS; k <= ALERT_OFF_COURSE; k++) {
+      if (!strcasecmp(s.c_str(), Alert_kindName(k))) {
+        out = k;
+        return true;
+      }
+    }
+  } else if (field == RULE_ALERT) {
+    if (s == "true" || s == "false") {
+      out = (s == "true");
+      return true;
+    }
+  }
+  return parseNumber(s, out);
+}
+
+static uint8_t parseOp(const std::string &s) {
+  if (s == "<") return CMP_LT;
+  if (s == "<=") return CMP_LT | CMP_EQ;
+  if (s == ">") return CMP_GT;
+  if (s == ">=") return CMP_GT | CMP_EQ;
+  if (s == "==") return CMP_EQ;
+  if (s == "!=") return CMP_LT | CMP_GT;
+  return 0;
+}
+
+// ======= RuleShard =======
+
+void RuleShard::reset(const RuleEngine *engine) {
+  _engine = engine;
+  _slot.clear();
+  _athletes.clear();
+  _since.clear();
+  _fired.clear();
+  _queue.clear();
+  _fires.assign(engine->rules(), 0);
+  _stats = RuleStats{};
+}
+
+void RuleShard::evaluate(const RuleInput &in) {
+  const RuleEngine &e = *_engine;
+  const size_t rules = e._names.size();
+  _stats.frames++;
+
+  auto it = _slot.find(in.id);
+  const bool isNew = (it == _slot.end());
+  uint32_t slot;
+  if (isNew) {
+    slot = (uint32_t)_athletes.size();
+    _slot[in.id] = slot;
+    _athletes.push_back(Athlete{in.t_s, in.lat, in.lon, in.t_s, NAN});
+    _since.resize(_since.size() + rules, NAN);
+    _fired.resize(_fired.size() + rules, 0);
+  } else {
+    slot = it->second;
+  }
+  Athlete &a = _athletes[slot];
+  double *since = _since.data() + (size_t)slot * rules;
+  uint8_t *fired = _fired.data() + (size_t)slot * rules;
+
+  // Holds cannot span a silence: the conditions may not have held throughout
+  if (!isNew && in.t_s - a.t_s > RULE_MAX_GAP_S) {
+    for (size_t r = 0; r < rules; r++) since[r] = NAN;
+  }
+  a.t_s = in.t_s;
+
+  const double dt = in.t_s - a.fixT_s;
+  if (dt >= RULE_SPEED_MIN_S) {
+    const float v = (float)(SpatialIndex::distance_m(a.fixLat, a.fixLon, in.lat, in.lon) / dt * 3.6);
+    a.speed = isnan(a.speed) ? v : a.speed + (v - a.speed) * (float)RULE_SPEED_SMOOTHING;
+    a.fixLat = in.lat;
+    a.fixLon = in.lon;
+    a.fixT_s = in.t_s;
+  }
+
+  float f[RULE_FIELDS];
+  f[RULE_HR] = in.hr;
+  f[RULE_RISK] = in.risk;
+  f[RULE_SPEED] = a.speed;
+  f[RULE_ALERT] = in.alert ? 1.0f : 0.0f;
+  f[RULE_EVENT] = in.event;
+  f[RULE_ELE] = in.ele;
+  f[RULE_GRADE] = in.grade;
+  f[RULE_CLIMB] = in.climb;
+
+  // One pass over the flat term array. Each term compares once three ways and
+  // keeps the outcomes its operator accepts; NaN compares none of them.
+  const RuleEngine::Term *term = e._terms.data();
+  for (size_t r = 0; r < rules; r++) {
+    const RuleEngine::Term *end = e._terms.data() + e._first[r + 1];
+    uint32_t ok = 1;
+    for (; term < end; term++) {
+      const float v = f[term->field];
+      const uint32_t cmp = (v < term->threshold ? CMP_LT : 0) | (v == term->threshold ? CMP_EQ : 0) |
+                           (v > term->threshold ? CMP_GT : 0);
+      ok &= (cmp & term->mask) != 0;
+    }
+
+    const double start = isnan(since[r]) ? in.t_s : since[r];
+    since[r] = ok ? start : NAN;
+    const bool fire = ok && !fired[r] && in.t_s - start >= e._hold_s[r];
+    fired[r] = (uint8_t)(ok & (fired[r] | fire));
+    if (fire) {
+      _queue.push_back(RuleFiring{(uint32_t)r, in.id, in.t_s, in.lat, in.lon});
+      _fires[r]++;
+      _stats.firings++;
+    }
+  }
+}
+
+size_t RuleShard::drain(std::vector<RuleFiring> &out) {
+  const size_t n = _queue.size();
+  out.insert(out.end(), _queue.begin(), _queue.end());
+  _queue.clear();
+  return n;
+}
+
+// ======= RuleEngine =======
+
+RuleEngine::RuleEngine(size_t shards) : _shards(shards > 0 ? shards : 1) {
+  _first.push_back(0);
+  for (RuleShard &s : _shards) s.reset(this);
+}
+
+bool RuleEngine::load(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    perror(path);
+    return false;
+  }
+  std::string text;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) text.append(buf, n);
+  fclose(fp);
+  return compile(text, path);
+}
+
+bool RuleEngine::compile(const std::string &text, const char *origin) {
+  std::vector<Term> terms;
+  std::vector<uint32_t> first(1, 0);
+  std::vector<double> hold;
+  std::vector<Action> actions;
+  std::vector<std::string> names, texts;
+  std::vector<RuleCrew> crews;
+  std::vector<std::pair<int, std::vector<std::string>>> notify; // line, crew names per rule (empty: not notify)
+
+  std::istringstream lines(text);
+  std::string line;
+  int lineNo = 0;
+  auto fail = [&](const std::string &msg) {
+    fprintf(stderr, "[rules] %s:%d: %s\n", origin, lineNo, msg.c_str());
+    return false;
+  };
+
+  while (std::getline(lines, line)) {
+    lineNo++;
+    const size_t hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+    std::istringstream in(line);
+    std::vector<std::string> tok;
+    for (std::string t; in >> t;) tok.push_back(t);
+    if (tok.empty()) continue;
+
+    if (tok[0] == "crew") {
+      double lat, lon;
+      if (tok.size() != 4 || !parseNumber(tok[2], lat) || !parseNumber(tok[3], lon)) {
+        return fail("expected: crew <name> <lat> <lon>");
+      }
+      for (const RuleCrew &c : crews) {
+        if (c.name == tok[1]) return fail("crew " + tok[1] + " defined twice");
+      }
+      crews.push_back(RuleCrew{tok[1], lat, lon});
+      continue;
+    }
+    if (tok[0] != "rule") return fail("unknown entry '" + tok[0] + "'");
+
+    // rule <name>: ... with or without a space before the colon
+    size_t i = 1;
+    std::string name = i < tok.size() ? tok[i++] : "";
+    if (!name.empty() && name.back() == ':') {
+      name.pop_back();
+    } else if (i < tok.size() && tok[i] == ":") {
+      i++;
+    } else {
+      return fail("expected: rule <name>: <conditions> -> <action>");
+    }
+    if (name.empty()) return fail("rule without a name");
+    for (const std::string &other : names) {
+      if (other == name) return fail("rule " + name + " defined twice");
+    }
+
+    // Conditions, joined by "and", then an optional "for <seconds>"
+    double holdS = 0.0;
+    const size_t termsBefore = terms.size();
+    for (;;) {
+      if (i + 3 > tok.size()) return fail("incomplete condition");
+      int field = -1;
+      for (int k = 0; k < RULE_FIELDS; k++) {
+        if (tok[i] == FIELD_NAMES[k]) field = k;
+      }
+      if (field < 0) return fail("unknown field '" + tok[i] + "'");
+      const uint8_t mask = parseOp(tok[i + 1]);
+      if (!mask) return fail("unknown operator '" + tok[i + 1] + "'");
+      double value;
+      if (!parseValue((uint8_t)field, tok[i + 2], value)) return fail("bad value '" + tok[i + 2] + "'");
+      terms.push_back(Term{(float)value, (uint8_t)field, mask});
+      i += 3;
+
+      if (i < tok.size() && tok[i] == "and") {
+        i++;
+        continue;
+      }
+      if (i < tok.size() && tok[i] == "for") {
+        if (i + 1 >= tok.size() || !parseNumber(tok[i + 1], holdS) || holdS < 0) {
+          return fail("expected: for <seconds>");
+        }
+        i += 2;
+      }
+      break;
+    }
+    if (terms.size() == termsBefore) return fail("rule without conditions");
+
+    // Action
+    if (i >= tok.size() || tok[i] != "->") return fail("expected '->' and an action");
+    i++;
+    Action action{ACTION_NOTIFY, 0.0, {}};
+    std::vector<std::string> targets;
+    if (i + 2 == tok.size() && tok[i] == "notify") {
+      std::istringstream list(tok[i + 1]);
+      for (std::string c; std::getline(list, c, ',');) {
+        if (!c.empty()) targets.push_back(c);
+      }
+      if (targets.empty()) return fail("notify without crews");
+    } else if (i + 3 == tok.size() && tok[i] == "crews" && tok[i + 1] == "within") {
+      if (!parseNumber(tok[i + 2], action.radius_m) || action.radius_m <= 0) return fail("bad radius");
+      action.kind = ACTION_WITHIN;
+    } else {
+      return fail("expected: notify <crew>[,<crew>...] | crews within <metres>");
+    }
+
+    first.push_back((uint32_t)terms.size());
+    hold.push_back(holdS);
+    actions.push_back(action);
+    notify.emplace_back(lineNo, targets);
+    names.push_back(name);
+    size_t colon = line.find(':');
+    size_t begin = line.find_first_not_of(" \t", colon + 1);
+    size_t last = line.find_last_not_of(" \t\r");
+    texts.push_back(begin <= last ? line.substr(begin, last - begin + 1) : std::string());
+  }
+
+  // Crews may be declared after the rules that name them
+  for (size_t r = 0; r < actions.size(); r++) {
+    lineNo = notify[r].first;
+    for (const std::string &target : notify[r].second) {
+      size_t c = 0;
+      while (c < crews.size() && crews[c].name != target) c++;
+      if (c == crews.size()) return fail("unknown crew '" + target + "'");
+      actions[r].crews.push_back((uint32_t)c);
+    }
+  }
+
+  _terms.swap(terms);
+  _first.swap(first);
+  _hold_s.swap(hold);
+  _actions.swap(actions);
+  _names.swap(names);
+  _texts.swap(texts);
+  _crews.swap(crews);
+  for (RuleShard &s : _shards) s.reset(this);
+  return true;
+}
+
+size_t RuleEngine::route(const RuleFiring &f, std::vector<const RuleCrew *> &out) const {
+  out.clear();
+  const Action &a = _actions[f.rule];
+  if (a.kind == ACTION_NOTIFY) {
+    for (uint32_t c : a.crews) out.push_back(&_crews[c]);
+  } else {
+    for (const RuleCrew &c : _crews) {
+      if (SpatialIndex::distance_m(f.lat, f.lon, c.lat, c.lon) <= a.radius_m) out.push_back(&c);
+    }
+  }
+  return out.size();
+}
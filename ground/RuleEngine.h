@@ -0,0 +1,180 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame.h"
+
+// Alert routing rules evaluated against every athlete frame.
+//
+// Rules file, one entry per line, '#' starts a comment:
+//   crew <name> <lat> <lon>
+//   rule <name>: <field> <op> <value> [and <field> <op> <value>]... [for <seconds>] -> <action>
+// fields:  hr risk speed (km/h) alert (0/1) event (sos fall risk off-course, 0 without)
+//          ele grade climb (need --dem)
+// ops:     < <= > >= == !=
+// actions: notify <crew>[,<crew>...]      the named crews
+//          crews within <metres>          every crew that close to the athlete
+// e.g.
+//   rule medic: hr > 185 and speed < 1 for 60 -> notify medic-3
+//   rule sos: event == sos -> crews within 5000
+//
+// The file is compiled once into a flat plan: every condition is a (field,
+// threshold, op mask) term, the terms of all rules back to back, so a frame is
+// one pass over an array with no per-rule branching on the operator. Unknown
+// values (NaN: no speed yet, no DEM) never match.
+//
+// A rule fires once when its conditions have held for its duration, then
+// re-arms when they stop holding. Per-athlete state (hold start and fired
+// flag per rule, last fix for the speed) lives in shards keyed by athlete id.
+// A shard is only ever touched by the thread that owns it and the plan is
+// immutable after load(), so shards evaluate in parallel without locks.
+
+#define RULE_DEFAULT_SHARDS 4
+// A hold restarts after a longer gap between frames, so that a resting
+// athlete's reports keep it; a lost report at that interval still does.
+#define RULE_MAX_GAP_S (1.5 * DEVICE_MAX_REPORT_S)
+#define RULE_SPEED_MIN_S 1.0   // frames closer than this keep the previous speed
+#define RULE_SPEED_SMOOTHING 0.5
+
+enum RuleField : uint8_t {
+  RULE_HR,
+  RULE_RISK,
+  RULE_SPEED,
+  RULE_ALERT,
+  RULE_EVENT,
+  RULE_ELE,
+  RULE_GRADE,
+  RULE_CLIMB,
+  RULE_FIELDS
+};
+
+// One frame as the rules see it; t_s is wall clock seconds
+struct RuleInput {
+  int32_t id;
+  double t_s;
+  double lat;
+  double lon;
+  float hr;
+  float risk;
+  bool alert;
+  uint8_t event;   // AlertKind of a first 'e' copy, 0 otherwise
+  float ele;       // NaN when unknown
+  float grade;
+  float climb;
+};
+
+struct RuleFiring {
+  uint32_t rule;
+  int32_t id;
+  double t_s;
+  double lat;
+  double lon;
+};
+
+struct RuleCrew {
+  std::string name;
+  double lat;
+  double lon;
+};
+
+struct RuleStats {
+  uint64_t frames;
+  uint64_t firings;
+};
+
+class RuleEngine;
+
+// Rolling state for the athletes of one shard. Cache-line aligned: shards
+// sit side by side and are written by different threads.
+class alignas(64) RuleShard {
+public:
+  // Evaluate one frame; firings are queued for drain()
+  void evaluate(const RuleInput &in);
+  // Move queued firings to out (appended); returns how many
+  size_t drain(std::vector<RuleFiring> &out);
+
+  const RuleStats &stats() const { return _stats; }
+  uint64_t fires(uint32_t rule) const { return _fires[rule]; }
+  size_t athletes() const { return _slot.size(); }
+
+private:
+  friend class RuleEngine;
+  struct Athlete {
+    double t_s;      // last frame
+    double fixLat;   // last fix the speed was measured from
+    double fixLon;
+    double fixT_s;
+    float speed;     // km/h, NaN until known
+  };
+
+  const RuleEngine *_engine = nullptr;
+  std::unordered_map<int32_t, uint32_t> _slot; // id -> athlete index
+  std::vector<Athlete> _athletes;
+  std::vector<double> _since;  // athlete * rules: time the conditions started holding, NaN if not
+  std::vector<uint8_t> _fired; // athlete * rules
+  std::vector<RuleFiring> _queue;
+  std::vector<uint64_t> _fires;
+  RuleStats _stats = {};
+
+  void reset(const RuleEngine *engine);
+};
+
+class RuleEngine {
+public:
+  explicit RuleEngine(size_t shards = RULE_DEFAULT_SHARDS);
+
+  // Parse and compile a rules file; on any error nothing changes and the
+  // problem is reported on stderr. Clears all per-athlete state.
+  bool load(const char *path);
+  // Same from text; `origin` names it in error messages
+  bool compile(const std::string &text, const char *origin);
+
+  size_t rules() const { return _names.size(); }
+  size_t terms() const { return _terms.size(); }
+  const std::string &ruleName(uint32_t rule) const { return _names[rule]; }
+  const std::string &ruleText(uint32_t rule) const { return _texts[rule]; }
+  const std::vector<RuleCrew> &crews() const { return _crews; }
+
+  size_t shards() const { return _shards.size(); }
+  size_t shardOf(int32_t id) const { return (uint32_t)id % _shards.size(); }
+  RuleShard &shard(size_t i) { return _shards[i]; }
+  const RuleShard &shard(size_t i) const { return _shards[i]; }
+
+  // Crews a firing is routed to
+  size_t route(const RuleFiring &f, std::vector<const RuleCrew *> &out) const;
+
+private:
+  friend class RuleShard;
+
+  struct Term {
+    float threshold;
+    uint8_t field;
+    uint8_t mask; // outcomes the operator accepts: 1 below, 2 equal, 4 above
+  };
+
+  enum ActionKind : uint8_t { ACTION_NOTIFY, ACTION_WITHIN };
+
+  struct Action {
+    ActionKind kind;
+    double radius_m;
+    std::vector<uint32_t> crews; // ACTION_NOTIFY
+  };
+
+  // Compiled plan: rule r owns terms [_first[r], _first[r + 1])
+  std::vector<Term> _terms;
+  std::vector<uint32_t> _first;
+  std::vector<double> _hold_s;
+  std::vector<Action> _actions;
+  std::vector<std::string> _names;
+  std::vector<std::string> _texts;
+  std::vector<RuleCrew> _crews;
+
+  std::vector<RuleShard> _shards;
+};
+
+#endif // RULE_ENGINE_H
@@ -0,0 +1,438 @@
+#include "SeriesStore.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const int64_t SeriesStore::ROLLUP_WIDTH_MS[ROLLUP_LEVELS] = {60000, 600000, 3600000};
+
+// Worst-case bits one point can add to each column
+static const uint16_t WORST_BITS[SERIES_COLUMNS] = {36, 44, 70, 1};
+static const uint16_t COLUMN_BYTES[SERIES_COLUMNS] = {
+  SERIES_TS_BYTES, SERIES_HR_BYTES, SERIES_POS_BYTES, SERIES_FLAG_BYTES};
+
+static const char ARCHIVE_MAGIC[8] = {'L', 'L', 'S', 'E', 'R', 'I', 'E', '1'};
+
+// ======= Bit I/O (MSB first) =======
+
+static uint8_t *columnData(SeriesBlock &b, int col) {
+  switch (col) {
+    case SERIES_COL_TS: return b.ts;
+    case SERIES_COL_HR: return b.hr;
+    case SERIES_COL_POS: return b.pos;
+    default: return b.flag;
+  }
+}
+
+static const uint8_t *columnData(const SeriesBlock &b, int col) {
+  return columnData(const_cast<SeriesBlock &>(b), col);
+}
+
+static void putBits(SeriesBlock &b, int col, uint64_t value, int n) {
+  uint8_t *data = columnData(b, col);
+  uint16_t &pos = b.bits[col];
+  for (int i = n - 1; i >= 0; i--) {
+    const uint8_t bit = (value >> i) & 1;
+    if (bit) data[pos >> 3] |= (uint8_t)(0x80 >> (pos & 7));
+    pos++;
+  }
+}
+
+struct BitReader {
+  const uint8_t *data;
+  uint32_t pos;
+
+  uint64_t get(int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) {
+      v = (v << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+      pos++;
+    }
+    return v;
+  }
+};
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline uint32_t floatBits(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float bitsFloat(uint32_t u) {
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline int32_t toFixed(double deg) {
+  return (int32_t)lround(deg * SERIES_POS_SCALE);
+}
+
+// ======= Column codecs =======
+
+static void putDod(SeriesBlock &b, int64_t dod) {
+  if (dod == 0) {
+    putBits(b, SERIES_COL_TS, 0x0, 1);
+  } else if (dod >= -63 && dod <= 64) {
+    putBits(b, SERIES_COL_TS, 0x2, 2);
+    putBits(b, SERIES_COL_TS, (uint64_t)(dod + 63), 7);
+  } else if (dod >= -255 && dod <= 256) {
+    putBits(b, SERIES_COL_TS, 0x6, 3);
+    putBits(b, SERIES_COL_TS, (uint64_t)(dod + 255), 9);
+  } else if (dod >= -2047 && dod <= 2048) {
+    putBits(b, SERIES_COL_TS, 0xE, 4);
+    putBits(b, SERIES_COL_TS, (uint64_t)(dod + 2047), 12);
+  } else {
+    putBits(b, SERIES_COL_TS, 0xF, 4);
+    putBits(b, SERIES_COL_TS, (uint32_t)(int32_t)dod, 32);
+  }
+}
+
+static int64_t getDod(BitReader &r) {
+  if (r.get(1) == 0) return 0;
+  if (r.get(1) == 0) return (int64_t)r.get(7) - 63;
+  if (r.get(1) == 0) return (int64_t)r.get(9) - 255;
+  if (r.get(1) == 0) return (int64_t)r.get(12) - 2047;
+  return (int32_t)(uint32_t)r.get(32);
+}
+
+static void putPosDelta(SeriesBlock &b, int32_t delta) {
+  const uint32_t z = zigzag(delta);
+  if (z == 0) {
+    putBits(b, SERIES_COL_POS, 0x0, 1);
+  } else if (z < (1u << 8)) {
+    putBits(b, SERIES_COL_POS, 0x2, 2);
+    putBits(b, SERIES_COL_POS, z, 8);
+  } else if (z < (1u << 16)) {
+    putBits(b, SERIES_COL_POS, 0x6, 3);
+    putBits(b, SERIES_COL_POS, z, 16);
+  } else {
+    putBits(b, SERIES_COL_POS, 0x7, 3);
+    putBits(b, SERIES_COL_POS, z, 32);
+  }
+}
+
+static int32_t getPosDelta(BitReader &r) {
+  if (r.get(1) == 0) return 0;
+  if (r.get(1) == 0) return unzigzag((uint32_t)r.get(8));
+  if (r.get(1) == 0) return unzigzag((uint32_t)r.get(16));
+  return unzigzag((uint32_t)r.get(32));
+}
+
+// ======= SeriesStore =======
+
+SeriesStore::SeriesStore() {
+  _points = 0;
+  _map = nullptr;
+  _mapLen = 0;
+}
+
+SeriesStore::~SeriesStore() {
+  unmap();
+}
+
+void SeriesStore::unmap() {
+  if (_map) {
+    munmap(_map, _mapLen);
+    _map = nullptr;
+    _mapLen = 0;
+  }
+}
+
+void SeriesStore::startBlock(Series &s, int32_t id) {
+  OpenBlock &ob = s.open;
+  memset(&ob.block, 0, sizeof(ob.block));
+  ob.block.athleteId = id;
+  ob.prevT = 0;
+  ob.prevDelta = 0;
+  ob.prevHr = 0;
+  ob.prevLeading = 0xFF; // no XOR window yet
+  ob.prevTrailing = 0;
+  ob.prevLat = 0;
+  ob.prevLon = 0;
+  s.hasOpen = true;
+}
+
+void SeriesStore::sealBlock(Series &s) {
+  if (!s.hasOpen || s.open.block.count == 0) return;
+  _owned.push_back(s.open.block);
+  s.sealed.push_back(&_owned.back());
+  s.hasOpen = false;
+}
+
+bool SeriesStore::blockFull(const OpenBlock &ob) {
+  if (ob.block.count >= SERIES_BLOCK_MAX_POINTS) return true;
+  for (int c = 0; c < SERIES_COLUMNS; c++) {
+    if (ob.block.bits[c] + WORST_BITS[c] > COLUMN_BYTES[c] * 8) return true;
+  }
+  return false;
+}
+
+void SeriesStore::encode(OpenBlock &ob, const SeriesPoint &p) {
+  SeriesBlock &b = ob.block;
+
+  // Timestamp: first one lives in the header
+  if (b.count == 0) {
+    b.tFirst_ms = p.t_ms;
+  } else {
+    const int64_t delta = p.t_ms - ob.prevT;
+    putDod(b, delta - ob.prevDelta);
+    ob.prevDelta = delta;
+  }
+  ob.prevT = p.t_ms;
+  b.tLast_ms = p.t_ms;
+
+  // Heart rate: XOR against the previous value
+  const uint32_t hr = floatBits(p.hr);
+  if (b.count == 0) {
+    putBits(b, SERIES_COL_HR, hr, 32);
+  } else {
+    const uint32_t x = hr ^ ob.prevHr;
+    if (x == 0) {
+      putBits(b, SERIES_COL_HR, 0x0, 1);
+    } else {
+      uint8_t leading = (uint8_t)__builtin_clz(x);
+      const uint8_t trailing = (uint8_t)__builtin_ctz(x);
+      if (leading > 31) leading = 31;
+      if (ob.prevLeading != 0xFF && leading >= ob.prevLeading && trailing >= ob.prevTrailing) {
+        // Fits the previous meaningful-bit window
+        const int len = 32 - ob.prevLeading - ob.prevTrailing;
+        putBits(b, SERIES_COL_HR, 0x2, 2);
+        putBits(b, SERIES_COL_HR, x >> ob.prevTrailing, len);
+      } else {
+        const int len = 32 - leading - trailing;
+        putBits(b, SERIES_COL_HR, 0x3, 2);
+        putBits(b, SERIES_COL_HR, leading, 5);
+        putBits(b, SERIES_COL_HR, len - 1, 5);
+        putBits(b, SERIES_COL_HR, x >> trailing, len);
+        ob.prevLeading = leading;
+        ob.prevTrailing = trailing;
+      }
+    }
+  }
+  ob.prevHr = hr;
+
+  // Position: fixed-point deltas (first point is a delta from zero)
+  const int32_t lat = toFixed(p.lat);
+  const int32_t lon = toFixed(p.lon);
+  putPosDelta(b, lat - ob.prevLat);
+  putPosDelta(b, lon - ob.prevLon);
+  ob.prevLat = lat;
+  ob.prevLon = lon;
+
+  putBits(b, SERIES_COL_FLAG, p.alert ? 1 : 0, 1);
+  b.count++;
+}
+
+void SeriesStore::decode(const SeriesBlock &b, int64_t t0_ms, int64_t t1_ms,
+                         std::vector<SeriesPoint> &out) {
+  BitReader ts{columnData(b, SERIES_COL_TS), 0};
+  BitReader hr{columnData(b, SERIES_COL_HR), 0};
+  BitReader pos{columnData(b, SERIES_COL_POS), 0};
+  BitReader flag{columnData(b, SERIES_COL_FLAG), 0};
+
+  int64_t t = b.tFirst_ms;
+  int64_t delta = 0;
+  uint32_t hrBits = 0;
+  int leading = 0, trailing = 0;
+  int32_t lat = 0, lon = 0;
+
+  for (uint16_t i = 0; i < b.count; i++) {
+    if (i > 0) {
+      delta += getDod(ts);
+      t += delta;
+    }
+
+    if (i == 0) {
+      hrBits = (uint32_t)hr.get(32);
+    } else if (hr.get(1)) {
+      if (hr.get(1)) {
+        leading = (int)hr.get(5);
+        const int len = (int)hr.get(5) + 1;
+        trailing = 32 - leading - len;
+      }
+      const int len = 32 - leading - trailing;
+      hrBits ^= (uint32_t)hr.get(len) << trailing;
+    }
+
+    lat += getPosDelta(pos);
+    lon += getPosDelta(pos);
+    const bool alert = flag.get(1) != 0;
+
+    if (t > t1_ms) break;
+    if (t >= t0_ms) {
+      out.push_back(SeriesPoint{t, bitsFloat(hrBits), lat / SERIES_POS_SCALE, lon / SERIES_POS_SCALE, alert});
+    }
+  }
+}
+
+void SeriesStore::addToRollups(Series &s, const SeriesPoint &p) {
+  for (int l = 0; l < ROLLUP_LEVELS; l++) {
+    const int64_t w = ROLLUP_WIDTH_MS[l];
+    const int64_t start = p.t_ms - (((p.t_ms % w) + w) % w);
+    std::vector<SeriesRollup> &v = s.roll[l];
+    if (v.empty() || v.back().tStart_ms != start) {
+      v.push_back(SeriesRollup{start, 0, 0, p.hr, p.hr, 0.0f, p.lat, p.lon});
+    }
+    SeriesRollup &r = v.back();
+    r.count++;
+    r.alerts += p.alert ? 1 : 0;
+    if (p.hr < r.hrMin) r.hrMin = p.hr;
+    if (p.hr > r.hrMax) r.hrMax = p.hr;
+    r.hrSum += p.hr;
+    r.lat = p.lat;
+    r.lon = p.lon;
+  }
+}
+
+bool SeriesStore::append(int32_t id, const SeriesPoint &p) {
+  auto it = _series.find(id);
+  if (it == _series.end()) {
+    it = _series.emplace(id, Series()).first;
+    it->second.hasOpen = false;
+    it->second.lastT = INT64_MIN;
+  }
+  Series &s = it->second;
+  if (p.t_ms < s.lastT) return false;
+
+  if (s.hasOpen && blockFull(s.open)) sealBlock(s);
+  if (!s.hasOpen) startBlock(s, id);
+
+  encode(s.open, p);
+  addToRollups(s, p);
+  s.lastT = p.t_ms;
+  _points++;
+  return true;
+}
+
+size_t SeriesStore::query(int32_t id, int64_t t0_ms, int64_t t1_ms,
+                          std::vector<SeriesPoint> &out) const {
+  out.clear();
+  auto it = _series.find(id);
+  if (it == _series.end()) return 0;
+  const Series &s = it->second;
+
+  // First sealed block that can contain t0
+  size_t lo = 0, hi = s.sealed.size();
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    if (s.sealed[mid]->tLast_ms < t0_ms) lo = mid + 1;
+    else hi = mid;
+  }
+  for (size_t i = lo; i < s.sealed.size(); i++) {
+    if (s.sealed[i]->tFirst_ms > t1_ms) return out.size();
+    decode(*s.sealed[i], t0_ms, t1_ms, out);
+  }
+  if (s.hasOpen && s.open.block.count > 0) decode(s.open.block, t0_ms, t1_ms, out);
+  return out.size();
+}
+
+size_t SeriesStore::rollups(int32_t id, RollupLevel level, int64_t t0_ms, int64_t t1_ms,
+                            std::vector<SeriesRollup> &out) const {
+  out.clear();
+  auto it = _series.find(id);
+  if (it == _series.end() || level >= ROLLUP_LEVELS) return 0;
+
+  const std::vector<SeriesRollup> &v = it->second.roll[level];
+  const int64_t w = ROLLUP_WIDTH_MS[level];
+  size_t lo = 0, hi = v.size();
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    if (v[mid].tStart_ms + w <= t0_ms) lo = mid + 1;
+    else hi = mid;
+  }
+  for (size_t i = lo; i < v.size() && v[i].tStart_ms <= t1_ms; i++) out.push_back(v[i]);
+  return out.size();
+}
+
+size_t SeriesStore::memoryBytes() const {
+  size_t bytes = _owned.size() * sizeof(SeriesBlock);
+  for (const auto &kv : _series) {
+    bytes += sizeof(Series) + kv.second.sealed.capacity() * sizeof(void *);
+    for (int l = 0; l < ROLLUP_LEVELS; l++) bytes += kv.second.roll[l].capacity() * sizeof(SeriesRollup);
+  }
+  return bytes;
+}
+
+// Archive layout: magic, block count, then raw 1 KiB blocks in per-athlete time order
+bool SeriesStore::save(const char *path) const {
+  FILE *fp = fopen(path, "wb");
+  if (!fp) return false;
+
+  uint64_t count = 0;
+  for (const auto &kv : _series) {
+    count += kv.second.sealed.size();
+    if (kv.second.hasOpen && kv.second.open.block.count > 0) count++;
+  }
+
+  bool ok = fwrite(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC), 1, fp) == 1;
+  ok = ok && fwrite(&count, sizeof(count), 1, fp) == 1;
+  for (const auto &kv : _series) {
+    for (const SeriesBlock *b : kv.second.sealed) ok = ok && fwrite(b, sizeof(*b), 1, fp) == 1;
+    if (kv.second.hasOpen && kv.second.open.block.count > 0) {
+      ok = ok && fwrite(&kv.second.open.block, sizeof(SeriesBlock), 1, fp) == 1;
+    }
+  }
+  return (fclose(fp) == 0) && ok;
+}
+
+bool SeriesStore::openMapped(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < 16) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const uint8_t *base = (const uint8_t *)map;
+  uint64_t count;
+  memcpy(&count, base + 8, sizeof(count));
+  if (memcmp(base, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+      count > ((uint64_t)st.st_size - 16) / sizeof(SeriesBlock)) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  unmap();
+  _series.clear();
+  _owned.clear();
+  _points = 0;
+  _map = map;
+  _mapLen = st.st_size;
+
+  // Blocks are referenced in place; only rollups are rebuilt
+  std::vector<SeriesPoint> pts;
+  const SeriesBlock *blocks = (const SeriesBlock *)(base + 16);
+  for (uint64_t i = 0; i < count; i++) {
+    const SeriesBlock &b = blocks[i];
+    Series &s = _series[b.athleteId];
+    if (s.sealed.empty() && s.roll[0].empty()) {
+      s.hasOpen = false;
+      s.lastT = INT64_MIN;
+    }
+    s.sealed.push_back(&b);
+    pts.clear();
+    decode(b, INT64_MIN, INT64_MAX, pts);
+    for (const SeriesPoint &p : pts) addToRollups(s, p);
+    s.lastT = b.tLast_ms;
+    _points += b.count;
+  }
+  return true;
+}
@@ -0,0 +1,143 @@
+#ifndef SERIES_STORE_H
+#define SERIES_STORE_H
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Append-only, compressed per-athlete history.
+//
+// Points are packed column by column into fixed 1 KiB blocks:
+//   - timestamps: delta-of-delta, Gorilla bucket codes
+//   - heart rate: Gorilla XOR float compression
+//   - position:   fixed-point (1e-6 deg, ~0.1 m) zigzag deltas
+//   - alert flag: 1 bit
+// Blocks are plain POD so a saved archive can be memory-mapped and queried
+// in place. Per-athlete rollups (1 min / 10 min / 1 h) are kept next to the
+// blocks for dashboard charts.
+
+#define SERIES_BLOCK_BYTES 1024
+#define SERIES_BLOCK_MAX_POINTS 255
+#define SERIES_POS_SCALE 1e6
+
+// Column capacities (bytes); header is 32 bytes, total 1 KiB
+#define SERIES_TS_BYTES    160
+#define SERIES_HR_BYTES    288
+#define SERIES_POS_BYTES   512
+#define SERIES_FLAG_BYTES  32
+
+enum SeriesColumn {
+  SERIES_COL_TS,
+  SERIES_COL_HR,
+  SERIES_COL_POS,
+  SERIES_COL_FLAG,
+  SERIES_COLUMNS
+};
+
+enum RollupLevel {
+  ROLLUP_1MIN,
+  ROLLUP_10MIN,
+  ROLLUP_1H,
+  ROLLUP_LEVELS
+};
+
+struct SeriesPoint {
+  int64_t t_ms;
+  float hr;
+  double lat;
+  double lon;
+  bool alert;
+};
+
+struct SeriesRollup {
+  int64_t tStart_ms;
+  uint32_t count;
+  uint32_t alerts;
+  float hrMin;
+  float hrMax;
+  float hrSum;
+  double lat; // last position in the bucket
+  double lon;
+};
+
+struct SeriesBlock {
+  int32_t athleteId;
+  uint16_t count;
+  uint16_t reserved;
+  int64_t tFirst_ms;
+  int64_t tLast_ms;
+  uint16_t bits[SERIES_COLUMNS]; // bits used per column
+  uint8_t ts[SERIES_TS_BYTES];
+  uint8_t hr[SERIES_HR_BYTES];
+  uint8_t pos[SERIES_POS_BYTES];
+  uint8_t flag[SERIES_FLAG_BYTES];
+};
+
+static_assert(sizeof(SeriesBlock) == SERIES_BLOCK_BYTES, "SeriesBlock must stay 1 KiB");
+
+class SeriesStore {
+public:
+  SeriesStore();
+  ~SeriesStore();
+
+  // Points must arrive in time order per athlete; older points are rejected
+  bool append(int32_t id, const SeriesPoint &p);
+
+  // Points with t0 <= t_ms <= t1, in time order
+  size_t query(int32_t id, int64_t t0_ms, int64_t t1_ms, std::vector<SeriesPoint> &out) const;
+
+  // Rollup buckets overlapping [t0, t1]
+  size_t rollups(int32_t id, RollupLevel level, int64_t t0_ms, int64_t t1_ms,
+                 std::vector<SeriesRollup> &out) const;
+
+  // Archive all blocks to a file / map an archive for read-mostly access.
+  // A mapped store still accepts appends; new blocks live in RAM.
+  bool save(const char *path) const;
+  bool openMapped(const char *path);
+
+  size_t athletes() const { return _series.size(); }
+  size_t points() const { return _points; }
+  size_t memoryBytes() const;
+
+  static const int64_t ROLLUP_WIDTH_MS[ROLLUP_LEVELS];
+
+private:
+  // Encoder state for the block being filled
+  struct OpenBlock {
+    SeriesBlock block;
+    int64_t prevT;
+    int64_t prevDelta;
+    uint32_t prevHr;
+    uint8_t prevLeading;
+    uint8_t prevTrailing;
+    int32_t prevLat;
+    int32_t prevLon;
+  };
+
+  struct Series {
+    std::vector<const SeriesBlock *> sealed;
+    OpenBlock open;
+    bool hasOpen;
+    int64_t lastT;
+    std::vector<SeriesRollup> roll[ROLLUP_LEVELS];
+  };
+
+  std::unordered_map<int32_t, Series> _series;
+  std::deque<SeriesBlock> _owned; // sealed blocks living in RAM (stable addresses)
+  size_t _points;
+
+  void *_map;
+  size_t _mapLen;
+
+  static void startBlock(Series &s, int32_t id);
+  void sealBlock(Series &s);
+  static bool blockFull(const OpenBlock &ob);
+  static void encode(OpenBlock &ob, const SeriesPoint &p);
+  static void decode(const SeriesBlock &b, int64_t t0_ms, int64_t t1_ms, std::vector<SeriesPoint> &out);
+  static void addToRollups(Series &s, const SeriesPoint &p);
+  void unmap();
+};
+
+#endif // SERIES_STORE_H
@@ -0,0 +1,265 @@
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <math.h>
+#include <queue>
+
+static const double METERS_PER_DEG_LAT = 111320.0;
+static const double DEG2RAD = M_PI / 180.0;
+
+SpatialIndex::SpatialIndex(double cellSize_m, double refLat_deg) {
+  _cellSize_m = cellSize_m > 1.0 ? cellSize_m : 1.0;
+  _refSet = false;
+  _minRow = _minCol = INT32_MAX;
+  _maxRow = _maxCol = INT32_MIN;
+  setReference(refLat_deg);
+  _refSet = (refLat_deg != 0.0);
+}
+
+void SpatialIndex::setReference(double lat_deg) {
+  _refLat_deg = lat_deg;
+  _cellLat_deg = _cellSize_m / METERS_PER_DEG_LAT;
+  double c = cos(lat_deg * DEG2RAD);
+  if (c < 0.01) c = 0.01; // keep cells finite near the poles
+  _cellLon_deg = _cellSize_m / (METERS_PER_DEG_LAT * c);
+}
+
+double SpatialIndex::distance_m(double lat1, double lon1, double lat2, double lon2) {
+  const double dNorth = (lat2 - lat1) * METERS_PER_DEG_LAT;
+  const double dEast = (lon2 - lon1) * METERS_PER_DEG_LAT * cos(0.5 * (lat1 + lat2) * DEG2RAD);
+  return sqrt(dNorth * dNorth + dEast * dEast);
+}
+
+int32_t SpatialIndex::rowOf(double lat_deg) const {
+  return (int32_t)floor(lat_deg / _cellLat_deg);
+}
+
+int32_t SpatialIndex::colOf(double lon_deg) const {
+  return (int32_t)floor(lon_deg / _cellLon_deg);
+}
+
+uint64_t SpatialIndex::cellKey(int32_t row, int32_t col) {
+  return ((uint64_t)(uint32_t)row << 32) | (uint32_t)col;
+}
+
+void SpatialIndex::growExtent(int32_t row, int32_t col) {
+  _minRow = std::min(_minRow, row);
+  _maxRow = std::max(_maxRow, row);
+  _minCol = std::min(_minCol, col);
+  _maxCol = std::max(_maxCol, col);
+}
+
+void SpatialIndex::cellInsert(uint32_t idx) {
+  Entry &e = _entries[idx];
+  const int32_t row = rowOf(e.lat);
+  const int32_t col = colOf(e.lon);
+  e.cell = cellKey(row, col);
+  std::vector<uint32_t> &cell = _cells[e.cell];
+  e.slot = (uint32_t)cell.size();
+  cell.push_back(idx);
+  growExtent(row, col);
+}
+
+void SpatialIndex::cellRemove(uint32_t idx) {
+  Entry &e = _entries[idx];
+  auto it = _cells.find(e.cell);
+  if (it == _cells.end()) return;
+
+  // Swap-remove inside the cell
+  std::vector<uint32_t> &cell = it->second;
+  const uint32_t last = cell.back();
+  cell[e.slot] = last;
+  _entries[last].slot = e.slot;
+  cell.pop_back();
+  if (!cell.empty()) return;
+  _cells.erase(it);
+
+  // An emptied cell on the edge may have been the last one holding it there
+  const int32_t row = (int32_t)(uint32_t)(e.cell >> 32);
+  const int32_t col = (int32_t)(uint32_t)e.cell;
+  if (row == _minRow || row == _maxRow || col == _minCol || col == _maxCol) shrinkExtent();
+}
+
+void SpatialIndex::shrinkExtent() {
+  _minRow = _minCol = INT32_MAX;
+  _maxRow = _maxCol = INT32_MIN;
+  for (const auto &kv : _cells) {
+    growExtent((int32_t)(uint32_t)(kv.first >> 32), (int32_t)(uint32_t)kv.first);
+  }
+}
+
+void SpatialIndex::upsert(int32_t id, double lat_deg, double lon_deg) {
+  if (!_refSet) {
+    setReference(lat_deg);
+    _refSet = true;
+  }
+
+  auto it = _byId.find(id);
+  if (it == _byId.end()) {
+    const uint32_t idx = (uint32_t)_entries.size();
+    _entries.push_back(Entry{id, lat_deg, lon_deg, 0, 0});
+    _byId[id] = idx;
+    cellInsert(idx);
+    return;
+  }
+
+  const uint32_t idx = it->second;
+  Entry &e = _entries[idx];
+  e.lat = lat_deg;
+  e.lon = lon_deg;
+  const int32_t row = rowOf(lat_deg);
+  const int32_t col = colOf(lon_deg);
+  if (cellKey(row, col) == e.cell) return; // still in the same cell
+
+  cellRemove(idx);
+  cellInsert(idx);
+}
+
+bool SpatialIndex::remove(int32_t id) {
+  auto it = _byId.find(id);
+  if (it == _byId.end()) return false;
+
+  const uint32_t idx = it->second;
+  cellRemove(idx);
+  _byId.erase(it);
+
+  // Swap-remove in dense storage and fix the moved entry's references
+  const uint32_t last = (uint32_t)_entries.size() - 1;
+  if (idx != last) {
+    _entries[idx] = _entries[last];
+    _byId[_entries[idx].id] = idx;
+    _cells[_entries[idx].cell][_entries[idx].slot] = idx;
+  }
+  _entries.pop_back();
+  return true;
+}
+
+void SpatialIndex::clear() {
+  _entries.clear();
+  _byId.clear();
+  _cells.clear();
+  _minRow = _minCol = INT32_MAX;
+  _maxRow = _maxCol = INT32_MIN;
+}
+
+size_t SpatialIndex::queryBox(double minLat, double minLon, double maxLat, double maxLon,
+                              std::vector<int32_t> &out) const {
+  out.clear();
+  if (_entries.empty()) return 0;
+
+  const int32_t r0 = std::max(rowOf(minLat), _minRow);
+  const int32_t r1 = std::min(rowOf(maxLat), _maxRow);
+  const int32_t c0 = std::max(colOf(minLon), _minCol);
+  const int32_t c1 = std::min(colOf(maxLon), _maxCol);
+
+  for (int32_t r = r0; r <= r1; r++) {
+    for (int32_t c = c0; c <= c1; c++) {
+      auto it = _cells.find(cellKey(r, c));
+      if (it == _cells.end()) continue;
+      const bool inner = (r > r0 && r < r1 && c > c0 && c < c1);
+      for (uint32_t idx : it->second) {
+        const Entry &e = _entries[idx];
+        if (inner || (e.lat >= minLat && e.lat <= maxLat && e.lon >= minLon && e.lon <= maxLon)) {
+          out.push_back(e.id);
+        }
+      }
+    }
+  }
+  return out.size();
+}
+
+static bool hitCloser(const SpatialHit &a, const SpatialHit &b) {
+  return a.distance_m < b.distance_m;
+}
+
+size_t SpatialIndex::queryRadius(double lat_deg, double lon_deg, double radius_m,
+                                 std::vector<SpatialHit> &out) const {
+  out.clear();
+  if (_entries.empty() || radius_m < 0) return 0;
+
+  const double dLat = radius_m / METERS_PER_DEG_LAT;
+  double c = cos(lat_deg * DEG2RAD);
+  if (c < 0.01) c = 0.01;
+  const double dLon = radius_m / (METERS_PER_DEG_LAT * c);
+
+  const int32_t r0 = std::max(rowOf(lat_deg - dLat), _minRow);
+  const int32_t r1 = std::min(rowOf(lat_deg + dLat), _maxRow);
+  const int32_t c0 = std::max(colOf(lon_deg - dLon), _minCol);
+  const int32_t c1 = std::min(colOf(lon_deg + dLon), _maxCol);
+
+  for (int32_t r = r0; r <= r1; r++) {
+    for (int32_t cc = c0; cc <= c1; cc++) {
+      auto it = _cells.find(cellKey(r, cc));
+      if (it == _cells.end()) continue;
+      for (uint32_t idx : it->second) {
+        const Entry &e = _entries[idx];
+        const double d = distance_m(lat_deg, lon_deg, e.lat, e.lon);
+        if (d <= radius_m) out.push_back(SpatialHit{e.id, d});
+      }
+    }
+  }
+  std::sort(out.begin(), out.end(), hitCloser);
+  return out.size();
+}
+
+size_t SpatialIndex::nearest(double lat_deg, double lon_deg, size_t k,
+                             std::vector<SpatialHit> &out) const {
+  out.clear();
+  if (_entries.empty() || k == 0) return 0;
+  k = std::min(k, _entries.size()); // no need to walk on once everyone is in
+
+  // Max-heap of the best k so far
+  auto farther = [](const SpatialHit &a, const SpatialHit &b) { return a.distance_m < b.distance_m; };
+  std::priority_queue<SpatialHit, std::vector<SpatialHit>, decltype(farther)> best(farther);
+
+  const int32_t row = rowOf(lat_deg);
+  const int32_t col = colOf(lon_deg);
+
+  // Anything in ring r+1 is at least r full cells away
+  const double cellSpan_m = std::min(_cellSize_m,
+                                     _cellLon_deg * METERS_PER_DEG_LAT * cos(lat_deg * DEG2RAD));
+
+  // Rings beyond this cover no occupied cell
+  const int32_t maxRing = std::max(std::max(std::abs(row - _minRow), std::abs(row - _maxRow)),
+                                   std::max(std::abs(col - _minCol), std::abs(col - _maxCol)));
+
+  auto visit = [&](int32_t r, int32_t c) {
+    if (r < _minRow || r > _maxRow || c < _minCol || c > _maxCol) return;
+    auto it = _cells.find(cellKey(r, c));
+    if (it == _cells.end()) return;
+    for (uint32_t idx : it->second) {
+      const Entry &e = _entries[idx];
+      const double d = distance_m(lat_deg, lon_deg, e.lat, e.lon);
+      if (best.size() < k) {
+        best.push(SpatialHit{e.id, d});
+      } else if (d < best.top().distance_m) {
+        best.pop();
+        best.push(SpatialHit{e.id, d});
+      }
+    }
+  };
+
+  for (int32_t ring = 0; ring <= maxRing; ring++) {
+    if (ring == 0) {
+      visit(row, col);
+    } else {
+      for (int32_t c = col - ring; c <= col + ring; c++) {
+        visit(row - ring, c);
+        visit(row + ring, c);
+      }
+      for (int32_t r = row - ring + 1; r <= row + ring - 1; r++) {
+        visit(r, col - ring);
+        visit(r, col + ring);
+      }
+    }
+
+    if (best.size() == k && best.top().distance_m <= ring * cellSpan_m) break;
+  }
+
+  out.resize(best.size());
+  for (size_t i = out.size(); i > 0; i--) {
+    out[i - 1] = best.top();
+    best.pop();
+  }
+  return out.size();
+}
@@ -0,0 +1,79 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Uniform lat/lon grid over live athlete positions.
+// Cells are square-ish in metres around the reference latitude (set from the
+// first position unless given), so a race course a few tens of km across maps
+// to a few thousand occupied cells. Updates are O(1); queries only touch the
+// cells that overlap the query area.
+
+#define SPATIAL_DEFAULT_CELL_M 250.0
+
+struct SpatialHit {
+  int32_t id;
+  double distance_m;
+};
+
+class SpatialIndex {
+public:
+  explicit SpatialIndex(double cellSize_m = SPATIAL_DEFAULT_CELL_M, double refLat_deg = 0.0);
+
+  // Insert or move an athlete
+  void upsert(int32_t id, double lat_deg, double lon_deg);
+  bool remove(int32_t id);
+  void clear();
+  size_t size() const { return _entries.size(); }
+
+  // All athletes inside the lat/lon box (inclusive). Returns number of hits.
+  size_t queryBox(double minLat, double minLon, double maxLat, double maxLon,
+                  std::vector<int32_t> &out) const;
+
+  // All athletes within radius_m of the point, sorted by distance.
+  size_t queryRadius(double lat_deg, double lon_deg, double radius_m,
+                     std::vector<SpatialHit> &out) const;
+
+  // Up to k nearest athletes, sorted by distance.
+  size_t nearest(double lat_deg, double lon_deg, size_t k,
+                 std::vector<SpatialHit> &out) const;
+
+  // Local flat-earth distance, good to well under 0.1% at race scales
+  static double distance_m(double lat1, double lon1, double lat2, double lon2);
+
+private:
+  struct Entry {
+    int32_t id;
+    double lat;
+    double lon;
+    uint64_t cell;
+    uint32_t slot; // position inside the cell's vector
+  };
+
+  double _cellSize_m;
+  double _refLat_deg;
+  bool _refSet;
+  double _cellLat_deg; // cell height in degrees
+  double _cellLon_deg; // cell width in degrees
+
+  std::vector<Entry> _entries;                               // dense storage
+  std::unordered_map<int32_t, uint32_t> _byId;               // id -> entry index
+  std::unordered_map<uint64_t, std::vector<uint32_t>> _cells; // cell -> entry indices
+
+  // Occupied cell extent, used to bound ring searches
+  int32_t _minRow, _maxRow, _minCol, _maxCol;
+
+  void setReference(double lat_deg);
+  int32_t rowOf(double lat_deg) const;
+  int32_t colOf(double lon_deg) const;
+  static uint64_t cellKey(int32_t row, int32_t col);
+  void cellInsert(uint32_t idx);
+  void cellRemove(uint32_t idx);
+  void growExtent(int32_t row, int32_t col);
+  void shrinkExtent(); // recompute from the occupied cells
+};
+
+#endif // SPATIAL_INDEX_H
@@ -0,0 +1,113 @@
+#include "TriageQueue.h"
+
+#include <queue>
+
+bool TriageQueue::before(const TriageEntry &a, const TriageEntry &b) {
+  if (a.alert != b.alert) return a.alert;
+  if (a.alert && a.alertSince != b.alertSince) return a.alertSince < b.alertSince;
+  if (a.risk != b.risk) return a.risk > b.risk;
+  if (a.lastSeen != b.lastSeen) return a.lastSeen > b.lastSeen;
+  return a.id < b.id; // total order: equal keys still rank the same every time
+}
+
+void TriageQueue::place(size_t i, const TriageEntry &e) {
+  _heap[i] = e;
+  _slot[e.id] = i;
+}
+
+void TriageQueue::siftUp(size_t i) {
+  const TriageEntry e = _heap[i];
+  while (i > 0) {
+    const size_t parent = (i - 1) / 2;
+    if (!before(e, _heap[parent])) break;
+    place(i, _heap[parent]);
+    i = parent;
+  }
+  place(i, e);
+}
+
+void TriageQueue::siftDown(size_t i) {
+  const TriageEntry e = _heap[i];
+  const size_t n = _heap.size();
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= n) break;
+    if (child + 1 < n && before(_heap[child + 1], _heap[child])) child++;
+    if (!before(_heap[child], e)) break;
+    place(i, _heap[child]);
+    i = child;
+  }
+  place(i, e);
+}
+
+void TriageQueue::update(int32_t id, uint8_t risk, bool alert, double now) {
+  auto it = _slot.find(id);
+  if (it == _slot.end()) {
+    if (alert) _alerts++;
+    _heap.push_back(TriageEntry{id, risk, alert, alert ? now : 0.0, now});
+    _slot[id] = _heap.size() - 1;
+    siftUp(_heap.size() - 1);
+    return;
+  }
+
+  const size_t i = it->second;
+  const TriageEntry old = _heap[i];
+  TriageEntry &e = _heap[i];
+  e.risk = risk;
+  e.lastSeen = now;
+  if (alert != e.alert) {
+    e.alertSince = alert ? now : 0.0;
+    if (alert) _alerts++;
+    else _alerts--;
+  }
+  e.alert = alert;
+
+  // A fresher lastSeen alone can only move it up
+  if (before(e, old)) siftUp(i);
+  else siftDown(i);
+}
+
+bool TriageQueue::remove(int32_t id) {
+  auto it = _slot.find(id);
+  if (it == _slot.end()) return false;
+  const size_t i = it->second;
+  _slot.erase(it);
+  if (_heap[i].alert) _alerts--;
+
+  const size_t last = _heap.size() - 1;
+  if (i != last) {
+    const TriageEntry moved = _heap[last];
+    _heap.pop_back();
+    place(i, moved);
+    if (i > 0 && before(moved, _heap[(i - 1) / 2])) siftUp(i);
+    else siftDown(i);
+  } else {
+    _heap.pop_back();
+  }
+  return true;
+}
+
+void TriageQueue::clear() {
+  _heap.clear();
+  _slot.clear();
+  _alerts = 0;
+}
+
+size_t TriageQueue::top(size_t k, std::vector<TriageEntry> &out) const {
+  out.clear();
+  if (k == 0 || _heap.empty()) return 0;
+
+  // Best-first walk: the next best entry is always a child of one already
+  // taken, so the frontier never holds more than k + 1 heap slots
+  auto worse = [this](size_t a, size_t b) { return before(_heap[b], _heap[a]); };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(worse)> frontier(worse);
+  frontier.push(0);
+  while (!frontier.empty() && out.size() < k) {
+    const size_t i = frontier.top();
+    frontier.pop();
+    out.push_back(_heap[i]);
+    if (2 * i + 1 < _heap.size()) frontier.push(2 * i + 1);
+    if (2 * i + 2 < _heap.size()) frontier.push(2 * i + 2);
+  }
+  return out.size();
+}
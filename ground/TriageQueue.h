@@ -0,0 +1,53 @@
+#ifndef TRIAGE_QUEUE_H
+#define TRIAGE_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Live "most at risk" ordering of the field for the crew dashboard.
+// Indexed binary max-heap over athletes: an id -> heap slot map lets every
+// frame move its athlete up or down in O(log n) instead of re-sorting the
+// participant list. The top k are read without disturbing the heap by walking
+// it best-first with a small frontier heap, O(k log k) whatever the field size.
+//
+// Order: athletes with the alert flag first, the longest-standing alert first
+// (oldest unanswered call at the top), then by risk score, then the most
+// recently heard from.
+
+struct TriageEntry {
+  int32_t id;
+  uint8_t risk;        // 0-100
+  bool alert;
+  double alertSince;   // wall clock seconds the alert flag went up, 0 without alert
+  double lastSeen;
+};
+
+class TriageQueue {
+public:
+  // Insert or re-rank an athlete. The alert age is kept across frames while
+  // the flag stays up and restarts when it drops and rises again.
+  void update(int32_t id, uint8_t risk, bool alert, double now);
+  bool remove(int32_t id);
+  void clear();
+  size_t size() const { return _heap.size(); }
+  size_t alerts() const { return _alerts; } // athletes with the alert flag up
+
+  // Up to k highest-priority athletes, best first. Returns the number written.
+  size_t top(size_t k, std::vector<TriageEntry> &out) const;
+
+  // Strict priority order used by the heap (a ranks above b)
+  static bool before(const TriageEntry &a, const TriageEntry &b);
+
+private:
+  std::vector<TriageEntry> _heap;
+  std::unordered_map<int32_t, size_t> _slot; // id -> heap index
+  size_t _alerts = 0;
+
+  void place(size_t i, const TriageEntry &e);
+  void siftUp(size_t i);
+  void siftDown(size_t i);
+};
+
+#endif // TRIAGE_QUEUE_H
@@ -0,0 +1,174 @@
+#include "frame.h"
+#include <math.h>
+#include <string.h>
+
+static bool isFrameType(uint8_t t) {
+  return Frame_size(t) != 0;
+}
+
+size_t Frame_size(uint8_t type) {
+  switch (type) {
+    case 'a':
+    case 'd': return FRAME_SIZE;
+    case 'e': return FRAME_EVENT_SIZE;
+    case 'c': return FRAME_COACH_SIZE;
+    default: return 0;
+  }
+}
+
+const char *Alert_kindName(uint8_t kind) {
+  switch (kind) {
+    case ALERT_SOS: return "SOS";
+    case ALERT_FALL: return "fall";
+    case ALERT_RISK: return "risk";
+    case ALERT_OFF_COURSE: return "off-course";
+    default: return "unknown";
+  }
+}
+
+// A false resync can line up a trailer around garbage; its coordinates would
+// reach the spatial index and the fixed-point history store
+static bool validPosition(float lat, float lon) {
+  return isfinite(lat) && isfinite(lon) && fabsf(lat) <= 90.0f && fabsf(lon) <= 180.0f;
+}
+
+// The device reports 0,0 until the GNSS has its first fix
+static bool hasFix(float lat, float lon) {
+  return lat != 0.0f || lon != 0.0f;
+}
+
+static bool decodeEvent(const uint8_t *buf, AthleteFrame &out) {
+  size_t off = 0;
+  out.type = (char)buf[off++];
+  memcpy(&out.id, buf + off, sizeof(out.id));
+  off += sizeof(out.id);
+  memcpy(&out.boot, buf + off, sizeof(out.boot));
+  off += sizeof(out.boot);
+  memcpy(&out.seq, buf + off, sizeof(out.seq));
+  off += sizeof(out.seq);
+  out.kind = buf[off++];
+  out.attempt = buf[off++];
+  memcpy(&out.eventMs, buf + off, sizeof(out.eventMs));
+  off += sizeof(out.eventMs);
+  memcpy(&out.sentMs, buf + off, sizeof(out.sentMs));
+  off += sizeof(out.sentMs);
+  memcpy(&out.lat, buf + off, sizeof(out.lat));
+  off += sizeof(out.lat);
+  memcpy(&out.lon, buf + off, sizeof(out.lon));
+  off += sizeof(out.lon);
+  out.hr = buf[off++];
+  out.risk = buf[off++];
+  out.alert = true;
+  // An alert raised before the first fix still counts, it just has no position
+  if (!validPosition(out.lat, out.lon)) return false;
+  out.fix = hasFix(out.lat, out.lon);
+  return true;
+}
+
+// Heart rates a summary can plausibly carry; anything else is a corrupt frame
+#define COACH_HR_LOW 25
+#define COACH_HR_HIGH 240
+
+static bool validCoach(const AthleteFrame &f) {
+  const auto &c = f.coach;
+  if (c.hrRest < COACH_HR_LOW || c.hrMax > COACH_HR_HIGH || c.hrRest >= c.hrMax) return false;
+  if (c.hrMedian != 0 && (c.hrMedian < COACH_HR_LOW || c.hrMedian > COACH_HR_HIGH)) return false;
+
+  // Zone time is part of the counted time; both are rounded down on the device
+  uint32_t zone_s = 0;
+  for (int z = 0; z < FRAME_COACH_ZONES; z++) zone_s += c.zone10s[z] * 10u;
+  return zone_s <= (c.elapsedMin + 1u) * 60u;
+}
+
+static bool decodeCoach(const uint8_t *buf, AthleteFrame &out) {
+  size_t off = 0;
+  out.type = (char)buf[off++];
+  memcpy(&out.id, buf + off, sizeof(out.id));
+  off += sizeof(out.id);
+  memcpy(&out.coach.elapsedMin, buf + off, sizeof(out.coach.elapsedMin));
+  off += sizeof(out.coach.elapsedMin);
+  out.coach.hrRest = buf[off++];
+  out.coach.hrMax = buf[off++];
+  out.coach.hrMedian = buf[off++];
+  memcpy(out.coach.zone10s, buf + off, sizeof(out.coach.zone10s));
+  off += sizeof(out.coach.zone10s);
+  memcpy(&out.coach.trimp, buf + off, sizeof(out.coach.trimp));
+  off += sizeof(out.coach.trimp);
+  memcpy(&out.coach.acuteX10, buf + off, sizeof(out.coach.acuteX10));
+  off += sizeof(out.coach.acuteX10);
+  memcpy(&out.coach.chronicX10, buf + off, sizeof(out.coach.chronicX10));
+  out.lat = out.lon = 0.0f;
+  out.fix = false;
+  out.hr = out.risk = 0;
+  out.alert = false;
+  out.boot = 0;
+  out.seq = 0;
+  out.kind = 0;
+  out.attempt = 0;
+  out.eventMs = out.sentMs = 0;
+  return validCoach(out);
+}
+
+bool Frame_decode(const uint8_t *buf, size_t len, AthleteFrame &out) {
+  size_t size = len > 0 ? Frame_size(buf[0]) : 0;
+  if (size == 0 || len < size) return false;
+  if (buf[size - 3] != 0x00 || buf[size - 2] != 0xFF || buf[size - 1] != 0x00) return false;
+
+  if (buf[0] == 'e') return decodeEvent(buf, out);
+  if (buf[0] == 'c') return decodeCoach(buf, out);
+
+  out.boot = 0;
+  out.seq = 0;
+  out.kind = 0;
+  out.attempt = 0;
+  out.eventMs = 0;
+  out.sentMs = 0;
+
+  size_t off = 0;
+  out.type = (char)buf[off++];
+  memcpy(&out.lat, buf + off, sizeof(out.lat));
+  off += sizeof(out.lat);
+  memcpy(&out.lon, buf + off, sizeof(out.lon));
+  off += sizeof(out.lon);
+  out.hr = buf[off++];
+  out.risk = buf[off++];
+  memcpy(&out.id, buf + off, sizeof(out.id));
+  out.alert = (out.type == 'a');
+  out.fix = hasFix(out.lat, out.lon);
+  return validPosition(out.lat, out.lon) && out.fix;
+}
+
+FrameParser::FrameParser() {
+  _len = 0;
+  _ok = 0;
+  _dropped = 0;
+}
+
+bool FrameParser::push(uint8_t b, AthleteFrame &out) {
+  // Waiting for a frame start: skip anything that cannot be a type byte
+  if (_len == 0 && !isFrameType(b)) {
+    _dropped++;
+    return false;
+  }
+
+  _buf[_len++] = b;
+
+  // After a resync the buffer may already hold a whole shorter frame
+  while (_len > 0 && _len >= Frame_size(_buf[0])) {
+    size_t size = Frame_size(_buf[0]);
+    if (Frame_decode(_buf, size, out)) {
+      memmove(_buf, _buf + size, _len - size);
+      _len -= size;
+      _ok++;
+      return true;
+    }
+
+    // Not aligned: drop the first byte and rescan for the next type byte
+    size_t start = 1;
+    while (start < _len && !isFrameType(_buf[start])) start++;
+    _dropped += start;
+    memmove(_buf, _buf + start, _len - start);
+    _len -= start;
+  }
+  return false;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Uplink frames as built by main/uplink.cpp and written to the satellite link:
+//   telemetry: [type:1]['a' alert / 'd' data] [lat:f32] [lon:f32] [hr:u8] [risk:u8] [id:i32] [0x00 0xFF 0x00]
+//   event:     ['e'] [id:i32] [boot:u16] [seq:u16] [kind:u8] [attempt:u8] [event_ms:u32] [sent_ms:u32]
+//              [lat:f32] [lon:f32] [hr:u8] [risk:u8] [0x00 0xFF 0x00]
+//   coach:     ['c'] [id:i32] [elapsed_min:u16] [hr_rest:u8] [hr_max:u8] [hr_median:u8]
+//              [zone_10s:u16 x5] [trimp:u16] [acute_x10:u16] [chronic_x10:u16] [0x00 0xFF 0x00]
+// All multi-byte fields are little-endian (ESP32 memcpy of native values).
+//
+// Telemetry comes at least every DEVICE_MAX_REPORT_S: the REST power profile's
+// report interval (main/power_manager.cpp), the slowest one. Anything timing
+// silences between frames has to allow for that, plus a lost frame or two.
+#define DEVICE_MAX_REPORT_S 60.0
+#define FRAME_SIZE 18
+#define FRAME_EVENT_SIZE 32
+#define FRAME_COACH_SIZE 29
+#define FRAME_COACH_ZONES 5
+#define FRAME_MAX_SIZE FRAME_EVENT_SIZE
+
+// Alert event kinds ('e' frames)
+enum AlertKind : uint8_t {
+  ALERT_SOS = 1,
+  ALERT_FALL = 2,
+  ALERT_RISK = 3,
+  ALERT_OFF_COURSE = 4,
+};
+
+struct AthleteFrame {
+  char type;      // 'a', 'd', 'e' or 'c'
+  float lat;
+  float lon;
+  bool fix;       // lat/lon are a GNSS fix (only an 'e' frame may arrive without one)
+  uint8_t hr;
+  uint8_t risk;   // 0-100 risk score
+  int32_t id;
+  bool alert;
+
+  // 'e' frames only
+  uint16_t boot;     // random per device power-up; seq and the clock restart with it
+  uint16_t seq;      // event number, same for every repeat
+  uint8_t kind;      // AlertKind
+  uint8_t attempt;   // 0 for the first transmission
+  uint32_t eventMs;  // device millis() when the event triggered
+  uint32_t sentMs;   // device millis() when this copy was written
+
+  // 'c' frames only (id is set, position and HR are not)
+  struct {
+    uint16_t elapsedMin;  // minutes with counted HR readings
+    uint8_t hrRest;       // limits the zones were computed from
+    uint8_t hrMax;
+    uint8_t hrMedian;
+    uint16_t zone10s[FRAME_COACH_ZONES]; // time in zones 1-5, 10 s units
+    uint16_t trimp;       // Banister TRIMP so far
+    uint16_t acuteX10;    // TRIMP per hour x10, short and long decay
+    uint16_t chronicX10;
+  } coach;
+};
+
+// Frame length for a type byte, 0 if it is not a frame type.
+size_t Frame_size(uint8_t type);
+
+const char *Alert_kindName(uint8_t kind);
+
+// Decode one complete frame. Returns false if the bytes are not a valid frame,
+// including positions that are not finite or outside +-90 / +-180 degrees, and
+// telemetry at 0,0 (no fix yet). Events without a fix decode with fix = false.
+// Coach summaries must have rest < max HR, plausible rates and no more zone
+// time than counted time.
+bool Frame_decode(const uint8_t *buf, size_t len, AthleteFrame &out);
+
+// Incremental parser for a raw link byte stream. Re-synchronises on the
+// 00 FF 00 trailer, so it copes with joining the stream mid-frame.
+class FrameParser {
+public:
+  FrameParser();
+
+  // Feed one byte; returns true and fills `out` when a frame completes.
+  bool push(uint8_t b, AthleteFrame &out);
+
+  uint32_t framesOk() const { return _ok; }
+  uint32_t bytesDropped() const { return _dropped; }
+
+private:
+  uint8_t _buf[FRAME_MAX_SIZE];
+  size_t _len;
+  uint32_t _ok;
+  uint32_t _dropped;
+};
@@ -0,0 +1,962 @@
+// Ground-side ingest service.
+// Reads the raw satellite link byte stream (serial device, capture file or
+// stdin), keeps the live state of every athlete and publishes snapshots for
+// the dashboard in frontend/.
+//
+// Build:  g++ -O2 -std=c++17 -pthread -o ingest ground/*.cpp
+// Run:    ./ingest /dev/ttyUSB0 --out frontend/participants.json [--archive race.lls] [--link-delay ms]
+//                  [--dem dir] [--tiles dir] [--triage-top k] [--rules file]
+//         --link-delay: known constant one-way delay of the satellite link, added
+//         to the measured alert latency (a one-way link cannot observe it)
+//         --dem: directory of DEM tiles (ElevationService.h); adds elevation,
+//         grade and climb rate to each athlete
+//         --tiles: where the heatmap tile pyramid is published (HeatmapPyramid.h);
+//         defaults to tiles/ next to the --out snapshot
+//         --triage-top: athletes listed in triage.json, published next to the
+//         --out snapshot (TriageQueue.h); default 50
+//         --rules: alert routing rules evaluated on every frame (RuleEngine.h);
+//         firings are logged with the crews they route to
+//
+// While running, stdin accepts triage queries:
+//   near <lat> <lon> <radius_m>     athletes within a radius
+//   knn  <lat> <lon> <k>            k nearest athletes
+//   box  <lat0> <lon0> <lat1> <lon1> athletes inside a lat/lon box
+//   history <id> <minutes>          per-minute HR/alert rollups for one athlete
+//   bench <n>                       time queries over n synthetic athletes
+//   bench-store <athletes> <hours>  fill a history store at 1 Hz and time range queries
+//   alerts                          alert events received and trigger-to-receipt latency
+//   terrain <lat> <lon>             elevation, slope and aspect at a point
+//   bench-dem <points>              time elevation lookups on synthetic tiles
+//   heat                            heatmap pyramid size and publish counters
+//   bench-heat <athletes> <seconds> time heatmap updates and publishing for a synthetic field
+//   triage [k]                      k most at-risk athletes (alerts first, oldest alert first)
+//   ack <id>                        clear the alert an 'e' event latched for an athlete
+//   bench-triage <athletes> <k>     time triage updates and top-k reads against re-sorting
+//   rules                           loaded routing rules and how often each fired
+//   bench-rules <athletes> <threads> time rule evaluation per frame as the rule count grows
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <map>
+#include <math.h>
+#include <poll.h>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AlertTracker.h"
+#include "ElevationService.h"
+#include "HeatmapPyramid.h"
+#include "RuleEngine.h"
+#include "SeriesStore.h"
+#include "SpatialIndex.h"
+#include "TriageQueue.h"
+#include "frame.h"
+
+struct AthleteState {
+  int32_t id;
+  double lat;
+  double lon;
+  uint8_t hr;
+  uint8_t risk;
+  bool alert;       // deviceAlert or eventLatched
+  bool deviceAlert; // alert flag of the last frame
+  bool eventLatched; // an 'e' event came in; held until "ack <id>"
+  bool onHeatmap;   // in the heatmap's live layer
+  bool located;     // has had a fix; lat/lon mean nothing until then
+  double lastSeen;  // wall clock seconds
+
+  // Terrain (--dem); NaN until known
+  float elevation_m;
+  float grade_pct;     // along the direction of travel, smoothed
+  float climb_m_per_h; // vertical metres per hour, smoothed
+  double anchorLat;    // last fix the grade was measured from
+  double anchorLon;
+  float anchorEle_m;
+  double anchorTime;
+};
+
+// Grade needs some horizontal distance to rise above GNSS and DEM noise
+#define TERRAIN_GRADE_MIN_M 15.0
+#define TERRAIN_CLIMB_MIN_S 1.0 // frames replayed from a capture arrive back to back
+#define TERRAIN_SMOOTHING 0.3f
+
+// Athletes silent this long leave the heatmap's live layer; the snapshot and
+// triage still list them. Two lost reports do not make a resting athlete flicker.
+#define HEAT_STALE_S (3 * DEVICE_MAX_REPORT_S)
+
+static std::map<int32_t, AthleteState> g_athletes;
+static std::map<int32_t, AthleteFrame> g_coach; // latest 'c' summary per athlete
+static SpatialIndex g_index;
+static SeriesStore g_store;
+static AlertTracker g_alerts;
+static ElevationService g_dem;
+static HeatmapPyramid g_heat;
+static TriageQueue g_triage;
+static RuleEngine g_rules;
+static const char *g_archivePath = nullptr;
+static const char *g_outPath = "frontend/participants.json";
+static std::string g_triagePath = "frontend/triage.json";
+static size_t g_triageTop = 50;
+static bool g_dirty = false;
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int) {
+  g_stop = 1;
+}
+
+static double nowSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double monoMicros() {
+  using namespace std::chrono;
+  return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void updateTerrain(AthleteState &a, bool isNew) {
+  const float ele = g_dem.elevation(a.lat, a.lon);
+  if (isNew || isnan(a.anchorEle_m)) {
+    a.grade_pct = a.climb_m_per_h = NAN;
+    a.elevation_m = ele;
+    a.anchorLat = a.lat;
+    a.anchorLon = a.lon;
+    a.anchorEle_m = ele;
+    a.anchorTime = a.lastSeen;
+    return;
+  }
+  a.elevation_m = ele;
+  if (isnan(ele)) return;
+
+  const double run = SpatialIndex::distance_m(a.anchorLat, a.anchorLon, a.lat, a.lon);
+  if (run < TERRAIN_GRADE_MIN_M) return;
+  const float rise = ele - a.anchorEle_m;
+  const float grade = (float)(100.0 * rise / run);
+  const double dt_h = (a.lastSeen - a.anchorTime) / 3600.0;
+  a.grade_pct = isnan(a.grade_pct) ? grade : a.grade_pct + (grade - a.grade_pct) * TERRAIN_SMOOTHING;
+  if (dt_h * 3600.0 >= TERRAIN_CLIMB_MIN_S) {
+    const float climb = (float)(rise / dt_h);
+    a.climb_m_per_h = isnan(a.climb_m_per_h) ? climb : a.climb_m_per_h + (climb - a.climb_m_per_h) * TERRAIN_SMOOTHING;
+  }
+  a.anchorLat = a.lat;
+  a.anchorLon = a.lon;
+  a.anchorEle_m = ele;
+  a.anchorTime = a.lastSeen;
+}
+
+// The reader is the only thread here, so it drives every shard itself
+static void evaluateRules(const AthleteFrame &f, const AthleteState &a) {
+  const bool dem = g_dem.enabled();
+  const RuleInput in{f.id, a.lastSeen, a.lat, a.lon, (float)f.hr, (float)f.risk, a.alert,
+                     (uint8_t)(f.type == 'e' ? f.kind : 0), dem ? a.elevation_m : NAN, dem ? a.grade_pct : NAN,
+                     dem ? a.climb_m_per_h : NAN};
+  RuleShard &shard = g_rules.shard(g_rules.shardOf(f.id));
+  shard.evaluate(in);
+
+  static std::vector<RuleFiring> fired;
+  static std::vector<const RuleCrew *> crews;
+  fired.clear();
+  shard.drain(fired);
+  for (const RuleFiring &r : fired) {
+    g_rules.route(r, crews);
+    fprintf(stderr, "[rule] %s: %d ->", g_rules.ruleName(r.rule).c_str(), r.id);
+    for (size_t i = 0; i < crews.size(); i++) fprintf(stderr, "%s %s", i ? "," : "", crews[i]->name.c_str());
+    fprintf(stderr, "%s\n", crews.empty() ? " no crew in range" : "");
+  }
+}
+
+static void onFrame(const AthleteFrame &f) {
+  // Coach summaries carry no position; they ride along with the athlete's record
+  if (f.type == 'c') {
+    // A resync can line up a trailer around garbage that still passes the
+    // field checks; a live device has sent telemetry before its first summary
+    if (g_athletes.find(f.id) == g_athletes.end()) {
+      fprintf(stderr, "[coach] summary for unknown athlete %d dropped\n", f.id);
+      return;
+    }
+    g_coach[f.id] = f;
+    g_dirty = true;
+    return;
+  }
+
+  // Alert events arrive several times; only the first copy updates the state
+  if (f.type == 'e') {
+    AlertReceipt r;
+    if (!g_alerts.onFrame(f, monoMicros() / 1000.0, r)) return;
+    fprintf(stderr, "[alert] %d %s #%u: latency %.0f ms (queued %.0f ms on device, copy %u)\n", r.id,
+            Alert_kindName(r.kind), r.seq, r.latency_ms, r.queue_ms, r.attempt);
+  }
+
+  AthleteState &a = g_athletes[f.id];
+  a.id = f.id;
+  // An event sent before the first fix keeps the last known position
+  const bool firstFix = f.fix && !a.located;
+  if (f.fix) {
+    a.lat = f.lat;
+    a.lon = f.lon;
+    a.located = true;
+  }
+  a.hr = f.hr;
+  a.risk = f.risk;
+  // An event keeps the athlete in the alert tier until a crew acknowledges
+  // it: the next telemetry frame may not carry the alert flag
+  a.deviceAlert = f.alert;
+  if (f.type == 'e') a.eventLatched = true;
+  a.alert = a.deviceAlert || a.eventLatched;
+  a.lastSeen = nowSeconds();
+  g_triage.update(f.id, f.risk, a.alert, a.lastSeen);
+  g_dirty = true;
+  if (!a.located) {
+    // Nowhere to put it yet: triage and the crew rules still see the alert
+    a.lat = a.lon = NAN;
+    if (g_rules.rules() > 0) evaluateRules(f, a);
+    return;
+  }
+  if (g_dem.enabled()) updateTerrain(a, firstFix);
+  g_index.upsert(f.id, a.lat, a.lon);
+  g_heat.update(f.id, a.lat, a.lon, f.risk, a.alert, a.lastSeen);
+  a.onHeatmap = true;
+  if (g_rules.rules() > 0) evaluateRules(f, a);
+  g_store.append(f.id, SeriesPoint{(int64_t)(a.lastSeen * 1000.0), (float)f.hr, (float)a.lat, (float)a.lon, a.alert});
+}
+
+// Crew handled the event: back to what the device itself reports
+static void acknowledge(int32_t id) {
+  auto it = g_athletes.find(id);
+  if (it == g_athletes.end() || !it->second.eventLatched) {
+    printf("%d: no latched alert\n", id);
+    return;
+  }
+  AthleteState &a = it->second;
+  a.eventLatched = false;
+  a.alert = a.deviceAlert;
+  if (a.onHeatmap) g_heat.update(a.id, a.lat, a.lon, a.risk, a.alert, a.lastSeen);
+  g_triage.update(a.id, a.risk, a.alert, a.lastSeen);
+  g_dirty = true;
+  printf("%d: acknowledged%s\n", id, a.alert ? ", device still reports an alert" : "");
+}
+
+// Take athletes that stopped reporting out of the live layer; their next
+// frame puts them back
+static void dropStale(double now) {
+  for (auto &kv : g_athletes) {
+    AthleteState &a = kv.second;
+    if (!a.onHeatmap || now - a.lastSeen < HEAT_STALE_S) continue;
+    g_heat.remove(a.id);
+    a.onHeatmap = false;
+    g_dirty = true;
+  }
+}
+
+// Same record shape the dashboard already loads: { id, lat, lon, hr, ... }
+static void writeSnapshot() {
+  std::string tmp = std::string(g_outPath) + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    perror(tmp.c_str());
+    return;
+  }
+  fprintf(fp, "[\n");
+  size_t n = 0;
+  for (const auto &kv : g_athletes) {
+    const AthleteState &a = kv.second;
+    if (!a.located) continue; // no marker to draw; the triage list has it
+    fprintf(fp, "%s  { \"id\": \"%d\", \"lat\": %.7f, \"lon\": %.7f, \"hr\": %u, \"risk\": %u, \"alert\": %s",
+            n++ ? ",\n" : "", a.id, a.lat, a.lon, a.hr, a.risk, a.alert ? "true" : "false");
+    if (g_dem.enabled() && !isnan(a.elevation_m)) {
+      fprintf(fp, ", \"ele\": %.0f", a.elevation_m);
+      if (!isnan(a.grade_pct)) fprintf(fp, ", \"grade\": %.1f", a.grade_pct);
+      if (!isnan(a.climb_m_per_h)) fprintf(fp, ", \"climb\": %.0f", a.climb_m_per_h);
+    }
+    auto c = g_coach.find(a.id);
+    if (c != g_coach.end()) {
+      const auto &s = c->second.coach;
+      fprintf(fp, ", \"coach\": { \"min\": %u, \"rest\": %u, \"max\": %u, \"median\": %u, \"zones\": [",
+              s.elapsedMin, s.hrRest, s.hrMax, s.hrMedian);
+      for (int z = 0; z < FRAME_COACH_ZONES; z++) fprintf(fp, "%s%.1f", z ? ", " : "", s.zone10s[z] / 6.0);
+      fprintf(fp, "], \"trimp\": %u, \"acute\": %.1f, \"chronic\": %.1f }", s.trimp, s.acuteX10 / 10.0,
+              s.chronicX10 / 10.0);
+    }
+    fprintf(fp, " }");
+  }
+  fprintf(fp, "%s]\n", n ? "\n" : "");
+  fclose(fp);
+  rename(tmp.c_str(), g_outPath);
+}
+
+// Crew triage list: the head of the queue only, so the dashboard never has to
+// load and sort the whole field
+static void writeTriage() {
+  std::vector<TriageEntry> top;
+  g_triage.top(g_triageTop, top);
+  const double now = nowSeconds();
+
+  std::string tmp = g_triagePath + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    perror(tmp.c_str());
+    return;
+  }
+  fprintf(fp, "{ \"time\": %.0f, \"athletes\": %zu, \"alerts\": %zu, \"top\": [\n", now, g_triage.size(),
+          g_triage.alerts());
+  for (size_t i = 0; i < top.size(); i++) {
+    const TriageEntry &e = top[i];
+    const AthleteState &a = g_athletes[e.id];
+    fprintf(fp, "  { \"id\": \"%d\", \"risk\": %u, \"hr\": %u, \"alert\": %s, ", e.id, e.risk, a.hr,
+            e.alert ? "true" : "false");
+    if (a.located) fprintf(fp, "\"lat\": %.7f, \"lon\": %.7f, ", a.lat, a.lon);
+    else fprintf(fp, "\"lat\": null, \"lon\": null, ");
+    fprintf(fp, "\"seen_s\": %.0f", now - e.lastSeen);
+    if (e.alert) fprintf(fp, ", \"alert_s\": %.0f", now - e.alertSince);
+    fprintf(fp, " }%s\n", (i + 1 < top.size()) ? "," : "");
+  }
+  fprintf(fp, "] }\n");
+  fclose(fp);
+  rename(tmp.c_str(), g_triagePath.c_str());
+}
+
+static void printHits(const std::vector<SpatialHit> &hits) {
+  for (const SpatialHit &h : hits) {
+    auto it = g_athletes.find(h.id);
+    printf("  %d  %.0f m  hr=%u risk=%u%s\n", h.id, h.distance_m,
+           it != g_athletes.end() ? it->second.hr : 0,
+           it != g_athletes.end() ? it->second.risk : 0,
+           (it != g_athletes.end() && it->second.alert) ? "  ALERT" : "");
+  }
+}
+
+static void runBench(int n) {
+  SpatialIndex idx;
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> dLat(42.60, 42.80); // ~22 km
+  std::uniform_real_distribution<double> dLon(23.20, 23.45); // ~20 km
+
+  double t0 = monoMicros();
+  for (int i = 0; i < n; i++) idx.upsert(i, dLat(rng), dLon(rng));
+  double t1 = monoMicros();
+  for (int i = 0; i < n; i++) idx.upsert(i, dLat(rng), dLon(rng)); // moves
+  double t2 = monoMicros();
+
+  const int Q = 1000;
+  std::vector<SpatialHit> hits;
+  size_t found = 0;
+  double t3 = monoMicros();
+  for (int q = 0; q < Q; q++) found += idx.queryRadius(dLat(rng), dLon(rng), 2000.0, hits);
+  double t4 = monoMicros();
+  for (int q = 0; q < Q; q++) found += idx.nearest(dLat(rng), dLon(rng), 10, hits);
+  double t5 = monoMicros();
+
+  printf("bench n=%d: insert %.3f us, move %.3f us, radius(2km) %.1f us, knn(10) %.1f us (avg hits %.1f)\n",
+         n, (t1 - t0) / n, (t2 - t1) / n, (t4 - t3) / Q, (t5 - t4) / Q, (double)found / (2 * Q));
+}
+
+static void runStoreBench(int athletes, double hours) {
+  SeriesStore store;
+  std::mt19937 rng(7);
+  std::normal_distribution<double> step(0.0, 1.0);
+  std::uniform_int_distribution<int> jitter(-20, 20);
+
+  const int64_t t0 = 1700000000000LL;
+  const int64_t n = (int64_t)(hours * 3600.0);
+  std::vector<double> lat(athletes, 42.70), lon(athletes, 23.32), hr(athletes, 120.0);
+
+  double a0 = monoMicros();
+  for (int64_t s = 0; s < n; s++) {
+    for (int i = 0; i < athletes; i++) {
+      lat[i] += 2.5e-5 + 5e-6 * step(rng); // ~3 m/s with GNSS noise
+      lon[i] += 1.0e-5 + 5e-6 * step(rng);
+      hr[i] = std::max(60.0, std::min(190.0, hr[i] + step(rng)));
+      const bool alert = (s % 3600) < 5 && i % 50 == 0;
+      store.append(i, SeriesPoint{t0 + s * 1000 + jitter(rng), (float)(int)hr[i], lat[i], lon[i], alert});
+    }
+  }
+  double a1 = monoMicros();
+
+  std::vector<SeriesPoint> pts;
+  std::vector<SeriesRollup> roll;
+  const int Q = 200;
+  std::uniform_int_distribution<int> who(0, athletes - 1);
+  std::uniform_int_distribution<int64_t> when(0, std::max<int64_t>(1, n - 3600));
+  size_t got = 0, rows = 0;
+  double q0 = monoMicros();
+  for (int q = 0; q < Q; q++) {
+    const int64_t start = t0 + when(rng) * 1000;
+    got += store.query(who(rng), start, start + 3600 * 1000, pts); // one hour of raw points
+  }
+  double q1 = monoMicros();
+  for (int q = 0; q < Q; q++) rows += store.rollups(who(rng), ROLLUP_1MIN, t0, t0 + n * 1000, roll);
+  double q2 = monoMicros();
+
+  const double raw = (double)store.points() * (sizeof(int64_t) + sizeof(float) + 2 * sizeof(double) + 1);
+  printf("bench-store %d athletes x %.1f h: %zu points, %.1f MB (%.2f B/point, %.1fx vs raw), append %.3f us\n",
+         athletes, hours, store.points(), store.memoryBytes() / 1e6,
+         (double)store.memoryBytes() / store.points(), raw / store.memoryBytes(),
+         (a1 - a0) / store.points());
+  printf("  1 h range query %.3f ms, full-race 1 min rollups %.3f ms (%zu points / %zu rows)\n",
+         (q1 - q0) / Q / 1000.0, (q2 - q1) / Q / 1000.0, got / Q, rows / Q);
+}
+
+// Synthetic 2 x 2 degree block of SRTM3 tiles, each a plane in post
+// coordinates, so bilinear lookups have a known exact answer
+static void runDemBench(int n) {
+  char dir[] = "/tmp/demXXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return;
+  }
+  const int posts = 1201;
+  std::vector<uint8_t> hgt((size_t)posts * posts * 2);
+  for (int r = 0; r < posts; r++) {
+    for (int c = 0; c < posts; c++) {
+      const int16_t z = (int16_t)(500 + 2 * r + 3 * c);
+      hgt[2 * ((size_t)r * posts + c)] = (uint8_t)(z >> 8);
+      hgt[2 * ((size_t)r * posts + c) + 1] = (uint8_t)z;
+    }
+  }
+  std::vector<std::string> files;
+  for (int lat = 42; lat < 44; lat++) {
+    for (int lon = 23; lon < 25; lon++) {
+      char path[64];
+      snprintf(path, sizeof(path), "%s/N%02dE%03d.hgt", dir, lat, lon);
+      FILE *fp = fopen(path, "wb");
+      if (!fp) continue;
+      fwrite(hgt.data(), 1, hgt.size(), fp);
+      fclose(fp);
+      files.push_back(path);
+    }
+  }
+
+  ElevationService dem(dir);
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> dLat(42.0, 44.0), dLon(23.0, 25.0);
+  std::vector<double> lat(n), lon(n);
+  for (int i = 0; i < n; i++) {
+    lat[i] = dLat(rng);
+    lon[i] = dLon(rng);
+  }
+
+  double maxErr = 0;
+  double t0 = monoMicros();
+  for (int i = 0; i < n; i++) {
+    const float z = dem.elevation(lat[i], lon[i]);
+    const double r = (ceil(lat[i]) - lat[i]) * (posts - 1), c = (lon[i] - floor(lon[i])) * (posts - 1);
+    maxErr = std::max(maxErr, fabs(z - (500 + 2 * r + 3 * c)));
+  }
+  double t1 = monoMicros();
+  // Batches the size of one second of fixes from a large field
+  const int batch = 2000;
+  std::vector<TerrainSample> out(batch);
+  size_t valid = 0;
+  for (int i = 0; i < n; i += batch) {
+    valid += dem.sampleBatch(&lat[i], &lon[i], std::min(batch, n - i), out.data());
+  }
+  double t2 = monoMicros();
+
+  // One athlete along a course: consecutive fixes a few metres apart
+  for (int i = 0; i < n; i++) {
+    lat[i] = 42.2 + 1.5 * i / n;
+    lon[i] = 23.3 + 1.2 * i / n;
+  }
+  double t3 = monoMicros();
+  for (int i = 0; i < n; i++) dem.sample(lat[i], lon[i]);
+  double t4 = monoMicros();
+
+  const ElevationStats &st = dem.stats();
+  printf("bench-dem %d points on 4 SRTM3 tiles: random %.3f us, batches of %d %.3f us (%zu valid), "
+         "along a course %.3f us\n", n, (t1 - t0) / n, batch, (t2 - t1) / n, valid, (t4 - t3) / n);
+  printf("  max bilinear error %.4f m | %llu tile loads, %llu evictions, %zu mapped\n", maxErr,
+         (unsigned long long)st.tileLoads, (unsigned long long)st.evictions, dem.tilesMapped());
+
+  dem.setDirectory("");
+  for (const std::string &f : files) unlink(f.c_str());
+  rmdir(dir);
+}
+
+// Field of athletes spread along a few km of course, moving at running pace.
+// Publishing goes to a temporary directory once per simulated second, as the
+// main loop does.
+static void runHeatBench(int athletes, int seconds) {
+  char dir[] = "/tmp/heatXXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return;
+  }
+  HeatmapPyramid heat(dir);
+  std::mt19937 rng(11);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  std::uniform_real_distribution<double> start(0.0, 1.0);
+  std::vector<double> s(athletes), pace(athletes);
+  for (int i = 0; i < athletes; i++) {
+    s[i] = 0.3 * start(rng);                 // fraction of the course, bunched near the start
+    pace[i] = (2.5 + 1.5 * start(rng)) / 30000.0; // 2.5-4 m/s over a 30 km loop
+  }
+
+  const double t0 = 1700000000.0;
+  double update_us = 0, publish_us = 0;
+  size_t written = 0;
+  for (int t = 0; t < seconds; t++) {
+    double a0 = monoMicros();
+    for (int i = 0; i < athletes; i++) {
+      s[i] = fmod(s[i] + pace[i], 1.0);
+      const double ang = 2 * M_PI * s[i];
+      const double lat = 42.70 + 0.06 * sin(ang) + 2e-5 * noise(rng);
+      const double lon = 23.32 + 0.09 * sin(ang) * cos(ang) + 2e-5 * noise(rng);
+      const uint8_t risk = (uint8_t)std::max(0.0, std::min(100.0, 25 + 15 * noise(rng)));
+      heat.update(i, lat, lon, risk, risk > 80, t0 + t);
+    }
+    double a1 = monoMicros();
+    written += heat.publish();
+    double a2 = monoMicros();
+    update_us += a1 - a0;
+    publish_us += a2 - a1;
+  }
+
+  const HeatmapStats &st = heat.stats();
+  printf("bench-heat %d athletes x %d s: update %.3f us/frame (%.1f cells), publish %.2f ms/s (%.0f tiles/s)\n",
+         athletes, seconds, update_us / st.updates, (double)st.cellUpdates / st.updates, publish_us / seconds / 1000.0,
+         (double)written / seconds);
+  printf("  %zu cells in memory | live layer, whole field vs %zu B of snapshot JSON:\n", heat.cells(),
+         (size_t)athletes * 95);
+  for (int z = HEATMAP_MIN_ZOOM; z <= HEATMAP_MAX_ZOOM; z += 2) {
+    size_t bytes = 0;
+    const size_t n = heat.tileCount(0, z, &bytes);
+    printf("    z%-2d %5zu tiles %8zu B\n", z, n, bytes);
+  }
+
+  // Leave nothing behind
+  char cmd[64];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", dir);
+}
+
+// Field streaming frames in random order with a drifting risk score and the
+// odd alert, as the link delivers them. Each frame re-ranks one athlete and
+// reads the top k, against the previous approach of sorting the whole list.
+static void runTriageBench(int athletes, int k) {
+  TriageQueue q;
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<int> who(0, athletes - 1);
+  std::normal_distribution<double> drift(0.0, 3.0);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::vector<double> risk(athletes, 30.0);
+  std::vector<TriageEntry> list(athletes), top;
+
+  const int frames = std::max(athletes * 20, 100000);
+  std::vector<int> ids(frames);
+  std::vector<uint8_t> risks(frames);
+  std::vector<bool> alerts(frames);
+  for (int f = 0; f < frames; f++) {
+    const int i = who(rng);
+    risk[i] = std::max(0.0, std::min(100.0, risk[i] + drift(rng)));
+    ids[f] = i;
+    risks[f] = (uint8_t)risk[i];
+    alerts[f] = risk[i] > 85 || u(rng) < 1e-3;
+  }
+
+  const double t0 = 1700000000.0;
+  for (int i = 0; i < athletes; i++) q.update(i, 30, false, t0);
+  double a0 = monoMicros();
+  for (int f = 0; f < frames; f++) q.update(ids[f], risks[f], alerts[f], t0 + f * 1e-3);
+  double a1 = monoMicros();
+  size_t got = 0;
+  for (int f = 0; f < frames; f++) got += q.top(k, top);
+  double a2 = monoMicros();
+
+  // Re-sort on every frame: only a slice of the frames, it is slow
+  for (int i = 0; i < athletes; i++) list[i] = TriageEntry{i, 30, false, 0.0, t0};
+  const int sorted = std::max(1, std::min(frames, 20000000 / athletes));
+  auto apply = [&](int f) {
+    TriageEntry &e = list[ids[f]];
+    if (alerts[f] != e.alert) e.alertSince = alerts[f] ? t0 + f * 1e-3 : 0.0;
+    e.risk = risks[f];
+    e.alert = alerts[f];
+    e.lastSeen = t0 + f * 1e-3;
+  };
+  double b0 = monoMicros();
+  for (int f = 0; f < sorted; f++) {
+    apply(f);
+    std::vector<TriageEntry> copy(list);
+    std::sort(copy.begin(), copy.end(), TriageQueue::before);
+    got += copy[0].id; // keep the sort from being optimised away
+  }
+  double b1 = monoMicros();
+
+  // The heap must agree with a full sort after every frame is applied
+  for (int f = sorted; f < frames; f++) apply(f);
+  std::sort(list.begin(), list.end(), TriageQueue::before);
+  q.top(athletes, top);
+  bool same = top.size() == list.size();
+  for (size_t i = 0; same && i < list.size(); i++) same = (top[i].id == list[i].id);
+
+  printf("bench-triage %d athletes, %d frames: update %.3f us, top-%d %.3f us | re-sort per frame %.1f us "
+         "(%d frames)%s\n", athletes, frames, (a1 - a0) / frames, k, (a2 - a1) / frames, (b1 - b0) / sorted, sorted,
+         same ? "" : " ORDER MISMATCH");
+  (void)got;
+}
+
+// Synthetic field for a minute at 1 Hz, evaluated against rule sets of growing
+// size: once on a single shard, then split over `threads` shards with one
+// thread each. Both runs must fire the same rules.
+static void runRuleBench(int athletes, int threads) {
+  threads = std::max(1, threads);
+  const int seconds = 60;
+  std::mt19937 rng(13);
+  std::normal_distribution<double> step(0.0, 1.0);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+
+  std::vector<RuleInput> frames;
+  frames.reserve((size_t)athletes * seconds);
+  std::vector<double> lat(athletes), lon(athletes), hr(athletes), risk(athletes), pace(athletes);
+  for (int i = 0; i < athletes; i++) {
+    lat[i] = 42.70 + 0.05 * u(rng);
+    lon[i] = 23.32 + 0.05 * u(rng);
+    hr[i] = 110 + 60 * u(rng);
+    risk[i] = 40 * u(rng);
+    pace[i] = u(rng) < 0.05 ? 0.0 : 2e-5 * (1 + u(rng)); // some stand still
+  }
+  const double t0 = 1700000000.0;
+  for (int s = 0; s < seconds; s++) {
+    for (int i = 0; i < athletes; i++) {
+      lat[i] += pace[i];
+      hr[i] = std::max(50.0, std::min(205.0, hr[i] + 2 * step(rng)));
+      risk[i] = std::max(0.0, std::min(100.0, risk[i] + step(rng)));
+      const uint8_t event = u(rng) < 1e-4 ? ALERT_SOS : 0;
+      frames.push_back(RuleInput{i, t0 + s + 1e-3 * (i % 1000), lat[i], lon[i], (float)(int)hr[i], (float)(int)risk[i],
+                                 risk[i] > 85 || event != 0, event, NAN, NAN, NAN});
+    }
+  }
+
+  printf("bench-rules %d athletes x %d s (%zu frames), %d shards on %d threads:\n", athletes, seconds, frames.size(),
+         threads, threads);
+  for (int count : {1, 4, 16, 64, 256}) {
+    std::string text = "crew medic 42.72 23.34\ncrew sweep 42.74 23.36\n";
+    char line[160];
+    for (int k = 0; k < count; k++) {
+      int n = snprintf(line, sizeof(line), "rule r%d: hr > %d", k, 150 + (k * 7) % 45);
+      if (k % 2) n += snprintf(line + n, sizeof(line) - n, " and speed < %d", 1 + k % 5);
+      if (k % 3 == 0) n += snprintf(line + n, sizeof(line) - n, " and risk >= %d", 30 + k % 50);
+      if (k % 4) n += snprintf(line + n, sizeof(line) - n, " for %d", 15 * (k % 4));
+      snprintf(line + n, sizeof(line) - n, k % 5 == 4 ? " -> crews within 3000\n" : " -> notify medic\n");
+      text += (k % 17 == 16) ? std::string("rule s") + std::to_string(k) + ": event == sos -> crews within 5000\n" : line;
+    }
+
+    RuleEngine one(1);
+    if (!one.compile(text, "bench")) return;
+    std::vector<RuleFiring> fired;
+    double a0 = monoMicros();
+    for (size_t f = 0; f < frames.size(); f++) {
+      one.shard(0).evaluate(frames[f]);
+      if ((f & 1023) == 0) {
+        fired.clear();
+        one.shard(0).drain(fired);
+      }
+    }
+    double a1 = monoMicros();
+
+    // Frames go to the shard that owns the athlete, each shard to its own thread
+    RuleEngine par(threads);
+    par.compile(text, "bench");
+    std::vector<std::vector<RuleInput>> parts(threads);
+    for (const RuleInput &in : frames) parts[par.shardOf(in.id)].push_back(in);
+    std::vector<std::thread> pool;
+    double b0 = monoMicros();
+    for (int t = 0; t < threads; t++) {
+      pool.emplace_back([&par, &parts, t] {
+        RuleShard &shard = par.shard(t);
+        std::vector<RuleFiring> out;
+        for (size_t f = 0; f < parts[t].size(); f++) {
+          shard.evaluate(parts[t][f]);
+          if ((f & 1023) == 0) {
+            out.clear();
+            shard.drain(out);
+          }
+        }
+      });
+    }
+    for (std::thread &th : pool) th.join();
+    double b1 = monoMicros();
+
+    uint64_t firings = 0;
+    for (size_t t = 0; t < par.shards(); t++) firings += par.shard(t).stats().firings;
+    const double single = (a1 - a0) * 1000.0 / frames.size();
+    const double sharded = (b1 - b0) * 1000.0 / frames.size();
+    printf("  %4zu rules %4zu terms: %7.1f ns/frame (%5.2f ns/rule) | sharded %7.1f ns/frame (%.1fx) | %llu firings%s\n",
+           one.rules(), one.terms(), single, single / one.rules(), sharded, single / sharded,
+           (unsigned long long)firings, firings == one.shard(0).stats().firings ? "" : " SHARD MISMATCH");
+  }
+}
+
+static void printRules() {
+  if (g_rules.rules() == 0) {
+    printf("no routing rules (start with --rules <file>)\n");
+    return;
+  }
+  uint64_t frames = 0;
+  size_t athletes = 0;
+  for (size_t s = 0; s < g_rules.shards(); s++) {
+    frames += g_rules.shard(s).stats().frames;
+    athletes += g_rules.shard(s).athletes();
+  }
+  printf("%zu rules (%zu terms), %zu crews | %llu frames from %zu athletes over %zu shards\n", g_rules.rules(),
+         g_rules.terms(), g_rules.crews().size(), (unsigned long long)frames, athletes, g_rules.shards());
+  for (uint32_t r = 0; r < g_rules.rules(); r++) {
+    uint64_t fires = 0;
+    for (size_t s = 0; s < g_rules.shards(); s++) fires += g_rules.shard(s).fires(r);
+    printf("  %-12s %6llu  %s\n", g_rules.ruleName(r).c_str(), (unsigned long long)fires, g_rules.ruleText(r).c_str());
+  }
+}
+
+static void printTriage(size_t k) {
+  std::vector<TriageEntry> top;
+  const double t0 = monoMicros();
+  g_triage.top(k, top);
+  const double now = nowSeconds();
+  printf("%zu of %zu athletes, %zu alerting (%.1f us)\n", top.size(), g_triage.size(), g_triage.alerts(),
+         monoMicros() - t0);
+  for (const TriageEntry &e : top) {
+    if (e.alert) printf("  %d  risk=%u  ALERT %.0f s\n", e.id, e.risk, now - e.alertSince);
+    else printf("  %d  risk=%u  seen %.0f s ago\n", e.id, e.risk, now - e.lastSeen);
+  }
+}
+
+static void printHistory(int32_t id, double minutes) {
+  const int64_t now = (int64_t)(nowSeconds() * 1000.0);
+  std::vector<SeriesRollup> roll;
+  g_store.rollups(id, ROLLUP_1MIN, now - (int64_t)(minutes * 60000.0), now, roll);
+  printf("%zu minutes of history for %d\n", roll.size(), id);
+  for (const SeriesRollup &r : roll) {
+    time_t t = (time_t)(r.tStart_ms / 1000);
+    char ts[16];
+    strftime(ts, sizeof(ts), "%H:%M", localtime(&t));
+    printf("  %s  n=%u  hr %.0f/%.0f/%.0f  alerts=%u\n", ts, r.count,
+           r.hrMin, r.hrSum / r.count, r.hrMax, r.alerts);
+  }
+}
+
+static void handleCommand(char *line) {
+  char cmd[16] = {0};
+  double a = 0, b = 0, c = 0, d = 0;
+  int n = sscanf(line, "%15s %lf %lf %lf %lf", cmd, &a, &b, &c, &d);
+  if (n < 1) return;
+
+  std::vector<SpatialHit> hits;
+  double t0 = monoMicros();
+
+  if (!strcmp(cmd, "near") && n == 4) {
+    g_index.queryRadius(a, b, c, hits);
+    printf("%zu within %.0f m (%.1f us)\n", hits.size(), c, monoMicros() - t0);
+    printHits(hits);
+  } else if (!strcmp(cmd, "knn") && n == 4) {
+    g_index.nearest(a, b, (size_t)c, hits);
+    printf("%zu nearest (%.1f us)\n", hits.size(), monoMicros() - t0);
+    printHits(hits);
+  } else if (!strcmp(cmd, "box") && n == 5) {
+    std::vector<int32_t> ids;
+    g_index.queryBox(a, b, c, d, ids);
+    printf("%zu in box (%.1f us)\n", ids.size(), monoMicros() - t0);
+    for (int32_t id : ids) printf("  %d\n", id);
+  } else if (!strcmp(cmd, "history") && n == 3) {
+    printHistory((int32_t)a, b);
+  } else if (!strcmp(cmd, "alerts")) {
+    const AlertStats &st = g_alerts.stats();
+    printf("%u events from %u frames (%u repeats dropped, %u device resets)\n", st.events, st.frames, st.duplicates,
+           st.reboots);
+    if (st.events > 0) {
+      printf("latency ms: min %.0f avg %.0f max %.0f | first copy received: #0 %u, #1 %u, #2 %u, later %u\n",
+             st.minLatency_ms, st.sumLatency_ms / st.events, st.maxLatency_ms,
+             st.firstCopy[0], st.firstCopy[1], st.firstCopy[2], st.firstCopy[3]);
+    }
+  } else if (!strcmp(cmd, "terrain") && n == 3) {
+    const TerrainSample ts = g_dem.sample(a, b);
+    if (ts.valid) {
+      printf("elevation %.1f m, slope %.1f deg facing %.0f deg (%.1f us)\n", ts.elevation_m, ts.slope_deg,
+             ts.aspect_deg, monoMicros() - t0);
+    } else {
+      printf("no terrain data%s\n", g_dem.enabled() ? "" : " (start with --dem <dir>)");
+    }
+  } else if (!strcmp(cmd, "heat")) {
+    const HeatmapStats &st = g_heat.stats();
+    printf("%zu cells over zoom %d-%d | %llu frames, %llu tiles written (%llu B), %llu removed\n", g_heat.cells(),
+           HEATMAP_MIN_ZOOM, HEATMAP_MAX_ZOOM, (unsigned long long)st.updates, (unsigned long long)st.tilesWritten,
+           (unsigned long long)st.bytesWritten, (unsigned long long)st.tilesRemoved);
+  } else if (!strcmp(cmd, "triage")) {
+    printTriage(n >= 2 ? (size_t)a : 10);
+  } else if (!strcmp(cmd, "ack") && n == 2) {
+    acknowledge((int32_t)a);
+  } else if (!strcmp(cmd, "rules")) {
+    printRules();
+  } else if (!strcmp(cmd, "bench") && n == 2) {
+    runBench((int)a);
+  } else if (!strcmp(cmd, "bench-store") && n == 3) {
+    runStoreBench((int)a, b);
+  } else if (!strcmp(cmd, "bench-dem") && n == 2) {
+    runDemBench((int)a);
+  } else if (!strcmp(cmd, "bench-heat") && n == 3) {
+    runHeatBench((int)a, (int)b);
+  } else if (!strcmp(cmd, "bench-triage") && n == 3) {
+    runTriageBench((int)a, (int)b);
+  } else if (!strcmp(cmd, "bench-rules") && n == 3) {
+    runRuleBench((int)a, (int)b);
+  } else {
+    printf("commands: near <lat> <lon> <m> | knn <lat> <lon> <k> | box <lat0> <lon0> <lat1> <lon1>\n"
+           "          history <id> <min> | alerts | terrain <lat> <lon> | heat | triage [k] | ack <id> | rules\n"
+           "          bench <n> | bench-store <athletes> <hours> | bench-dem <points>\n"
+           "          bench-heat <athletes> <seconds> | bench-triage <athletes> <k>\n"
+           "          bench-rules <athletes> <threads>\n");
+  }
+  fflush(stdout);
+}
+
+static int openInput(const char *path) {
+  if (!strcmp(path, "-")) return STDIN_FILENO;
+
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) return -1;
+
+  // Serial adapters: raw 9600 8N1, same as the device's Link port
+  if (isatty(fd)) {
+    termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+      cfmakeraw(&tio);
+      cfsetispeed(&tio, B9600);
+      cfsetospeed(&tio, B9600);
+      tcsetattr(fd, TCSANOW, &tio);
+    }
+  }
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <link-device|capture-file|-> [--out participants.json] [--archive file] [--link-delay ms]"
+                    " [--dem dir] [--tiles dir] [--triage-top k] [--rules file]\n", argv[0]);
+    return 1;
+  }
+  const char *tilesDir = nullptr;
+  for (int i = 2; i + 1 < argc; i++) {
+    if (!strcmp(argv[i], "--out")) g_outPath = argv[++i];
+    else if (!strcmp(argv[i], "--archive")) g_archivePath = argv[++i];
+    else if (!strcmp(argv[i], "--link-delay")) g_alerts = AlertTracker(atof(argv[++i]));
+    else if (!strcmp(argv[i], "--dem")) g_dem.setDirectory(argv[++i]);
+    else if (!strcmp(argv[i], "--tiles")) tilesDir = argv[++i];
+    else if (!strcmp(argv[i], "--triage-top")) g_triageTop = (size_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--rules")) {
+      // Routing is safety-relevant: refuse to run on a file that does not compile
+      const char *path = argv[++i];
+      if (!g_rules.load(path)) return 1;
+      fprintf(stderr, "[ingest] %zu routing rules, %zu crews from %s\n", g_rules.rules(), g_rules.crews().size(), path);
+    }
+  }
+  const char *outSlash = strrchr(g_outPath, '/');
+  const std::string outDir = outSlash ? std::string(g_outPath, outSlash - g_outPath) + "/" : std::string();
+  g_triagePath = outDir + "triage.json";
+  if (tilesDir) {
+    g_heat.setDirectory(tilesDir);
+  } else {
+    g_heat.setDirectory(outDir + "tiles");
+  }
+
+  // Resume history from a previous run; old blocks stay memory-mapped
+  if (g_archivePath && access(g_archivePath, R_OK) == 0) {
+    if (g_store.openMapped(g_archivePath)) {
+      fprintf(stderr, "[ingest] mapped %zu points for %zu athletes from %s\n",
+              g_store.points(), g_store.athletes(), g_archivePath);
+    } else {
+      fprintf(stderr, "[ingest] could not map archive %s\n", g_archivePath);
+    }
+  }
+
+  int linkFd = openInput(argv[1]);
+  if (linkFd < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  bool commands = (linkFd != STDIN_FILENO);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  FrameParser parser;
+  AthleteFrame frame;
+  uint8_t buf[512];
+  char line[256];
+  size_t lineLen = 0;
+  double lastSnapshot = 0;
+  double lastStaleCheck = 0;
+  bool linkOpen = true;
+
+  while ((linkOpen || commands) && !g_stop) {
+    pollfd fds[2];
+    int nfds = 0;
+    if (linkOpen) fds[nfds++] = pollfd{linkFd, POLLIN, 0};
+    if (commands) fds[nfds++] = pollfd{STDIN_FILENO, POLLIN, 0};
+    poll(fds, nfds, 200);
+
+    for (int i = 0; i < nfds; i++) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP))) continue;
+      ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+
+      if (fds[i].fd == linkFd && linkOpen) {
+        if (n <= 0) {
+          linkOpen = false;
+          continue;
+        }
+        for (ssize_t k = 0; k < n; k++) {
+          if (parser.push(buf[k], frame)) onFrame(frame);
+        }
+      } else {
+        if (n <= 0) {
+          commands = false; // stdin closed
+          continue;
+        }
+        for (ssize_t k = 0; k < n; k++) {
+          if (buf[k] == '\n' || lineLen + 1 >= sizeof(line)) {
+            line[lineLen] = '\0';
+            handleCommand(line);
+            lineLen = 0;
+          } else {
+            line[lineLen++] = (char)buf[k];
+          }
+        }
+      }
+    }
+
+    // Publish at most once per second
+    double now = nowSeconds();
+    if (now - lastStaleCheck >= 1.0) {
+      dropStale(now);
+      lastStaleCheck = now;
+    }
+    if (g_dirty && (now - lastSnapshot >= 1.0 || !linkOpen)) {
+      writeSnapshot();
+      writeTriage();
+      g_heat.publish();
+      g_dirty = false;
+      lastSnapshot = now;
+    }
+  }
+
+  if (g_archivePath) {
+    // Write to a temp file first: the current archive may still be mapped
+    std::string tmp = std::string(g_archivePath) + ".tmp";
+    if (g_store.save(tmp.c_str()) && rename(tmp.c_str(), g_archivePath) == 0) {
+      fprintf(stderr, "[ingest] archived %zu points to %s\n", g_store.points(), g_archivePath);
+    } else {
+      perror(g_archivePath);
+    }
+  }
+
+  fprintf(stderr, "[ingest] %u frames, %u bytes dropped, %zu athletes\n",
+          parser.framesOk(), parser.bytesDropped(), g_athletes.size());
+  return 0;
+}
@@ -0,0 +1,270 @@
+#include "CoachStats_Service.h"
+#include "RiskScore_Service.h"
+
+// Zone lower bounds as a fraction of heart-rate reserve (Karvonen)
+static const float ZONE_FLOOR[COACH_ZONES] = {0.50, 0.60, 0.70, 0.80, 0.90};
+
+// Banister TRIMP weighting: y = A * x * e^(B * x), x = fraction of HR reserve
+static const float TRIMP_A = 0.64;
+static const float TRIMP_B = 1.92;
+
+static float ema(float avg, float x, float dt, float tau)
+{
+  const float alpha = dt / (tau + dt);
+  return avg + alpha * (x - avg);
+}
+
+// ======= P2Quantile =======
+
+void P2Quantile::begin(float p)
+{
+  _p = p;
+  _count = 0;
+}
+
+float P2Quantile::parabolic(int i, float d) const
+{
+  return _q[i] + d / (_n[i + 1] - _n[i - 1]) *
+                     ((_n[i] - _n[i - 1] + d) * (_q[i + 1] - _q[i]) / (_n[i + 1] - _n[i]) +
+                      (_n[i + 1] - _n[i] - d) * (_q[i] - _q[i - 1]) / (_n[i] - _n[i - 1]));
+}
+
+float P2Quantile::linear(int i, int d) const
+{
+  return _q[i] + d * (_q[i + d] - _q[i]) / (_n[i + d] - _n[i]);
+}
+
+void P2Quantile::add(float x)
+{
+  // The first five values are kept sorted and become the markers
+  if (_count < 5)
+  {
+    int i = _count++;
+    while (i > 0 && _q[i - 1] > x)
+    {
+      _q[i] = _q[i - 1];
+      i--;
+    }
+    _q[i] = x;
+    if (_count == 5)
+    {
+      for (int j = 0; j < 5; j++)
+        _n[j] = j + 1;
+      _np[0] = 1;
+      _np[1] = 1 + 2 * _p;
+      _np[2] = 1 + 4 * _p;
+      _np[3] = 3 + 2 * _p;
+      _np[4] = 5;
+      _dn[0] = 0;
+      _dn[1] = _p / 2;
+      _dn[2] = _p;
+      _dn[3] = (1 + _p) / 2;
+      _dn[4] = 1;
+    }
+    return;
+  }
+  _count++;
+
+  // Cell of x; the extreme markers follow the min and max
+  int k;
+  if (x < _q[0])
+  {
+    _q[0] = x;
+    k = 0;
+  }
+  else if (x >= _q[4])
+  {
+    _q[4] = x;
+    k = 3;
+  }
+  else
+  {
+    k = 0;
+    while (x >= _q[k + 1])
+      k++;
+  }
+  for (int i = k + 1; i < 5; i++)
+    _n[i] += 1;
+  for (int i = 0; i < 5; i++)
+    _np[i] += _dn[i];
+
+  // Move the middle markers that are a position or more off
+  for (int i = 1; i <= 3; i++)
+  {
+    const float d = _np[i] - _n[i];
+    if ((d >= 1 && _n[i + 1] - _n[i] > 1) || (d <= -1 && _n[i - 1] - _n[i] < -1))
+    {
+      const int s = d > 0 ? 1 : -1;
+      const float q = parabolic(i, s);
+      _q[i] = (_q[i - 1] < q && q < _q[i + 1]) ? q : linear(i, s);
+      _n[i] += s;
+    }
+  }
+}
+
+float P2Quantile::value() const
+{
+  if (_count == 0)
+    return NAN;
+  if (_count < 5)
+    return _q[(int)(_p * (_count - 1) + 0.5f)];
+  return _q[2];
+}
+
+// ======= RollingQuantile =======
+
+void RollingQuantile::begin(float p, uint32_t window)
+{
+  _p = p;
+  _window = window;
+  _est[0].begin(p);
+  _est[1].begin(p);
+}
+
+void RollingQuantile::add(float x)
+{
+  // The younger estimator starts one window after the older one; once the
+  // older one has seen two windows the younger takes its place
+  _est[0].add(x);
+  if (_est[0].count() > _window)
+    _est[1].add(x);
+  if (_est[0].count() >= 2 * _window)
+  {
+    _est[0] = _est[1];
+    _est[1].begin(_p);
+  }
+}
+
+float RollingQuantile::value() const
+{
+  return _est[0].value();
+}
+
+uint32_t RollingQuantile::count() const
+{
+  return _est[0].count();
+}
+
+// ======= CoachStats_Service =======
+
+CoachStats_Service::CoachStats_Service()
+{
+  _profileRest = RISK_DEFAULT_HR_REST;
+  _profileMax = RISK_DEFAULT_HR_MAX;
+  reset();
+}
+
+void CoachStats_Service::begin()
+{
+  reset();
+}
+
+void CoachStats_Service::reset()
+{
+  _lastUpdate = 0;
+  _haveLast = false;
+  _stillSince = 0;
+  _rest.begin(COACH_REST_QUANTILE, COACH_BASELINE_WINDOW);
+  _max.begin(COACH_MAX_QUANTILE, COACH_BASELINE_WINDOW);
+  _median.begin(0.5f);
+  memset(&_summary, 0, sizeof(_summary));
+  _summary.hrRestEstimate = NAN;
+  _summary.hrMaxEstimate = NAN;
+  _summary.hrMedian = NAN;
+  _summary.hrRest = _profileRest;
+  _summary.hrMax = _profileMax;
+  _lastCycles = 0;
+  _maxCycles = 0;
+}
+
+void CoachStats_Service::setHeartRateLimits(float hrRest, float hrMax)
+{
+  if (hrRest > 30 && hrMax > hrRest + 20)
+  {
+    _profileRest = hrRest;
+    _profileMax = hrMax;
+    refreshLimits();
+  }
+}
+
+void CoachStats_Service::refreshLimits()
+{
+  float rest = _profileRest;
+  float hrMax = _profileMax;
+  if (restReady())
+  {
+    _summary.hrRestEstimate = _rest.value();
+    rest = _summary.hrRestEstimate;
+  }
+  if (maxReady())
+  {
+    _summary.hrMaxEstimate = _max.value();
+    hrMax = max(_profileMax, _summary.hrMaxEstimate);
+  }
+  // Keep a usable reserve if the athlete never rested during the window
+  if (hrMax - rest < 20)
+    rest = hrMax - 20;
+  _summary.hrRest = rest;
+  _summary.hrMax = hrMax;
+}
+
+uint8_t CoachStats_Service::zoneOf(float hr) const
+{
+  const float reserve = (hr - _summary.hrRest) / (_summary.hrMax - _summary.hrRest);
+  uint8_t zone = 0;
+  while (zone < COACH_ZONES && reserve >= ZONE_FLOOR[zone])
+    zone++;
+  return zone;
+}
+
+bool CoachStats_Service::update(const HeartRateData &hr, float speed_mps, float motion_dps, uint32_t now)
+{
+  // Activity is tracked on every call, counted readings or not; stillness
+  // only starts from an actual motion reading
+  const bool active = speed_mps > COACH_REST_MAX_SPEED || motion_dps > COACH_REST_MAX_DPS;
+  if (active)
+    _stillSince = 0;
+  else if (_stillSince == 0 && !isnan(motion_dps))
+    _stillSince = now | 1; // 0 means active
+
+  if (!hr.validReading || hr.heartRate <= 0 || hr.signalQuality < COACH_MIN_QUALITY)
+    return false;
+  if (_haveLast && now - _lastUpdate < COACH_SAMPLE_MS)
+    return false;
+
+  const uint32_t startCycles = ESP.getCycleCount();
+
+  // Gaps (sensor off, poor signal) count towards nothing
+  uint32_t dtMs = 0;
+  if (_haveLast && now - _lastUpdate <= COACH_MAX_DT_MS)
+    dtMs = now - _lastUpdate;
+  _haveLast = true;
+  _lastUpdate = now;
+
+  const float bpm = hr.heartRate;
+  if (_stillSince != 0 && now - _stillSince >= COACH_REST_SETTLE_MS)
+    _rest.add(bpm);
+  _max.add(bpm);
+  _median.add(bpm);
+  _summary.hrMedian = _median.value();
+  refreshLimits();
+
+  if (dtMs > 0)
+  {
+    const float dt = dtMs * 0.001;
+    float x = (bpm - _summary.hrRest) / (_summary.hrMax - _summary.hrRest);
+    x = constrain(x, 0.0f, 1.0f);
+    const float perMinute = TRIMP_A * x * expf(TRIMP_B * x);
+
+    _summary.elapsed_ms += dtMs;
+    _summary.zone_ms[zoneOf(bpm)] += dtMs;
+    _summary.trimp += perMinute * dt / 60.0f;
+    _summary.acuteLoad = ema(_summary.acuteLoad, perMinute * 60.0f, dt, COACH_ACUTE_TAU_S);
+    _summary.chronicLoad = ema(_summary.chronicLoad, perMinute * 60.0f, dt, COACH_CHRONIC_TAU_S);
+  }
+
+  _lastCycles = ESP.getCycleCount() - startCycles;
+  if (_lastCycles > _maxCycles)
+    _maxCycles = _lastCycles;
+  return true;
+}
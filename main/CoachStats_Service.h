@@ -0,0 +1,128 @@
+#ifndef COACHSTATS_SERVICE_H
+#define COACHSTATS_SERVICE_H
+
+#include <Arduino.h>
+#include "HeartRate_Service.h"
+
+// Coach Mode analytics configuration
+#define COACH_ZONES 5                 // HR-reserve zones 50/60/70/80/90 %
+#define COACH_SAMPLE_MS 1000          // readings are folded in at most this often
+#define COACH_MAX_DT_MS 5000          // longer gaps (no finger, poor signal) are not counted
+#define COACH_MIN_QUALITY 30          // readings below this signal quality are ignored
+#define COACH_BASELINE_WINDOW 7200    // readings per rolling baseline estimator (2 h at 1/s)
+#define COACH_BASELINE_WARMUP 600     // readings before the max estimate replaces the profile value
+#define COACH_REST_QUANTILE 0.05f     // resting HR estimate, over settled resting readings only
+#define COACH_REST_WARMUP 300         // resting readings before the rest estimate replaces the profile value
+#define COACH_REST_MAX_SPEED 0.5f     // m/s; faster is activity
+#define COACH_REST_MAX_DPS 30.0f      // |roll| + |pitch| rate; more is activity
+#define COACH_REST_SETTLE_MS 120000   // still this long before readings count as resting
+#define COACH_MAX_QUANTILE 0.99f      // max HR estimate (ignores single spikes)
+#define COACH_ACUTE_TAU_S 600.0f      // decayed training load time constants
+#define COACH_CHRONIC_TAU_S 3600.0f
+
+// Streaming quantile estimate (P² algorithm, Jain & Chlamtac 1985): five
+// markers whose heights track the p-quantile of everything added so far.
+// Fixed memory and O(1) per value; no samples are stored.
+class P2Quantile
+{
+private:
+  float _p;
+  float _q[5];    // marker heights
+  float _n[5];    // marker positions (1-based)
+  float _np[5];   // desired positions
+  float _dn[5];   // desired position increments
+  uint32_t _count;
+
+  float parabolic(int i, float d) const;
+  float linear(int i, int d) const;
+
+public:
+  void begin(float p);
+  void add(float x);
+  float value() const;  // NAN while empty
+  uint32_t count() const { return _count; }
+};
+
+// Quantile over a sliding window of recent values: two P² estimators
+// restarted in turn every `window` values, the older one answering. The
+// estimate covers the last window to two windows of values.
+class RollingQuantile
+{
+private:
+  P2Quantile _est[2];
+  uint32_t _window;
+  float _p;
+
+public:
+  void begin(float p, uint32_t window);
+  void add(float x);
+  float value() const;
+  uint32_t count() const;
+};
+
+struct CoachSummary
+{
+  uint32_t elapsed_ms;               // time with counted readings
+  uint32_t zone_ms[COACH_ZONES + 1];  // [0] below zone 1, [z] zone z
+  float trimp;                        // Banister TRIMP accumulated
+  float acuteLoad;                    // TRIMP per hour, decayed over COACH_ACUTE_TAU_S
+  float chronicLoad;                  // TRIMP per hour, decayed over COACH_CHRONIC_TAU_S
+  float hrRestEstimate;               // rolling COACH_REST_QUANTILE of resting readings, NAN until warm
+  float hrMaxEstimate;                // rolling COACH_MAX_QUANTILE, NAN until warm
+  float hrMedian;                     // whole session, NAN until the first reading
+  float hrRest;                       // limits the zones are computed from
+  float hrMax;
+};
+
+class CoachStats_Service
+{
+private:
+  // Profile limits (e.g. from the athlete's settings)
+  float _profileRest;
+  float _profileMax;
+
+  uint32_t _lastUpdate;
+  bool _haveLast;
+  uint32_t _stillSince;  // start of the current low-activity stretch, 0 while active
+  RollingQuantile _rest;
+  RollingQuantile _max;
+  P2Quantile _median;
+  CoachSummary _summary;
+
+  // Cycle cost of update()
+  uint32_t _lastCycles;
+  uint32_t _maxCycles;
+
+  void refreshLimits();
+
+public:
+  CoachStats_Service();
+
+  void begin();
+  void reset();
+
+  // Profile resting and max HR, used until the baselines are warm. The
+  // estimated max only ever raises the profile max: a session rarely
+  // reaches a true maximum.
+  void setHeartRateLimits(float hrRest, float hrMax);
+
+  // One HeartRate_Service reading at `now` (millis()) with the current
+  // activity: speed in m/s and |roll| + |pitch| rate in dps (NAN when there
+  // is no new reading; the activity state carries over). Only readings after COACH_REST_SETTLE_MS of low activity feed
+  // the resting HR estimate; exercise readings would put it near the
+  // working HR. Call every loop; returns true when the reading was counted.
+  bool update(const HeartRateData &hr, float speed_mps, float motion_dps, uint32_t now);
+
+  // Zone of a heart rate with the current limits, 0 below zone 1
+  uint8_t zoneOf(float hr) const;
+
+  bool restReady() const { return _rest.count() >= COACH_REST_WARMUP; }
+  bool maxReady() const { return _max.count() >= COACH_BASELINE_WARMUP; }
+  bool baselinesReady() const { return restReady() && maxReady(); }
+  const CoachSummary &getSummary() const { return _summary; }
+
+  uint32_t getLastCycles() const { return _lastCycles; }
+  uint32_t getMaxCycles() const { return _maxCycles; }
+};
+
+#endif // COACHSTATS_SERVICE_H
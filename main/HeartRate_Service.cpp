@@ -1,9 +1,11 @@
 #include "HeartRate_Service.h"
+#include "profiler.h"
 
 HeartRate_Service::HeartRate_Service()
 {
   _bufferIndex = 0;
   _bufferFull = false;
+  _irAvg = 0;
   _lastHeartRate = 0;
   _lastBeatTime = 0;
   _beatInterval = 0;
@@ -12,12 +14,14 @@ HeartRate_Service::HeartRate_Service()
   _lastValleyValue = 0;
   _peakDetected = false;
   _peakCount = 0;
+  _beatDetection = true;
   _lastSpO2 = 0;
   _redAC = 0;
   _redDC = 0;
   _irAC = 0;
   _irDC = 0;
   _signalQuality = 0;
+  _temperature = NAN;
 }
 
 void HeartRate_Service::begin()
@@ -28,14 +32,12 @@ void HeartRate_Service::begin()
 void HeartRate_Service::reset()
 {
   // Clear buffers
-  for (int i = 0; i < HR_BUFFER_SIZE; i++)
-  {
-    _redBuffer[i] = 0;
-    _irBuffer[i] = 0;
-  }
+  _redBuffer.clear();
+  _irBuffer.clear();
 
   _bufferIndex = 0;
   _bufferFull = false;
+  _irAvg = 0;
   _lastHeartRate = 0;
   _lastBeatTime = 0;
   _beatInterval = 0;
@@ -48,8 +50,20 @@ void HeartRate_Service::reset()
   _signalQuality = 0;
 }
 
-void HeartRate_Service::addSample(uint32_t red, uint32_t ir)
+void HeartRate_Service::markDiscontinuity()
+{
+  _redBuffer.clear();
+  _irBuffer.clear();
+  _bufferIndex = 0;
+  _bufferFull = false;
+  _lastBeatTime = 0; // Beat interval across the gap would be meaningless
+  _beatInterval = 0;
+  _peakDetected = false;
+}
+
+void HeartRate_Service::addSample(uint32_t red, uint32_t ir, uint32_t timestamp)
 {
+  PROF_SCOPE("HR addSample");
   // Update circular buffers
   updateBuffers(red, ir);
 
@@ -58,9 +72,10 @@ void HeartRate_Service::addSample(uint32_t red, uint32_t ir)
   {
     return;
   }
+  _irAvg = getBufferAverage(_irBuffer);
 
   // Detect peaks for heart rate
-  if (detectPeak())
+  if (_beatDetection && detectPeak(timestamp))
   {
     _lastHeartRate = calculateHeartRate();
   }
@@ -91,12 +106,29 @@ bool HeartRate_Service::isReady()
   return _bufferFull;
 }
 
+void HeartRate_Service::setBeatDetection(bool enabled)
+{
+  if (enabled && !_beatDetection)
+  {
+    // No beats were timed meanwhile; start the interval afresh
+    _lastBeatTime = 0;
+    _beatInterval = 0;
+    _peakDetected = false;
+  }
+  _beatDetection = enabled;
+}
+
+void HeartRate_Service::setTemperature(float celsius)
+{
+  _temperature = celsius;
+}
+
 // Private helper functions
 
 void HeartRate_Service::updateBuffers(uint32_t red, uint32_t ir)
 {
-  _redBuffer[_bufferIndex] = red;
-  _irBuffer[_bufferIndex] = ir;
+  _redBuffer.set(_bufferIndex, red);
+  _irBuffer.set(_bufferIndex, ir);
 
   _bufferIndex++;
 
@@ -107,7 +139,7 @@ void HeartRate_Service::updateBuffers(uint32_t red, uint32_t ir)
   }
 }
 
-bool HeartRate_Service::detectPeak()
+bool HeartRate_Service::detectPeak(uint32_t timestamp)
 {
   if (!_bufferFull)
   {
@@ -115,12 +147,12 @@ bool HeartRate_Service::detectPeak()
   }
 
   // Use IR signal for peak detection (more stable than RED)
-  uint32_t currentValue = _irBuffer[(_bufferIndex - 1 + HR_BUFFER_SIZE) % HR_BUFFER_SIZE];
-  uint32_t previousValue = _irBuffer[(_bufferIndex - 2 + HR_BUFFER_SIZE) % HR_BUFFER_SIZE];
-  uint32_t beforePrevious = _irBuffer[(_bufferIndex - 3 + HR_BUFFER_SIZE) % HR_BUFFER_SIZE];
+  uint32_t currentValue = _irBuffer.get((_bufferIndex - 1 + HR_BUFFER_SIZE) % HR_BUFFER_SIZE);
+  uint32_t previousValue = _irBuffer.get((_bufferIndex - 2 + HR_BUFFER_SIZE) % HR_BUFFER_SIZE);
+  uint32_t beforePrevious = _irBuffer.get((_bufferIndex - 3 + HR_BUFFER_SIZE) % HR_BUFFER_SIZE);
 
   // Calculate average and threshold
-  uint32_t avgValue = getBufferAverage(_irBuffer);
+  uint32_t avgValue = _irAvg;
   uint32_t threshold = avgValue * 1.05; // 5% above average
 
   // Detect peak: previous value is higher than both neighbors and above threshold
@@ -136,13 +168,12 @@ bool HeartRate_Service::detectPeak()
       _lastPeakValue = previousValue;
       _peakCount++;
 
-      // Record beat time
-      uint32_t currentTime = millis();
+      // Record beat time (of the sample that completed the peak)
       if (_lastBeatTime > 0)
       {
-        _beatInterval = currentTime - _lastBeatTime;
+        _beatInterval = timestamp - _lastBeatTime;
       }
-      _lastBeatTime = currentTime;
+      _lastBeatTime = timestamp;
 
       return true;
     }
@@ -190,7 +221,7 @@ float HeartRate_Service::calculateSpO2()
 
   // Calculate DC (average) and AC (variation) for both RED and IR
   _redDC = getBufferAverage(_redBuffer);
-  _irDC = getBufferAverage(_irBuffer);
+  _irDC = _irAvg;
 
   uint32_t redMax = getBufferMax(_redBuffer);
   uint32_t redMin = getBufferMin(_redBuffer);
@@ -209,6 +240,12 @@ float HeartRate_Service::calculateSpO2()
   // Calculate R value (ratio of ratios)
   float R = (_redAC / _redDC) / (_irAC / _irDC);
 
+  // Compensate LED wavelength drift away from the calibration temperature
+  if (!isnan(_temperature))
+  {
+    R *= 1.0 - SPO2_R_TEMP_COEF * (_temperature - SPO2_REF_TEMP);
+  }
+
   // SpO2 calculation using empirical formula
   // This is a simplified version - actual calibration may be needed
   float spO2 = 110.0 - 25.0 * R;
@@ -240,7 +277,7 @@ float HeartRate_Service::calculateSignalQuality()
   // 2. Signal variation (IR AC value)
   // 3. Signal stability (standard deviation)
 
-  uint32_t irAvg = getBufferAverage(_irBuffer);
+  uint32_t irAvg = _irAvg;
   float irStdDev = getBufferStdDev(_irBuffer, irAvg);
 
   // Strength score (0-100)
@@ -273,56 +310,29 @@ bool HeartRate_Service::isFingerDetected()
     return false;
   }
 
-  uint32_t irAvg = getBufferAverage(_irBuffer);
-  return (irAvg > HR_FINGER_THRESHOLD);
+  return (_irAvg > HR_FINGER_THRESHOLD);
 }
 
 // Signal processing helpers
 
-uint32_t HeartRate_Service::getBufferAverage(uint32_t *buffer)
+uint32_t HeartRate_Service::getBufferAverage(const HR_Window &buffer)
 {
-  uint64_t sum = 0;
-  for (int i = 0; i < HR_BUFFER_SIZE; i++)
-  {
-    sum += buffer[i];
-  }
-  return (uint32_t)(sum / HR_BUFFER_SIZE);
+  return (uint32_t)(buffer.sum() / HR_BUFFER_SIZE);
 }
 
-uint32_t HeartRate_Service::getBufferMax(uint32_t *buffer)
+uint32_t HeartRate_Service::getBufferMax(const HR_Window &buffer)
 {
-  uint32_t maxVal = 0;
-  for (int i = 0; i < HR_BUFFER_SIZE; i++)
-  {
-    if (buffer[i] > maxVal)
-    {
-      maxVal = buffer[i];
-    }
-  }
-  return maxVal;
+  return buffer.maxValue();
 }
 
-uint32_t HeartRate_Service::getBufferMin(uint32_t *buffer)
+uint32_t HeartRate_Service::getBufferMin(const HR_Window &buffer)
 {
-  uint32_t minVal = 0xFFFFFFFF;
-  for (int i = 0; i < HR_BUFFER_SIZE; i++)
-  {
-    if (buffer[i] < minVal)
-    {
-      minVal = buffer[i];
-    }
-  }
-  return minVal;
+  return buffer.minValue();
 }
 
-float HeartRate_Service::getBufferStdDev(uint32_t *buffer, uint32_t mean)
+float HeartRate_Service::getBufferStdDev(const HR_Window &buffer, uint32_t mean)
 {
-  float variance = 0;
-  for (int i = 0; i < HR_BUFFER_SIZE; i++)
-  {
-    float diff = (float)buffer[i] - (float)mean;
-    variance += diff * diff;
-  }
+  float variance = buffer.squaredDeviation(mean);
   variance /= HR_BUFFER_SIZE;
   return sqrt(variance);
 }
@@ -341,6 +351,11 @@ float HeartRate_Service::getRValue()
   return R;
 }
 
+uint32_t HeartRate_Service::getClippedSamples()
+{
+  return _redBuffer.clipped() + _irBuffer.clipped();
+}
+
 void HeartRate_Service::getSignalComponents(float &redAC, float &redDC, float &irAC, float &irDC)
 {
   redAC = _redAC;
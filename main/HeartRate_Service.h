@@ -2,6 +2,7 @@
 #define HEARTRATE_SERVICE_H
 
 #include <Arduino.h>
+#include "PpgWindow.h"
 
 // Configuration constants
 #define HR_BUFFER_SIZE 100        // Number of samples to store for analysis
@@ -10,10 +11,26 @@
 #define HR_SAMPLE_RATE 100        // Samples per second (must match MAX30102 config)
 #define HR_FINGER_THRESHOLD 50000 // Minimum IR value to detect finger
 
+// Sample windows as int16 residuals against block bases (PpgWindow.h): a
+// little over half the SRAM, same readings. 0 keeps plain uint32_t samples.
+#ifndef HR_COMPACT_WINDOW
+#define HR_COMPACT_WINDOW 1
+#endif
+
+#if HR_COMPACT_WINDOW
+typedef PpgWindow_Compact<HR_BUFFER_SIZE> HR_Window;
+#else
+typedef PpgWindow_Plain<HR_BUFFER_SIZE> HR_Window;
+#endif
+
 // SpO2 calculation constants
 #define SPO2_MIN 70  // Minimum valid SpO2 percentage
 #define SPO2_MAX 100 // Maximum valid SpO2 percentage
 
+// SpO2 temperature compensation (LED wavelength drifts with temperature)
+#define SPO2_REF_TEMP 25.0     // Temperature the SpO2 curve was calibrated at (°C)
+#define SPO2_R_TEMP_COEF 0.002 // Relative R drift per °C, tune in calibration mode
+
 struct HeartRateData
 {
   float heartRate;       // Heart rate in BPM
@@ -28,10 +45,11 @@ class HeartRate_Service
 {
 private:
   // Circular buffers for RED and IR samples
-  uint32_t _redBuffer[HR_BUFFER_SIZE];
-  uint32_t _irBuffer[HR_BUFFER_SIZE];
+  HR_Window _redBuffer;
+  HR_Window _irBuffer;
   uint8_t _bufferIndex;
   bool _bufferFull;
+  uint32_t _irAvg; // IR window mean, computed once per sample
 
   // Heart rate detection
   float _lastHeartRate;
@@ -44,6 +62,7 @@ private:
   uint32_t _lastValleyValue;
   bool _peakDetected;
   uint8_t _peakCount;
+  bool _beatDetection;
 
   // SpO2 calculation
   float _lastSpO2;
@@ -55,19 +74,22 @@ private:
   // Signal quality
   float _signalQuality;
 
+  // Sensor temperature for SpO2 compensation (NAN = unknown)
+  float _temperature;
+
   // Helper functions
   void updateBuffers(uint32_t red, uint32_t ir);
-  bool detectPeak();
+  bool detectPeak(uint32_t timestamp);
   float calculateHeartRate();
   float calculateSpO2();
   float calculateSignalQuality();
   bool isFingerDetected();
 
   // Signal processing helpers
-  uint32_t getBufferAverage(uint32_t *buffer);
-  uint32_t getBufferMax(uint32_t *buffer);
-  uint32_t getBufferMin(uint32_t *buffer);
-  float getBufferStdDev(uint32_t *buffer, uint32_t mean);
+  uint32_t getBufferAverage(const HR_Window &buffer);
+  uint32_t getBufferMax(const HR_Window &buffer);
+  uint32_t getBufferMin(const HR_Window &buffer);
+  float getBufferStdDev(const HR_Window &buffer, uint32_t mean);
 
 public:
   HeartRate_Service();
@@ -75,8 +97,12 @@ public:
   // Initialize the service
   void begin();
 
-  // Add new sample and process
-  void addSample(uint32_t red, uint32_t ir);
+  // Add new sample and process. `timestamp` is when the sensor took it
+  // (millis() scale): samples drained from the FIFO in a burst are older than
+  // the drain, one sample period apart, and beats are timed from these.
+  void addSample(uint32_t red, uint32_t ir, uint32_t timestamp);
+  // Sample taken just now
+  void addSample(uint32_t red, uint32_t ir) { addSample(red, ir, millis()); }
 
   // Get current readings
   HeartRateData getReadings();
@@ -84,9 +110,23 @@ public:
   // Reset all data
   void reset();
 
+  // Drop buffered samples after a front-end change (LED current, pulse width,
+  // ADC range) so windows never mix two gain settings. Last HR/SpO2 are kept.
+  void markDiscontinuity();
+
   // Check if enough data collected
   bool isReady();
 
+  // Per-sample beat detection (on by default). Turned off when another
+  // estimator provides the heart rate; SpO2 and quality keep updating.
+  void setBeatDetection(bool enabled);
+
+  // Latest sensor temperature (°C), used to compensate the SpO2 R value
+  void setTemperature(float celsius);
+
+  // Samples the compact window could not store exactly (0 with plain windows)
+  uint32_t getClippedSamples();
+
   // Calibration helpers
   float getRValue();                                                              // Get current R value for calibration
   void getSignalComponents(float &redAC, float &redDC, float &irAC, float &irDC); // Get AC/DC components
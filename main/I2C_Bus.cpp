@@ -0,0 +1,342 @@
+#include "I2C_Bus.h"
+
+// One manager per hardware controller
+static I2C_Bus *s_buses[I2C_BUS_COUNT] = {nullptr, nullptr};
+
+I2C_Bus::I2C_Bus(TwoWire &wire, uint8_t index) : _wire(wire) {
+  _index = index;
+  _sda = -1;
+  _scl = -1;
+  _frequency = 0;
+  _started = false;
+  _lock = xSemaphoreCreateMutex();
+  _queueMux = portMUX_INITIALIZER_UNLOCKED;
+  _task = nullptr;
+  _nextSeq = 1;
+  for (int i = 0; i < I2C_QUEUE_DEPTH; i++) {
+    _queueSeq[i] = 0;
+  }
+  memset(&_stats, 0, sizeof(_stats));
+  _statsStart = micros();
+}
+
+I2C_Bus *I2C_Bus::forPins(int sda, int scl, uint32_t frequency) {
+  for (int i = 0; i < I2C_BUS_COUNT; i++) {
+    I2C_Bus *bus = s_buses[i];
+    if (bus && bus->_sda == sda && bus->_scl == scl) {
+      // Shared bus: run at the slowest requested clock
+      if (frequency < bus->_frequency) {
+        xSemaphoreTake(bus->_lock, portMAX_DELAY);
+        bus->_frequency = frequency;
+        bus->_wire.setClock(frequency);
+        xSemaphoreGive(bus->_lock);
+      }
+      return bus;
+    }
+  }
+
+  for (int i = 0; i < I2C_BUS_COUNT; i++) {
+    if (!s_buses[i]) {
+      s_buses[i] = new I2C_Bus(i == 0 ? Wire : Wire1, i);
+      s_buses[i]->start(sda, scl, frequency);
+      return s_buses[i];
+    }
+  }
+  return nullptr;
+}
+
+// Worker task comes with the bus, so submit() never has to create it
+void I2C_Bus::start(int sda, int scl, uint32_t frequency) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _sda = sda;
+  _scl = scl;
+  _frequency = frequency;
+  _wire.begin(sda, scl, frequency);
+  _wire.setTimeOut(I2C_DEFAULT_TIMEOUT_MS);
+  if (!_task) {
+    char name[8] = {'i', '2', 'c', (char)('0' + _index), 0};
+    xTaskCreatePinnedToCore(taskEntry, name, I2C_TASK_STACK, this, I2C_TASK_PRIORITY, &_task, 1);
+  }
+  _started = true;
+  xSemaphoreGive(_lock);
+}
+
+// ======= Blocking access =======
+
+int8_t I2C_Bus::readRegs(uint8_t address, uint8_t reg, uint8_t *buf, uint8_t len, uint16_t timeout_ms) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  int8_t status = execRead(address, reg, buf, len, timeout_ms);
+  xSemaphoreGive(_lock);
+  return status;
+}
+
+int8_t I2C_Bus::writeRegs(uint8_t address, uint8_t reg, const uint8_t *buf, uint8_t len, uint16_t timeout_ms) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  int8_t status = execWrite(address, reg, buf, len, timeout_ms);
+  xSemaphoreGive(_lock);
+  return status;
+}
+
+bool I2C_Bus::probe(uint8_t address) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _wire.beginTransmission(address);
+  bool ok = (_wire.endTransmission() == 0);
+  xSemaphoreGive(_lock);
+  return ok;
+}
+
+// ======= Asynchronous access =======
+
+int8_t I2C_Bus::submit(const I2C_Transaction &t) {
+  if (t.len == 0 || t.len > I2C_MAX_XFER) {
+    return I2C_ERR_BUS;
+  }
+
+  if (!_task) {
+    return I2C_ERR_BUS;
+  }
+
+  int slot = -1;
+  portENTER_CRITICAL(&_queueMux);
+  for (int i = 0; i < I2C_QUEUE_DEPTH; i++) {
+    if (_queueSeq[i] == 0) {
+      slot = i;
+      _queue[i] = t;
+      _queueSeq[i] = _nextSeq++;
+      break;
+    }
+  }
+  if (slot < 0) {
+    _stats.dropped++;
+  }
+  portEXIT_CRITICAL(&_queueMux);
+
+  if (slot < 0) {
+    return I2C_ERR_QUEUE_FULL;
+  }
+  xTaskNotifyGive(_task);
+  return I2C_OK;
+}
+
+uint8_t I2C_Bus::pending() {
+  uint8_t n = 0;
+  portENTER_CRITICAL(&_queueMux);
+  for (int i = 0; i < I2C_QUEUE_DEPTH; i++) {
+    if (_queueSeq[i] != 0) n++;
+  }
+  portEXIT_CRITICAL(&_queueMux);
+  return n;
+}
+
+// Highest priority first, FIFO within a priority. Call with _queueMux held.
+int I2C_Bus::popNext() {
+  int best = -1;
+  for (int i = 0; i < I2C_QUEUE_DEPTH; i++) {
+    if (_queueSeq[i] == 0) continue;
+    if (best < 0 || _queue[i].priority < _queue[best].priority ||
+        (_queue[i].priority == _queue[best].priority && _queueSeq[i] < _queueSeq[best])) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void I2C_Bus::processOne() {
+  I2C_Transaction t;
+  I2C_Transaction merged[I2C_QUEUE_DEPTH];
+  uint8_t mergedCount = 0;
+  uint8_t burstLen;
+
+  portENTER_CRITICAL(&_queueMux);
+  int slot = popNext();
+  if (slot < 0) {
+    portEXIT_CRITICAL(&_queueMux);
+    return;
+  }
+  t = _queue[slot];
+  _queueSeq[slot] = 0;
+  burstLen = t.len;
+
+  // Fold queued reads of the registers right after this one into one burst
+  if (!(t.flags & I2C_WRITE) && (t.flags & I2C_MERGEABLE)) {
+    bool grew = true;
+    while (grew) {
+      grew = false;
+      for (int i = 0; i < I2C_QUEUE_DEPTH; i++) {
+        const I2C_Transaction &q = _queue[i];
+        if (_queueSeq[i] == 0 || (q.flags & I2C_WRITE) || !(q.flags & I2C_MERGEABLE)) continue;
+        if (q.address != t.address || q.reg != (uint8_t)(t.reg + burstLen)) continue;
+        if (burstLen + q.len > I2C_MAX_XFER) continue;
+        merged[mergedCount++] = q;
+        burstLen += q.len;
+        _queueSeq[i] = 0;
+        grew = true;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&_queueMux);
+
+  const uint16_t timeout = t.timeout_ms ? t.timeout_ms : I2C_DEFAULT_TIMEOUT_MS;
+  int8_t status;
+  uint8_t burst[I2C_MAX_XFER];
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (t.flags & I2C_WRITE) {
+    status = execWrite(t.address, t.reg, t.data, t.len, timeout);
+  } else {
+    status = execRead(t.address, t.reg, burst, burstLen, timeout);
+    _stats.merged += mergedCount;
+  }
+  xSemaphoreGive(_lock);
+
+  if (t.flags & I2C_WRITE) {
+    if (t.callback) t.callback(status, nullptr, 0, t.ctx);
+    return;
+  }
+
+  // Split the burst back into the original requests
+  if (t.callback) t.callback(status, burst, t.len, t.ctx);
+  uint8_t offset = t.len;
+  for (uint8_t i = 0; i < mergedCount; i++) {
+    const I2C_Transaction &q = merged[i];
+    if (q.callback) q.callback(status, burst + offset, q.len, q.ctx);
+    offset += q.len;
+  }
+}
+
+void I2C_Bus::taskEntry(void *arg) {
+  I2C_Bus *bus = (I2C_Bus *)arg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (bus->pending() > 0) {
+      bus->processOne();
+    }
+  }
+}
+
+// ======= Wire access (bus locked) =======
+
+int8_t I2C_Bus::execRead(uint8_t address, uint8_t reg, uint8_t *buf, uint8_t len, uint16_t timeout_ms) {
+  uint32_t start = micros();
+  _wire.setTimeOut(timeout_ms);
+
+  _wire.beginTransmission(address);
+  _wire.write(reg);
+  uint8_t err = _wire.endTransmission(false);
+
+  int8_t status = I2C_OK;
+  if (err == 2 || err == 3) {
+    status = I2C_ERR_NACK;
+  } else if (err == 5) {
+    status = I2C_ERR_TIMEOUT;
+  } else if (err != 0) {
+    status = I2C_ERR_BUS;
+  } else {
+    uint8_t n = _wire.requestFrom((int)address, (int)len);
+    if (n != len || _wire.available() < len) {
+      status = (micros() - start >= (uint32_t)timeout_ms * 1000UL) ? I2C_ERR_TIMEOUT : I2C_ERR_NACK;
+    } else {
+      for (uint8_t i = 0; i < len; i++) {
+        buf[i] = _wire.read();
+      }
+    }
+  }
+
+  account(status, len, start);
+  return status;
+}
+
+int8_t I2C_Bus::execWrite(uint8_t address, uint8_t reg, const uint8_t *buf, uint8_t len, uint16_t timeout_ms) {
+  uint32_t start = micros();
+  _wire.setTimeOut(timeout_ms);
+
+  _wire.beginTransmission(address);
+  _wire.write(reg);
+  for (uint8_t i = 0; i < len; i++) {
+    _wire.write(buf[i]);
+  }
+  uint8_t err = _wire.endTransmission();
+
+  int8_t status = I2C_OK;
+  if (err == 2 || err == 3) status = I2C_ERR_NACK;
+  else if (err == 5) status = I2C_ERR_TIMEOUT;
+  else if (err != 0) status = I2C_ERR_BUS;
+
+  account(status, len, start);
+  return status;
+}
+
+void I2C_Bus::account(int8_t status, uint8_t len, uint32_t startMicros) {
+  _stats.transactions++;
+  _stats.busy_us += micros() - startMicros;
+  if (status == I2C_OK) {
+    _stats.bytes += len;
+    return;
+  }
+
+  _stats.errors++;
+  if (status == I2C_ERR_TIMEOUT || status == I2C_ERR_BUS) {
+    // A slave holding SDA low survives a controller reset; clock it free
+    if (status == I2C_ERR_TIMEOUT) _stats.timeouts++;
+    recover();
+  }
+}
+
+void I2C_Bus::recover() {
+  _wire.end();
+
+  // Up to 9 clocks until the slave releases SDA, then a STOP condition
+  pinMode(_sda, INPUT_PULLUP);
+  pinMode(_scl, OUTPUT_OPEN_DRAIN);
+  for (int i = 0; i < 9 && digitalRead(_sda) == LOW; i++) {
+    digitalWrite(_scl, LOW);
+    delayMicroseconds(5);
+    digitalWrite(_scl, HIGH);
+    delayMicroseconds(5);
+  }
+  pinMode(_sda, OUTPUT_OPEN_DRAIN);
+  digitalWrite(_sda, LOW);
+  delayMicroseconds(5);
+  digitalWrite(_scl, HIGH);
+  delayMicroseconds(5);
+  digitalWrite(_sda, HIGH);
+  delayMicroseconds(5);
+
+  _wire.begin(_sda, _scl, _frequency);
+  _wire.setTimeOut(I2C_DEFAULT_TIMEOUT_MS);
+  _stats.recoveries++;
+}
+
+// ======= Statistics =======
+
+void I2C_Bus::getStats(I2C_BusStats &out, bool reset) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  uint32_t now = micros();
+  out = _stats;
+  out.window_us = now - _statsStart;
+  out.utilisation = out.window_us ? (float)out.busy_us / (float)out.window_us : 0.0f;
+  if (reset) {
+    memset(&_stats, 0, sizeof(_stats));
+    _statsStart = now;
+  }
+  xSemaphoreGive(_lock);
+}
+
+void I2C_Bus::printStats() {
+  I2C_BusStats s;
+  getStats(s);
+  Serial.printf("[I2C%u] SDA=%d SCL=%d %lu kHz | %lu xfers, %lu bytes, %.2f%% busy | "
+                "%lu err (%lu timeout, %lu recover), %lu merged, %lu dropped\n",
+                _index, _sda, _scl, (unsigned long)(_frequency / 1000),
+                (unsigned long)s.transactions, (unsigned long)s.bytes, s.utilisation * 100.0f,
+                (unsigned long)s.errors, (unsigned long)s.timeouts, (unsigned long)s.recoveries,
+                (unsigned long)s.merged, (unsigned long)s.dropped);
+}
+
+void I2C_Bus::printAllStats() {
+  for (uint8_t i = 0; i < I2C_BUS_COUNT; i++) {
+    if (s_buses[i]) {
+      s_buses[i]->printStats();
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// Bus configuration
+#define I2C_BUS_COUNT 2            // ESP32 has two I2C controllers (Wire, Wire1)
+#define I2C_QUEUE_DEPTH 16         // Pending async transactions per bus
+#define I2C_MAX_XFER 32            // Largest single read/write (bytes)
+#define I2C_DEFAULT_TIMEOUT_MS 20  // Per-transaction timeout
+#define I2C_TASK_PRIORITY 5
+#define I2C_TASK_STACK 3072
+
+// Transaction flags
+#define I2C_READ       0x00
+#define I2C_WRITE      0x01
+#define I2C_MERGEABLE  0x02  // Device auto-increments: adjacent reads may be merged
+
+// Status codes
+#define I2C_OK             0
+#define I2C_ERR_NACK       1
+#define I2C_ERR_TIMEOUT    2
+#define I2C_ERR_BUS        3
+#define I2C_ERR_QUEUE_FULL 4
+
+// Completion callback, runs in the bus task. data/len hold the read result.
+typedef void (*I2C_Callback)(int8_t status, const uint8_t *data, uint8_t len, void *ctx);
+
+struct I2C_Transaction {
+  uint8_t address;
+  uint8_t reg;
+  uint8_t len;              // Bytes to read or write
+  uint8_t flags;            // I2C_READ / I2C_WRITE | I2C_MERGEABLE
+  uint8_t priority;         // 0 = most urgent
+  uint16_t timeout_ms;      // 0 = I2C_DEFAULT_TIMEOUT_MS
+  uint8_t data[I2C_MAX_XFER];
+  I2C_Callback callback;
+  void *ctx;
+};
+
+struct I2C_BusStats {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t errors;
+  uint32_t timeouts;
+  uint32_t recoveries;
+  uint32_t merged;          // Reads folded into another burst
+  uint32_t dropped;         // Rejected because the queue was full
+  uint32_t busy_us;         // Time spent on the wire
+  uint32_t window_us;       // Measurement window
+  float utilisation;        // busy / window (0-1)
+};
+
+class I2C_Bus {
+private:
+  TwoWire &_wire;
+  uint8_t _index;
+  int _sda;
+  int _scl;
+  uint32_t _frequency;
+  bool _started;
+
+  SemaphoreHandle_t _lock;  // Serialises access to the controller
+  portMUX_TYPE _queueMux;   // Protects the queue
+  TaskHandle_t _task;
+
+  I2C_Transaction _queue[I2C_QUEUE_DEPTH];
+  uint32_t _queueSeq[I2C_QUEUE_DEPTH];  // 0 = free slot, else submission order
+  uint32_t _nextSeq;
+
+  I2C_BusStats _stats;
+  uint32_t _statsStart;
+
+  I2C_Bus(TwoWire &wire, uint8_t index);
+
+  void start(int sda, int scl, uint32_t frequency);
+  int8_t execRead(uint8_t address, uint8_t reg, uint8_t *buf, uint8_t len, uint16_t timeout_ms);
+  int8_t execWrite(uint8_t address, uint8_t reg, const uint8_t *buf, uint8_t len, uint16_t timeout_ms);
+  void account(int8_t status, uint8_t len, uint32_t startMicros);
+  void recover();
+  int popNext();
+  void processOne();
+  static void taskEntry(void *arg);
+
+public:
+  // Bus for a pin pair: shares the controller if the pins are already in
+  // use, otherwise claims the next free one. nullptr if none is left.
+  static I2C_Bus *forPins(int sda, int scl, uint32_t frequency = 400000);
+
+  // Blocking access (locks the bus; safe from any task)
+  int8_t readRegs(uint8_t address, uint8_t reg, uint8_t *buf, uint8_t len,
+                  uint16_t timeout_ms = I2C_DEFAULT_TIMEOUT_MS);
+  int8_t writeRegs(uint8_t address, uint8_t reg, const uint8_t *buf, uint8_t len,
+                   uint16_t timeout_ms = I2C_DEFAULT_TIMEOUT_MS);
+  bool probe(uint8_t address);
+
+  // Asynchronous access: queued by priority, completed by the bus task
+  int8_t submit(const I2C_Transaction &t);
+  uint8_t pending();
+
+  void getStats(I2C_BusStats &out, bool reset = false);
+  void printStats();
+  static void printAllStats();
+};
+
+#endif // I2C_BUS_H
@@ -0,0 +1,128 @@
+#include "LedAGC_Service.h"
+
+LedAGC_Service::LedAGC_Service(MAX30102_Driver &sensor) : _sensor(sensor)
+{
+  _config = MAX30102_Driver::defaultConfig();
+  _enabled = true;
+  _lastEval = 0;
+  _lastRetune = 0;
+  _retuneCount = 0;
+  _retuned = false;
+}
+
+void LedAGC_Service::begin()
+{
+  _config = _sensor.getConfig();
+  _lastEval = millis();
+  _lastRetune = _lastEval;
+  _retuneCount = 0;
+  _retuned = false;
+}
+
+bool LedAGC_Service::update(const AGC_Measurement &m, uint32_t now)
+{
+  _retuned = false;
+
+  if (!_enabled || !m.fingerDetected)
+  {
+    return false;
+  }
+  if (now - _lastEval < AGC_INTERVAL_MS || now - _lastRetune < AGC_SETTLE_MS)
+  {
+    return false;
+  }
+  _lastEval = now;
+
+  // Start from the driver's shadow copy so rate/averaging changes made by
+  // others (power profiles) are kept; this costs no bus traffic
+  _config = _sensor.getConfig();
+  MAX30102_Config next = _config;
+  bool needStronger = false;
+  bool needWeaker = false;
+
+  next.irCurrent = tuneCurrent(_config.irCurrent, m.irAC, m.irDC, needStronger, needWeaker);
+  next.redCurrent = tuneCurrent(_config.redCurrent, m.redAC, m.redDC, needStronger, needWeaker);
+
+  // Currents at their limits: use the shared pulse width / ADC range.
+  // Clipping always wins over a weak signal.
+  if (needWeaker)
+  {
+    if (next.adcRange < MAX30102_ADC_RANGE_16384)
+      next.adcRange++;
+    else if (next.pulseWidth > MAX30102_PULSE_WIDTH_69)
+      next.pulseWidth--;
+  }
+  else if (needStronger)
+  {
+    if (next.pulseWidth < MAX30102_PULSE_WIDTH_411)
+      next.pulseWidth++;
+    else if (next.adcRange > MAX30102_ADC_RANGE_2048)
+      next.adcRange--;
+  }
+
+  if (next.irCurrent == _config.irCurrent && next.redCurrent == _config.redCurrent &&
+      next.pulseWidth == _config.pulseWidth && next.adcRange == _config.adcRange)
+  {
+    return false;
+  }
+
+  // One batched transaction; only the changed registers go on the bus
+  _sensor.applyConfig(next);
+  _config = next;
+  _lastRetune = now;
+  _retuneCount++;
+  _retuned = true;
+  return true;
+}
+
+// Private helper functions
+
+uint8_t LedAGC_Service::tuneCurrent(uint8_t current, float ac, float dc, bool &needStronger, bool &needWeaker)
+{
+  const float peak = dc + ac * 0.5;
+
+  // Clipping or DC too close to full scale: back off
+  if (peak > AGC_SATURATION * AGC_FULL_SCALE || dc > AGC_DC_HIGH * AGC_FULL_SCALE)
+  {
+    if (current > AGC_MIN_CURRENT)
+      return stepDown(current);
+    needWeaker = true;
+    return current;
+  }
+
+  // Too little light or pulsation: drive harder
+  if (dc < AGC_DC_LOW * AGC_FULL_SCALE || ac < AGC_AC_MIN)
+  {
+    if (current < AGC_MAX_CURRENT)
+      return stepUp(current);
+    needStronger = true;
+    return current;
+  }
+
+  // Usable signal: drop current while the AC amplitude, scaled by the
+  // current ratio, would still clear the minimum with margin (hysteresis)
+  const uint8_t lower = stepDown(current);
+  if (lower >= AGC_MIN_CURRENT && lower < current)
+  {
+    const float predictedAC = ac * (float)lower / (float)current;
+    const float predictedDC = dc * (float)lower / (float)current;
+    if (predictedAC > AGC_AC_MIN * AGC_AC_MARGIN && predictedDC > AGC_DC_LOW * AGC_FULL_SCALE * AGC_AC_MARGIN)
+      return lower;
+  }
+  return current;
+}
+
+uint8_t LedAGC_Service::stepUp(uint8_t current)
+{
+  // ~25% steps keep each retune small enough to converge without overshoot
+  uint16_t next = (uint16_t)current + max((uint16_t)1, (uint16_t)(current / 4));
+  return (uint8_t)min((uint16_t)AGC_MAX_CURRENT, next);
+}
+
+uint8_t LedAGC_Service::stepDown(uint8_t current)
+{
+  uint16_t delta = max((uint16_t)1, (uint16_t)(current / 5));
+  if (current <= AGC_MIN_CURRENT + delta)
+    return AGC_MIN_CURRENT;
+  return current - delta;
+}
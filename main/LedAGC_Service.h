@@ -0,0 +1,66 @@
+#ifndef LEDAGC_SERVICE_H
+#define LEDAGC_SERVICE_H
+
+#include <Arduino.h>
+#include "MAX30102_Driver.h"
+
+// AGC configuration
+#define AGC_INTERVAL_MS 1000       // Evaluate once per analysis window
+#define AGC_SETTLE_MS 2000         // No new decisions while the new setting settles
+#define AGC_FULL_SCALE 262143      // 18-bit ADC
+#define AGC_SATURATION 0.90        // Window peak above this fraction of full scale = clipping
+#define AGC_DC_HIGH 0.75           // Reduce drive above this DC fraction
+#define AGC_DC_LOW 0.20            // Increase drive below this DC fraction
+#define AGC_AC_MIN 300             // Minimum usable AC amplitude (counts)
+#define AGC_AC_MARGIN 1.6          // Only step down if predicted AC stays this far above the minimum
+#define AGC_MIN_CURRENT 0x04       // ~0.8 mA
+#define AGC_MAX_CURRENT 0x9F       // ~32 mA, battery cap
+
+// One evaluation input, taken from HeartRate_Service::getSignalComponents()
+struct AGC_Measurement
+{
+  float redAC;
+  float redDC;
+  float irAC;
+  float irDC;
+  bool fingerDetected;
+};
+
+class LedAGC_Service
+{
+private:
+  MAX30102_Driver &_sensor;
+  MAX30102_Config _config;
+  bool _enabled;
+
+  uint32_t _lastEval;
+  uint32_t _lastRetune;
+  uint16_t _retuneCount;
+  bool _retuned;
+
+  // Per-LED decision; returns the new current (may equal the old one)
+  // and sets needStronger/needWeaker when the current alone cannot fix it.
+  uint8_t tuneCurrent(uint8_t current, float ac, float dc, bool &needStronger, bool &needWeaker);
+  static uint8_t stepUp(uint8_t current);
+  static uint8_t stepDown(uint8_t current);
+
+public:
+  LedAGC_Service(MAX30102_Driver &sensor);
+
+  // Read the starting point from the driver (call after sensor begin())
+  void begin();
+
+  void setEnabled(bool enabled) { _enabled = enabled; }
+  bool isEnabled() { return _enabled; }
+
+  // Evaluate once per AGC_INTERVAL_MS; returns true when the front end was
+  // retuned, in which case buffered samples straddle a gain change.
+  bool update(const AGC_Measurement &m, uint32_t now);
+
+  // True until the next update() after a retune
+  bool retuned() { return _retuned; }
+  uint16_t getRetuneCount() { return _retuneCount; }
+  const MAX30102_Config &getConfig() { return _config; }
+};
+
+#endif // LEDAGC_SERVICE_H
@@ -3,42 +3,72 @@
 MAX30102_Driver::MAX30102_Driver(uint8_t sdaPin, uint8_t sclPin) {
   _sdaPin = sdaPin;
   _sclPin = sclPin;
+  _bus = nullptr;
   _initialized = false;
+  _tempPending = false;
+  _tempStartTime = 0;
+  _lastTemperature = NAN;
+  _shadowValid = 0;
+  memset(_shadow, 0, sizeof(_shadow));
 }
 
 bool MAX30102_Driver::begin() {
-  // Initialize I2C
-  Wire.begin(_sdaPin, _sclPin);
-  Wire.setClock(400000); // 400kHz I2C
+  // Initialize I2C (400kHz, shared through the bus manager)
+  _bus = I2C_Bus::forPins(_sdaPin, _sclPin, 400000);
+  if (!_bus) {
+    return false;
+  }
   
-  delay(100); // Wait for sensor to stabilize
+  // Wait for the sensor to answer instead of a fixed power-up delay
+  unsigned long start = millis();
+  while (!checkConnection()) {
+    if (millis() - start > MAX30102_POWERUP_TIMEOUT_MS) {
+      return false;
+    }
+    delay(1);
+  }
   
-  // Check if sensor is connected
-  if (!checkConnection()) {
+  // Reset the sensor (polls for completion)
+  if (!reset()) {
     return false;
   }
   
-  // Reset the sensor
-  reset();
-  delay(100);
-  
-  // Default configuration for SpO2 mode
-  setFIFOAverage(4);           // Average 4 samples
-  enableFIFORollover(true);    // Enable FIFO rollover
-  setMode(MAX30102_MODE_SPO2); // SpO2 mode (Red + IR)
-  setSampleRate(MAX30102_SAMPLE_RATE_100); // 100 samples per second
-  setPulseWidth(MAX30102_PULSE_WIDTH_411); // 411us pulse width
-  setLEDCurrent(MAX30102_LED_CURRENT_11MA, MAX30102_LED_CURRENT_11MA); // 11mA for both LEDs
+  // Default configuration for SpO2 mode: 4-sample average, FIFO rollover,
+  // Red + IR, 100 sps, 411us pulse width, 11mA on both LEDs
+  if (!applyConfig(defaultConfig())) {
+    return false;
+  }
+  bitMask(MAX30102_INT_ENABLE_2, (uint8_t)~MAX30102_INT_DIE_TEMP_RDY, MAX30102_INT_DIE_TEMP_RDY); // Temperature ready interrupt
   
+  _tempPending = false;
   clearFIFO();
   
   _initialized = true;
   return true;
 }
 
-void MAX30102_Driver::reset() {
-  writeRegister(MAX30102_MODE_CONFIG, 0x40);
-  delay(100);
+bool MAX30102_Driver::reset() {
+  _shadowValid = 0;
+  writeRegister(MAX30102_MODE_CONFIG, MAX30102_MODE_RESET);
+  
+  // RESET self-clears once the part is back at power-on defaults
+  unsigned long start = millis();
+  while (readRegister(MAX30102_MODE_CONFIG) & MAX30102_MODE_RESET) {
+    if (millis() - start > MAX30102_RESET_TIMEOUT_MS) {
+      return false;
+    }
+    delayMicroseconds(200);
+  }
+  
+  // All configuration registers power up as 0x00
+  memset(_shadow, 0, sizeof(_shadow));
+  _shadowValid = 0;
+  for (uint8_t reg = 0; reg < MAX30102_SHADOW_SIZE; reg++) {
+    if (isShadowed(reg)) {
+      _shadowValid |= (1UL << reg);
+    }
+  }
+  return true;
 }
 
 void MAX30102_Driver::shutdown() {
@@ -67,27 +97,108 @@ void MAX30102_Driver::setLEDCurrent(uint8_t redLED, uint8_t irLED) {
 }
 
 void MAX30102_Driver::setFIFOAverage(uint8_t samples) {
-  uint8_t avgValue = 0;
-  if (samples == 1) avgValue = 0;
-  else if (samples == 2) avgValue = 1;
-  else if (samples == 4) avgValue = 2;
-  else if (samples == 8) avgValue = 3;
-  else if (samples == 16) avgValue = 4;
-  else if (samples == 32) avgValue = 5;
-  else avgValue = 2; // Default to 4 samples
-  
-  bitMask(MAX30102_FIFO_CONFIG, 0x1F, avgValue << 5);
+  bitMask(MAX30102_FIFO_CONFIG, 0x1F, fifoAverageCode(samples) << 5);
 }
 
 void MAX30102_Driver::enableFIFORollover(bool enable) {
   bitMask(MAX30102_FIFO_CONFIG, 0xEF, enable ? 0x10 : 0x00);
 }
 
+void MAX30102_Driver::setADCRange(uint8_t range) {
+  bitMask(MAX30102_SPO2_CONFIG, 0x9F, (range & 0x03) << 5);
+}
+
+MAX30102_Config MAX30102_Driver::defaultConfig() {
+  MAX30102_Config config;
+  config.mode = MAX30102_MODE_SPO2;
+  config.sampleRate = MAX30102_SAMPLE_RATE_100;
+  config.pulseWidth = MAX30102_PULSE_WIDTH_411;
+  config.adcRange = MAX30102_ADC_RANGE_2048;
+  config.fifoAverage = 4;
+  config.fifoRollover = true;
+  config.redCurrent = MAX30102_LED_CURRENT_11MA;
+  config.irCurrent = MAX30102_LED_CURRENT_11MA;
+  return config;
+}
+
+bool MAX30102_Driver::applyConfig(const MAX30102_Config &config) {
+  // Make sure every register we touch has a known shadow value
+  const uint8_t regs[] = {MAX30102_FIFO_CONFIG, MAX30102_MODE_CONFIG, MAX30102_SPO2_CONFIG,
+                          MAX30102_LED1_PA, MAX30102_LED2_PA};
+  for (uint8_t i = 0; i < sizeof(regs); i++) {
+    if (!(_shadowValid & (1UL << regs[i]))) {
+      shadowStore(regs[i], readRegister(regs[i]));
+    }
+  }
+  
+  // Target register images (keep bits the config does not own)
+  uint8_t target[MAX30102_SHADOW_SIZE];
+  memcpy(target, _shadow, sizeof(target));
+  target[MAX30102_FIFO_CONFIG] = (fifoAverageCode(config.fifoAverage) << 5) |
+                                 (config.fifoRollover ? 0x10 : 0x00) |
+                                 (_shadow[MAX30102_FIFO_CONFIG] & 0x0F);
+  target[MAX30102_MODE_CONFIG] = (_shadow[MAX30102_MODE_CONFIG] & MAX30102_MODE_SHDN) | (config.mode & 0x07);
+  target[MAX30102_SPO2_CONFIG] = ((config.adcRange & 0x03) << 5) |
+                                 ((config.sampleRate & 0x07) << 2) |
+                                 (config.pulseWidth & 0x03);
+  target[MAX30102_LED1_PA] = config.redCurrent;
+  target[MAX30102_LED2_PA] = config.irCurrent;
+  
+  // Write each run of changed, consecutive registers as one burst.
+  // 0x0B is reserved, so FIFO/MODE/SPO2 and LED1/LED2 form separate runs.
+  bool ok = true;
+  uint8_t reg = MAX30102_FIFO_CONFIG;
+  while (reg <= MAX30102_LED2_PA) {
+    if (reg == 0x0B || target[reg] == _shadow[reg]) {
+      reg++;
+      continue;
+    }
+    uint8_t end = reg;
+    while (end + 1 <= MAX30102_LED2_PA && end + 1 != 0x0B && target[end + 1] != _shadow[end + 1]) {
+      end++;
+    }
+    ok = writeRegisters(reg, &target[reg], end - reg + 1) && ok;
+    reg = end + 1;
+  }
+  return ok;
+}
+
+MAX30102_Config MAX30102_Driver::getConfig() {
+  const uint8_t regs[] = {MAX30102_FIFO_CONFIG, MAX30102_MODE_CONFIG, MAX30102_SPO2_CONFIG,
+                          MAX30102_LED1_PA, MAX30102_LED2_PA};
+  for (uint8_t i = 0; i < sizeof(regs); i++) {
+    if (!(_shadowValid & (1UL << regs[i]))) {
+      shadowStore(regs[i], readRegister(regs[i]));
+    }
+  }
+  
+  MAX30102_Config config;
+  config.fifoAverage = 1 << min(5, _shadow[MAX30102_FIFO_CONFIG] >> 5);
+  config.fifoRollover = (_shadow[MAX30102_FIFO_CONFIG] & 0x10) != 0;
+  config.mode = _shadow[MAX30102_MODE_CONFIG] & 0x07;
+  config.adcRange = (_shadow[MAX30102_SPO2_CONFIG] >> 5) & 0x03;
+  config.sampleRate = (_shadow[MAX30102_SPO2_CONFIG] >> 2) & 0x07;
+  config.pulseWidth = _shadow[MAX30102_SPO2_CONFIG] & 0x03;
+  config.redCurrent = _shadow[MAX30102_LED1_PA];
+  config.irCurrent = _shadow[MAX30102_LED2_PA];
+  return config;
+}
+
 bool MAX30102_Driver::available() {
-  uint8_t writePtr = readRegister(MAX30102_FIFO_WR_PTR);
-  uint8_t readPtr = readRegister(MAX30102_FIFO_RD_PTR);
+  return samplesAvailable() > 0;
+}
+
+uint8_t MAX30102_Driver::samplesAvailable() {
+  // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR in one burst
+  uint8_t ptrs[3];
+  if (!readRegisters(MAX30102_FIFO_WR_PTR, ptrs, sizeof(ptrs))) {
+    return 0;
+  }
   
-  return (writePtr != readPtr);
+  if (ptrs[1] & 0x1F) {
+    return 32; // Overflowed: the FIFO is full
+  }
+  return (ptrs[0] - ptrs[2]) & 0x1F;
 }
 
 MAX30102_Data MAX30102_Driver::readSample() {
@@ -99,25 +210,21 @@ MAX30102_Data MAX30102_Driver::readSample() {
   }
   
   // Read 6 bytes from FIFO (3 bytes Red + 3 bytes IR)
-  Wire.beginTransmission(MAX30102_ADDRESS);
-  Wire.write(MAX30102_FIFO_DATA);
-  Wire.endTransmission(false);
+  uint8_t raw[6];
   
-  Wire.requestFrom(MAX30102_ADDRESS, 6);
-  
-  if (Wire.available() >= 6) {
+  if (readRegisters(MAX30102_FIFO_DATA, raw, sizeof(raw))) {
     // Read Red LED data (18-bit)
     uint32_t red = 0;
-    red |= (uint32_t)Wire.read() << 16;
-    red |= (uint32_t)Wire.read() << 8;
-    red |= Wire.read();
+    red |= (uint32_t)raw[0] << 16;
+    red |= (uint32_t)raw[1] << 8;
+    red |= raw[2];
     red &= 0x3FFFF; // 18-bit mask
     
     // Read IR LED data (18-bit)
     uint32_t ir = 0;
-    ir |= (uint32_t)Wire.read() << 16;
-    ir |= (uint32_t)Wire.read() << 8;
-    ir |= Wire.read();
+    ir |= (uint32_t)raw[3] << 16;
+    ir |= (uint32_t)raw[4] << 8;
+    ir |= raw[5];
     ir &= 0x3FFFF; // 18-bit mask
     
     data.red = red;
@@ -129,23 +236,67 @@ MAX30102_Data MAX30102_Driver::readSample() {
 }
 
 void MAX30102_Driver::clearFIFO() {
-  writeRegister(MAX30102_FIFO_WR_PTR, 0);
-  writeRegister(MAX30102_FIFO_OVF_CNT, 0);
-  writeRegister(MAX30102_FIFO_RD_PTR, 0);
+  // FIFO_WR_PTR, OVF_COUNTER and FIFO_RD_PTR are consecutive: one burst
+  const uint8_t zeros[3] = {0, 0, 0};
+  writeRegisters(MAX30102_FIFO_WR_PTR, zeros, sizeof(zeros));
 }
 
 float MAX30102_Driver::readTemperature() {
-  // Trigger temperature reading
+  float celsius = _lastTemperature;
+  
+  if (!_tempPending) {
+    startTemperature();
+  }
+  
+  // Poll the ready flag instead of sleeping for the worst case
+  while (_tempPending) {
+    if (pollTemperature(celsius)) {
+      break;
+    }
+    delay(1);
+  }
+  
+  return celsius;
+}
+
+bool MAX30102_Driver::startTemperature() {
+  if (_tempPending) {
+    return false;
+  }
+  
+  // Clear a stale DIE_TEMP_RDY flag, then trigger a single conversion
+  readRegister(MAX30102_INT_STATUS_2);
   writeRegister(MAX30102_TEMP_CONFIG, 0x01);
   
-  // Wait for temperature conversion to complete
-  delay(100);
+  _tempPending = true;
+  _tempStartTime = millis();
+  return true;
+}
+
+bool MAX30102_Driver::pollTemperature(float &celsius) {
+  if (!_tempPending) {
+    return false;
+  }
+  
+  // Reading INT_STATUS_2 clears DIE_TEMP_RDY
+  uint8_t status = readRegister(MAX30102_INT_STATUS_2);
+  if (!(status & MAX30102_INT_DIE_TEMP_RDY)) {
+    if (millis() - _tempStartTime > MAX30102_TEMP_TIMEOUT_MS) {
+      _tempPending = false; // Give up; caller can start a new conversion
+    }
+    return false;
+  }
   
-  // Read temperature
-  int8_t tempInt = readRegister(MAX30102_TEMP_INT);
-  uint8_t tempFrac = readRegister(MAX30102_TEMP_FRAC);
+  // TEMP_INT and TEMP_FRAC in one burst
+  uint8_t raw[2];
+  _tempPending = false;
+  if (!readRegisters(MAX30102_TEMP_INT, raw, 2)) {
+    return false;
+  }
   
-  return (float)tempInt + ((float)tempFrac * 0.0625);
+  _lastTemperature = (float)(int8_t)raw[0] + ((float)(raw[1] & 0x0F) * 0.0625);
+  celsius = _lastTemperature;
+  return true;
 }
 
 uint8_t MAX30102_Driver::getPartID() {
@@ -163,29 +314,95 @@ bool MAX30102_Driver::checkConnection() {
 
 // Private helper functions
 uint8_t MAX30102_Driver::readRegister(uint8_t reg) {
-  Wire.beginTransmission(MAX30102_ADDRESS);
-  Wire.write(reg);
-  Wire.endTransmission(false);
+  uint8_t value;
   
-  Wire.requestFrom(MAX30102_ADDRESS, 1);
-  
-  if (Wire.available()) {
-    return Wire.read();
+  if (readRegisters(reg, &value, 1)) {
+    if (isShadowed(reg)) {
+      shadowStore(reg, value);
+    }
+    return value;
   }
   
   return 0;
 }
 
+bool MAX30102_Driver::readRegisters(uint8_t reg, uint8_t *buf, uint8_t len) {
+  if (!_bus) {
+    return false;
+  }
+  return _bus->readRegs(MAX30102_ADDRESS, reg, buf, len) == I2C_OK;
+}
+
 void MAX30102_Driver::writeRegister(uint8_t reg, uint8_t value) {
-  Wire.beginTransmission(MAX30102_ADDRESS);
-  Wire.write(reg);
-  Wire.write(value);
-  Wire.endTransmission();
+  writeRegisters(reg, &value, 1);
+}
+
+bool MAX30102_Driver::writeRegisters(uint8_t reg, const uint8_t *values, uint8_t len) {
+  // Register pointer auto-increments, so consecutive registers go in one transaction
+  bool ok = _bus && (_bus->writeRegs(MAX30102_ADDRESS, reg, values, len) == I2C_OK);
+  
+  for (uint8_t i = 0; i < len; i++) {
+    uint8_t r = reg + i;
+    if (!isShadowed(r)) {
+      continue;
+    }
+    if (ok && !(r == MAX30102_MODE_CONFIG && (values[i] & MAX30102_MODE_RESET))) {
+      shadowStore(r, values[i]);
+    } else {
+      _shadowValid &= ~(1UL << r); // Unknown state: re-read on next use
+    }
+  }
+  return ok;
 }
 
 void MAX30102_Driver::bitMask(uint8_t reg, uint8_t mask, uint8_t value) {
-  uint8_t originalValue = readRegister(reg);
+  // Use the shadow copy when we have one; only fall back to a bus read if not
+  uint8_t originalValue;
+  if (isShadowed(reg) && (_shadowValid & (1UL << reg))) {
+    originalValue = _shadow[reg];
+  } else {
+    originalValue = readRegister(reg);
+  }
+  
   uint8_t newValue = (originalValue & mask) | value;
+  if (isShadowed(reg) && (_shadowValid & (1UL << reg)) && newValue == originalValue) {
+    return; // Already set: no bus traffic at all
+  }
   writeRegister(reg, newValue);
 }
 
+bool MAX30102_Driver::isShadowed(uint8_t reg) {
+  // Configuration registers only: status, FIFO pointers/data and the
+  // self-clearing temperature trigger always go to the device
+  switch (reg) {
+    case MAX30102_INT_ENABLE_1:
+    case MAX30102_INT_ENABLE_2:
+    case MAX30102_FIFO_CONFIG:
+    case MAX30102_MODE_CONFIG:
+    case MAX30102_SPO2_CONFIG:
+    case MAX30102_LED1_PA:
+    case MAX30102_LED2_PA:
+    case MAX30102_PILOT_PA:
+    case MAX30102_MULTI_LED_CTRL1:
+    case MAX30102_MULTI_LED_CTRL2:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void MAX30102_Driver::shadowStore(uint8_t reg, uint8_t value) {
+  _shadow[reg] = value;
+  _shadowValid |= (1UL << reg);
+}
+
+uint8_t MAX30102_Driver::fifoAverageCode(uint8_t samples) {
+  if (samples == 1) return 0;
+  else if (samples == 2) return 1;
+  else if (samples == 4) return 2;
+  else if (samples == 8) return 3;
+  else if (samples == 16) return 4;
+  else if (samples == 32) return 5;
+  return 2; // Default to 4 samples
+}
+
@@ -2,7 +2,7 @@
 #define MAX30102_DRIVER_H
 
 #include <Arduino.h>
-#include <Wire.h>
+#include "I2C_Bus.h"
 
 // MAX30102 I2C Address
 #define MAX30102_ADDRESS 0x57
@@ -30,6 +30,23 @@
 #define MAX30102_REV_ID          0xFE
 #define MAX30102_PART_ID         0xFF
 
+// Mode Configuration bits
+#define MAX30102_MODE_SHDN       0x80
+#define MAX30102_MODE_RESET      0x40
+
+// Reset / power-up timing
+#define MAX30102_RESET_TIMEOUT_MS   50   // RESET bit self-clears well within this
+#define MAX30102_POWERUP_TIMEOUT_MS 100  // Time allowed for the part to answer on I2C
+
+// Number of registers tracked by the shadow cache (0x00 - 0x12)
+#define MAX30102_SHADOW_SIZE 0x13
+
+// Interrupt bits
+#define MAX30102_INT_DIE_TEMP_RDY 0x02  // INT_STATUS_2 / INT_ENABLE_2
+
+// Temperature conversion timing
+#define MAX30102_TEMP_TIMEOUT_MS 100    // Typical conversion is ~29 ms
+
 // Mode Configuration
 #define MAX30102_MODE_HR_ONLY    0x02
 #define MAX30102_MODE_SPO2       0x03
@@ -51,6 +68,12 @@
 #define MAX30102_PULSE_WIDTH_215  0x02
 #define MAX30102_PULSE_WIDTH_411  0x03
 
+// ADC Range (full scale)
+#define MAX30102_ADC_RANGE_2048  0x00
+#define MAX30102_ADC_RANGE_4096  0x01
+#define MAX30102_ADC_RANGE_8192  0x02
+#define MAX30102_ADC_RANGE_16384 0x03
+
 // LED Current (mA)
 #define MAX30102_LED_CURRENT_0MA    0x00
 #define MAX30102_LED_CURRENT_4_4MA  0x0F
@@ -69,6 +92,18 @@
 #define MAX30102_LED_CURRENT_46_8MA 0xDF
 #define MAX30102_LED_CURRENT_50MA   0xFF
 
+// Complete acquisition setup, applied in one batched transaction
+struct MAX30102_Config {
+  uint8_t mode;          // MAX30102_MODE_*
+  uint8_t sampleRate;    // MAX30102_SAMPLE_RATE_*
+  uint8_t pulseWidth;    // MAX30102_PULSE_WIDTH_*
+  uint8_t adcRange;      // MAX30102_ADC_RANGE_*
+  uint8_t fifoAverage;   // 1, 2, 4, 8, 16 or 32 samples
+  bool fifoRollover;
+  uint8_t redCurrent;    // MAX30102_LED_CURRENT_*
+  uint8_t irCurrent;
+};
+
 struct MAX30102_Data {
   uint32_t red;
   uint32_t ir;
@@ -79,19 +114,34 @@ class MAX30102_Driver {
 private:
   uint8_t _sdaPin;
   uint8_t _sclPin;
+  I2C_Bus *_bus;
   bool _initialized;
   
+  // Asynchronous temperature state
+  bool _tempPending;
+  unsigned long _tempStartTime;
+  float _lastTemperature;
+  
+  // Shadow copy of the configuration registers, so bit changes need no read-back
+  uint8_t _shadow[MAX30102_SHADOW_SIZE];
+  uint32_t _shadowValid; // bit n set = _shadow[n] matches the device
+  
   // Helper functions
   uint8_t readRegister(uint8_t reg);
+  bool readRegisters(uint8_t reg, uint8_t *buf, uint8_t len);
   void writeRegister(uint8_t reg, uint8_t value);
+  bool writeRegisters(uint8_t reg, const uint8_t *values, uint8_t len);
   void bitMask(uint8_t reg, uint8_t mask, uint8_t value);
+  static bool isShadowed(uint8_t reg);
+  void shadowStore(uint8_t reg, uint8_t value);
+  static uint8_t fifoAverageCode(uint8_t samples);
   
 public:
   MAX30102_Driver(uint8_t sdaPin = 26, uint8_t sclPin = 27);
   
   // Initialization and configuration
   bool begin();
-  void reset();
+  bool reset();
   void shutdown();
   void wakeup();
   
@@ -102,19 +152,35 @@ public:
   void setLEDCurrent(uint8_t redLED, uint8_t irLED);
   void setFIFOAverage(uint8_t samples);
   void enableFIFORollover(bool enable);
+  void setADCRange(uint8_t range);
+  
+  // Batched configuration: writes only the registers that differ from the
+  // shadow copy, merging neighbouring registers into burst writes.
+  bool applyConfig(const MAX30102_Config &config);
+  MAX30102_Config getConfig();
+  static MAX30102_Config defaultConfig();
   
   // Data reading
   bool available();
+  uint8_t samplesAvailable(); // Unread FIFO samples (32 once the FIFO overflowed)
   MAX30102_Data readSample();
   void clearFIFO();
   
-  // Temperature reading
+  // Temperature reading (blocking, polls until the conversion completes)
   float readTemperature();
   
+  // Asynchronous temperature: start a conversion, then poll until it completes.
+  // pollTemperature() returns true once, when a new value is available.
+  bool startTemperature();
+  bool pollTemperature(float &celsius);
+  bool isTemperaturePending() { return _tempPending; }
+  float getLastTemperature() { return _lastTemperature; }
+  
   // Diagnostic
   uint8_t getPartID();
   uint8_t getRevisionID();
   bool checkConnection();
+  I2C_Bus *getBus() { return _bus; }
 };
 
 #endif // MAX30102_DRIVER_H
@@ -0,0 +1,214 @@
+#include "MotionCancel_Service.h"
+
+MotionCancel_Service::MotionCancel_Service()
+{
+  _enabled = true;
+  _lastCycles = 0;
+  _maxCycles = 0;
+  _avgCycles = 0;
+  _samples = 0;
+  _referenced = 0;
+  _adapted = 0;
+  _historyHead = 0;
+  _historyCount = 0;
+  reset();
+}
+
+void MotionCancel_Service::begin()
+{
+  reset();
+  _historyHead = 0;
+  _historyCount = 0;
+}
+
+void MotionCancel_Service::reset()
+{
+  memset(&_ir, 0, sizeof(_ir));
+  memset(&_red, 0, sizeof(_red));
+  memset(_delay, 0, sizeof(_delay));
+  _head = 0;
+}
+
+void MotionCancel_Service::addReference(uint32_t timestamp, float rollRate, float pitchRate, float yawRate)
+{
+  MotionReference &r = _history[_historyHead];
+  r.timestamp = timestamp;
+  r.rate[0] = rollRate;
+  r.rate[1] = pitchRate;
+  r.rate[2] = yawRate;
+
+  _historyHead = (_historyHead + 1) % MC_REF_HISTORY;
+  if (_historyCount < MC_REF_HISTORY)
+  {
+    _historyCount++;
+  }
+}
+
+void MotionCancel_Service::process(uint32_t timestamp, uint32_t &red, uint32_t &ir)
+{
+  const uint32_t startCycles = ESP.getCycleCount();
+
+  float rate[MC_REF_CHANNELS];
+  bool haveReference = _enabled && referenceAt(timestamp, rate);
+
+  if (haveReference)
+  {
+    _referenced++;
+    pushDelay(rate);
+
+    // Reference power over the tap window (same for both PPG channels)
+    float power = 0;
+    for (uint8_t c = 0; c < MC_REF_CHANNELS; c++)
+    {
+      const float *u = &_delay[c][_head];
+      for (uint8_t k = 0; k < MC_TAPS; k++)
+      {
+        power += u[k] * u[k];
+      }
+    }
+
+    // Only adapt while there is motion to learn from; when still the
+    // weights are kept so the next stride starts from the last solution
+    bool adapt = power > (MC_MOTION_MIN_DPS * MC_MOTION_MIN_DPS) * MC_WEIGHTS;
+    if (adapt)
+    {
+      _adapted++;
+    }
+
+    red = filterChannel(_red, red, power, adapt);
+    ir = filterChannel(_ir, ir, power, adapt);
+  }
+  else
+  {
+    // Pass through, but keep the DC trackers warm
+    filterChannel(_red, red, 0, false);
+    filterChannel(_ir, ir, 0, false);
+  }
+
+  _samples++;
+  _lastCycles = ESP.getCycleCount() - startCycles;
+  if (_lastCycles > _maxCycles)
+  {
+    _maxCycles = _lastCycles;
+  }
+  _avgCycles += (_lastCycles - _avgCycles) * 0.01f;
+}
+
+// Private helper functions
+
+bool MotionCancel_Service::referenceAt(uint32_t timestamp, float *rate)
+{
+  if (_historyCount == 0)
+  {
+    return false;
+  }
+
+  // Walk back from the newest reading to the first one not after timestamp
+  uint8_t newer = MC_REF_HISTORY;
+  for (uint8_t n = 0; n < _historyCount; n++)
+  {
+    uint8_t i = (_historyHead + MC_REF_HISTORY - 1 - n) % MC_REF_HISTORY;
+    const MotionReference &r = _history[i];
+    int32_t age = (int32_t)(timestamp - r.timestamp);
+
+    if (age >= 0)
+    {
+      if (age > MC_REF_MAX_AGE_US)
+      {
+        return false;
+      }
+
+      if (newer == MC_REF_HISTORY)
+      {
+        // Sample is after the newest reading: hold it
+        memcpy(rate, r.rate, sizeof(r.rate));
+        return true;
+      }
+
+      // Linear interpolation between the two bracketing readings
+      const MotionReference &next = _history[newer];
+      float span = (float)(int32_t)(next.timestamp - r.timestamp);
+      float f = span > 0 ? (float)age / span : 0;
+      for (uint8_t c = 0; c < MC_REF_CHANNELS; c++)
+      {
+        rate[c] = r.rate[c] + (next.rate[c] - r.rate[c]) * f;
+      }
+      return true;
+    }
+
+    newer = i;
+  }
+
+  // Sample is older than the whole history: use the oldest reading if close
+  const MotionReference &oldest = _history[newer];
+  if ((int32_t)(oldest.timestamp - timestamp) > MC_REF_MAX_AGE_US)
+  {
+    return false;
+  }
+  memcpy(rate, oldest.rate, sizeof(oldest.rate));
+  return true;
+}
+
+void MotionCancel_Service::pushDelay(const float *rate)
+{
+  _head = (_head + MC_TAPS - 1) % MC_TAPS;
+  for (uint8_t c = 0; c < MC_REF_CHANNELS; c++)
+  {
+    _delay[c][_head] = rate[c];
+    _delay[c][_head + MC_TAPS] = rate[c];
+  }
+}
+
+uint32_t MotionCancel_Service::filterChannel(Channel &ch, uint32_t sample, float power, bool adapt)
+{
+  // Remove the DC so the filter only models the pulsatile/motion part
+  if (!ch.primed)
+  {
+    ch.dc = (float)sample;
+    ch.primed = true;
+  }
+  ch.dc += ((float)sample - ch.dc) * MC_DC_ALPHA;
+
+  if (power <= 0)
+  {
+    return sample;
+  }
+
+  float d = (float)sample - ch.dc;
+
+  // Motion estimate from the reference taps
+  float y = 0;
+  for (uint8_t c = 0; c < MC_REF_CHANNELS; c++)
+  {
+    const float *u = &_delay[c][_head];
+    const float *w = &ch.weights[c * MC_TAPS];
+    for (uint8_t k = 0; k < MC_TAPS; k++)
+    {
+      y += w[k] * u[k];
+    }
+  }
+
+  float e = d - y;
+
+  // Normalised LMS update
+  if (adapt)
+  {
+    float g = MC_STEP_SIZE * e / (MC_REGULARIZATION + power);
+    for (uint8_t c = 0; c < MC_REF_CHANNELS; c++)
+    {
+      const float *u = &_delay[c][_head];
+      float *w = &ch.weights[c * MC_TAPS];
+      for (uint8_t k = 0; k < MC_TAPS; k++)
+      {
+        w[k] += g * u[k];
+      }
+    }
+  }
+
+  float out = ch.dc + e;
+  if (out < 0)
+  {
+    return 0;
+  }
+  return (uint32_t)(out + 0.5f);
+}
@@ -0,0 +1,100 @@
+#ifndef MOTIONCANCEL_SERVICE_H
+#define MOTIONCANCEL_SERVICE_H
+
+#include <Arduino.h>
+
+// Adaptive motion-artifact cancellation (NLMS) configuration
+#define MC_REF_CHANNELS 3          // Gyro roll, pitch and yaw rate
+#define MC_TAPS 16                 // FIR taps per reference channel
+#define MC_WEIGHTS (MC_REF_CHANNELS * MC_TAPS)
+// Gyro readings kept for time alignment. HR_step drains the PPG FIFO in
+// bursts, so the oldest sample of a burst needs the gyro reading from a whole
+// drain ago: the longest is a full 32-sample FIFO at 25 sps (ACTIVE, 100 sps
+// averaged by 4) with the gyro at 50 Hz.
+#define MC_MAX_DRAIN_US 1280000    // 32 samples at 25 sps
+#define MC_MIN_REF_INTERVAL_US 20000
+#define MC_REF_HISTORY (MC_MAX_DRAIN_US / MC_MIN_REF_INTERVAL_US + 8)
+#define MC_REF_MAX_AGE_US 100000   // Older reference = no motion data, bypass
+#define MC_STEP_SIZE 0.1f          // NLMS step size (mu), 0 < mu < 2
+#define MC_REGULARIZATION 25.0f    // Added to the reference power (dps^2)
+#define MC_MOTION_MIN_DPS 5.0f     // RMS reference rate below which weights are frozen
+#define MC_DC_ALPHA 0.02f          // DC tracker coefficient per sample
+
+static_assert(MC_REF_HISTORY < 256, "history indices are uint8_t");
+
+// One gyro reading used as a reference input
+struct MotionReference
+{
+  uint32_t timestamp; // micros()
+  float rate[MC_REF_CHANNELS];
+};
+
+class MotionCancel_Service
+{
+private:
+  // Adaptive filter state per PPG channel
+  struct Channel
+  {
+    float weights[MC_WEIGHTS];
+    float dc;
+    bool primed;
+  };
+
+  Channel _ir;
+  Channel _red;
+
+  // Reference delay line, each channel written twice so that the newest
+  // MC_TAPS values are always contiguous starting at _head
+  float _delay[MC_REF_CHANNELS][2 * MC_TAPS];
+  uint8_t _head;
+
+  // Gyro history for aligning references to PPG sample times
+  MotionReference _history[MC_REF_HISTORY];
+  uint8_t _historyHead;
+  uint8_t _historyCount;
+
+  bool _enabled;
+
+  // Cycle cost of process()
+  uint32_t _lastCycles;
+  uint32_t _maxCycles;
+  float _avgCycles;
+  uint32_t _samples;
+  uint32_t _referenced;
+  uint32_t _adapted;
+
+  bool referenceAt(uint32_t timestamp, float *rate);
+  void pushDelay(const float *rate);
+  uint32_t filterChannel(Channel &ch, uint32_t sample, float power, bool adapt);
+
+public:
+  MotionCancel_Service();
+
+  void begin();
+
+  // Clear weights and DC trackers (front-end gain or rate change)
+  void reset();
+
+  void setEnabled(bool enabled) { _enabled = enabled; }
+  bool isEnabled() { return _enabled; }
+
+  // Record one gyro reading (dps) taken at timestamp (micros())
+  void addReference(uint32_t timestamp, float rollRate, float pitchRate, float yawRate);
+
+  // Clean one PPG sample taken at timestamp (micros()). Without a recent
+  // reference the samples pass through unchanged.
+  void process(uint32_t timestamp, uint32_t &red, uint32_t &ir);
+
+  // Measured cost of process() in CPU cycles
+  uint32_t getLastCycles() { return _lastCycles; }
+  uint32_t getMaxCycles() { return _maxCycles; }
+  float getAverageCycles() { return _avgCycles; }
+
+  // Samples processed, how many found a motion reference and how many of
+  // them updated the weights
+  uint32_t getSampleCount() { return _samples; }
+  uint32_t getReferencedCount() { return _referenced; }
+  uint32_t getAdaptedCount() { return _adapted; }
+};
+
+#endif // MOTIONCANCEL_SERVICE_H
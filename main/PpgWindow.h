@@ -0,0 +1,258 @@
+#ifndef PPGWINDOW_H
+#define PPGWINDOW_H
+
+#include <Arduino.h>
+
+// Sliding-window storage for one PPG channel, written in ring order.
+//
+// Both classes have the same interface, so the analysis code is written once
+// against either. PpgWindow_Plain keeps uint32_t samples. PpgWindow_Compact
+// keeps int16 residuals against a per-block base (PPG_BLOCK samples per
+// block): the pulse and the baseline wander within a block are a tiny part
+// of the 18-bit range, so a window takes a little over half the memory, and
+// sum/minValue/maxValue read 16-bit residuals plus one base per block.
+//
+// Samples are exact unless a block cannot hold all its samples within
+// +/-32767 of one base (a swing of more than 65534 counts within one block,
+// i.e. a step far beyond any pulse); the newest sample is then kept exact and
+// older ones in the block saturate. clipped() counts that.
+//
+// Slots are written in order from 0 after clear(), as the ring index runs.
+// sum/minValue/maxValue cover every slot, so call them once the window is full.
+
+#define PPG_BLOCK 25 // samples per base in the compact window
+
+template <uint16_t N>
+class PpgWindow_Plain
+{
+private:
+  uint32_t _v[N];
+
+public:
+  PpgWindow_Plain() { clear(); }
+
+  void clear()
+  {
+    for (uint16_t i = 0; i < N; i++)
+    {
+      _v[i] = 0;
+    }
+  }
+
+  void set(uint16_t i, uint32_t value) { _v[i] = value; }
+  uint32_t get(uint16_t i) const { return _v[i]; }
+
+  uint64_t sum() const
+  {
+    uint64_t s = 0;
+    for (uint16_t i = 0; i < N; i++)
+    {
+      s += _v[i];
+    }
+    return s;
+  }
+
+  uint32_t maxValue() const
+  {
+    uint32_t m = 0;
+    for (uint16_t i = 0; i < N; i++)
+    {
+      if (_v[i] > m)
+      {
+        m = _v[i];
+      }
+    }
+    return m;
+  }
+
+  uint32_t minValue() const
+  {
+    uint32_t m = 0xFFFFFFFF;
+    for (uint16_t i = 0; i < N; i++)
+    {
+      if (_v[i] < m)
+      {
+        m = _v[i];
+      }
+    }
+    return m;
+  }
+
+  // Sum of squared (float) deviations from mean, in slot order
+  float squaredDeviation(uint32_t mean) const
+  {
+    float acc = 0;
+    for (uint16_t i = 0; i < N; i++)
+    {
+      float diff = (float)_v[i] - (float)mean;
+      acc += diff * diff;
+    }
+    return acc;
+  }
+
+  uint32_t clipped() const { return 0; }
+  static constexpr size_t bytes() { return sizeof(uint32_t) * N; }
+};
+
+template <uint16_t N>
+class PpgWindow_Compact
+{
+private:
+  static_assert(N % PPG_BLOCK == 0, "window must be a whole number of blocks");
+  static const uint16_t BLOCKS = N / PPG_BLOCK;
+
+  int16_t _res[N];
+  uint32_t _base[BLOCKS];
+  uint16_t _written; // slots written since clear(), up to N
+  uint32_t _clipped;
+
+  static int16_t saturate(int32_t r)
+  {
+    return (int16_t)(r > 32767 ? 32767 : (r < -32768 ? -32768 : r));
+  }
+
+  // Move block b to a base that holds value at slot i and, if they fit
+  // together, every other live slot of the block
+  void rebase(uint16_t b, uint16_t i, uint32_t value)
+  {
+    const uint16_t first = b * PPG_BLOCK;
+    uint32_t lo = value, hi = value;
+    for (uint16_t j = first; j < first + PPG_BLOCK; j++)
+    {
+      if (j == i || j >= _written)
+      {
+        continue;
+      }
+      uint32_t v = get(j);
+      lo = v < lo ? v : lo;
+      hi = v > hi ? v : hi;
+    }
+
+    uint32_t base;
+    if (hi - lo <= 65534)
+    {
+      base = lo + (hi - lo) / 2; // room on both sides for what comes next
+    }
+    else
+    {
+      base = value; // keep the newest exact; older slots saturate
+      _clipped++;
+    }
+    for (uint16_t j = first; j < first + PPG_BLOCK; j++)
+    {
+      if (j != i && j < _written)
+      {
+        _res[j] = saturate((int32_t)(get(j) - base));
+      }
+    }
+    _base[b] = base;
+  }
+
+public:
+  PpgWindow_Compact() : _clipped(0) { clear(); }
+
+  void clear()
+  {
+    for (uint16_t i = 0; i < N; i++)
+    {
+      _res[i] = 0;
+    }
+    for (uint16_t b = 0; b < BLOCKS; b++)
+    {
+      _base[b] = 0;
+    }
+    _written = 0;
+  }
+
+  void set(uint16_t i, uint32_t value)
+  {
+    const uint16_t b = i / PPG_BLOCK;
+    int32_t r = (int32_t)(value - _base[b]);
+    if (r < -32768 || r > 32767)
+    {
+      rebase(b, i, value);
+      r = (int32_t)(value - _base[b]);
+    }
+    _res[i] = (int16_t)r;
+    if (_written < N && i >= _written)
+    {
+      _written = i + 1;
+    }
+  }
+
+  uint32_t get(uint16_t i) const { return _base[i / PPG_BLOCK] + (int32_t)_res[i]; }
+
+  uint64_t sum() const
+  {
+    uint64_t s = 0;
+    for (uint16_t b = 0; b < BLOCKS; b++)
+    {
+      const int16_t *res = &_res[b * PPG_BLOCK];
+      int32_t r = 0;
+      for (uint16_t k = 0; k < PPG_BLOCK; k++)
+      {
+        r += res[k];
+      }
+      s += (uint64_t)_base[b] * PPG_BLOCK + r;
+    }
+    return s;
+  }
+
+  uint32_t maxValue() const
+  {
+    uint32_t m = 0;
+    for (uint16_t b = 0; b < BLOCKS; b++)
+    {
+      const int16_t *res = &_res[b * PPG_BLOCK];
+      int16_t r = res[0];
+      for (uint16_t k = 1; k < PPG_BLOCK; k++)
+      {
+        r = res[k] > r ? res[k] : r;
+      }
+      uint32_t v = _base[b] + (int32_t)r;
+      m = v > m ? v : m;
+    }
+    return m;
+  }
+
+  uint32_t minValue() const
+  {
+    uint32_t m = 0xFFFFFFFF;
+    for (uint16_t b = 0; b < BLOCKS; b++)
+    {
+      const int16_t *res = &_res[b * PPG_BLOCK];
+      int16_t r = res[0];
+      for (uint16_t k = 1; k < PPG_BLOCK; k++)
+      {
+        r = res[k] < r ? res[k] : r;
+      }
+      uint32_t v = _base[b] + (int32_t)r;
+      m = v < m ? v : m;
+    }
+    return m;
+  }
+
+  // Same sums in the same order as PpgWindow_Plain, so results match it
+  float squaredDeviation(uint32_t mean) const
+  {
+    float acc = 0;
+    for (uint16_t b = 0; b < BLOCKS; b++)
+    {
+      const int16_t *res = &_res[b * PPG_BLOCK];
+      // Deviation of the base, exact in float for 18-bit samples
+      const float offset = (float)_base[b] - (float)mean;
+      for (uint16_t k = 0; k < PPG_BLOCK; k++)
+      {
+        float diff = offset + (float)res[k];
+        acc += diff * diff;
+      }
+    }
+    return acc;
+  }
+
+  // Samples that saturated since construction
+  uint32_t clipped() const { return _clipped; }
+  static constexpr size_t bytes() { return sizeof(int16_t) * N + sizeof(uint32_t) * BLOCKS; }
+};
+
+#endif // PPGWINDOW_H
@@ -0,0 +1,343 @@
+#include "RiskScore_Service.h"
+
+// ======= Model coefficients (compile-time tables) =======
+// Each table is a piecewise-linear map from a feature to a 0-100 risk
+// contribution. Breakpoints must be sorted by x.
+
+struct RiskBreakpoint
+{
+  float x;
+  float risk;
+};
+
+// Sustained fraction of heart-rate reserve -> overexertion risk
+static const RiskBreakpoint EXERTION_TABLE[] = {
+  {0.60, 0}, {0.80, 20}, {0.90, 50}, {0.95, 75}, {1.00, 95}};
+
+// HR above what the current speed/grade explains (bpm) -> heat risk (cardiac drift)
+static const RiskBreakpoint DRIFT_TABLE[] = {
+  {5, 0}, {15, 30}, {25, 60}, {40, 90}};
+
+// Skin-side sensor temperature (°C) -> heat risk
+static const RiskBreakpoint TEMP_TABLE[] = {
+  {34.0, 0}, {35.5, 20}, {36.5, 50}, {37.5, 85}};
+
+// Averaged SpO2 (%) -> hypoxia risk
+static const RiskBreakpoint SPO2_TABLE[] = {
+  {85, 100}, {88, 75}, {91, 40}, {94, 10}, {96, 0}};
+
+// Seconds of stillness after an impact -> fall risk
+static const RiskBreakpoint FALL_TABLE[] = {
+  {1, 10}, {3, 40}, {5, 70}, {10, 100}};
+
+// Expected HR = rest + SPEED_COEF * v + GRADE_COEF * v * grade%
+static const float EFFORT_SPEED_COEF = 30.0;  // bpm per m/s on the flat
+static const float EFFORT_GRADE_COEF = 4.0;   // bpm per m/s per % grade
+
+// Drift is only judged on a sustained moving stretch: HR lags effort by a
+// minute or more, so just after a start or a stop it says nothing about heat
+static const float DRIFT_MIN_SPEED = 1.0;            // m/s
+static const uint32_t DRIFT_MIN_MOVING_MS = 180000;  // moving this long first
+
+// Filter time constants (seconds)
+static const float TAU_HR_SLOW = 60.0;
+static const float TAU_HR_FAST = 10.0;
+static const float TAU_SPO2 = 20.0;
+static const float TAU_TEMP = 60.0;
+static const float TAU_TREND = 120.0;
+static const float TAU_SPEED = 10.0;
+static const float TAU_GRADE = 30.0;
+static const float TAU_FALL_DECAY = 60.0;
+
+// Fall detection thresholds (|roll| + |pitch| rate, dps)
+static const float FALL_IMPACT_DPS = 250.0;
+static const float FALL_STILL_DPS = 15.0;
+static const float FALL_MOVING_DPS = 60.0;
+static const uint32_t FALL_WINDOW_MS = 30000; // stillness must start within this after impact
+
+// Weight of the non-dominant components in the overall score
+static const float RISK_SECONDARY_WEIGHT = 0.2;
+
+template <size_t N>
+static float lookup(const RiskBreakpoint (&table)[N], float x)
+{
+  if (x <= table[0].x)
+    return table[0].risk;
+  for (size_t i = 1; i < N; i++)
+  {
+    if (x < table[i].x)
+    {
+      const float f = (x - table[i - 1].x) / (table[i].x - table[i - 1].x);
+      return table[i - 1].risk + f * (table[i].risk - table[i - 1].risk);
+    }
+  }
+  return table[N - 1].risk;
+}
+
+static uint8_t toScore(float v)
+{
+  if (v <= 0)
+    return 0;
+  if (v >= 100)
+    return 100;
+  return (uint8_t)(v + 0.5);
+}
+
+RiskScore_Service::RiskScore_Service()
+{
+  _hrMax = RISK_DEFAULT_HR_MAX;
+  _hrRest = RISK_DEFAULT_HR_REST;
+  reset();
+}
+
+void RiskScore_Service::begin()
+{
+  reset();
+}
+
+void RiskScore_Service::reset()
+{
+  _lastUpdate = 0;
+  _hrSlow = 0;
+  _hrFast = 0;
+  _spO2Avg = 0;
+  _tempAvg = NAN;
+  _tempTrend = 0;
+  _speedAvg = 0;
+  _gradeAvg = 0;
+  _effortHr = 0;
+  _movingSince = 0;
+
+  _havePosition = false;
+  _lastFixTime = 0;
+  _lastEast = 0;
+  _lastNorth = 0;
+  _lastAlt = NAN;
+
+  _impactTime = 0;
+  _stillSince = 0;
+  _fallLevel = 0;
+
+  _score = RiskScore{0, 0, 0, 0, 0, false};
+  _lastCycles = 0;
+  _maxCycles = 0;
+}
+
+void RiskScore_Service::setHeartRateLimits(float hrRest, float hrMax)
+{
+  if (hrRest > 30 && hrMax > hrRest + 20)
+  {
+    _hrRest = hrRest;
+    _hrMax = hrMax;
+  }
+}
+
+void RiskScore_Service::addFix(uint32_t timestamp, double east_m, double north_m, float alt_m)
+{
+  if (_havePosition)
+  {
+    const uint32_t dtMs = timestamp - _lastFixTime;
+    if (dtMs > 0 && dtMs <= RISK_MAX_DT_MS)
+    {
+      const float dt = dtMs * 0.001;
+      const float de = east_m - _lastEast;
+      const float dn = north_m - _lastNorth;
+      const float dist = sqrt(de * de + dn * dn);
+      _speedAvg = ema(_speedAvg, dist / dt, dt, TAU_SPEED);
+
+      // Grade only over meaningful horizontal distance
+      if (!isnan(alt_m) && !isnan(_lastAlt) && dist > 0.5)
+      {
+        const float grade = 100.0 * (alt_m - _lastAlt) / dist;
+        _gradeAvg = ema(_gradeAvg, grade, dt, TAU_GRADE);
+      }
+    }
+    else
+    {
+      _movingSince = 0; // gap: the stretch cannot be vouched for
+    }
+  }
+
+  if (_speedAvg < DRIFT_MIN_SPEED)
+    _movingSince = 0;
+  else if (_movingSince == 0)
+    _movingSince = timestamp;
+
+  _havePosition = true;
+  _lastFixTime = timestamp;
+  _lastEast = east_m;
+  _lastNorth = north_m;
+  _lastAlt = alt_m;
+}
+
+const RiskScore &RiskScore_Service::update(const RiskInput &in)
+{
+  const uint32_t startCycles = ESP.getCycleCount();
+
+  float dt = 0;
+  if (_lastUpdate != 0)
+  {
+    const uint32_t dtMs = in.timestamp - _lastUpdate;
+    if (dtMs > RISK_MAX_DT_MS)
+    {
+      // Long gap: restart averages from the new sample
+      _hrSlow = _hrFast = _spO2Avg = _effortHr = 0;
+    }
+    else
+    {
+      dt = dtMs * 0.001;
+    }
+  }
+  _lastUpdate = in.timestamp;
+
+  // Vitals only when the optical signal is trustworthy
+  if (in.signalQuality >= RISK_MIN_QUALITY)
+  {
+    if (in.heartRate > 0)
+    {
+      _hrSlow = (_hrSlow > 0) ? ema(_hrSlow, in.heartRate, dt, TAU_HR_SLOW) : in.heartRate;
+      _hrFast = (_hrFast > 0) ? ema(_hrFast, in.heartRate, dt, TAU_HR_FAST) : in.heartRate;
+    }
+    if (in.spO2 > 0)
+    {
+      _spO2Avg = (_spO2Avg > 0) ? ema(_spO2Avg, in.spO2, dt, TAU_SPO2) : in.spO2;
+    }
+  }
+
+  // What the current effort explains, through the same filter as _hrSlow so
+  // the two are compared at the same lag
+  if (_havePosition)
+  {
+    float expected = _hrRest + EFFORT_SPEED_COEF * _speedAvg + EFFORT_GRADE_COEF * _speedAvg * max(0.0f, _gradeAvg);
+    if (expected > _hrMax)
+      expected = _hrMax;
+    _effortHr = (_effortHr > 0) ? ema(_effortHr, expected, dt, TAU_HR_SLOW) : expected;
+  }
+
+  if (!isnan(in.temperature))
+  {
+    if (isnan(_tempAvg))
+    {
+      _tempAvg = in.temperature;
+    }
+    else
+    {
+      const float prev = _tempAvg;
+      _tempAvg = ema(_tempAvg, in.temperature, dt, TAU_TEMP);
+      if (dt > 0)
+      {
+        _tempTrend = ema(_tempTrend, (_tempAvg - prev) * 60.0 / dt, dt, TAU_TREND);
+      }
+    }
+  }
+
+  const float heat = heatComponent();
+  const float exertion = exertionComponent();
+  const float hypoxia = hypoxiaComponent();
+  const float fall = fallComponent(in, dt);
+
+  // Dominant component plus a fraction of the others
+  float top = max(max(heat, exertion), max(hypoxia, fall));
+  float total = top + RISK_SECONDARY_WEIGHT * (heat + exertion + hypoxia + fall - top);
+
+  _score.heat = toScore(heat);
+  _score.exertion = toScore(exertion);
+  _score.hypoxia = toScore(hypoxia);
+  _score.fall = toScore(fall);
+  _score.score = toScore(total);
+  _score.alert = _score.score >= RISK_ALERT_THRESHOLD;
+
+  _lastCycles = ESP.getCycleCount() - startCycles;
+  if (_lastCycles > _maxCycles)
+    _maxCycles = _lastCycles;
+
+  return _score;
+}
+
+// Private helper functions
+
+float RiskScore_Service::ema(float avg, float x, float dt, float tau)
+{
+  const float alpha = dt / (tau + dt);
+  return avg + alpha * (x - avg);
+}
+
+float RiskScore_Service::heatComponent()
+{
+  float risk = 0;
+
+  // Cardiac drift: HR higher than the effort explains, while moving steadily.
+  // Standing still (aid stations, recovery) is never drift.
+  if (_hrSlow > 0 && _effortHr > 0 && _movingSince != 0 && _lastFixTime - _movingSince >= DRIFT_MIN_MOVING_MS)
+  {
+    risk = lookup(DRIFT_TABLE, _hrSlow - _effortHr);
+  }
+
+  // Temperature level, boosted while it keeps rising
+  if (!isnan(_tempAvg))
+  {
+    float tempRisk = lookup(TEMP_TABLE, _tempAvg);
+    if (_tempTrend > 0.05)
+      tempRisk += min(20.0f, _tempTrend * 100.0f);
+    risk = max(risk, tempRisk);
+  }
+
+  return risk;
+}
+
+float RiskScore_Service::exertionComponent()
+{
+  if (_hrSlow <= 0)
+    return 0;
+
+  const float reserve = _hrMax - _hrRest;
+  const float sustained = lookup(EXERTION_TABLE, (_hrSlow - _hrRest) / reserve);
+  const float burst = lookup(EXERTION_TABLE, (_hrFast - _hrRest) / reserve) * 0.7;
+  return max(sustained, burst);
+}
+
+float RiskScore_Service::hypoxiaComponent()
+{
+  if (_spO2Avg <= 0)
+    return 0;
+  return lookup(SPO2_TABLE, _spO2Avg);
+}
+
+float RiskScore_Service::fallComponent(const RiskInput &in, float dt)
+{
+  // No reading on this pass: the stillness timing waits for the next one,
+  // the level decays as over a quiet reading
+  if (isnan(in.rollRate_dps) || isnan(in.pitchRate_dps))
+  {
+    _fallLevel = ema(_fallLevel, 0, dt, TAU_FALL_DECAY);
+    return _fallLevel;
+  }
+
+  const float rate = fabs(in.rollRate_dps) + fabs(in.pitchRate_dps);
+  float target = 0;
+
+  if (rate > FALL_IMPACT_DPS)
+  {
+    _impactTime = in.timestamp;
+    _stillSince = 0;
+  }
+  else if (_impactTime != 0)
+  {
+    if (rate < FALL_STILL_DPS)
+    {
+      if (_stillSince == 0 && (in.timestamp - _impactTime) < FALL_WINDOW_MS)
+        _stillSince = in.timestamp;
+      if (_stillSince != 0)
+        target = lookup(FALL_TABLE, (in.timestamp - _stillSince) * 0.001);
+    }
+    else if (rate > FALL_MOVING_DPS)
+    {
+      // Athlete is moving again
+      _impactTime = 0;
+      _stillSince = 0;
+    }
+  }
+
+  _fallLevel = max(target, ema(_fallLevel, 0, dt, TAU_FALL_DECAY));
+  return _fallLevel;
+}
@@ -0,0 +1,104 @@
+#ifndef RISKSCORE_SERVICE_H
+#define RISKSCORE_SERVICE_H
+
+#include <Arduino.h>
+
+// Risk score configuration
+#define RISK_ALERT_THRESHOLD 70    // Score at/above which a local alert is raised
+#define RISK_DEFAULT_HR_MAX 190    // Used until a personal max is configured
+#define RISK_DEFAULT_HR_REST 60    // Used until a personal resting HR is configured
+#define RISK_MIN_QUALITY 30        // Vitals below this signal quality are ignored
+#define RISK_MAX_DT_MS 5000        // Gaps longer than this restart the filters
+
+// One timestamped feature vector. Missing inputs are passed as NAN (or 0 for HR/SpO2).
+struct RiskInput
+{
+  uint32_t timestamp;    // millis() of the sample
+  float heartRate;       // bpm, 0 if unavailable
+  float spO2;            // %, 0 if unavailable
+  float signalQuality;   // 0-100 from HeartRate_Service
+  float rollRate_dps;    // IMU angular rates, NAN without a new reading
+  float pitchRate_dps;
+  float temperature;     // Sensor/skin temperature in °C, NAN if unknown
+};
+
+struct RiskScore
+{
+  uint8_t score;     // Overall 0-100
+  uint8_t heat;      // Heat-stress component 0-100
+  uint8_t exertion;  // Overexertion component 0-100
+  uint8_t hypoxia;   // Low-SpO2 component 0-100
+  uint8_t fall;      // Fall/no-movement component 0-100
+  bool alert;        // score >= RISK_ALERT_THRESHOLD
+};
+
+class RiskScore_Service
+{
+private:
+  // Personal parameters
+  float _hrMax;
+  float _hrRest;
+
+  // Filter state (fixed memory, all exponential)
+  uint32_t _lastUpdate;
+  float _hrSlow;         // ~60 s HR average
+  float _hrFast;         // ~10 s HR average
+  float _spO2Avg;        // ~20 s SpO2 average
+  float _tempAvg;        // ~60 s temperature average
+  float _tempTrend;      // °C per minute
+  float _speedAvg;       // ~10 s speed average (m/s)
+  float _gradeAvg;       // ~30 s grade average (%)
+  float _effortHr;       // HR the effort explains, averaged like _hrSlow
+  uint32_t _movingSince; // first fix of the current moving stretch, 0 when stopped
+
+  // Position-derived features
+  bool _havePosition;
+  uint32_t _lastFixTime;
+  double _lastEast;
+  double _lastNorth;
+  float _lastAlt;
+
+  // Fall detection
+  uint32_t _impactTime;
+  uint32_t _stillSince;
+  float _fallLevel;
+
+  RiskScore _score;
+
+  // Cycle cost of update()
+  uint32_t _lastCycles;
+  uint32_t _maxCycles;
+
+  // Helpers
+  static float ema(float avg, float x, float dt, float tau);
+  float heatComponent();
+  float exertionComponent();
+  float hypoxiaComponent();
+  float fallComponent(const RiskInput &in, float dt);
+
+public:
+  RiskScore_Service();
+
+  void begin();
+  void reset();
+
+  // Personal calibration from the athlete profile
+  void setHeartRateLimits(float hrRest, float hrMax);
+
+  // Position fix in the local east/north frame (EllipsePoint), altitude NAN if unknown.
+  // Updates speed and grade features.
+  void addFix(uint32_t timestamp, double east_m, double north_m, float alt_m);
+
+  // Incremental update from one feature vector; returns the new score
+  const RiskScore &update(const RiskInput &in);
+
+  const RiskScore &getScore() const { return _score; }
+  float getSpeed() const { return _speedAvg; }
+  float getGrade() const { return _gradeAvg; }
+
+  // Measured cost of update() in CPU cycles
+  uint32_t getLastCycles() const { return _lastCycles; }
+  uint32_t getMaxCycles() const { return _maxCycles; }
+};
+
+#endif // RISKSCORE_SERVICE_H
@@ -20,6 +20,18 @@ SOSButton_Driver::SOSButton_Driver(uint8_t pin, bool pullupEnabled, bool activeH
   _longPressTriggered = false;
   _pressCount = 0;
   _callback = nullptr;
+  _hook = nullptr;
+  
+  _interruptMode = false;
+  _queue = nullptr;
+  _timer = nullptr;
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+  _timerActive = false;
+  _startPending = false;
+  _edgePending = false;
+  _edgeTime = 0;
+  _stateEdgeTime = 0;
+  memset(&_stats, 0, sizeof(_stats));
 }
 
 void SOSButton_Driver::begin() {
@@ -33,6 +45,38 @@ void SOSButton_Driver::begin() {
   _currentState = _lastState;
 }
 
+bool SOSButton_Driver::beginInterrupt(uint8_t queueLength) {
+  begin();
+  
+  if (!_queue) {
+    _queue = xQueueCreate(queueLength, sizeof(ButtonEvent));
+    if (!_queue) {
+      return false;
+    }
+  }
+  
+  if (!_timer) {
+    esp_timer_create_args_t args = {};
+    args.callback = timerEntry;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "sos_button";
+    if (esp_timer_create(&args, &_timer) != ESP_OK) {
+      return false;
+    }
+  }
+  
+  _interruptMode = true;
+  attachInterruptArg(digitalPinToInterrupt(_pin), isrEntry, this, CHANGE);
+  
+  // Already held at boot: time it like a fresh press
+  if (_currentState) {
+    _currentState = false;
+    startTimer();
+  }
+  return true;
+}
+
 void SOSButton_Driver::setDebounceDelay(unsigned long ms) {
   _debounceDelay = ms;
 }
@@ -49,10 +93,32 @@ void SOSButton_Driver::setCallback(ButtonCallback callback) {
   _callback = callback;
 }
 
+void SOSButton_Driver::setEventHook(ButtonEventHook hook) {
+  _hook = hook;
+}
+
 void SOSButton_Driver::update() {
-  bool reading = readButtonState();
-  unsigned long currentTime = millis();
+  if (!_interruptMode) {
+    process(readButtonState(), millis());
+    return;
+  }
   
+  // Edges can be missed while the CPU is in light sleep: restart timing if
+  // the pin disagrees with the debounced state
+  if (!_timerActive && readButtonState() != _currentState) {
+    startTimer();
+  }
+  
+  ButtonEvent event;
+  while (pollEvent(event)) {
+    if (_callback) {
+      _callback(event.state);
+    }
+  }
+}
+
+// Shared state machine: debounce, press/release, double press, long press
+void SOSButton_Driver::process(bool reading, unsigned long currentTime) {
   // Debouncing
   if (reading != _lastState) {
     _lastDebounceTime = currentTime;
@@ -63,6 +129,10 @@ void SOSButton_Driver::update() {
     if (reading != _currentState) {
       _currentState = reading;
       
+      // Time of the first edge of this transition (interrupt mode)
+      _stateEdgeTime = _edgePending ? _edgeTime : micros();
+      _edgePending = false;
+      
       // Button pressed
       if (_currentState) {
         _isPressed = true;
@@ -72,15 +142,13 @@ void SOSButton_Driver::update() {
         // Check for double press
         if ((currentTime - _lastPressTime) < _doublePressInterval) {
           _pressCount = 2;
-          if (_callback) {
-            _callback(BUTTON_DOUBLE_PRESS);
-          }
+          emit(BUTTON_DOUBLE_PRESS);
         } else {
           _pressCount = 1;
         }
         
-        if (_callback && _pressCount == 1) {
-          _callback(BUTTON_PRESSED);
+        if (_pressCount == 1) {
+          emit(BUTTON_PRESSED);
         }
       }
       // Button released
@@ -88,8 +156,8 @@ void SOSButton_Driver::update() {
         _isPressed = false;
         _lastPressTime = currentTime;
         
-        if (_callback && !_longPressTriggered) {
-          _callback(BUTTON_RELEASED);
+        if (!_longPressTriggered) {
+          emit(BUTTON_RELEASED);
         }
       }
     }
@@ -98,9 +166,7 @@ void SOSButton_Driver::update() {
     if (_currentState && !_longPressTriggered) {
       if ((currentTime - _pressStartTime) >= _longPressThreshold) {
         _longPressTriggered = true;
-        if (_callback) {
-          _callback(BUTTON_LONG_PRESS);
-        }
+        emit(BUTTON_LONG_PRESS);
       }
     }
   }
@@ -108,6 +174,43 @@ void SOSButton_Driver::update() {
   _lastState = reading;
 }
 
+void SOSButton_Driver::emit(ButtonState state) {
+  if (!_interruptMode) {
+    if (_callback) {
+      _callback(state);
+    }
+    return;
+  }
+  
+  ButtonEvent event;
+  event.state = state;
+  event.triggerTime = _stateEdgeTime;
+  if (state == BUTTON_LONG_PRESS) {
+    event.triggerTime += _longPressThreshold * 1000UL;
+  }
+  event.detectTime = micros();
+  
+  if (_hook) {
+    _hook(event);
+  }
+  
+  float latency_ms = (event.detectTime - event.triggerTime) / 1000.0f;
+  bool queued = (xQueueSend(_queue, &event, 0) == pdTRUE);
+  
+  portENTER_CRITICAL(&_mux);
+  if (queued) {
+    _stats.events++;
+    _stats.lastDetect_ms = latency_ms;
+    if (latency_ms > _stats.maxDetect_ms) {
+      _stats.maxDetect_ms = latency_ms;
+    }
+    _stats.avgDetect_ms += (latency_ms - _stats.avgDetect_ms) / _stats.events;
+  } else {
+    _stats.dropped++;
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
 bool SOSButton_Driver::isPressed() {
   return _currentState;
 }
@@ -145,7 +248,95 @@ void SOSButton_Driver::reset() {
   _lastPressTime = 0;
 }
 
+bool SOSButton_Driver::pollEvent(ButtonEvent &event, uint32_t timeout_ms) {
+  if (!_queue || xQueueReceive(_queue, &event, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    return false;
+  }
+  
+  float latency_ms = (micros() - event.triggerTime) / 1000.0f;
+  portENTER_CRITICAL(&_mux);
+  _stats.lastDeliver_ms = latency_ms;
+  if (latency_ms > _stats.maxDeliver_ms) {
+    _stats.maxDeliver_ms = latency_ms;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return true;
+}
+
+void SOSButton_Driver::getLatencyStats(ButtonLatencyStats &out) {
+  portENTER_CRITICAL(&_mux);
+  out = _stats;
+  portEXIT_CRITICAL(&_mux);
+}
+
 // Private helper functions
+void IRAM_ATTR SOSButton_Driver::isrEntry(void *arg) {
+  SOSButton_Driver *self = (SOSButton_Driver *)arg;
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  
+  portENTER_CRITICAL_ISR(&self->_mux);
+  if (!self->_edgePending) {
+    self->_edgeTime = now;
+    self->_edgePending = true;
+  }
+  bool start = !self->_timerActive && !self->_startPending;
+  if (start) {
+    self->_startPending = true;
+  }
+  portEXIT_CRITICAL_ISR(&self->_mux);
+  
+  // esp_timer cannot be started from an ISR: the timer service task does it.
+  // If its queue is full, the next edge or update() starts the timer.
+  if (start) {
+    BaseType_t woken = pdFALSE;
+    if (xTimerPendFunctionCallFromISR(deferredStart, self, 0, &woken) != pdPASS) {
+      self->_startPending = false;
+    }
+    if (woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+void SOSButton_Driver::deferredStart(void *arg, uint32_t) {
+  ((SOSButton_Driver *)arg)->startTimer();
+}
+
+void SOSButton_Driver::timerEntry(void *arg) {
+  ((SOSButton_Driver *)arg)->onTick();
+}
+
+void SOSButton_Driver::startTimer() {
+  portENTER_CRITICAL(&_mux);
+  _startPending = false;
+  if (!_timerActive) {
+    _timerActive = true;
+    esp_timer_start_periodic(_timer, SOS_TICK_US);
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
+void SOSButton_Driver::onTick() {
+  unsigned long currentTime = millis();
+  bool reading = readButtonState();
+  process(reading, currentTime);
+  
+  // Keep ticking while bouncing, and while held until the long press fired;
+  // the next edge interrupt restarts the timer
+  bool settled = (reading == _currentState) && (currentTime - _lastDebounceTime) > _debounceDelay;
+  if (settled && (!_currentState || _longPressTriggered)) {
+    // Re-check under the lock: an edge after the read above would otherwise be
+    // lost, since the ISR only starts the timer when it is not running
+    portENTER_CRITICAL(&_mux);
+    if (readButtonState() == _currentState) {
+      _edgePending = false;
+      _timerActive = false;
+      esp_timer_stop(_timer);
+    }
+    portEXIT_CRITICAL(&_mux);
+  }
+}
+
 bool SOSButton_Driver::readButtonState() {
   bool state = digitalRead(_pin);
   
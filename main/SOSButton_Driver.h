@@ -2,6 +2,14 @@
 #define SOS_BUTTON_DRIVER_H
 
 #include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/timers.h>
+
+// Interrupt mode configuration
+#define SOS_TICK_US 2000     // State machine period while a press is being timed
+#define SOS_QUEUE_LENGTH 8   // Events buffered for the consumer
 
 // Button states
 enum ButtonState {
@@ -15,6 +23,29 @@ enum ButtonState {
 // Button event callback type
 typedef void (*ButtonCallback)(ButtonState state);
 
+// Event delivered through the queue in interrupt mode
+struct ButtonEvent {
+  ButtonState state;
+  uint32_t triggerTime; // micros(): edge that caused it, or the long-press deadline
+  uint32_t detectTime;  // micros(): when the state machine queued it
+};
+
+// Called from the button timer task as soon as an event is detected, before
+// it is queued. Must be short and thread-safe (e.g. hand off to a queue).
+typedef void (*ButtonEventHook)(const ButtonEvent &event);
+
+// Latency from trigger to queued event (detect; press/release include the
+// debounce delay) and from trigger to the consumer reading it (deliver)
+struct ButtonLatencyStats {
+  uint32_t events;
+  uint32_t dropped;
+  float lastDetect_ms;
+  float maxDetect_ms;
+  float avgDetect_ms;
+  float lastDeliver_ms;
+  float maxDeliver_ms;
+};
+
 class SOSButton_Driver {
 private:
   uint8_t _pin;
@@ -40,9 +71,31 @@ private:
   
   // Callback
   ButtonCallback _callback;
+  ButtonEventHook _hook;
+  
+  // Interrupt mode: the GPIO ISR stamps the first edge and has the timer
+  // service task start a periodic esp_timer that runs the state machine
+  // until the button is idle again
+  bool _interruptMode;
+  QueueHandle_t _queue;
+  esp_timer_handle_t _timer;
+  portMUX_TYPE _mux;
+  volatile bool _timerActive;
+  volatile bool _startPending; // start handed to the timer service task
+  volatile bool _edgePending;
+  volatile uint32_t _edgeTime;
+  uint32_t _stateEdgeTime;
+  ButtonLatencyStats _stats;
   
   // Helper functions
   bool readButtonState();
+  void process(bool reading, unsigned long currentTime);
+  void emit(ButtonState state);
+  void onTick();
+  void startTimer();
+  static void IRAM_ATTR isrEntry(void *arg);
+  static void deferredStart(void *arg, uint32_t);
+  static void timerEntry(void *arg);
   
 public:
   SOSButton_Driver(uint8_t pin, bool pullupEnabled = true, bool activeHigh = false);
@@ -50,11 +103,24 @@ public:
   // Initialization
   void begin();
   
+  // Interrupt mode (instead of begin()): debounce, long and double press are
+  // timed by a GPIO interrupt and a hardware timer, independent of how often
+  // update() runs. Events go through a FreeRTOS queue; update() drains it and
+  // calls the callback, or consumers read it with pollEvent().
+  bool beginInterrupt(uint8_t queueLength = SOS_QUEUE_LENGTH);
+  bool isInterruptMode() { return _interruptMode; }
+  bool pollEvent(ButtonEvent &event, uint32_t timeout_ms = 0);
+  QueueHandle_t getEventQueue() { return _queue; }
+  bool isActive() { return _timerActive; } // A press is being timed
+  void getLatencyStats(ButtonLatencyStats &out);
+  
   // Configuration
   void setDebounceDelay(unsigned long ms);
   void setLongPressThreshold(unsigned long ms);
   void setDoublePressInterval(unsigned long ms);
+  unsigned long getDoublePressInterval() { return _doublePressInterval; }
   void setCallback(ButtonCallback callback);
+  void setEventHook(ButtonEventHook hook); // Interrupt mode only
   
   // State reading
   void update();
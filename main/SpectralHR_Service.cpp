@@ -0,0 +1,298 @@
+#include "SpectralHR_Service.h"
+#include "profiler.h"
+
+SpectralHR_Service::SpectralHR_Service()
+{
+  _sampleRate = 0;
+  _decimation = 1;
+  _decimatedRate = 0;
+  _bins = 0;
+  for (int i = 0; i < SHR_WINDOW; i++)
+  {
+    _window[i] = 0;
+  }
+  for (int k = 0; k < SHR_BINS; k++)
+  {
+    _coeff[k] = 0;
+  }
+  _lastUpdate = 0;
+  reset();
+}
+
+void SpectralHR_Service::begin(float sampleRate)
+{
+  // Hann window
+  for (int i = 0; i < SHR_WINDOW; i++)
+  {
+    _window[i] = 0.5f - 0.5f * cosf(2.0f * PI * i / (SHR_WINDOW - 1));
+  }
+  _sampleRate = 0;
+  setSampleRate(sampleRate);
+}
+
+void SpectralHR_Service::setSampleRate(float sampleRate)
+{
+  if (sampleRate == _sampleRate)
+  {
+    return;
+  }
+  _sampleRate = sampleRate;
+
+  int decimation = (int)(sampleRate / SHR_TARGET_RATE);
+  _decimation = (uint8_t)constrain(decimation, 1, 255);
+  _decimatedRate = sampleRate / _decimation;
+
+  // Goertzel coefficients for the bins the decimated rate can represent
+  _bins = 0;
+  for (int k = 0; k < SHR_BINS; k++)
+  {
+    float f = SHR_MIN_HZ + k * SHR_BIN_HZ;
+    if (f >= 0.5f * _decimatedRate)
+    {
+      break;
+    }
+    _coeff[k] = 2.0f * cosf(2.0f * PI * f / _decimatedRate);
+    _bins++;
+  }
+
+  reset();
+}
+
+void SpectralHR_Service::reset()
+{
+  _accum = 0;
+  _accumCount = 0;
+  _head = 0;
+  _count = 0;
+  for (int i = 0; i < SHR_WINDOW; i++)
+  {
+    _buffer[i] = 0;
+  }
+  for (int k = 0; k < SHR_BINS; k++)
+  {
+    _power[k] = 0;
+  }
+  _data.heartRate = 0;
+  _data.confidence = 0;
+  _data.validReading = false;
+  _data.timestamp = 0;
+  _track = 0;
+  _jumpCount = 0;
+  _misses = 0;
+}
+
+void SpectralHR_Service::addSample(uint32_t ir)
+{
+  _accum += ir;
+  if (++_accumCount < _decimation)
+  {
+    return;
+  }
+
+  _buffer[_head] = (float)_accum / _decimation;
+  _head = (_head + 1) % SHR_WINDOW;
+  if (_count < SHR_WINDOW)
+  {
+    _count++;
+  }
+  _accum = 0;
+  _accumCount = 0;
+}
+
+bool SpectralHR_Service::update(uint32_t now)
+{
+  if (now - _lastUpdate < SHR_UPDATE_MS)
+  {
+    return false;
+  }
+  _lastUpdate = now;
+
+  if (!isReady() || _bins < 3)
+  {
+    _data.validReading = false;
+    return false;
+  }
+
+  PROF_SCOPE("HR spectral");
+  computeSpectrum();
+
+  int peak = _track > 0 ? trackedPeak() : strongestPeak();
+
+  // Confidence: how much of the band power sits in the chosen peak
+  float total = 0;
+  float inPeak = 0;
+  for (int k = 0; k < _bins; k++)
+  {
+    total += _power[k];
+    if (abs(k - peak) <= SHR_PEAK_BINS)
+    {
+      inPeak += _power[k];
+    }
+  }
+  float confidence = total > 0 ? 100.0f * inPeak / total : 0;
+
+  // Parabolic interpolation on the magnitudes around the peak bin
+  float offset = 0;
+  if (peak > 0 && peak < _bins - 1)
+  {
+    float a = sqrtf(_power[peak - 1]);
+    float b = sqrtf(_power[peak]);
+    float c = sqrtf(_power[peak + 1]);
+    float denom = a - 2.0f * b + c;
+    if (denom < 0)
+    {
+      offset = constrain(0.5f * (a - c) / denom, -0.5f, 0.5f);
+    }
+  }
+
+  _data.confidence = confidence;
+  _data.timestamp = now;
+  _data.validReading = confidence >= SHR_MIN_CONFIDENCE;
+  if (_data.validReading)
+  {
+    _data.heartRate = binBpm(peak + offset);
+    _track = _data.heartRate;
+    _misses = 0;
+  }
+  else if (++_misses >= SHR_TRACK_TIMEOUT)
+  {
+    _track = 0;
+    _jumpCount = 0;
+  }
+
+  return true;
+}
+
+SpectralHRData SpectralHR_Service::getReadings()
+{
+  return _data;
+}
+
+bool SpectralHR_Service::isReady()
+{
+  return _count >= SHR_WINDOW;
+}
+
+// Private helper functions
+
+void SpectralHR_Service::computeSpectrum()
+{
+  // Oldest sample first (_head is the oldest once the ring is full). Remove
+  // the mean and the linear trend (baseline wander), then window.
+  const float mid = (SHR_WINDOW - 1) * 0.5f;
+  float sum = 0;
+  float sumTY = 0;
+  for (int i = 0; i < SHR_WINDOW; i++)
+  {
+    float y = _buffer[(_head + i) % SHR_WINDOW];
+    _work[i] = y;
+    sum += y;
+    sumTY += (i - mid) * y;
+  }
+  const float mean = sum / SHR_WINDOW;
+  const float sumTT = (float)SHR_WINDOW * ((float)SHR_WINDOW * SHR_WINDOW - 1.0f) / 12.0f;
+  const float slope = sumTY / sumTT;
+  for (int i = 0; i < SHR_WINDOW; i++)
+  {
+    _work[i] = (_work[i] - mean - slope * (i - mid)) * _window[i];
+  }
+
+  // Goertzel, one bin at a time
+  for (int k = 0; k < _bins; k++)
+  {
+    const float coeff = _coeff[k];
+    float s1 = 0;
+    float s2 = 0;
+    for (int i = 0; i < SHR_WINDOW; i++)
+    {
+      float s0 = _work[i] + coeff * s1 - s2;
+      s2 = s1;
+      s1 = s0;
+    }
+    _power[k] = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+  }
+  for (int k = _bins; k < SHR_BINS; k++)
+  {
+    _power[k] = 0;
+  }
+}
+
+int SpectralHR_Service::strongestPeak()
+{
+  int best = 0;
+  for (int k = 1; k < _bins; k++)
+  {
+    if (_power[k] > _power[best])
+    {
+      best = k;
+    }
+  }
+
+  // The dicrotic notch gives the pulse a strong 2nd harmonic; if there is
+  // real power at half the frequency, that is the heart rate
+  float half = ((SHR_MIN_HZ + best * SHR_BIN_HZ) * 0.5f - SHR_MIN_HZ) / SHR_BIN_HZ;
+  int h = (int)lroundf(half);
+  if (h >= 0)
+  {
+    int sub = -1;
+    for (int k = max(0, h - 1); k <= min(_bins - 1, h + 1); k++)
+    {
+      if (sub < 0 || _power[k] > _power[sub])
+      {
+        sub = k;
+      }
+    }
+    if (sub >= 0 && _power[sub] >= SHR_HARMONIC_RATIO * _power[best])
+    {
+      best = sub;
+    }
+  }
+  return best;
+}
+
+int SpectralHR_Service::trackedPeak()
+{
+  const int strongest = strongestPeak();
+
+  // Local maxima, weighted by their distance from the tracked rate
+  int best = -1;
+  float bestScore = 0;
+  for (int k = 0; k < _bins; k++)
+  {
+    if ((k > 0 && _power[k] < _power[k - 1]) || (k < _bins - 1 && _power[k] < _power[k + 1]))
+    {
+      continue;
+    }
+    float d = (binBpm(k) - _track) / SHR_TRACK_BPM;
+    float score = _power[k] / (1.0f + d * d);
+    if (best < 0 || score > bestScore)
+    {
+      best = k;
+      bestScore = score;
+    }
+  }
+  if (best < 0)
+  {
+    return strongest;
+  }
+
+  // A different peak has to keep winning before the track moves to it
+  if (fabsf(binBpm(strongest) - binBpm(best)) > SHR_TRACK_BPM)
+  {
+    if (++_jumpCount >= SHR_JUMP_UPDATES)
+    {
+      _jumpCount = 0;
+      return strongest;
+    }
+  }
+  else
+  {
+    _jumpCount = 0;
+  }
+  return best;
+}
+
+float SpectralHR_Service::binBpm(float bin)
+{
+  return (SHR_MIN_HZ + bin * SHR_BIN_HZ) * 60.0f;
+}
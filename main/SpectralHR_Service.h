@@ -0,0 +1,102 @@
+#ifndef SPECTRALHR_SERVICE_H
+#define SPECTRALHR_SERVICE_H
+
+#include <Arduino.h>
+
+// Spectral heart-rate estimator configuration
+#define SHR_WINDOW 128            // Decimated samples per estimate (~10 s)
+#define SHR_TARGET_RATE 10.0f     // Decimate to no less than this many samples per second
+#define SHR_MIN_HZ 0.7f           // Search band: 42 bpm ...
+#define SHR_MAX_HZ 3.5f           // ... to 210 bpm
+#define SHR_BIN_HZ 0.1f           // Goertzel bin spacing (6 bpm), refined by interpolation
+#define SHR_BINS 29               // (SHR_MAX_HZ - SHR_MIN_HZ) / SHR_BIN_HZ + 1
+#define SHR_PEAK_BINS 2           // Bins either side counted as the peak (Hann main lobe)
+#define SHR_UPDATE_MS 1000        // One estimate per second
+#define SHR_MIN_CONFIDENCE 30.0f  // Below this the estimate is not valid
+#define SHR_HARMONIC_RATIO 0.4f   // Sub-harmonic power (vs the peak) that marks the peak as a 2nd harmonic
+#define SHR_TRACK_BPM 15.0f       // Distance from the tracked rate at which a peak's weight halves
+#define SHR_JUMP_UPDATES 3        // Consecutive estimates an off-track peak must win to take over
+#define SHR_TRACK_TIMEOUT 5       // Invalid estimates after which the track is dropped
+
+struct SpectralHRData
+{
+  float heartRate;    // Heart rate in BPM (0 until the first valid estimate)
+  float confidence;   // Share of the band power in the chosen peak (0-100%)
+  bool validReading;  // Window full and confidence above SHR_MIN_CONFIDENCE
+  uint32_t timestamp; // millis() of the estimate
+};
+
+// Heart rate from the spectrum of the IR signal instead of individual beats.
+//
+// addSample() only box-car decimates the input to about SHR_TARGET_RATE and
+// stores it. update() runs once per SHR_UPDATE_MS: the last SHR_WINDOW
+// decimated samples are detrended and Hann windowed, and a bank of Goertzel
+// bins over SHR_MIN_HZ..SHR_MAX_HZ gives the power spectrum. The strongest
+// peak (or its sub-harmonic, when the pulse's 2nd harmonic dominates) is
+// refined by parabolic interpolation. Once there is an estimate, peaks are
+// weighted by their distance from it, so a short motion burst cannot pull
+// the rate away; a different peak takes over only after winning
+// SHR_JUMP_UPDATES times in a row.
+class SpectralHR_Service
+{
+private:
+  // Decimation
+  float _sampleRate;
+  uint8_t _decimation;
+  float _decimatedRate;
+  uint64_t _accum;
+  uint8_t _accumCount;
+
+  // Decimated samples (ring) and scratch for the windowed copy
+  float _buffer[SHR_WINDOW];
+  uint8_t _head;
+  uint8_t _count;
+  float _work[SHR_WINDOW];
+  float _window[SHR_WINDOW];
+
+  // Goertzel bins below the decimated Nyquist frequency
+  float _coeff[SHR_BINS];
+  float _power[SHR_BINS];
+  uint8_t _bins;
+
+  // Estimate and peak tracking
+  SpectralHRData _data;
+  uint32_t _lastUpdate;
+  float _track;
+  uint8_t _jumpCount;
+  uint8_t _misses;
+
+  void computeSpectrum();
+  int strongestPeak();
+  int trackedPeak();
+  float binBpm(float bin);
+
+public:
+  SpectralHR_Service();
+
+  // Initialize for an input rate in samples per second
+  void begin(float sampleRate);
+
+  // Input rate change (power profiles); drops buffered samples if it differs
+  void setSampleRate(float sampleRate);
+
+  // Drop buffered samples and the tracked rate (front-end change, reset)
+  void reset();
+
+  // Add one IR sample (cheap; the spectrum is computed in update())
+  void addSample(uint32_t ir);
+
+  // Estimate if SHR_UPDATE_MS has passed since the last one. Returns true
+  // when a new estimate was made.
+  bool update(uint32_t now);
+
+  SpectralHRData getReadings();
+
+  // True once a full window of decimated samples is buffered
+  bool isReady();
+
+  // Power per bin of the last estimate, SHR_BINS entries from SHR_MIN_HZ
+  const float *getSpectrum() { return _power; }
+};
+
+#endif // SPECTRALHR_SERVICE_H
@@ -0,0 +1,60 @@
+#include "alert_engine.h"
+
+// The device's alert state (state machine in alert_state.cpp)
+static AlertEngine g_engine;
+static bool g_log = true;
+
+static bool raiseOnUplink(UplinkAlertKind kind, uint32_t eventMs, void *ctx) {
+  (void)ctx;
+  return Uplink_raiseAlert(kind, eventMs);
+}
+
+void Alert_init(bool serialLogging) {
+  g_log = serialLogging;
+  g_engine.begin(raiseOnUplink, nullptr, serialLogging);
+  if (g_log) {
+    Serial.println(F("[Alert] Init"));
+  }
+}
+
+bool Alert_update(AlertCondition c, float value, uint32_t now, uint32_t span_ms) {
+  return g_engine.update(c, value, now, span_ms);
+}
+
+void Alert_service(uint32_t now) {
+  g_engine.service(now);
+}
+
+void Alert_latchSOS() {
+  g_engine.latchSOS();
+}
+
+bool Alert_active() {
+  return g_engine.active();
+}
+
+bool Alert_isActive(AlertCondition c) {
+  return g_engine.isActive(c);
+}
+
+bool Alert_latched() {
+  return g_engine.latched();
+}
+
+uint8_t Alert_acknowledge() {
+  return g_engine.acknowledge();
+}
+
+void Alert_getStats(AlertEngineStats &out) {
+  out = g_engine.stats();
+}
+
+void Alert_printStats() {
+  const AlertEngineStats &st = g_engine.stats();
+  Serial.printf("[Alert] entered fall %lu, risk %lu, off-course %lu | %lu raised, %lu deferred (max %lu ms), "
+                "%lu short excursions ignored, %lu acknowledged%s\n",
+                (unsigned long)st.entered[ALERT_COND_FALL], (unsigned long)st.entered[ALERT_COND_RISK],
+                (unsigned long)st.entered[ALERT_COND_OFF_COURSE], (unsigned long)st.raised,
+                (unsigned long)st.deferred, (unsigned long)st.maxDefer_ms, (unsigned long)st.ignored,
+                (unsigned long)st.acknowledged, Alert_active() ? " | ACTIVE" : "");
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <Arduino.h>
+#include "uplink.h"
+
+// Alert state machine for the IMU and vitals conditions.
+//
+// Each condition is fed one measurement per evaluation and moves through
+// idle -> active -> (latched) -> idle:
+//   - it becomes active once the value has stayed at/above its enter level
+//     for enterDwell_ms, so a single bump or noisy sample does not raise it;
+//   - it clears once the value has stayed at/below its exit level (below the
+//     enter level: hysteresis) for exitDwell_ms;
+//   - latching conditions stay raised after they clear, until acknowledged
+//     (Alert_acknowledge(), a short button press on the device).
+// While any condition is active or latched, telemetry goes out as 'a' frames.
+//
+// Entering a condition raises one event on the uplink priority path
+// (Uplink_raiseAlert) at most once per condition per minInterval_ms, and all
+// conditions share a token bucket of ALERT_BURST events refilled every
+// ALERT_REFILL_MS. Events over either limit are deferred, not dropped: they
+// go out with their original trigger time once the limit allows, as do
+// events the uplink had no free slot for. SOS does not go through here; the
+// button raises it directly and latches it with Alert_latchSOS(), so
+// telemetry stays on 'a' frames until it is acknowledged like any latch.
+
+#define ALERT_BURST 3            // events that may go out back to back
+#define ALERT_REFILL_MS 60000    // one more event allowed per minute after that
+
+enum AlertCondition : uint8_t {
+  ALERT_COND_FALL,        // gyro rate (dps), max of roll and pitch
+  ALERT_COND_RISK,        // risk score 0-100
+  ALERT_COND_OFF_COURSE,  // 1 while course_monitor reports off course, else 0
+  ALERT_COND_COUNT
+};
+
+struct AlertRule {
+  const char *name;
+  UplinkAlertKind kind;
+  float enter;              // active once value >= enter ...
+  uint16_t enterDwell_ms;   // ... for this long
+  float exit;               // clears once value <= exit ...
+  uint16_t exitDwell_ms;    // ... for this long
+  bool latch;               // stays raised until acknowledged
+  uint32_t minInterval_ms;  // between events of this condition
+};
+
+struct AlertEngineStats {
+  uint32_t entered[ALERT_COND_COUNT];  // transitions to active
+  uint32_t ignored;         // excursions over the enter level shorter than the dwell
+  uint32_t raised;          // events handed to the uplink
+  uint32_t deferred;        // events held back by the rate limit or a full uplink
+  uint32_t acknowledged;
+  uint32_t maxDefer_ms;     // longest hold-back of a deferred event
+};
+
+// Alert state for one device. Events are handed to `raise` (the uplink on
+// the device, Uplink_raiseAlert); it returns false when it has no room and
+// the event is retried on the next service(). The state machine has no other
+// outside dependencies, so host tools run it per session
+// (tools/session_pipeline.h). Implemented in alert_state.cpp.
+class AlertEngine {
+public:
+  typedef bool (*RaiseFn)(UplinkAlertKind kind, uint32_t eventMs, void *ctx);
+
+  void begin(RaiseFn raise, void *ctx, bool serialLogging = false);
+
+  bool update(AlertCondition c, float value, uint32_t now, uint32_t span_ms = 0);
+  void service(uint32_t now);
+  void latchSOS() { _sosLatched = true; }
+  bool active() const;
+  bool isActive(AlertCondition c) const;
+  bool latched() const;
+  uint8_t acknowledge();
+  const AlertEngineStats &stats() const { return _stats; }
+
+private:
+  struct ConditionState {
+    bool active;
+    bool latched;
+    bool over;           // at/above enter, waiting out the enter dwell
+    bool under;          // at/below exit, waiting out the exit dwell
+    bool pending;        // event waiting for the rate limit or an uplink slot
+    bool haveEvent;
+    uint32_t overSince;
+    uint32_t underSince;
+    uint32_t eventMs;    // trigger time of the pending / last event
+    uint32_t pendingSince;
+  };
+
+  RaiseFn _raise = nullptr;
+  void *_ctx = nullptr;
+  bool _inited = false;
+  bool _log = false;
+  ConditionState _cond[ALERT_COND_COUNT];
+  volatile bool _sosLatched = false;  // set from the button timer task
+  uint8_t _tokens = ALERT_BURST;
+  uint32_t _refillAt = 0;
+  AlertEngineStats _stats;
+
+  void refill(uint32_t now);
+  void raisePending(uint32_t now);
+  void enter(AlertCondition c, uint32_t now);
+};
+
+// ======= Device instance, raising on the uplink =======
+
+void Alert_init(bool serialLogging = true);
+
+// One measurement of a condition at `now` (millis()). A value averaged over
+// an interval (span_ms up to now) counts as over the level for all of it, so
+// sparse readings can meet the enter dwell. Returns true when the condition
+// became active on this call.
+bool Alert_update(AlertCondition c, float value, uint32_t now, uint32_t span_ms = 0);
+
+// Raise deferred events the rate limit allows by now. Call every loop.
+void Alert_service(uint32_t now);
+
+// SOS sent by the button: latched until Alert_acknowledge(). Safe from the
+// button timer task.
+void Alert_latchSOS();
+
+// Any condition active or latched, or SOS latched ('a' telemetry frames)
+bool Alert_active();
+bool Alert_isActive(AlertCondition c);
+bool Alert_latched();
+
+// Clear latched conditions and SOS; conditions still over their exit level
+// stay active until they clear. Returns the number of latches cleared.
+uint8_t Alert_acknowledge();
+
+const AlertRule &Alert_rule(AlertCondition c);
+void Alert_getStats(AlertEngineStats &out);
+void Alert_printStats();
@@ -0,0 +1,159 @@
+#include "alert_engine.h"
+#include "RiskScore_Service.h"
+
+// Per-condition minInterval_ms must not be shorter than UPLINK_HOLDOFF_MS, or
+// the uplink would fold a deferred event into the previous one of its kind.
+static const AlertRule RULES[ALERT_COND_COUNT] = {
+  //  name        kind                     enter                 dwell  exit                       dwell  latch  interval
+  {"fall",       UPLINK_ALERT_FALL,       100.0f,                  40,  60.0f,                      1000, true,   10000},
+  {"risk",       UPLINK_ALERT_RISK,       RISK_ALERT_THRESHOLD,  5000,  RISK_ALERT_THRESHOLD - 10,  30000, false, 300000},
+  {"off-course", UPLINK_ALERT_OFF_COURSE, 1.0f,                     0,  0.0f,                          0, false,  60000},
+};
+
+const AlertRule &Alert_rule(AlertCondition c) {
+  return RULES[c < ALERT_COND_COUNT ? c : 0];
+}
+
+void AlertEngine::begin(RaiseFn raise, void *ctx, bool serialLogging) {
+  _raise = raise;
+  _ctx = ctx;
+  _inited = true;
+  _log = serialLogging;
+  memset(_cond, 0, sizeof(_cond));
+  _sosLatched = false;
+  memset(&_stats, 0, sizeof(_stats));
+  _tokens = ALERT_BURST;
+  _refillAt = 0;
+}
+
+void AlertEngine::refill(uint32_t now) {
+  while (_tokens < ALERT_BURST && (int32_t)(now - _refillAt) >= 0) {
+    _tokens++;
+    _refillAt += ALERT_REFILL_MS;
+  }
+}
+
+// Hand pending events to the uplink, oldest trigger first, while tokens last
+void AlertEngine::raisePending(uint32_t now) {
+  refill(now);
+  while (_tokens > 0) {
+    int next = -1;
+    for (int c = 0; c < ALERT_COND_COUNT; c++) {
+      if (!_cond[c].pending) continue;
+      if (next < 0 || (int32_t)(_cond[c].eventMs - _cond[next].eventMs) < 0) next = c;
+    }
+    if (next < 0) return;
+
+    ConditionState &s = _cond[next];
+    if (!_raise(RULES[next].kind, s.eventMs, _ctx)) return;  // no free slot: retry next loop
+    if (_tokens == ALERT_BURST) _refillAt = now + ALERT_REFILL_MS;
+    _tokens--;
+    s.pending = false;
+    _stats.raised++;
+    if (now - s.pendingSince > _stats.maxDefer_ms) _stats.maxDefer_ms = now - s.pendingSince;
+    if (_log) {
+      Serial.printf("[Alert] %s raised (%lu ms after trigger)\n", RULES[next].name, (unsigned long)(now - s.eventMs));
+    }
+  }
+}
+
+void AlertEngine::enter(AlertCondition c, uint32_t now) {
+  ConditionState &s = _cond[c];
+  const AlertRule &r = RULES[c];
+  s.active = true;
+  s.under = false;
+  if (r.latch) s.latched = true;
+  _stats.entered[c]++;
+
+  // Back within minInterval of the last event (or that one is still
+  // waiting): same episode, the 'a' frames already carry it
+  if (s.pending || (s.haveEvent && s.overSince - s.eventMs < r.minInterval_ms)) return;
+  s.pending = true;
+  s.haveEvent = true;
+  s.eventMs = s.overSince;  // trigger time is the first sample over the level
+  s.pendingSince = now;
+  raisePending(now);
+  if (s.pending) _stats.deferred++;
+}
+
+bool AlertEngine::update(AlertCondition c, float value, uint32_t now, uint32_t span_ms) {
+  if (!_inited || c >= ALERT_COND_COUNT || isnan(value)) return false;
+  ConditionState &s = _cond[c];
+  const AlertRule &r = RULES[c];
+
+  if (!s.active) {
+    if (value < r.enter) {
+      if (s.over) _stats.ignored++;
+      s.over = false;
+      return false;
+    }
+    if (!s.over) {
+      s.over = true;
+      s.overSince = now - span_ms;
+    }
+    if (now - s.overSince < r.enterDwell_ms) return false;
+    enter(c, now);
+    return true;
+  }
+
+  if (value > r.exit) {
+    s.under = false;
+    return false;
+  }
+  if (!s.under) {
+    s.under = true;
+    s.underSince = now;
+  }
+  if (now - s.underSince >= r.exitDwell_ms) {
+    s.active = false;
+    s.over = false;
+    s.under = false;
+    if (_log) {
+      Serial.printf("[Alert] %s cleared%s\n", r.name, s.latched ? ", latched until acknowledged" : "");
+    }
+  }
+  return false;
+}
+
+void AlertEngine::service(uint32_t now) {
+  if (!_inited) return;
+  raisePending(now);
+}
+
+bool AlertEngine::active() const {
+  if (_sosLatched) return true;
+  for (int c = 0; c < ALERT_COND_COUNT; c++) {
+    if (_cond[c].active || _cond[c].latched) return true;
+  }
+  return false;
+}
+
+bool AlertEngine::isActive(AlertCondition c) const {
+  return c < ALERT_COND_COUNT && (_cond[c].active || _cond[c].latched);
+}
+
+bool AlertEngine::latched() const {
+  if (_sosLatched) return true;
+  for (int c = 0; c < ALERT_COND_COUNT; c++) {
+    if (_cond[c].latched) return true;
+  }
+  return false;
+}
+
+uint8_t AlertEngine::acknowledge() {
+  uint8_t cleared = 0;
+  if (_sosLatched) {
+    _sosLatched = false;
+    cleared++;
+  }
+  for (int c = 0; c < ALERT_COND_COUNT; c++) {
+    if (!_cond[c].latched) continue;
+    _cond[c].latched = false;
+    cleared++;
+  }
+  _stats.acknowledged += cleared;
+  if (_log && cleared > 0) {
+    Serial.printf("[Alert] acknowledged %u\n", cleared);
+  }
+  return cleared;
+}
@@ -0,0 +1,203 @@
+#include "blackbox.h"
+#include "recorder.h"
+#include "session_format.h"
+
+// Output stream of the recorder. write() is called from the writer task
+// only: the file header once, then one call per chunk.
+class SegmentSink : public Stream {
+public:
+  using Stream::write;
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t *buf, size_t len) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override;
+};
+
+static SegmentSink g_sink;
+static fs::FS *g_fs = nullptr;
+static File g_file;
+static bool g_running = false;
+static uint32_t g_first = 0;   // oldest segment still on flash
+static uint32_t g_next = 0;    // number of the next segment to open
+static uint32_t g_segments = BLACKBOX_MIN_SEGMENTS;  // ring size
+static uint32_t g_segmentBytes = 0;
+static uint8_t g_header[SESSION_FILE_HEADER_SIZE];
+static uint16_t g_headerLen = 0;
+static uint8_t g_block[BLACKBOX_BLOCK_BYTES] __attribute__((aligned(4)));
+static uint16_t g_staged = 0;
+static uint32_t g_rollSession = 0;  // headers restarted; the next segment opens at this session's first chunk
+static BlackBoxStats g_stats;
+
+// Chunks already queued or open when the headers restart still go into the
+// current segment: room for all of them
+static const uint32_t ROLL_MARGIN = (RECORDER_BUFFERS + 1) * RECORDER_CHUNK_BYTES;
+
+static void segmentPath(char *path, size_t len, uint32_t seq) {
+  snprintf(path, len, BLACKBOX_DIR "/%08lu.ses", (unsigned long)seq);
+}
+
+// Make room when the filesystem is full: delete the oldest segment (never
+// the open one) and keep the ring that much shorter from now on
+static bool dropOldest() {
+  if (g_next - g_first <= 1) return false;
+  char path[32];
+  segmentPath(path, sizeof(path), g_first++);
+  if (!g_fs->remove(path)) return false;
+  g_stats.deleted++;
+  g_segments = max((uint32_t)BLACKBOX_MIN_SEGMENTS, min(g_segments, g_next - g_first));
+  g_stats.ringSegments = g_segments;
+  return true;
+}
+
+static void writeBlock() {
+  if (g_staged == 0 || !g_file) return;
+  uint32_t start = micros();
+  size_t n = g_file.write(g_block, g_staged);
+  if (n < g_staged && dropOldest()) n += g_file.write(g_block + n, g_staged - n);
+  g_file.flush();
+  uint32_t took = micros() - start;
+  if (n != g_staged) g_stats.writeErrors++;
+  if (g_staged == BLACKBOX_BLOCK_BYTES) g_stats.blocks++;
+  if (took > g_stats.maxBlock_us) g_stats.maxBlock_us = took;
+  g_stats.bytes += n;
+  g_segmentBytes += g_staged;
+  g_staged = 0;
+}
+
+static void stage(const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    size_t n = min(len, (size_t)(BLACKBOX_BLOCK_BYTES - g_staged));
+    memcpy(g_block + g_staged, buf, n);
+    g_staged += n;
+    buf += n;
+    len -= n;
+    if (g_staged == BLACKBOX_BLOCK_BYTES) writeBlock();
+  }
+}
+
+// Close the current segment and start the next with the file header. The
+// modules' stream headers come in the first chunks of the new session.
+static bool openSegment() {
+  writeBlock();
+  if (g_file) g_file.close();
+
+  char path[32];
+  while (g_next - g_first >= g_segments) {
+    segmentPath(path, sizeof(path), g_first++);
+    if (g_fs->remove(path)) g_stats.deleted++;
+  }
+  segmentPath(path, sizeof(path), g_next++);
+  g_file = g_fs->open(path, FILE_WRITE);
+  if (!g_file && dropOldest()) g_file = g_fs->open(path, FILE_WRITE);
+  if (!g_file) {
+    g_stats.writeErrors++;
+    return false;
+  }
+  g_stats.segments++;
+  g_segmentBytes = 0;
+  stage(g_header, g_headerLen);
+  return true;
+}
+
+size_t SegmentSink::write(const uint8_t *buf, size_t len) {
+  // The recorder writes the file header first, as one piece: keep it for
+  // the start of every segment
+  if (g_headerLen == 0 && len == SESSION_FILE_HEADER_SIZE) {
+    memcpy(g_header, buf, len);
+    g_headerLen = len;
+    return openSegment() ? len : 0;
+  }
+  const uint32_t size = g_segmentBytes + g_staged + len;
+  if (g_rollSession == 0 && size + ROLL_MARGIN > BLACKBOX_SEGMENT_BYTES) {
+    // Nearly full: let the modules write their headers again and switch at
+    // the first chunk that can carry them
+    Recorder_restartHeaders();
+    g_rollSession = Recorder_session();
+  }
+  if (g_rollSession != 0 && Recorder_chunkSession() == g_rollSession) {
+    g_rollSession = 0;
+    if (!openSegment()) return 0;
+  }
+  if (!g_file) return 0;
+  stage(buf, len);
+  return len;
+}
+
+void SegmentSink::flush() {
+  writeBlock();
+}
+
+// Continue numbering after the newest segment already on flash
+static void scanRing() {
+  g_first = g_next = 0;
+  bool any = false;
+  File dir = g_fs->open(BLACKBOX_DIR);
+  if (!dir || !dir.isDirectory()) {
+    g_fs->mkdir(BLACKBOX_DIR);
+    return;
+  }
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    const char *name = f.name();
+    const char *slash = strrchr(name, '/');
+    if (slash) name = slash + 1;
+    char *end;
+    uint32_t seq = strtoul(name, &end, 10);
+    f.close();
+    if (end == name || strcmp(end, ".ses") != 0) continue;
+    if (!any || seq < g_first) g_first = seq;
+    if (!any || seq + 1 > g_next) g_next = seq + 1;
+    any = true;
+  }
+  dir.close();
+}
+
+bool BlackBox_begin(fs::FS &fs, int32_t deviceId, size_t capacityBytes) {
+  if (g_running || Recorder_session() != 0) return false;
+  if (capacityBytes < (size_t)BLACKBOX_MIN_SEGMENTS * BLACKBOX_SEGMENT_BYTES) {
+    Serial.printf("[BlackBox] %u KB is too small for a ring\n", (unsigned)(capacityBytes / 1024));
+    return false;
+  }
+  g_fs = &fs;
+  memset(&g_stats, 0, sizeof(g_stats));
+  g_segments = min((size_t)BLACKBOX_MAX_SEGMENTS, capacityBytes / BLACKBOX_SEGMENT_BYTES);
+  g_stats.ringSegments = g_segments;
+  g_headerLen = 0;
+  g_staged = 0;
+  g_rollSession = 0;
+  scanRing();
+  if (!Recorder_start(g_sink, deviceId, /*startTask=*/true, /*compress=*/true, BLACKBOX_IMU_WINDOW_US)) {
+    if (g_file) g_file.close();
+    return false;
+  }
+  g_running = true;
+  Serial.printf("[BlackBox] recording to " BLACKBOX_DIR ", segment %lu, ring of %lu\n", (unsigned long)(g_next - 1),
+                (unsigned long)g_segments);
+  return true;
+}
+
+void BlackBox_end() {
+  if (!g_running) return;
+  Recorder_stop();  // drains and flushes the sink
+  g_file.close();
+  g_running = false;
+}
+
+bool BlackBox_running() {
+  return g_running;
+}
+
+void BlackBox_getStats(BlackBoxStats &out) {
+  out = g_stats;
+}
+
+void BlackBox_printStats() {
+  Serial.printf("[BlackBox] %s | segment %lu (%lu of %lu on flash, %lu deleted) at %lu KB | %lu blocks, %.1f KB "
+                "written | block write max %.1f ms | %lu errors\n",
+                g_running ? "recording" : "idle", (unsigned long)(g_next - 1), (unsigned long)(g_next - g_first),
+                (unsigned long)g_segments, (unsigned long)g_stats.deleted, (unsigned long)((g_segmentBytes + g_staged) / 1024),
+                (unsigned long)g_stats.blocks, g_stats.bytes / 1024.0f, g_stats.maxBlock_us / 1000.0f,
+                (unsigned long)g_stats.writeErrors);
+  Recorder_printStats();
+}
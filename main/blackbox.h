@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+// Always-on black-box recording of the raw sensor streams.
+//
+// Runs the recorder (recorder.h) with chunk coding on into a ring of segment
+// files BLACKBOX_DIR/<seq>.ses on flash or SD. Each segment is a complete
+// session file (same file header, PPG and IMU headers written again at its
+// start), so any segment can be read on its own by session_replay, and
+// tools/blackbox_extract.cpp stitches a time window out of the ring.
+//
+// The writer task stages chunks into a BLACKBOX_BLOCK_BYTES block and writes
+// whole blocks, so the filesystem sees few, aligned writes while the loop
+// task keeps filling the recorder's other chunk buffers. When a segment is
+// nearly BLACKBOX_SEGMENT_BYTES the headers are restarted, and the next
+// segment opens at the first chunk recorded after that; the ring keeps
+// as many segments as fit in the capacity given to BlackBox_begin() (at most
+// BLACKBOX_MAX_SEGMENTS) and deletes the oldest to open a new one. If a write
+// or open still fails (the filesystem is shared and fuller than planned) the
+// oldest segment is deleted, the write retried and the ring stays one segment
+// shorter. After a reset the ring carries on after the newest segment found.
+//
+// PPG and fixes are kept at full rate. The gyro is averaged over
+// BLACKBOX_IMU_WINDOW_US (recorder.h), a quarter of the 50 Hz ACTIVE rate:
+// angles replay the same, only rate peaks shorter than the window flatten.
+// Coded, a segment then holds about 13 min (6 min with every gyro sample),
+// and the 2.6 MB data partition of main/partitions.csv, less room for a
+// session recording, keeps the last ~2 h. An SD card holds more.
+//
+// Data not yet on flash at a power loss: the recorder's open chunk and full
+// chunks (~1 s at full rate) plus the staged block (a few seconds coded).
+// Each block write is followed by a file flush so the filesystem commits it.
+
+#define BLACKBOX_DIR "/bb"
+#define BLACKBOX_SEGMENT_BYTES (256 * 1024)
+#define BLACKBOX_MIN_SEGMENTS 2        // the open segment and the one before it
+#define BLACKBOX_MAX_SEGMENTS 64
+#define BLACKBOX_BLOCK_BYTES 4096      // flash erase block
+#define BLACKBOX_IMU_WINDOW_US 90000   // under Gyro_integrate()'s 100 ms gap
+
+struct BlackBoxStats {
+  uint32_t segments;     // opened since BlackBox_begin()
+  uint32_t deleted;      // old segments removed to make room
+  uint32_t ringSegments; // segments the ring keeps (capacity, less any shrinking)
+  uint32_t blocks;       // full blocks written
+  uint32_t bytes;        // written to segment files
+  uint32_t writeErrors;
+  uint32_t maxBlock_us;  // longest block write (flush included)
+};
+
+// Start recording into the ring on `fs` (mounted by the caller), using at
+// most capacityBytes of it. Fails if that is less than BLACKBOX_MIN_SEGMENTS.
+bool BlackBox_begin(fs::FS &fs, int32_t deviceId, size_t capacityBytes);
+
+// Stop the recorder and close the current segment.
+void BlackBox_end();
+
+bool BlackBox_running();
+
+void BlackBox_getStats(BlackBoxStats &out);
+void BlackBox_printStats();
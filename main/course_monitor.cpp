@@ -0,0 +1,333 @@
+#include "course_monitor.h"
+#include <math.h>
+#include <stdlib.h>
+#include "profiler.h"
+
+// Course in the local frame; segment i runs from point i to point i + 1
+static GeoFrame g_frame;
+static float *g_east = nullptr;
+static float *g_north = nullptr;
+static float *g_along = nullptr;  // distance along the course at each point
+static uint16_t g_points = 0;
+static uint16_t g_capacity = 0;
+
+// Grid: cell c lists g_cellSegs[g_cellStart[c] .. g_cellStart[c + 1])
+static float g_originE = 0, g_originN = 0;
+static float g_cell = 0;
+static uint16_t g_cols = 0, g_rows = 0;
+static uint32_t *g_cellStart = nullptr;
+static uint16_t *g_cellSegs = nullptr;
+static uint16_t g_maxPerCell = 0;
+
+static CourseStatus g_status;
+static uint8_t g_offCount = 0;
+static uint8_t g_onCount = 0;
+static float g_furthest = 0;  // furthest progress so far
+
+static void freeAll() {
+  free(g_east);
+  free(g_north);
+  free(g_along);
+  free(g_cellStart);
+  free(g_cellSegs);
+  g_east = g_north = g_along = nullptr;
+  g_cellStart = nullptr;
+  g_cellSegs = nullptr;
+  g_points = g_capacity = 0;
+  g_cols = g_rows = 0;
+  g_maxPerCell = 0;
+}
+
+static void resetStatus() {
+  g_status.valid = false;
+  g_status.distance_m = INFINITY;
+  g_status.progress_m = 0;
+  g_status.remaining_m = 0;
+  g_status.offCourse = false;
+  g_status.changed = false;
+  g_offCount = 0;
+  g_onCount = 0;
+  g_furthest = 0;
+}
+
+static bool addPoint(double lat_deg, double lon_deg) {
+  if (g_points == 0) Geo_frame(g_frame, lat_deg, lon_deg);
+  double e, n;
+  Geo_toLocal(g_frame, lat_deg, lon_deg, e, n);
+
+  if (g_points > 0) {
+    float de = (float)e - g_east[g_points - 1];
+    float dn = (float)n - g_north[g_points - 1];
+    if (de * de + dn * dn < COURSE_MIN_SPACING_M * COURSE_MIN_SPACING_M) return true;
+  }
+  if (g_points >= COURSE_MAX_POINTS) return false;
+
+  if (g_points == g_capacity) {
+    uint32_t cap = g_capacity ? (uint32_t)g_capacity * 2 : 256;
+    if (cap > COURSE_MAX_POINTS) cap = COURSE_MAX_POINTS;
+    float *e2 = (float *)realloc(g_east, cap * sizeof(float));
+    if (e2) g_east = e2;
+    float *n2 = (float *)realloc(g_north, cap * sizeof(float));
+    if (n2) g_north = n2;
+    if (!e2 || !n2) return false;
+    g_capacity = (uint16_t)cap;
+  }
+  g_east[g_points] = (float)e;
+  g_north[g_points] = (float)n;
+  g_points++;
+  return true;
+}
+
+// Squared distance from (e, n) to segment s and the fraction along it
+static float segmentDistance2(uint16_t s, float e, float n, float &t) {
+  const float ax = g_east[s], ay = g_north[s];
+  const float dx = g_east[s + 1] - ax, dy = g_north[s + 1] - ay;
+  const float len2 = dx * dx + dy * dy;
+  t = len2 > 0 ? ((e - ax) * dx + (n - ay) * dy) / len2 : 0;
+  t = constrain(t, 0.0f, 1.0f);
+  const float px = ax + t * dx - e, py = ay + t * dy - n;
+  return px * px + py * py;
+}
+
+// Cells a segment is listed in: those whose centre is within the radius plus
+// half a cell diagonal, so every point of the cell within the radius of the
+// segment finds it
+template <class F> static void forEachCell(uint16_t s, F fn) {
+  const float reach = COURSE_INDEX_RADIUS_M + g_cell * 0.7072f;
+  const float e0 = min(g_east[s], g_east[s + 1]) - reach, e1 = max(g_east[s], g_east[s + 1]) + reach;
+  const float n0 = min(g_north[s], g_north[s + 1]) - reach, n1 = max(g_north[s], g_north[s + 1]) + reach;
+  const int c0 = max(0, (int)floorf((e0 - g_originE) / g_cell));
+  const int c1 = min((int)g_cols - 1, (int)floorf((e1 - g_originE) / g_cell));
+  const int r0 = max(0, (int)floorf((n0 - g_originN) / g_cell));
+  const int r1 = min((int)g_rows - 1, (int)floorf((n1 - g_originN) / g_cell));
+  for (int r = r0; r <= r1; r++) {
+    for (int c = c0; c <= c1; c++) {
+      float t;
+      const float ce = g_originE + (c + 0.5f) * g_cell, cn = g_originN + (r + 0.5f) * g_cell;
+      if (segmentDistance2(s, ce, cn, t) <= reach * reach) fn((uint32_t)r * g_cols + c);
+    }
+  }
+}
+
+static bool buildIndex() {
+  // Distance along the course
+  g_along = (float *)malloc(g_points * sizeof(float));
+  if (!g_along) return false;
+  g_along[0] = 0;
+  for (uint16_t i = 1; i < g_points; i++) {
+    g_along[i] = g_along[i - 1] + hypotf(g_east[i] - g_east[i - 1], g_north[i] - g_north[i - 1]);
+  }
+
+  // Grid over the course bounds plus the index radius
+  float minE = g_east[0], maxE = g_east[0], minN = g_north[0], maxN = g_north[0];
+  for (uint16_t i = 1; i < g_points; i++) {
+    minE = min(minE, g_east[i]);
+    maxE = max(maxE, g_east[i]);
+    minN = min(minN, g_north[i]);
+    maxN = max(maxN, g_north[i]);
+  }
+  g_originE = minE - COURSE_INDEX_RADIUS_M;
+  g_originN = minN - COURSE_INDEX_RADIUS_M;
+  const float width = maxE - minE + 2 * COURSE_INDEX_RADIUS_M;
+  const float height = maxN - minN + 2 * COURSE_INDEX_RADIUS_M;
+  g_cell = max(COURSE_MIN_CELL_M, sqrtf(width * height / COURSE_MAX_CELLS));
+  while (ceilf(width / g_cell) * ceilf(height / g_cell) > COURSE_MAX_CELLS) g_cell *= 1.05f;
+  g_cols = (uint16_t)ceilf(width / g_cell);
+  g_rows = (uint16_t)ceilf(height / g_cell);
+  const uint32_t cells = (uint32_t)g_cols * g_rows;
+
+  // Two passes: count per cell, then fill
+  g_cellStart = (uint32_t *)calloc(cells + 1, sizeof(uint32_t));
+  if (!g_cellStart) return false;
+  for (uint16_t s = 0; s + 1 < g_points; s++) {
+    forEachCell(s, [](uint32_t c) { g_cellStart[c + 1]++; });
+  }
+  for (uint32_t c = 0; c < cells; c++) {
+    uint32_t n = g_cellStart[c + 1];
+    if (n > g_maxPerCell) g_maxPerCell = (uint16_t)min(n, (uint32_t)UINT16_MAX);
+    g_cellStart[c + 1] += g_cellStart[c];
+  }
+  g_cellSegs = (uint16_t *)malloc(max(g_cellStart[cells], (uint32_t)1) * sizeof(uint16_t));
+  if (!g_cellSegs) return false;
+  for (uint16_t s = 0; s + 1 < g_points; s++) {
+    forEachCell(s, [s](uint32_t c) { g_cellSegs[g_cellStart[c]++] = s; });
+  }
+  // The fill advanced each start to the next cell's; shift back
+  for (uint32_t c = cells; c > 0; c--) g_cellStart[c] = g_cellStart[c - 1];
+  g_cellStart[0] = 0;
+  return true;
+}
+
+static bool finishLoad(bool ok) {
+  if (!ok || g_points < 2 || !buildIndex()) {
+    freeAll();
+    return false;
+  }
+  return true;
+}
+
+bool Course_loadPoints(const double *lat_deg, const double *lon_deg, size_t count) {
+  Course_unload();
+  bool ok = true;
+  for (size_t i = 0; i < count && ok; i++) ok = addPoint(lat_deg[i], lon_deg[i]);
+  return finishLoad(ok);
+}
+
+bool Course_load(Stream &in) {
+  Course_unload();
+  char line[64];
+  size_t len = 0;
+  bool ok = true;
+  for (;;) {
+    int c = in.read();
+    if (c < 0 || c == '\n') {
+      line[len] = '\0';
+      char *end;
+      double lat = strtod(line, &end);
+      if (end != line && *end == ',') {
+        char *p = end + 1;
+        double lon = strtod(p, &end);
+        if (end != p) ok = addPoint(lat, lon) && ok;
+      }
+      len = 0;
+      if (c < 0) break;
+    } else if (c != '\r' && len < sizeof(line) - 1) {
+      line[len++] = (char)c;
+    }
+  }
+  return finishLoad(ok);
+}
+
+void Course_unload() {
+  freeAll();
+  resetStatus();
+}
+
+bool Course_loaded() {
+  return g_cellStart != nullptr;
+}
+
+const CourseStatus &Course_update(double lat_deg, double lon_deg) {
+  PROF_SCOPE("Course_update");
+  g_status.changed = false;
+  if (!Course_loaded()) return g_status;
+
+  double e64, n64;
+  Geo_toLocal(g_frame, lat_deg, lon_deg, e64, n64);
+  const float e = (float)e64, n = (float)n64;
+
+  // Nearest segment in this fix's cell
+  float best2 = INFINITY;
+  const int col = (int)floorf((e - g_originE) / g_cell);
+  const int row = (int)floorf((n - g_originN) / g_cell);
+  uint32_t first = 0, last = 0;
+  if (col >= 0 && col < g_cols && row >= 0 && row < g_rows) {
+    const uint32_t cell = (uint32_t)row * g_cols + col;
+    first = g_cellStart[cell];
+    last = g_cellStart[cell + 1];
+  }
+  for (uint32_t i = first; i < last; i++) {
+    float t;
+    best2 = min(best2, segmentDistance2(g_cellSegs[i], e, n, t));
+  }
+
+  float distance = sqrtf(best2);
+  if (distance > COURSE_INDEX_RADIUS_M) distance = INFINITY;
+
+  if (distance != INFINITY) {
+    // Where the course passes close to itself (out-and-back, hairpins,
+    // laps), several segments are about as near. Athletes move forward, so
+    // each is charged for how far its progress is from the furthest so far
+    // and the cheapest wins. The first fix takes the nearest segment.
+    const float limit = g_status.valid ? distance + COURSE_AMBIGUITY_M : distance + 0.01f;
+    float chosen = -1;
+    float bestCost = INFINITY;
+    for (uint32_t i = first; i < last; i++) {
+      float t;
+      const uint16_t s = g_cellSegs[i];
+      const float d2 = segmentDistance2(s, e, n, t);
+      if (d2 > limit * limit) continue;
+      const float progress = g_along[s] + t * (g_along[s + 1] - g_along[s]);
+      const float cost = sqrtf(d2) + COURSE_PROGRESS_WEIGHT * fabsf(progress - g_furthest);
+      if (cost < bestCost) {
+        bestCost = cost;
+        chosen = progress;
+      }
+    }
+    g_status.progress_m = chosen;
+    g_furthest = max(g_furthest, chosen);
+    g_status.remaining_m = g_along[g_points - 1] - chosen;
+  }
+  g_status.distance_m = distance;
+  g_status.valid = true;
+
+  // Hysteresis
+  if (!g_status.offCourse) {
+    g_offCount = distance > COURSE_OFF_M ? g_offCount + 1 : 0;
+    if (g_offCount >= COURSE_OFF_FIXES) {
+      g_status.offCourse = true;
+      g_status.changed = true;
+      g_offCount = 0;
+    }
+  } else {
+    g_onCount = distance < COURSE_ON_M ? g_onCount + 1 : 0;
+    if (g_onCount >= COURSE_ON_FIXES) {
+      g_status.offCourse = false;
+      g_status.changed = true;
+      g_onCount = 0;
+    }
+  }
+  return g_status;
+}
+
+const CourseStatus &Course_status() {
+  return g_status;
+}
+
+float Course_distanceBrute(double lat_deg, double lon_deg, float *progress_m) {
+  if (!Course_loaded()) return INFINITY;
+  double e64, n64;
+  Geo_toLocal(g_frame, lat_deg, lon_deg, e64, n64);
+  float best2 = INFINITY, bestProgress = 0;
+  for (uint16_t s = 0; s + 1 < g_points; s++) {
+    float t;
+    float d2 = segmentDistance2(s, (float)e64, (float)n64, t);
+    if (d2 < best2) {
+      best2 = d2;
+      bestProgress = g_along[s] + t * (g_along[s + 1] - g_along[s]);
+    }
+  }
+  if (progress_m) *progress_m = bestProgress;
+  return sqrtf(best2);
+}
+
+void Course_getInfo(CourseInfo &out) {
+  const uint32_t cells = (uint32_t)g_cols * g_rows;
+  out.points = g_points;
+  out.length_m = g_points > 0 && g_along ? g_along[g_points - 1] : 0;
+  out.cell_m = g_cell;
+  out.cols = g_cols;
+  out.rows = g_rows;
+  out.entries = Course_loaded() ? g_cellStart[cells] : 0;
+  out.maxPerCell = g_maxPerCell;
+  out.bytes = Course_loaded()
+                  ? (uint32_t)(3 * g_points * sizeof(float) + (cells + 1) * sizeof(uint32_t) +
+                               out.entries * sizeof(uint16_t))
+                  : 0;
+}
+
+void Course_printInfo() {
+  if (!Course_loaded()) {
+    Serial.println("[Course] none");
+    return;
+  }
+  CourseInfo ci;
+  Course_getInfo(ci);
+  Serial.printf("[Course] %u points, %.2f km | grid %ux%u of %.0f m, %lu refs (max %u/cell) | %.1f KB\n", ci.points,
+                ci.length_m / 1000.0f, ci.cols, ci.rows, ci.cell_m, (unsigned long)ci.entries, ci.maxPerCell,
+                ci.bytes / 1024.0f);
+  if (g_status.valid) {
+    Serial.printf("[Course] %.1f m from course, %.0f m done, %.0f m to go%s\n", g_status.distance_m,
+                  g_status.progress_m, g_status.remaining_m, g_status.offCourse ? " | OFF COURSE" : "");
+  }
+}
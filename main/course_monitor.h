@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+#include "geo_local.h"
+
+// Course deviation: distance to the marked course, progress along it and an
+// off-course flag with hysteresis, per GNSS fix.
+//
+// The course (lat/lon polyline from flash) is projected once into a local
+// east/north frame (geo_local.h, origin at the first point) and indexed by a
+// uniform grid: each cell lists the segments that come within
+// COURSE_INDEX_RADIUS_M of it. A fix only looks at its own cell, so the cost
+// per fix does not depend on the course length. Fixes in a cell with no
+// segments are further than COURSE_INDEX_RADIUS_M from the course.
+
+#define COURSE_INDEX_RADIUS_M 60.0f   // segments listed per cell out to this distance
+#define COURSE_MAX_CELLS 4096         // grid limit; cells grow on large courses
+#define COURSE_MIN_CELL_M 25.0f
+#define COURSE_MIN_SPACING_M 2.0f     // closer points are merged when loading
+#define COURSE_MAX_POINTS 65535
+#define COURSE_OFF_M 50.0f            // off course beyond this ...
+#define COURSE_OFF_FIXES 3            // ... for this many fixes in a row
+#define COURSE_ON_M 30.0f             // back on course within this ...
+#define COURSE_ON_FIXES 2             // ... for this many fixes in a row
+#define COURSE_AMBIGUITY_M 25.0f      // where the course passes itself, pick by progress among these
+#define COURSE_PROGRESS_WEIGHT 0.1f   // metres of distance per metre of progress jump, among those
+
+struct CourseStatus {
+  bool valid;         // a course is loaded and at least one fix was processed
+  float distance_m;   // to the course; INFINITY beyond COURSE_INDEX_RADIUS_M
+  float progress_m;   // along the course at the closest point (kept while far)
+  float remaining_m;
+  bool offCourse;     // with hysteresis
+  bool changed;       // offCourse flipped on this fix
+};
+
+struct CourseInfo {
+  uint16_t points;
+  float length_m;
+  float cell_m;
+  uint16_t cols;
+  uint16_t rows;
+  uint32_t entries;     // segment references in the grid
+  uint16_t maxPerCell;
+  uint32_t bytes;       // heap used by points and index
+};
+
+// Load a course: one "lat,lon" point per line, in course order. Blank lines,
+// '#' comments and a header line are skipped. Replaces any loaded course.
+bool Course_load(Stream &in);
+
+// Same from arrays (host tools)
+bool Course_loadPoints(const double *lat_deg, const double *lon_deg, size_t count);
+
+void Course_unload();
+bool Course_loaded();
+
+// Process one fix
+const CourseStatus &Course_update(double lat_deg, double lon_deg);
+const CourseStatus &Course_status();
+
+// Distance by scanning every segment, for checking the index on the host.
+// Returns INFINITY without a course.
+float Course_distanceBrute(double lat_deg, double lon_deg, float *progress_m);
+
+void Course_getInfo(CourseInfo &out);
+void Course_printInfo();
@@ -1,7 +1,10 @@
 #include "ellipse_sim.h"
 #include <math.h>
+#include "geo_local.h"
+#include "profiler.h"
 
 static EllipseConfig G;
+static GeoFrame g_frame;
 static uint32_t g_step = 0;
 
 static inline double deg2rad(double d) {
@@ -12,20 +15,15 @@ static double urand() {
   return (double)random(-10000, 10001) / 10000.0;
 }
 
-static void enMetersToLatLon(double east_m, double north_m, double centerLatDeg, double centerLonDeg, double& outLatDeg, double& outLonDeg) {
-  const double metersPerDegLat = 111320.0;
-  const double metersPerDegLon = 111320.0 * cos(deg2rad(centerLatDeg));
-  outLatDeg = centerLatDeg + (north_m / metersPerDegLat);
-  outLonDeg = centerLonDeg + (east_m / metersPerDegLon);
-}
-
 void Ellipse_init(const EllipseConfig& cfg) {
   G = cfg;
+  Geo_frame(g_frame, G.center_lat_deg, G.center_lon_deg);
   g_step = 0;
   randomSeed((uint32_t)esp_timer_get_time());
 }
 
 bool Ellipse_step(EllipsePoint& out) {
+  PROF_SCOPE("Ellipse_step");
   const double phi0 = deg2rad(G.start_phase_deg);
   const double psi = deg2rad(G.rotation_deg);
   const double dphi = TWO_PI * (G.step_sec / G.period_sec);
@@ -40,7 +38,7 @@ bool Ellipse_step(EllipsePoint& out) {
   const double north_m = yr + jy;
 
   double latDeg, lonDeg;
-  enMetersToLatLon(east_m, north_m, G.center_lat_deg, G.center_lon_deg, latDeg, lonDeg);
+  Geo_toLatLon(g_frame, east_m, north_m, latDeg, lonDeg);
 
   out.lat_deg = latDeg;
   out.lon_deg = lonDeg;
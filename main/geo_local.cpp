@@ -0,0 +1,21 @@
+#include "geo_local.h"
+#include <math.h>
+
+static const double METERS_PER_DEG_LAT = 111320.0;
+
+void Geo_frame(GeoFrame &f, double lat0_deg, double lon0_deg) {
+  f.lat0_deg = lat0_deg;
+  f.lon0_deg = lon0_deg;
+  f.metersPerDegLat = METERS_PER_DEG_LAT;
+  f.metersPerDegLon = METERS_PER_DEG_LAT * cos(lat0_deg * (PI / 180.0));
+}
+
+void Geo_toLatLon(const GeoFrame &f, double east_m, double north_m, double &lat_deg, double &lon_deg) {
+  lat_deg = f.lat0_deg + (north_m / f.metersPerDegLat);
+  lon_deg = f.lon0_deg + (east_m / f.metersPerDegLon);
+}
+
+void Geo_toLocal(const GeoFrame &f, double lat_deg, double lon_deg, double &east_m, double &north_m) {
+  north_m = (lat_deg - f.lat0_deg) * f.metersPerDegLat;
+  east_m = (lon_deg - f.lon0_deg) * f.metersPerDegLon;
+}
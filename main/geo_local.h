@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+// Local east/north frame around a reference point: equirectangular, with the
+// longitude scale taken at the reference latitude. Good to well under 0.1%
+// over the few tens of km of a course or the simulator's ellipse.
+struct GeoFrame {
+  double lat0_deg;
+  double lon0_deg;
+  double metersPerDegLat;
+  double metersPerDegLon;
+};
+
+void Geo_frame(GeoFrame &f, double lat0_deg, double lon0_deg);
+
+// Metres east/north of the reference -> lat/lon
+void Geo_toLatLon(const GeoFrame &f, double east_m, double north_m, double &lat_deg, double &lon_deg);
+
+// lat/lon -> metres east/north of the reference
+void Geo_toLocal(const GeoFrame &f, double lat_deg, double lon_deg, double &east_m, double &north_m);
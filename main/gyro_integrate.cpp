@@ -0,0 +1,41 @@
+#include "gyro_module.h"
+
+// Kept apart from gyro_module.cpp (I2C, FreeRTOS) so host tools can link it.
+void Gyro_integrate(GyroIntegrator &state, const GyroCalibration &cal, const int16_t raw[3], uint32_t t_us,
+                    GyroReading &out) {
+  // Orientation convention: roll=X, pitch=-Y, yaw=-Z
+  int16_t gx = raw[0];
+  int16_t gy = -raw[1];
+  int16_t gz = -raw[2];
+
+  float rollRate_dps = (gx / cal.sensitivity) - cal.biasRoll_dps;
+  float pitchRate_dps = (gy / cal.sensitivity) - cal.biasPitch_dps;
+  float yawRate_dps = (gz / cal.sensitivity) - cal.biasYaw_dps;
+
+  if (state.last_us == 0) state.last_us = t_us;
+  float dt = (t_us - state.last_us) * 1e-6f;
+  state.last_us = t_us;
+  if (dt <= 0.0f || dt > 0.1f) dt = 0.001f;
+
+  state.roll_deg += rollRate_dps * dt;
+  state.pitch_deg += pitchRate_dps * dt;
+
+  out.roll_deg = state.roll_deg;
+  out.pitch_deg = state.pitch_deg;
+  out.rollRate_dps = rollRate_dps;
+  out.pitchRate_dps = pitchRate_dps;
+  out.yawRate_dps = yawRate_dps;
+  out.t_us = t_us;
+}
+
+float Gyro_tiltAngle(const int16_t a[3], const int16_t b[3]) {
+  float dot = 0.0f, na = 0.0f, nb = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    dot += (float)a[i] * b[i];
+    na += (float)a[i] * a[i];
+    nb += (float)b[i] * b[i];
+  }
+  if (na < 1.0f || nb < 1.0f) return 0.0f;
+  const float c = dot / sqrtf(na * nb);
+  return acosf(c > 1.0f ? 1.0f : (c < -1.0f ? -1.0f : c)) * (180.0f / (float)PI);
+}
@@ -1,30 +1,76 @@
 #include "gyro_module.h"
-#include <Wire.h>
+#include "I2C_Bus.h"
+#include "profiler.h"
+#include "recorder.h"
 
 static const uint8_t MPU_ADDR = 0x68;
 static const float GYR_SENS = 65.5f;
 
 static bool g_inited = false;
 static bool g_log = true;
-static float g_rateBiasRoll = 0.0f, g_rateBiasPitch = 0.0f, g_rateBiasYaw = 0.0f;
-static float g_roll_deg = 0.0f, g_pitch_deg = 0.0f;
-static uint32_t g_last_us = 0;
+static GyroCalibration g_cal = {GYR_SENS, 0.0f, 0.0f, 0.0f};
+static GyroIntegrator g_state = {0.0f, 0.0f, 0};
+static I2C_Bus *g_bus = nullptr;
+static uint32_t g_recSession = 0; // recorder session that has our calibration header
+
+// Rate reads completed by the bus task, handed out by Gyro_step()
+static portMUX_TYPE g_readMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool g_readQueued = false;
+static bool g_readDone = false;
+static uint8_t g_readBuf[6];
+static uint32_t g_read_us = 0;
+
+// Low-power (accelerometer cycle) mode
+static const float ACC_MOTION_LSB = 1600.0f; // ~0.1 g change at +/-2 g (16384 LSB/g)
+static const uint32_t ACC_CYCLE_MS = 200;    // LP_WAKE_CTRL 5 Hz
+static bool g_lowPower = false;
+static bool g_motion = false;
+static bool g_haveAcc = false;
+static int16_t g_lastAcc[3] = {0, 0, 0};
+static uint32_t g_lastAcc_ms = 0;
+static float g_tilt_dps = NAN;   // fastest turn since Gyro_tiltRate()
+static uint32_t g_tiltSpan_ms = 0;
 
 static void mpuWrite(uint8_t reg, uint8_t val) {
-  Wire.beginTransmission(MPU_ADDR);
-  Wire.write(reg);
-  Wire.write(val);
-  Wire.endTransmission();
+  if (!g_bus) return;
+  g_bus->writeRegs(MPU_ADDR, reg, &val, 1);
 }
 
 static bool mpuRead(uint8_t startReg, uint8_t *buf, size_t len) {
-  Wire.beginTransmission(MPU_ADDR);
-  Wire.write(startReg);
-  if (Wire.endTransmission(false) != 0) return false;
-  int n = Wire.requestFrom((int)MPU_ADDR, (int)len);
-  if (n != (int)len) return false;
-  for (size_t i = 0; i < len; ++i) buf[i] = Wire.read();
-  return true;
+  if (!g_bus) return false;
+  return g_bus->readRegs(MPU_ADDR, startReg, buf, (uint8_t)len) == I2C_OK;
+}
+
+// Bus task: keep the raw rates and when they were read
+static void onRatesRead(int8_t status, const uint8_t *data, uint8_t len, void *ctx) {
+  uint32_t now = micros();
+  portENTER_CRITICAL(&g_readMux);
+  if (status == I2C_OK && len == sizeof(g_readBuf)) {
+    memcpy(g_readBuf, data, sizeof(g_readBuf));
+    g_read_us = now;
+    g_readDone = true;
+  }
+  g_readQueued = false;
+  portEXIT_CRITICAL(&g_readMux);
+}
+
+static void queueRatesRead() {
+  if (!g_bus || g_readQueued) return;
+  I2C_Transaction t = {};
+  t.address = MPU_ADDR;
+  t.reg = 0x43;
+  t.len = sizeof(g_readBuf);
+  t.flags = I2C_READ | I2C_MERGEABLE;
+  t.priority = 1; // after the PPG FIFO drains
+  t.callback = onRatesRead;
+  g_readQueued = true;
+  if (g_bus->submit(t) != I2C_OK) g_readQueued = false;
+}
+
+static void dropRatesRead() {
+  portENTER_CRITICAL(&g_readMux);
+  g_readDone = false;
+  portEXIT_CRITICAL(&g_readMux);
 }
 
 void Gyro_init(bool serialLogging, int sdaPin, int sclPin) {
@@ -38,6 +84,12 @@ void Gyro_init(bool serialLogging, int sdaPin, int sclPin) {
     Serial.println(F("\n[Gyro] Init..."));
   }
 
+  // Shares the controller with the PPG sensor when the pins match
+  g_bus = I2C_Bus::forPins(sdaPin, sclPin, 400000);
+  if (!g_bus && g_log) {
+    Serial.println(F("[Gyro] No I2C controller available"));
+  }
+
   mpuWrite(0x6B, 0x00);
   delay(100);
 
@@ -66,12 +118,12 @@ void Gyro_init(bool serialLogging, int sdaPin, int sclPin) {
     delay(1);
   }
 
-  g_rateBiasRoll = sumX / N;
-  g_rateBiasPitch = sumY / N;
-  g_rateBiasYaw = sumZ / N;
-  g_roll_deg = 0.0f;
-  g_pitch_deg = 0.0f;
-  g_last_us = 0;
+  g_cal.biasRoll_dps = sumX / N;
+  g_cal.biasPitch_dps = sumY / N;
+  g_cal.biasYaw_dps = sumZ / N;
+  g_state.roll_deg = 0.0f;
+  g_state.pitch_deg = 0.0f;
+  g_state.last_us = 0;
 
   if (g_log) {
     Serial.println(F("[Gyro] Calibration complete."));
@@ -79,35 +131,120 @@ void Gyro_init(bool serialLogging, int sdaPin, int sclPin) {
 }
 
 bool Gyro_step(GyroReading &out) {
+  PROF_SCOPE("Gyro_step");
   if (!g_inited) return false;
 
-  uint8_t raw[6];
-  if (!mpuRead(0x43, raw, 6)) return false;
+  uint32_t session = Recorder_session();
+  if (session != 0 && session != g_recSession) {
+    g_recSession = session;
+    Recorder_imuHeader(micros(), g_cal);
+  }
 
-  int16_t gx = ((int16_t)raw[0] << 8) | raw[1];
-  int16_t gy = ((int16_t)raw[2] << 8) | raw[3];
-  int16_t gz = ((int16_t)raw[4] << 8) | raw[5];
+  if (g_lowPower) {
+    // Gyro is in standby: hold the angles, report no rotation
+    out.roll_deg = g_state.roll_deg;
+    out.pitch_deg = g_state.pitch_deg;
+    out.rollRate_dps = 0.0f;
+    out.pitchRate_dps = 0.0f;
+    out.yawRate_dps = 0.0f;
+    out.t_us = micros();
+    Recorder_imuHeld(out.t_us);
+    return true;
+  }
 
-  // Orientation convention: roll=X, pitch=-Y, yaw=-Z
-  gy = -gy;
-  gz = -gz;
+  uint8_t buf[6];
+  uint32_t now = 0;
+  portENTER_CRITICAL(&g_readMux);
+  const bool have = g_readDone;
+  if (have) {
+    memcpy(buf, g_readBuf, sizeof(buf));
+    now = g_read_us;
+    g_readDone = false;
+  }
+  portEXIT_CRITICAL(&g_readMux);
+  queueRatesRead();
+  if (!have) return false;
 
-  float rollRate_dps = (gx / GYR_SENS) - g_rateBiasRoll;
-  float pitchRate_dps = (gy / GYR_SENS) - g_rateBiasPitch;
+  int16_t raw[3];
+  for (int i = 0; i < 3; ++i) raw[i] = ((int16_t)buf[2 * i] << 8) | buf[2 * i + 1];
 
-  uint32_t now = micros();
-  if (g_last_us == 0) g_last_us = now;
-  float dt = (now - g_last_us) * 1e-6f;
-  g_last_us = now;
-  if (dt <= 0.0f || dt > 0.1f) dt = 0.001f;
+  Recorder_imu(now, raw);
+  Gyro_integrate(g_state, g_cal, raw, now, out);
+  return true;
+}
 
-  g_roll_deg += rollRate_dps * dt;
-  g_pitch_deg += pitchRate_dps * dt;
+const GyroCalibration &Gyro_calibration() {
+  return g_cal;
+}
 
-  out.roll_deg = g_roll_deg;
-  out.pitch_deg = g_pitch_deg;
-  out.rollRate_dps = rollRate_dps;
-  out.pitchRate_dps = pitchRate_dps;
+void Gyro_setLowPower(bool enable) {
+  if (!g_inited || enable == g_lowPower) return;
+  g_lowPower = enable;
+  g_haveAcc = false;
+  g_motion = false;
+  g_tilt_dps = NAN;
+  dropRatesRead(); // taken before the switch
+
+  if (enable) {
+    // PWR_MGMT_2: LP_WAKE_CTRL=5 Hz, gyro X/Y/Z standby
+    mpuWrite(0x6C, (0x01 << 6) | 0x07);
+    // PWR_MGMT_1: CYCLE, temperature sensor off
+    mpuWrite(0x6B, 0x20 | 0x08);
+  } else {
+    mpuWrite(0x6B, 0x00);
+    mpuWrite(0x6C, 0x00);
+    g_state.last_us = 0; // restart integration timing after the gap
+    Recorder_event(micros(), SESSION_EVT_IMU_RESUME, 0.0f);
+  }
 
-  return true;
+  if (g_log) {
+    Serial.println(enable ? F("[Gyro] Low-power (accel cycle) mode") : F("[Gyro] Full-rate mode"));
+  }
+}
+
+bool Gyro_isLowPower() {
+  return g_lowPower;
+}
+
+// Low-power mode: one accelerometer reading, for motion and tilt
+static void sampleAccel() {
+  uint8_t raw[6];
+  if (!mpuRead(0x3B, raw, 6)) return;
+  const uint32_t now = millis();
+  int16_t acc[3];
+  for (int i = 0; i < 3; ++i) acc[i] = ((int16_t)raw[2 * i] << 8) | raw[2 * i + 1];
+  if (g_haveAcc) {
+    int32_t change = 0;
+    for (int i = 0; i < 3; ++i) change += abs((int32_t)acc[i] - g_lastAcc[i]);
+    if (change > ACC_MOTION_LSB) g_motion = true;
+
+    // Readings closer than the cycle may straddle one update of the sample
+    const uint32_t span = max(now - g_lastAcc_ms, ACC_CYCLE_MS);
+    const float rate = Gyro_tiltAngle(g_lastAcc, acc) * 1000.0f / span;
+    if (isnan(g_tilt_dps) || rate > g_tilt_dps) {
+      g_tilt_dps = rate;
+      g_tiltSpan_ms = span;
+    }
+  }
+  memcpy(g_lastAcc, acc, sizeof(acc));
+  g_lastAcc_ms = now;
+  g_haveAcc = true;
+}
+
+bool Gyro_motionDetected() {
+  if (!g_inited || !g_lowPower) return false;
+  sampleAccel();
+  bool motion = g_motion;
+  g_motion = false;
+  return motion;
+}
+
+float Gyro_tiltRate(uint32_t &span_ms) {
+  span_ms = 0;
+  if (!g_inited || !g_lowPower) return NAN;
+  sampleAccel();
+  const float rate = g_tilt_dps;
+  span_ms = g_tiltSpan_ms;
+  if (!isnan(rate)) g_tilt_dps = 0.0f;
+  return rate;
 }
@@ -6,8 +6,56 @@ struct GyroReading {
   float pitch_deg;
   float rollRate_dps;
   float pitchRate_dps;
+  float yawRate_dps;
+  uint32_t t_us;  // micros() when the rates were sampled
 };
 
-void Gyro_init(bool serialLogging = true, int sdaPin = 13, int sclPin = 14);
+// Sensor constants and the integration state, separate from the I2C side so
+// the same math runs on recorded raw counts (tools/session_replay.cpp).
+struct GyroCalibration {
+  float sensitivity;  // LSB per deg/s
+  float biasRoll_dps;
+  float biasPitch_dps;
+  float biasYaw_dps;
+};
+
+struct GyroIntegrator {
+  float roll_deg;
+  float pitch_deg;
+  uint32_t last_us;  // 0 = restart timing at the next sample
+};
+
+// Pure integration step: raw MPU6050 gyro counts (X, Y, Z as read) taken at
+// t_us -> rates and angles. Updates `state`; no hardware access.
+void Gyro_integrate(GyroIntegrator &state, const GyroCalibration &cal, const int16_t raw[3], uint32_t t_us,
+                    GyroReading &out);
 
+// Angle (deg) between two raw accelerometer readings: how far gravity turned
+// in the sensor frame. 0 if either reading is near zero.
+float Gyro_tiltAngle(const int16_t a[3], const int16_t b[3]);
+
+// The MPU6050 shares the PPG sensor's bus (MAX30102_Driver, pins 26/27).
+void Gyro_init(bool serialLogging = true, int sdaPin = 26, int sclPin = 27);
+
+// Rates are read through the bus queue (I2C_Bus::submit): each call returns
+// the reading completed since the previous call, stamped with its own time,
+// and queues the next one. False on the first call and after a failed read.
 bool Gyro_step(GyroReading &out);
+
+// Calibration measured by Gyro_init().
+const GyroCalibration &Gyro_calibration();
+
+// Low-power mode: gyro axes in standby, accelerometer in cycle mode at ~5 Hz.
+// Gyro_step() then returns zero rates and only motion detection works.
+void Gyro_setLowPower(bool enable);
+bool Gyro_isLowPower();
+
+// In low-power mode: true if the accelerometer saw movement since the last call.
+bool Gyro_motionDetected();
+
+// In low-power mode, the stand-in for the gyro rates in fall detection: the
+// fastest turn of gravity between two accelerometer readings since the last
+// call, in deg/s averaged over span_ms (at least the 200 ms accelerometer
+// cycle). A collapse turns the wrist through tens of degrees within one
+// reading interval. NAN if there are no two readings yet.
+float Gyro_tiltRate(uint32_t &span_ms);
@@ -1,9 +1,16 @@
 #include "hr_module.h"
 #include <Arduino.h>
+#include "uplink.h"
+#include "alert_engine.h"
+#include "profiler.h"
+#include "recorder.h"
 
 // ======= Instances (kept private to the module) =======
 static MAX30102_Driver heartSensor;
 static HeartRate_Service hrService;
+static LedAGC_Service ledAgc(heartSensor);
+static MotionCancel_Service motionCancel;
+static SpectralHR_Service spectralHr;
 static SOSButton_Driver sosButton(34, /*usePullUp=*/false, /*activeHigh=*/true);
 
 // ======= Module state =======
@@ -13,6 +20,40 @@ static bool g_calibration = false;
 static unsigned long g_lastPrint = 0;
 static const unsigned long PRINT_INTERVAL = 1000; // ms
 static unsigned long g_sampleCount = 0;
+static const unsigned long TEMP_INTERVAL = 5000; // ms between die temperature conversions
+static unsigned long g_lastTempStart = 0;
+static float g_temperature = NAN;
+static uint32_t g_recSession = 0; // recorder session that has the current PPG header; 0 = rewrite
+static HrEstimator g_estimator = HR_ESTIMATOR_DEFAULT;
+// "I am OK" press while an alert is latched: acknowledged once the press is
+// released short and no second press follows within the double-press window
+static bool g_ackArmed = false;
+static bool g_ackReleased = false;
+static unsigned long g_ackReleaseMs = 0;
+
+static void recordPpgHeader(uint32_t t_us) {
+  MAX30102_Config c = heartSensor.getConfig();
+  SessionPpgHeader h;
+  h.rate_sps = HR_getEffectiveRate();
+  h.sampleRate = c.sampleRate;
+  h.fifoAverage = c.fifoAverage;
+  h.adcRange = c.adcRange;
+  h.pulseWidth = c.pulseWidth;
+  h.redCurrent = c.redCurrent;
+  h.irCurrent = c.irCurrent;
+  h.motionCancel = motionCancel.isEnabled() ? 1 : 0;
+  h.reserved = 0;
+  Recorder_ppgHeader(t_us, h);
+}
+
+// ======= Button hook (button timer task) =======
+// SOS goes straight to the uplink without waiting for the next HR_step()
+static void onButtonHook(const ButtonEvent &event) {
+  if (event.state != BUTTON_LONG_PRESS) return;
+  uint32_t age_ms = (micros() - event.triggerTime) / 1000;
+  Uplink_raiseAlert(UPLINK_ALERT_SOS, millis() - age_ms);
+  Alert_latchSOS();
+}
 
 // ======= Button callback =======
 static void onButtonEvent(ButtonState state) {
@@ -23,7 +64,14 @@ static void onButtonEvent(ButtonState state) {
   // Toggle/Reset/SOS behavior stays internal; logging optional
   switch (state) {
     case BUTTON_PRESSED:
-      // Toggle logging on short press
+      // With a latched alert (e.g. a fall), a short press is "I am OK";
+      // decided on release so a long press (SOS) never clears it
+      if (Alert_latched()) {
+        g_ackArmed = true;
+        g_ackReleased = false;
+        break;
+      }
+      // Otherwise toggle logging on short press
       g_logging = !g_logging;
       if (g_logging) {
         Serial.println(F("\n✅ LOGGING RESUMED\n"));
@@ -33,18 +81,31 @@ static void onButtonEvent(ButtonState state) {
       break;
 
     case BUTTON_RELEASED:
+      if (g_ackArmed) {
+        g_ackReleased = true;
+        g_ackReleaseMs = millis();
+      }
       if (g_logging) Serial.println(F("[BUTTON EVENT] Button RELEASED"));
       break;
 
     case BUTTON_LONG_PRESS:
+      g_ackArmed = false;
+      // Interrupt mode already raised it from onButtonHook()
+      if (!sosButton.isInterruptMode()) {
+        Uplink_raiseAlert(UPLINK_ALERT_SOS, millis());
+        Alert_latchSOS();
+      }
       if (g_logging) {
         Serial.println(F("[BUTTON EVENT] ⚠️  LONG PRESS (2s) -> SOS MODE"));
-        Serial.println(F("    >>> SOS MODE ACTIVATED (placeholder) <<<"));
+        Serial.println(F("    >>> SOS alert sent on the priority uplink <<<"));
       }
       break;
 
     case BUTTON_DOUBLE_PRESS:
+      g_ackArmed = false;
       hrService.reset();
+      spectralHr.reset();
+      Recorder_event(micros(), SESSION_EVT_HR_RESET, 0.0f);
       g_sampleCount = 0;
       if (g_logging) {
         Serial.println(F("[BUTTON EVENT] ⚡ DOUBLE PRESS -> reset readings"));
@@ -75,9 +136,12 @@ void HR_init(bool serialLogging, bool calibrationMode) {
     Serial.println(F("Initializing SOS Button (GPIO4)..."));
   }
 
-  // Button
-  sosButton.begin();
+  // Button: interrupt + timer driven, falls back to polling in HR_step()
+  if (!sosButton.beginInterrupt()) {
+    sosButton.begin();
+  }
   sosButton.setCallback(onButtonEvent);
+  sosButton.setEventHook(onButtonHook);
   if (sosButton.isPressed()) {
   //   Serial.println(F("✓ Button initialized."));
   //   Serial.print(F("Button initial state: "));
@@ -88,6 +152,7 @@ void HR_init(bool serialLogging, bool calibrationMode) {
 
   // Sensor
   if (g_logging) Serial.println(F("Initializing MAX30102 sensor..."));
+  unsigned long initStart = micros();
   if (!heartSensor.begin()) {
     if (g_logging) {
       Serial.println(F("✗ Failed to initialize MAX30102!"));
@@ -99,23 +164,29 @@ void HR_init(bool serialLogging, bool calibrationMode) {
 
   if (g_logging) {
     Serial.println(F("✓ MAX30102 initialized successfully!"));
+    Serial.print(F("Init time: ")); Serial.print((micros() - initStart) / 1000.0, 1); Serial.println(F(" ms"));
     Serial.print(F("Part ID: 0x")); Serial.println(heartSensor.getPartID(), HEX);
     Serial.print(F("Revision ID: 0x")); Serial.println(heartSensor.getRevisionID(), HEX);
 
     float temp = heartSensor.readTemperature();
+    g_temperature = temp;
     Serial.print(F("Sensor Temperature: ")); Serial.print(temp); Serial.println(F(" °C"));
 
     Serial.println(F("\nSensor Configuration:"));
     Serial.println(F("- Mode: SpO2 (Red + IR)"));
     Serial.println(F("- Sample Rate: 100 Hz"));
     Serial.println(F("- Pulse Width: 411 μs"));
-    Serial.println(F("- LED Current: 11 mA"));
+    Serial.println(F("- LED Current: 11 mA (automatic gain control)"));
     Serial.println(F("- FIFO Average: 4 samples"));
 
     Serial.println(F("\nInitializing Heart Rate Service..."));
   }
 
   hrService.begin();
+  hrService.setBeatDetection(g_estimator == HR_ESTIMATOR_PEAKS);
+  spectralHr.begin(HR_getEffectiveRate());
+  ledAgc.begin();
+  motionCancel.begin();
 
   if (g_logging) {
     Serial.println(F("✓ Heart Rate Service initialized!"));
@@ -137,7 +208,8 @@ void HR_init(bool serialLogging, bool calibrationMode) {
 
 // Returns bpm or 0.0 if not ready/invalid
 float HR_step() {
-  // Button state machine
+  PROF_SCOPE("HR_step");
+  // Button events (timed in the background in interrupt mode)
   sosButton.update();
 
   // Edge-detect press to also allow pause/resume without callback latency
@@ -148,17 +220,81 @@ float HR_step() {
   }
   lastButtonState = curr;
 
-  // Sensor sampling → service
-  if (heartSensor.available()) {
+  // Short press released and the double-press window closed: "I am OK"
+  if (g_ackArmed && g_ackReleased && millis() - g_ackReleaseMs >= sosButton.getDoublePressInterval()) {
+    g_ackArmed = false;
+    Alert_acknowledge();
+  }
+
+  // Sensor sampling → service. Drain everything queued in the FIFO so the
+  // caller may sleep between steps (FIFO holds 32 samples). The newest sample
+  // was taken about now; older ones are one sample period apart, which is
+  // what the motion filter needs to line them up with the gyro readings.
+  uint8_t queued = heartSensor.samplesAvailable();
+  uint32_t nowMicros = micros();
+  uint32_t nowMillis = millis();
+  float rate = HR_getEffectiveRate();
+  uint32_t period = rate > 0 ? (uint32_t)(1000000.0f / rate) : 0;
+
+  // Session recording: raw samples as read, before the motion filter
+  uint32_t session = Recorder_session();
+  if (session != 0 && session != g_recSession) {
+    g_recSession = session;
+    recordPpgHeader(nowMicros);
+  }
+  uint32_t rawRed[SESSION_PPG_MAX_BATCH], rawIr[SESSION_PPG_MAX_BATCH];
+  uint8_t n = 0;
+
+  for (; n < queued; n++) {
     MAX30102_Data data = heartSensor.readSample();
-    if (data.valid) {
-      hrService.addSample(data.red, data.ir);
-      g_sampleCount++;
+    if (!data.valid) break;
+    if (n < SESSION_PPG_MAX_BATCH) {
+      rawRed[n] = data.red;
+      rawIr[n] = data.ir;
     }
+    const uint32_t age = (uint32_t)(queued - 1 - n) * period;
+    motionCancel.process(nowMicros - age, data.red, data.ir);
+    hrService.addSample(data.red, data.ir, nowMillis - age / 1000);
+    if (g_estimator == HR_ESTIMATOR_SPECTRAL) spectralHr.addSample(data.ir);
+    g_sampleCount++;
+  }
+  if (session != 0) Recorder_ppg(nowMicros, period, queued, rawRed, rawIr, n);
+  if (g_estimator == HR_ESTIMATOR_SPECTRAL) spectralHr.update(millis());
+
+  // LED current / pulse width / ADC range control from the window statistics
+  if (hrService.isReady()) {
+    AGC_Measurement m;
+    hrService.getSignalComponents(m.redAC, m.redDC, m.irAC, m.irDC);
+    m.fingerDetected = hrService.getReadings().fingerDetected;
+    if (ledAgc.update(m, millis())) {
+      hrService.markDiscontinuity();
+      spectralHr.reset();
+      motionCancel.reset();
+      g_recSession = 0;
+      if (g_logging) {
+        const MAX30102_Config &c = ledAgc.getConfig();
+        Serial.print(F("[AGC] retune #")); Serial.print(ledAgc.getRetuneCount());
+        Serial.print(F(" IR=0x")); Serial.print(c.irCurrent, HEX);
+        Serial.print(F(" RED=0x")); Serial.print(c.redCurrent, HEX);
+        Serial.print(F(" PW=")); Serial.print(c.pulseWidth);
+        Serial.print(F(" RANGE=")); Serial.println(c.adcRange);
+      }
+    }
+  }
+
+  // Die temperature: start a conversion periodically and collect it on a later step
+  float celsius;
+  if (heartSensor.pollTemperature(celsius)) {
+    g_temperature = celsius;
+    hrService.setTemperature(celsius);
+    Recorder_event(micros(), SESSION_EVT_TEMPERATURE, celsius);
+  } else if (!heartSensor.isTemperaturePending() && (millis() - g_lastTempStart >= TEMP_INTERVAL)) {
+    g_lastTempStart = millis();
+    heartSensor.startTemperature();
   }
 
   // Get computed readings
-  HeartRateData hrData = hrService.getReadings();
+  HeartRateData hrData = HR_getReadings();
 
   // Optional 1 Hz logging (does not affect return value)
   unsigned long now = millis();
@@ -187,6 +323,9 @@ float HR_step() {
     // Quality, Finger, Status
     Serial.print(hrData.signalQuality, 0); Serial.print(F("% | "));
     Serial.print(hrData.fingerDetected ? F("YES") : F("NO ")); Serial.print(F(" | "));
+    if (g_estimator == HR_ESTIMATOR_SPECTRAL) {
+      Serial.print(F("conf ")); Serial.print(spectralHr.getReadings().confidence, 0); Serial.print(F("% | "));
+    }
 
     if (!hrData.fingerDetected)       Serial.println(F("Place finger on sensor"));
     else if (!hrService.isReady())    Serial.println(F("Collecting data..."));
@@ -200,3 +339,97 @@ float HR_step() {
   }
   return 0.0f;
 }
+
+HeartRateData HR_getReadings() {
+  HeartRateData data = hrService.getReadings();
+  if (g_estimator == HR_ESTIMATOR_SPECTRAL) {
+    SpectralHRData s = spectralHr.getReadings();
+    data.heartRate = s.validReading ? s.heartRate : 0.0f;
+    data.lastBeatTime = s.timestamp;
+  }
+  return data;
+}
+
+void HR_setEstimator(HrEstimator estimator) {
+  if (estimator == g_estimator) return;
+  g_estimator = estimator;
+  hrService.setBeatDetection(estimator == HR_ESTIMATOR_PEAKS);
+  spectralHr.reset();
+  if (g_logging) {
+    Serial.println(estimator == HR_ESTIMATOR_SPECTRAL ? F("[HR] spectral estimator") : F("[HR] peak estimator"));
+  }
+}
+
+HrEstimator HR_getEstimator() {
+  return g_estimator;
+}
+
+SpectralHRData HR_getSpectral() {
+  return spectralHr.getReadings();
+}
+
+float HR_getTemperature() {
+  return g_temperature;
+}
+
+void HR_setSampling(uint8_t sampleRate, uint8_t fifoAverage) {
+  MAX30102_Config config = heartSensor.getConfig();
+  if (config.sampleRate == sampleRate && config.fifoAverage == fifoAverage) return;
+
+  config.sampleRate = sampleRate;
+  config.fifoAverage = fifoAverage;
+  heartSensor.applyConfig(config);
+  heartSensor.clearFIFO();
+  hrService.markDiscontinuity();
+  spectralHr.setSampleRate(HR_getEffectiveRate());
+  motionCancel.reset();
+  g_recSession = 0;
+
+  if (g_logging) {
+    Serial.print(F("[HR] sampling: ")); Serial.print(HR_getEffectiveRate(), 1); Serial.println(F(" sps"));
+  }
+}
+
+float HR_getEffectiveRate() {
+  static const uint16_t RATES[] = {50, 100, 200, 400, 800, 1000, 1600, 3200};
+  MAX30102_Config config = heartSensor.getConfig();
+  return (float)RATES[config.sampleRate & 0x07] / (float)max((uint8_t)1, config.fifoAverage);
+}
+
+void HR_addMotionReference(const GyroReading &g) {
+  motionCancel.addReference(g.t_us, g.rollRate_dps, g.pitchRate_dps, g.yawRate_dps);
+}
+
+void HR_setMotionCancel(bool enabled) {
+  motionCancel.setEnabled(enabled);
+  motionCancel.reset();
+  g_recSession = 0;
+}
+
+void HR_printMotionStats() {
+  float rate = HR_getEffectiveRate();
+  uint32_t budget = rate > 0 ? (uint32_t)(ESP.getCpuFreqMHz() * 1000000.0f / rate) : 0;
+  uint32_t samples = motionCancel.getSampleCount();
+  Serial.printf("[MC] %s | %.0f avg / %lu max cycles per sample (budget %lu @ %.1f sps) | referenced %lu, "
+                "adapted %lu/%lu\n",
+                motionCancel.isEnabled() ? "on" : "off",
+                motionCancel.getAverageCycles(), (unsigned long)motionCancel.getMaxCycles(),
+                (unsigned long)budget, rate, (unsigned long)motionCancel.getReferencedCount(),
+                (unsigned long)motionCancel.getAdaptedCount(), (unsigned long)samples);
+}
+
+bool HR_isButtonActive() {
+  return sosButton.isActive() || g_ackArmed;
+}
+
+void HR_printButtonStats() {
+  if (!sosButton.isInterruptMode()) {
+    Serial.println(F("[SOS] polled mode"));
+    return;
+  }
+  ButtonLatencyStats st;
+  sosButton.getLatencyStats(st);
+  Serial.printf("[SOS] %lu events (%lu dropped) | detect %.1f last / %.1f avg / %.1f max ms | deliver %.1f last / %.1f max ms\n",
+                (unsigned long)st.events, (unsigned long)st.dropped,
+                st.lastDetect_ms, st.avgDetect_ms, st.maxDetect_ms, st.lastDeliver_ms, st.maxDeliver_ms);
+}
@@ -2,6 +2,22 @@
 #include "MAX30102_Driver.h"
 #include "SOSButton_Driver.h"
 #include "HeartRate_Service.h"
+#include "LedAGC_Service.h"
+#include "MotionCancel_Service.h"
+#include "SpectralHR_Service.h"
+#include "gyro_module.h"
+
+// Heart-rate estimator: per-sample beat detection in HeartRate_Service, or
+// the once-a-second spectral estimate (SpectralHR_Service). SpO2, quality
+// and finger detection come from HeartRate_Service either way.
+enum HrEstimator {
+  HR_ESTIMATOR_PEAKS,
+  HR_ESTIMATOR_SPECTRAL,
+};
+
+#ifndef HR_ESTIMATOR_DEFAULT
+#define HR_ESTIMATOR_DEFAULT HR_ESTIMATOR_PEAKS
+#endif
 
 // Initialize the heart-rate subsystem (what used to live in setup()).
 // - serialLogging: if true, the module prints status/log lines; if false, it stays quiet.
@@ -13,3 +29,44 @@ void HR_init(bool serialLogging = true, bool calibrationMode = false);
 // - Returns current heart rate (bpm) if a valid reading is available, otherwise 0.0f.
 // - Non-blocking; you choose your own pacing (e.g., call every 10–20 ms).
 float HR_step();
+
+// Latest full reading (HR, SpO2, signal quality, finger detection) for
+// consumers that need more than the bpm value returned by HR_step().
+HeartRateData HR_getReadings();
+
+// Select the heart-rate estimator at runtime (default HR_ESTIMATOR_DEFAULT).
+void HR_setEstimator(HrEstimator estimator);
+HrEstimator HR_getEstimator();
+
+// Latest spectral estimate with its confidence (only updated while the
+// spectral estimator is selected).
+SpectralHRData HR_getSpectral();
+
+// Latest MAX30102 die temperature in °C (NAN until the first conversion).
+// Refreshed in the background by HR_step() without blocking.
+float HR_getTemperature();
+
+// Change the PPG sample rate (MAX30102_SAMPLE_RATE_*) and FIFO averaging.
+// Used by power profiles; buffered samples are discarded on a change.
+void HR_setSampling(uint8_t sampleRate, uint8_t fifoAverage);
+
+// Samples per second delivered by the FIFO with the current settings.
+float HR_getEffectiveRate();
+
+// Feed one gyro reading as the motion reference for artifact cancellation.
+// Call right after Gyro_step(); PPG samples are aligned to it by timestamp.
+void HR_addMotionReference(const GyroReading &g);
+
+// Enable/disable the adaptive motion-artifact filter (enabled by default).
+void HR_setMotionCancel(bool enabled);
+
+// Filter cost (cycles per PPG sample) against the budget at the current rate.
+void HR_printMotionStats();
+
+// True while the SOS button timer is timing a press or an acknowledge press
+// waits out the double-press window (keep the CPU out of light sleep so
+// long/double press detection stays on schedule).
+bool HR_isButtonActive();
+
+// SOS button event latency: edge to queued event, and edge to consumer.
+void HR_printButtonStats();
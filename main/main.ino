@@ -1,38 +1,279 @@
 #include "hr_module.h"
 #include "gyro_module.h"
 #include "ellipse_sim.h"
+#include "RiskScore_Service.h"
+#include "CoachStats_Service.h"
+#include "power_manager.h"
+#include "I2C_Bus.h"
+#include "uplink.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "course_monitor.h"
+#include "alert_engine.h"
+#include "blackbox.h"
+#include <LittleFS.h>
 
 float bpm;
 GyroReading g;
 EllipseConfig cfg;
-bool alert = false;
+bool gyroOk = false;
+EllipsePoint p;
+RiskScore_Service risk;
+CoachStats_Service coach;
+uint32_t lastPowerStats = 0;
+uint32_t lastCoachReport = 0;
+const uint32_t COACH_REPORT_MS = 300000; // coach summary frame every 5 min
 
 HardwareSerial Link(2);
+const int32_t DEVICE_ID = 1234;
+
+// Raw sensor session on flash (tools/session_replay.cpp reads it back)
+const char *SESSION_PATH = "/session.bin";
+File sessionFile;
+
+// Course to follow, "lat,lon" per line (course_monitor.h); optional
+const char *COURSE_PATH = "/course.csv";
+
+// Flash the black-box ring leaves free: a SESSION_PATH recording (~4 min
+// uncoded at full rate), the course file and filesystem metadata
+const size_t FS_RESERVE_BYTES = 320 * 1024;
+
+// Serial console:
+//   "prof"       dump the profiler table, "prof reset" clears it
+//   "rec start"  record raw sensor data to SESSION_PATH, "rec stop" ends it
+//                (the black box pauses meanwhile)
+//   "rec dump"   write the last session to this port as raw bytes
+//   "bb"         black-box ring state (blackbox.h)
+//   "hr peaks"   beat-by-beat heart rate, "hr spectral" once-a-second spectral estimate
+//   "course"     loaded course, index size and distance from it
+//   "alerts"     alert engine counters, "ack" acknowledges latched alerts
+//   "coach"      time in zones, training load and HR baselines
+char cmdLine[32];
+uint8_t cmdLen = 0;
+
+void startBlackBox() {
+  if (!LittleFS.begin(/*formatOnFail=*/true)) {
+    Serial.println("[BlackBox] not recording");
+    return;
+  }
+  const size_t total = LittleFS.totalBytes();
+  if (!BlackBox_begin(LittleFS, DEVICE_ID, total > FS_RESERVE_BYTES ? total - FS_RESERVE_BYTES : 0)) {
+    Serial.println("[BlackBox] not recording");
+  }
+}
+
+void startRecording() {
+  if (Recorder_session() != 0 && !BlackBox_running()) return;
+  BlackBox_end();
+  if (!LittleFS.begin(/*formatOnFail=*/true)) {
+    Serial.println("[Rec] no filesystem");
+    return;
+  }
+  sessionFile = LittleFS.open(SESSION_PATH, FILE_WRITE);
+  if (!sessionFile || !Recorder_start(sessionFile, DEVICE_ID)) {
+    Serial.println("[Rec] cannot open session file");
+    startBlackBox();
+    return;
+  }
+  Serial.printf("[Rec] recording to %s\n", SESSION_PATH);
+}
+
+void stopRecording() {
+  if (Recorder_session() == 0 || BlackBox_running()) return;
+  Recorder_stop();
+  sessionFile.close();
+  Recorder_printStats();
+  startBlackBox();
+}
+
+void dumpRecording() {
+  if ((Recorder_session() != 0 && !BlackBox_running()) || !LittleFS.begin()) return;
+  File f = LittleFS.open(SESSION_PATH, FILE_READ);
+  if (!f) {
+    Serial.println("[Rec] no session");
+    return;
+  }
+  Serial.printf("[Rec] dump %u bytes\n", (unsigned)f.size());
+  uint8_t buf[256];
+  int n;
+  while ((n = f.read(buf, sizeof(buf))) > 0) {
+    Serial.write(buf, n);
+  }
+  f.close();
+  Serial.println();
+  Serial.println("[Rec] dump end");
+}
+
+void loadCourse() {
+  if (!LittleFS.begin() || !LittleFS.exists(COURSE_PATH)) return;
+  File f = LittleFS.open(COURSE_PATH, FILE_READ);
+  if (!f) return;
+  if (!Course_load(f)) {
+    Serial.println("[Course] cannot load course");
+  }
+  f.close();
+  Course_printInfo();
+}
+
+void printCoach() {
+  const CoachSummary &s = coach.getSummary();
+  Serial.printf("[Coach] %.1f min | zones", s.elapsed_ms / 60000.0f);
+  for (int z = 1; z <= COACH_ZONES; z++) Serial.printf(" %.1f", s.zone_ms[z] / 60000.0f);
+  Serial.printf(" min | TRIMP %.1f, load %.0f/h acute %.0f/h chronic | HR rest %.0f%s max %.0f%s median %.0f | "
+                "%u cycles\n",
+                s.trimp, s.acuteLoad, s.chronicLoad, s.hrRest, coach.restReady() ? "" : " (profile)", s.hrMax,
+                coach.maxReady() ? "" : " (profile)", s.hrMedian, (unsigned)coach.getMaxCycles());
+}
+
+// Summary frame for the coach dashboard. The baselines stay coaching
+// figures: the risk score keeps its profile HR limits.
+void sendCoachSummary() {
+  const CoachSummary &s = coach.getSummary();
+  UplinkCoachSummary u;
+  u.elapsed_min = (uint16_t)min(s.elapsed_ms / 60000, (uint32_t)65535);
+  u.hrRest = (uint8_t)constrain(s.hrRest, 0.0f, 255.0f);
+  u.hrMax = (uint8_t)constrain(s.hrMax, 0.0f, 255.0f);
+  u.hrMedian = isnan(s.hrMedian) ? 0 : (uint8_t)constrain(s.hrMedian, 0.0f, 255.0f);
+  for (int z = 0; z < UPLINK_COACH_ZONES; z++) u.zone_10s[z] = (uint16_t)min(s.zone_ms[z + 1] / 10000, (uint32_t)65535);
+  u.trimp = (uint16_t)constrain(s.trimp, 0.0f, 65535.0f);
+  u.acute_x10 = (uint16_t)constrain(s.acuteLoad * 10.0f, 0.0f, 65535.0f);
+  u.chronic_x10 = (uint16_t)constrain(s.chronicLoad * 10.0f, 0.0f, 65535.0f);
+  Uplink_sendCoach(u);
+}
+
+void handleCommand(const char *cmd) {
+  if (strcmp(cmd, "prof") == 0) {
+    Prof_print();
+  } else if (strcmp(cmd, "prof reset") == 0) {
+    Prof_reset();
+    Serial.println("[Prof] reset");
+  } else if (strcmp(cmd, "rec start") == 0) {
+    startRecording();
+  } else if (strcmp(cmd, "rec stop") == 0) {
+    stopRecording();
+  } else if (strcmp(cmd, "rec dump") == 0) {
+    dumpRecording();
+  } else if (strcmp(cmd, "bb") == 0) {
+    BlackBox_printStats();
+  } else if (strcmp(cmd, "hr peaks") == 0) {
+    HR_setEstimator(HR_ESTIMATOR_PEAKS);
+  } else if (strcmp(cmd, "hr spectral") == 0) {
+    HR_setEstimator(HR_ESTIMATOR_SPECTRAL);
+  } else if (strcmp(cmd, "course") == 0) {
+    Course_printInfo();
+  } else if (strcmp(cmd, "alerts") == 0) {
+    Alert_printStats();
+  } else if (strcmp(cmd, "ack") == 0) {
+    Alert_acknowledge();
+  } else if (strcmp(cmd, "coach") == 0) {
+    printCoach();
+  } else if (cmd[0] != '\0') {
+    Serial.printf("unknown command: %s\n", cmd);
+  }
+}
+
+void pollConsole() {
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c == '\r' || c == '\n') {
+      cmdLine[cmdLen] = '\0';
+      handleCommand(cmdLine);
+      cmdLen = 0;
+    } else if (cmdLen < sizeof(cmdLine) - 1) {
+      cmdLine[cmdLen++] = c;
+    }
+  }
+}
 
 void setup() {
   Serial.begin(115200);
   Link.begin(9600, SERIAL_8N1, 32, 33);
+  Uplink_init(Link, DEVICE_ID, (uint16_t)esp_random()); // new boot id every power-up
+  Alert_init(/*serialLogging=*/true);
 
   HR_init(/*serialLogging=*/false, /*calibrationMode=*/false);
 
   Gyro_init(/*serialLogging=*/true);
 
   Ellipse_init(cfg);
+  Ellipse_step(p);
+
+  risk.begin();
+  coach.begin();
+
+  loadCourse();
+  startBlackBox();
+
+  Power_init(/*serialLogging=*/true, /*wakePin=*/34, /*wakeActiveHigh=*/true);
 }
 
 void loop() {
-  // HR sensor
-  bpm = HR_step();
-  Serial.print("BPM: ");
-  Serial.println(bpm);
-
-  // Gyro sensor
-  if (Gyro_step(g)) {
-    if (g.rollRate_dps > 100 || g.pitchRate_dps > 100) {
-      alert = true;
-    } else {
-      alert = false;
+  const uint32_t now = millis();
+  bool imuFresh = false; // g holds a reading taken on this pass
+
+  // HR sensor (drains the MAX30102 FIFO)
+  if (Power_due(POWER_TASK_PPG, now)) {
+    bpm = HR_step();
+  }
+
+  // Gyro sensor; a sustained rate spike is a fall (alert_engine.h), a bump is not
+  if (Power_due(POWER_TASK_IMU, now)) {
+    gyroOk = Gyro_step(g);
+    imuFresh = gyroOk;
+    if (gyroOk) {
+      HR_addMotionReference(g); // reference for PPG motion-artifact cancellation
+      if (Gyro_isLowPower()) {
+        // REST: the gyro sleeps, the accelerometer's tilt rate stands in
+        uint32_t span_ms;
+        const float tilt = Gyro_tiltRate(span_ms);
+        Alert_update(ALERT_COND_FALL, tilt, now, span_ms);
+      } else {
+        Alert_update(ALERT_COND_FALL, max(fabsf(g.rollRate_dps), fabsf(g.pitchRate_dps)), now);
+      }
     }
+  }
+
+  // GPS position simulator
+  if (Power_due(POWER_TASK_FIX, now)) {
+    Ellipse_step(p);
+    Recorder_fix(micros(), p.lat_deg, p.lon_deg, p.east_m, p.north_m);
+    risk.addFix(now, p.east_m, p.north_m, NAN);
+
+    // Off-course with hysteresis (course_monitor.h)
+    const CourseStatus &cs = Course_update(p.lat_deg, p.lon_deg);
+    Alert_update(ALERT_COND_OFF_COURSE, cs.offCourse ? 1.0f : 0.0f, now);
+  }
+
+  // Risk score
+  HeartRateData hr_data = HR_getReadings();
+  RiskInput in;
+  in.timestamp = now;
+  in.heartRate = hr_data.validReading ? hr_data.heartRate : 0;
+  in.spO2 = hr_data.validReading ? hr_data.spO2 : 0;
+  in.signalQuality = hr_data.signalQuality;
+  // Rates only from a reading taken on this pass; a held one would be
+  // counted again on every pass until the next IMU step
+  in.rollRate_dps = imuFresh ? g.rollRate_dps : NAN;
+  in.pitchRate_dps = imuFresh ? g.pitchRate_dps : NAN;
+  in.temperature = HR_getTemperature();
+  const RiskScore &rs = risk.update(in);
+  coach.update(hr_data, risk.getSpeed(), imuFresh ? fabsf(g.rollRate_dps) + fabsf(g.pitchRate_dps) : NAN, now);
+  Alert_update(ALERT_COND_RISK, rs.score, now);
+
+  // Deferred alert events, as the rate limit allows
+  Alert_service(now);
+  const bool alert = Alert_active();
+
+  // Position and vitals carried by the next telemetry or alert frame
+  Uplink_setStatus(p.lat_deg, p.lon_deg, (uint8_t)bpm, rs.score);
+
+  // Activity / risk driven power profile
+  Power_update(g, rs.score, alert, now);
+
+  // Send payload to satellite at the profile's reporting interval
+  if (Power_due(POWER_TASK_REPORT, now)) {
+    Serial.print("BPM: ");
+    Serial.println(bpm);
     Serial.print("roll=");
     Serial.print(g.roll_deg, 1);
     Serial.print("  pitch=");
@@ -43,34 +284,36 @@ void loop() {
     Serial.print(g.pitchRate_dps, 1);
     Serial.print(" | ");
     Serial.println(alert ? " !ALERT" : "");
+    Serial.printf("lat=%.7f lon=%.7f\n", p.lat_deg, p.lon_deg);
+    Serial.printf("risk=%u (heat %u, exertion %u, hypoxia %u, fall %u) %u cycles | %s\n",
+                  rs.score, rs.heat, rs.exertion, rs.hypoxia, rs.fall, (unsigned)risk.getLastCycles(),
+                  Power_config().name);
+
+    // Telemetry goes out from the uplink task; alerts raised above pre-empt it
+    Uplink_sendTelemetry(alert);
+    Serial.println();
   }
 
-  // GPS position simulator
-  EllipsePoint p;
-  Ellipse_step(p);
-  Serial.printf("lat=%.7f lon=%.7f\n", p.lat_deg, p.lon_deg);
-
-  // Send payload to satellite
-  const float lat = p.lat_deg;
-  const float lon = p.lon_deg;
-  const uint8_t hr = bpm;
-  const int32_t id = 1234;
-  uint8_t payload[17];
-  size_t off = 0;
-  payload[off++] = (uint8_t)(alert ? 'a' : 'd');  // 'a' = alert, 'd' = data
-  memcpy(payload + off, &lat, sizeof(lat));
-  off += sizeof(lat);
-  memcpy(payload + off, &lon, sizeof(lon));
-  off += sizeof(lon);
-  payload[off++] = hr;
-  memcpy(payload + off, &id, sizeof(id));
-  off += sizeof(id);
-  payload[off++] = 0x00;
-  payload[off++] = 0xFF;
-  payload[off++] = 0x00;
-  Link.write(payload, off);
-
-  // Pacing
-  Serial.println();
-  delay(200);
+  if (now - lastCoachReport >= COACH_REPORT_MS) {
+    lastCoachReport = now;
+    sendCoachSummary();
+  }
+
+  // Battery estimate and bus load once a minute
+  if (now - lastPowerStats >= 60000) {
+    lastPowerStats = now;
+    Power_printStats();
+    I2C_Bus::printAllStats();
+    HR_printMotionStats();
+    HR_printButtonStats();
+    Uplink_printStats();
+    Alert_printStats();
+    if (BlackBox_running()) BlackBox_printStats();
+    else Recorder_printStats();
+  }
+
+  pollConsole();
+
+  // Pacing: sleep until the next task is due
+  Power_idle();
 }
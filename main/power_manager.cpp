@@ -0,0 +1,234 @@
+#include "power_manager.h"
+#include "hr_module.h"
+#include "uplink.h"
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+
+// Battery used for the life estimate
+static const float BATTERY_MAH = 1000.0f;
+
+// Activity thresholds on the smoothed |roll| + |pitch| rate (dps)
+static const float MOTION_ACTIVE_DPS = 40.0f;
+static const float MOTION_MODERATE_DPS = 8.0f;
+static const float MOTION_TAU_S = 5.0f;
+static const uint32_t STILL_TO_REST_MS = 60000;   // stillness before REST
+static const uint32_t MIN_DWELL_MS = 10000;       // before stepping down a profile
+static const uint32_t MIN_SLEEP_MS = 5;           // shorter idles just delay()
+static const uint8_t FIFO_WAKE_SAMPLES = 24;      // drain before the 32-deep FIFO fills
+static const uint8_t RISK_ALERT_LEVEL = 70;
+
+// The ground times silences from the slowest report interval
+// (DEVICE_MAX_REPORT_S in ground/frame.h): keep the two in step
+static const PowerProfileConfig PROFILES[POWER_PROFILE_COUNT] = {
+  //  name        PPG rate                  avg  imuLP  imu   fix    report  sleep  awake  sleep
+  {"ALERT",    MAX30102_SAMPLE_RATE_100, 4, false,  20,  1000,   1000, false, 62.0f, 62.0f},
+  {"ACTIVE",   MAX30102_SAMPLE_RATE_100, 4, false,  20,  1000,   5000, false, 58.0f, 58.0f},
+  {"MODERATE", MAX30102_SAMPLE_RATE_50,  2, false,  50,  2000,  15000, true,  45.0f, 9.0f},
+  {"REST",     MAX30102_SAMPLE_RATE_50,  4, true,  500, 10000,  60000, true,  40.0f, 3.5f},
+};
+
+static bool g_inited = false;
+static bool g_log = true;
+static PowerProfile g_profile = POWER_ACTIVE;
+static uint32_t g_profileSince = 0;
+static float g_motion = 0.0f;
+static uint32_t g_lastUpdate = 0;
+static uint32_t g_stillSince = 0;
+static uint32_t g_nextDue[POWER_TASK_COUNT];
+static int g_wakePin = -1;
+static bool g_wakeActiveHigh = true;
+
+// Accounting
+static uint64_t g_awake_us[POWER_PROFILE_COUNT];
+static uint64_t g_sleep_us[POWER_PROFILE_COUNT];
+static uint32_t g_transitions = 0;
+static int64_t g_lastMark_us = 0;
+
+static uint32_t taskInterval(PowerTask task) {
+  const PowerProfileConfig &c = PROFILES[g_profile];
+  switch (task) {
+    case POWER_TASK_PPG: {
+      float rate = HR_getEffectiveRate();
+      return rate > 0 ? (uint32_t)(1000.0f * FIFO_WAKE_SAMPLES / rate) : 200;
+    }
+    case POWER_TASK_IMU: return c.imuInterval_ms;
+    case POWER_TASK_FIX: return c.fixInterval_ms;
+    default: return c.reportInterval_ms;
+  }
+}
+
+// Charge elapsed awake time to the current profile
+static void markAwake() {
+  int64_t now = esp_timer_get_time();
+  g_awake_us[g_profile] += (uint64_t)(now - g_lastMark_us);
+  g_lastMark_us = now;
+}
+
+static void applyProfile(PowerProfile p, uint32_t now) {
+  markAwake();
+  g_profile = p;
+  g_profileSince = now;
+  g_transitions++;
+
+  const PowerProfileConfig &c = PROFILES[p];
+  HR_setSampling(c.ppgSampleRate, c.ppgAverage);
+  Gyro_setLowPower(c.imuLowPower);
+
+  // Re-plan every task from now on the new intervals
+  for (int t = 0; t < POWER_TASK_COUNT; t++) {
+    g_nextDue[t] = now + taskInterval((PowerTask)t);
+  }
+  g_nextDue[POWER_TASK_REPORT] = now; // report the change right away
+
+  if (g_log) {
+    Serial.print(F("[Power] profile -> ")); Serial.println(c.name);
+  }
+}
+
+void Power_init(bool serialLogging, int wakePin, bool wakeActiveHigh) {
+  if (g_inited) return;
+  g_inited = true;
+  g_log = serialLogging;
+
+  for (int p = 0; p < POWER_PROFILE_COUNT; p++) {
+    g_awake_us[p] = 0;
+    g_sleep_us[p] = 0;
+  }
+  g_lastMark_us = esp_timer_get_time();
+
+  uint32_t now = millis();
+  g_lastUpdate = now;
+  g_stillSince = now;
+  for (int t = 0; t < POWER_TASK_COUNT; t++) g_nextDue[t] = now;
+  g_profile = POWER_ACTIVE;
+  g_profileSince = now;
+
+  // The SOS button must wake the CPU from light sleep. The level wake is
+  // armed only around each sleep (Power_idle): it replaces the pin's
+  // interrupt type, and the button driver runs on its edge interrupt.
+  g_wakePin = wakePin;
+  g_wakeActiveHigh = wakeActiveHigh;
+  if (wakePin >= 0) {
+    esp_sleep_enable_gpio_wakeup();
+  }
+
+  if (g_log) {
+    Serial.println(F("[Power] Init, profile ACTIVE"));
+  }
+}
+
+PowerProfile Power_update(const GyroReading &g, uint8_t riskScore, bool alert, uint32_t now) {
+  if (!g_inited) return g_profile;
+
+  float dt = (now - g_lastUpdate) * 0.001f;
+  g_lastUpdate = now;
+
+  // Motion intensity: smoothed gyro rate, or accel-detected motion while the gyro sleeps
+  float rate = fabsf(g.rollRate_dps) + fabsf(g.pitchRate_dps);
+  if (Gyro_isLowPower() && Gyro_motionDetected()) {
+    rate = MOTION_ACTIVE_DPS;
+    g_motion = MOTION_ACTIVE_DPS; // wake up immediately
+  }
+  float alpha = dt / (MOTION_TAU_S + dt);
+  g_motion += alpha * (rate - g_motion);
+  if (g_motion >= MOTION_MODERATE_DPS) g_stillSince = now;
+
+  PowerProfile target;
+  if (alert || riskScore >= RISK_ALERT_LEVEL) target = POWER_ALERT;
+  else if (g_motion >= MOTION_ACTIVE_DPS) target = POWER_ACTIVE;
+  else if (now - g_stillSince >= STILL_TO_REST_MS) target = POWER_REST;
+  else target = POWER_MODERATE;
+
+  // Step up immediately, step down only after a minimum dwell
+  if (target < g_profile || (target > g_profile && now - g_profileSince >= MIN_DWELL_MS)) {
+    applyProfile(target, now);
+  }
+  return g_profile;
+}
+
+PowerProfile Power_profile() {
+  return g_profile;
+}
+
+const PowerProfileConfig &Power_config() {
+  return PROFILES[g_profile];
+}
+
+bool Power_due(PowerTask task, uint32_t now) {
+  if ((int32_t)(now - g_nextDue[task]) < 0) return false;
+  g_nextDue[task] = now + taskInterval(task);
+  return true;
+}
+
+void Power_idle() {
+  uint32_t now = millis();
+  int32_t wait = INT32_MAX;
+  for (int t = 0; t < POWER_TASK_COUNT; t++) {
+    wait = min(wait, (int32_t)(g_nextDue[t] - now));
+  }
+  if (wait <= 0) return;
+
+  // No light sleep while the SOS button timer is timing a press or the
+  // uplink still has frames or alert repeats to send (UART stops in sleep)
+  if (!PROFILES[g_profile].lightSleep || (uint32_t)wait < MIN_SLEEP_MS || HR_isButtonActive() || Uplink_busy()) {
+    delay(wait);
+    return;
+  }
+
+  // A level wake on a pin already at that level would return at once
+  const gpio_num_t pin = (gpio_num_t)g_wakePin;
+  if (g_wakePin >= 0 && digitalRead(g_wakePin) == (g_wakeActiveHigh ? HIGH : LOW)) {
+    delay(wait);
+    return;
+  }
+
+  markAwake();
+  Serial.flush(); // UART stops in light sleep
+  esp_sleep_enable_timer_wakeup((uint64_t)wait * 1000ULL);
+  if (g_wakePin >= 0) {
+    // Interrupt off while the pin is level-triggered, or a held button would
+    // re-enter the ISR without end after waking
+    gpio_intr_disable(pin);
+    gpio_wakeup_enable(pin, g_wakeActiveHigh ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+  }
+  int64_t t0 = esp_timer_get_time();
+  esp_light_sleep_start();
+  int64_t t1 = esp_timer_get_time();
+  if (g_wakePin >= 0) {
+    // Back to the edge interrupt the SOS driver attached; an edge missed
+    // meanwhile is picked up by its update() (HR_step)
+    gpio_wakeup_disable(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    gpio_intr_enable(pin);
+  }
+  g_sleep_us[g_profile] += (uint64_t)(t1 - t0);
+  g_lastMark_us = t1;
+
+  // Woken by the SOS button: deliver its events (HR_step) right away
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+    g_nextDue[POWER_TASK_PPG] = millis();
+  }
+}
+
+void Power_printStats() {
+  markAwake();
+
+  uint64_t total_us = 0;
+  float charge_mAs = 0.0f;
+  for (int p = 0; p < POWER_PROFILE_COUNT; p++) {
+    total_us += g_awake_us[p] + g_sleep_us[p];
+    charge_mAs += PROFILES[p].awake_mA * (g_awake_us[p] * 1e-6f) + PROFILES[p].sleep_mA * (g_sleep_us[p] * 1e-6f);
+  }
+  if (total_us == 0) return;
+
+  Serial.println(F("[Power] profile    time(s)  awake%  share%"));
+  for (int p = 0; p < POWER_PROFILE_COUNT; p++) {
+    uint64_t t = g_awake_us[p] + g_sleep_us[p];
+    Serial.printf("[Power] %-9s %8.0f  %6.1f  %6.1f\n", PROFILES[p].name, t * 1e-6,
+                  t ? 100.0 * g_awake_us[p] / t : 0.0, 100.0 * t / total_us);
+  }
+
+  float avg_mA = charge_mAs / (total_us * 1e-6f);
+  Serial.printf("[Power] avg %.1f mA, used %.1f mAh, est. battery life %.1f h, %u transitions\n",
+                avg_mA, charge_mAs / 3600.0f, BATTERY_MAH / avg_mA, (unsigned)g_transitions);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+#include "gyro_module.h"
+
+// Power profiles, from most to least capable
+enum PowerProfile {
+  POWER_ALERT,     // risk/alert active: everything at full rate
+  POWER_ACTIVE,    // running / moving a lot
+  POWER_MODERATE,  // walking, light movement
+  POWER_REST,      // still for a while: IMU in accel-only cycle mode
+  POWER_PROFILE_COUNT
+};
+
+// Periodic tasks scheduled by the power manager
+enum PowerTask {
+  POWER_TASK_PPG,     // drain the MAX30102 FIFO
+  POWER_TASK_IMU,     // Gyro_step()
+  POWER_TASK_FIX,     // GNSS fix
+  POWER_TASK_REPORT,  // uplink frame
+  POWER_TASK_COUNT
+};
+
+struct PowerProfileConfig {
+  const char *name;
+  uint8_t ppgSampleRate;      // MAX30102_SAMPLE_RATE_*
+  uint8_t ppgAverage;         // FIFO averaging
+  bool imuLowPower;           // accel-only cycle mode
+  uint16_t imuInterval_ms;
+  uint16_t fixInterval_ms;
+  uint32_t reportInterval_ms;
+  bool lightSleep;            // light-sleep between tasks
+  float awake_mA;             // estimated draw while the CPU runs
+  float sleep_mA;             // estimated draw in light sleep
+};
+
+// Initialize. wakePin: GPIO that wakes the CPU from light sleep (SOS button), -1 for none.
+void Power_init(bool serialLogging = true, int wakePin = -1, bool wakeActiveHigh = true);
+
+// Feed the latest motion and risk state. Applies profile changes to the
+// sensors and returns the active profile.
+PowerProfile Power_update(const GyroReading &g, uint8_t riskScore, bool alert, uint32_t now);
+
+PowerProfile Power_profile();
+const PowerProfileConfig &Power_config();
+
+// True when a task is due; marks it as run.
+bool Power_due(PowerTask task, uint32_t now);
+
+// Idle until the next task is due: light sleep if the profile allows it, delay otherwise.
+void Power_idle();
+
+// Print time spent per profile, awake vs sleep, and the battery estimate.
+void Power_printStats();
@@ -0,0 +1,86 @@
+#include "profiler.h"
+
+#if PROFILING_ENABLED
+
+#include <freertos/FreeRTOS.h>
+
+static ProfEntry g_entries[PROF_MAX_ENTRIES];
+static uint8_t g_count = 0;
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void clearEntry(ProfEntry &e) {
+  e.count = 0;
+  e.min = UINT32_MAX;
+  e.max = 0;
+  e.total = 0;
+  memset(e.hist, 0, sizeof(e.hist));
+}
+
+static uint8_t bucketOf(uint32_t ticks) {
+  uint8_t k = ticks ? (uint8_t)(31 - __builtin_clz(ticks)) : 0;
+  return k < PROF_HIST_BUCKETS ? k : PROF_HIST_BUCKETS - 1;
+}
+
+uint8_t Prof_register(const char *name) {
+  uint8_t slot = PROF_MAX_ENTRIES;
+  portENTER_CRITICAL(&g_mux);
+  for (uint8_t i = 0; i < g_count; i++) {
+    if (g_entries[i].name == name || strcmp(g_entries[i].name, name) == 0) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot == PROF_MAX_ENTRIES && g_count < PROF_MAX_ENTRIES) {
+    slot = g_count++;
+    g_entries[slot].name = name;
+    clearEntry(g_entries[slot]);
+  }
+  portEXIT_CRITICAL(&g_mux);
+  return slot;
+}
+
+void Prof_record(uint8_t slot, uint32_t ticks) {
+  if (slot >= PROF_MAX_ENTRIES) return;
+  ProfEntry &e = g_entries[slot];
+  e.count++;
+  e.total += ticks;
+  if (ticks < e.min) e.min = ticks;
+  if (ticks > e.max) e.max = ticks;
+  e.hist[bucketOf(ticks)]++;
+}
+
+bool Prof_get(uint8_t slot, ProfEntry &out) {
+  if (slot >= g_count) return false;
+  portENTER_CRITICAL(&g_mux);
+  out = g_entries[slot];
+  portEXIT_CRITICAL(&g_mux);
+  return true;
+}
+
+void Prof_reset() {
+  portENTER_CRITICAL(&g_mux);
+  for (uint8_t i = 0; i < g_count; i++) clearEntry(g_entries[i]);
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void Prof_print() {
+  const float ticksPerUs = (float)ESP.getCpuFreqMHz();
+  Serial.println(F("[Prof] scope                 calls      min     mean      max  ticks | mean us | log2(ticks):calls"));
+
+  ProfEntry e;
+  for (uint8_t i = 0; Prof_get(i, e); i++) {
+    if (e.count == 0) {
+      Serial.printf("[Prof] %-20s %6u        -        -        -\n", e.name, 0u);
+      continue;
+    }
+    float mean = (float)e.total / e.count;
+    Serial.printf("[Prof] %-20s %6lu %8lu %8.0f %8lu        | %7.1f |", e.name, (unsigned long)e.count,
+                  (unsigned long)e.min, mean, (unsigned long)e.max, mean / ticksPerUs);
+    for (uint8_t k = 0; k < PROF_HIST_BUCKETS; k++) {
+      if (e.hist[k]) Serial.printf(" %u:%lu", k, (unsigned long)e.hist[k]);
+    }
+    Serial.println();
+  }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+#include <Arduino.h>
+
+// Scoped cycle-count profiling for hot paths.
+//
+//   void Gyro_step(...) {
+//     PROF_SCOPE("Gyro_step");
+//     ...
+//   }
+//
+// Each named scope gets a slot in a static table with call count, min/max/
+// mean and a log2 histogram of its cost. Ticks are CPU cycles (Xtensa CCOUNT)
+// on target and nanoseconds (steady_clock) in host builds. A slot is meant to
+// be updated from one task; there is no locking on the hot path.
+//
+// Build with PROFILING_ENABLED=0 to compile every PROF_* macro out.
+
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED 1
+#endif
+
+#define PROF_MAX_ENTRIES 24
+#define PROF_HIST_BUCKETS 24 // bucket k counts calls of [2^k, 2^(k+1)) ticks; the last is open-ended
+
+struct ProfEntry {
+  const char *name;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t hist[PROF_HIST_BUCKETS];
+};
+
+#if PROFILING_ENABLED
+
+#if !defined(__XTENSA__)
+#include <chrono>
+#endif
+
+static inline uint32_t Prof_ticks() {
+#if defined(__XTENSA__)
+  uint32_t ccount;
+  __asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));
+  return ccount;
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Slot for a scope name (same pointer or equal string = same slot).
+// Returns PROF_MAX_ENTRIES if the table is full.
+uint8_t Prof_register(const char *name);
+void Prof_record(uint8_t slot, uint32_t ticks);
+
+class ProfScope {
+public:
+  explicit ProfScope(uint8_t slot) : _slot(slot), _start(Prof_ticks()) {}
+  ~ProfScope() { Prof_record(_slot, Prof_ticks() - _start); }
+
+private:
+  uint8_t _slot;
+  uint32_t _start;
+};
+
+#define PROF_CAT_(a, b) a##b
+#define PROF_CAT(a, b) PROF_CAT_(a, b)
+#define PROF_SCOPE(name)                                                    \
+  static const uint8_t PROF_CAT(_profSlot, __LINE__) = Prof_register(name); \
+  ProfScope PROF_CAT(_profScope, __LINE__)(PROF_CAT(_profSlot, __LINE__))
+
+// Print the table: ticks and microseconds per call plus the histogram.
+void Prof_print();
+void Prof_reset();
+
+// Copy of one slot, false past the last used slot.
+bool Prof_get(uint8_t slot, ProfEntry &out);
+
+#else
+
+#define PROF_SCOPE(name) \
+  do {                   \
+  } while (0)
+
+static inline void Prof_print() {}
+static inline void Prof_reset() {}
+static inline bool Prof_get(uint8_t, ProfEntry &) { return false; }
+
+#endif
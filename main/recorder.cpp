@@ -0,0 +1,391 @@
+#include "recorder.h"
+#include "session_codec.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const uint32_t TASK_STACK = 3072;
+static const UBaseType_t TASK_PRIORITY = 1;  // same as loop(); flash writes may block
+static const uint32_t WRITER_POLL_MS = 200;
+
+static Stream *g_out = nullptr;
+static uint32_t g_session = 0;
+static uint32_t g_sessionCount = 0;
+static bool g_compress = false;
+static TaskHandle_t g_task = nullptr;
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Chunk buffers. Full ones are written in order; g_mux guards the lists.
+static uint8_t g_buf[RECORDER_BUFFERS][RECORDER_CHUNK_BYTES];
+static uint8_t g_full[RECORDER_BUFFERS];
+static uint8_t g_fullHead = 0, g_fullCount = 0;
+static uint8_t g_free[RECORDER_BUFFERS];
+static uint8_t g_freeCount = 0;
+static uint32_t g_chunkSession[RECORDER_BUFFERS]; // session each chunk was recorded in
+static uint32_t g_writingSession = 0;             // of the chunk being written (writer task)
+static bool g_serviceBusy = false;
+static RecorderStats g_stats;
+static uint8_t g_coded[RECORDER_CHUNK_BYTES];  // writer task only
+
+// Open chunk (loop task only)
+static int8_t g_cur = -1;
+static uint16_t g_curLen = 0;  // header included
+static uint16_t g_curRecords = 0;
+static uint64_t g_lastT = 0;
+static uint32_t g_gap = 0;     // records dropped since the last open chunk
+
+// IMU averaging window (loop task only)
+static uint32_t g_imuWindow_us = 0;
+static int32_t g_imuSum[3];
+static uint8_t g_imuCount = 0;
+static uint32_t g_imuStart_us = 0; // last IMU record written; the window opens there
+static uint32_t g_imuLast_us = 0;  // last sample added
+
+static void recorderTask(void *) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WRITER_POLL_MS));
+    Recorder_service();
+  }
+}
+
+static void wake() {
+  if (g_task) xTaskNotifyGive(g_task);
+}
+
+// micros() stamps are 32-bit; chunks carry the full esp_timer time. Hooks are
+// called with recent stamps, so the difference to now fits in 32 bits.
+static uint64_t fullTime(uint32_t t_us) {
+  uint64_t now = (uint64_t)esp_timer_get_time();
+  return now - (uint32_t)((uint32_t)now - t_us);
+}
+
+static void putRecordHeader(uint8_t type, uint8_t count, uint16_t dt) {
+  uint8_t *p = g_buf[g_cur] + g_curLen;
+  p[0] = type;
+  p[1] = count;
+  memcpy(p + 2, &dt, sizeof(dt));
+  g_curLen += SESSION_RECORD_HEADER_SIZE;
+  g_curRecords++;
+}
+
+static void closeChunk() {
+  if (g_cur < 0) return;
+  uint8_t *chunk = g_buf[g_cur];
+  uint16_t sync = SESSION_CHUNK_SYNC;
+  uint16_t payload = g_curLen - SESSION_CHUNK_HEADER_SIZE;
+  uint16_t crc = 0; // filled in by the writer
+  memcpy(chunk + 0, &sync, 2);
+  memcpy(chunk + 2, &payload, 2);
+  memcpy(chunk + 4, &g_curRecords, 2);
+  memcpy(chunk + 6, &crc, 2);
+
+  portENTER_CRITICAL(&g_mux);
+  g_full[(g_fullHead + g_fullCount) % RECORDER_BUFFERS] = (uint8_t)g_cur;
+  g_fullCount++;
+  if (g_fullCount > g_stats.maxQueued) g_stats.maxQueued = g_fullCount;
+  portEXIT_CRITICAL(&g_mux);
+
+  g_cur = -1;
+  wake();
+}
+
+static bool openChunk(uint64_t t) {
+  portENTER_CRITICAL(&g_mux);
+  int8_t idx = g_freeCount > 0 ? (int8_t)g_free[--g_freeCount] : -1;
+  portEXIT_CRITICAL(&g_mux);
+  if (idx < 0) return false;
+
+  g_cur = idx;
+  g_chunkSession[g_cur] = g_session;
+  memcpy(g_buf[g_cur] + 8, &t, sizeof(t));
+  g_curLen = SESSION_CHUNK_HEADER_SIZE;
+  g_curRecords = 0;
+  g_lastT = t;
+
+  if (g_gap > 0) {
+    float value = (float)g_gap;
+    putRecordHeader(SESSION_REC_EVENT, SESSION_EVT_GAP, 0);
+    memcpy(g_buf[g_cur] + g_curLen, &value, sizeof(value));
+    g_curLen += sizeof(value);
+    g_gap = 0;
+  }
+  return true;
+}
+
+// Reserve a record at t_us; returns where its body goes, or nullptr if it
+// was dropped (not recording, or no free chunk buffer).
+static uint8_t *beginRecord(uint8_t type, uint8_t count, uint32_t t_us, size_t body) {
+  if (g_session == 0) return nullptr;
+
+  uint64_t t = fullTime(t_us);
+  const size_t need = SESSION_RECORD_HEADER_SIZE + body;
+  // A chunk never spans a header restart: the output may start a new file
+  // at the first chunk of the new session
+  if (g_cur >= 0 && g_chunkSession[g_cur] != g_session) closeChunk();
+  if (g_cur >= 0) {
+    if (t < g_lastT) t = g_lastT;
+    uint64_t dt = t - g_lastT;
+    size_t extra = dt > 0xFFFF ? SESSION_RECORD_HEADER_SIZE + 4 : 0;
+    if (dt > UINT32_MAX || g_curLen + extra + need > RECORDER_CHUNK_BYTES) closeChunk();
+  }
+  if (g_cur < 0 && !openChunk(t)) {
+    g_gap++;
+    g_stats.dropped++;
+    return nullptr;
+  }
+
+  uint64_t dt = t - g_lastT;
+  if (dt > 0xFFFF) {
+    uint32_t longDt = (uint32_t)dt;
+    putRecordHeader(SESSION_REC_TIME, 0, 0);
+    memcpy(g_buf[g_cur] + g_curLen, &longDt, sizeof(longDt));
+    g_curLen += sizeof(longDt);
+    dt = 0;
+  }
+  putRecordHeader(type, count, (uint16_t)dt);
+  g_lastT = t;
+
+  uint8_t *p = g_buf[g_cur] + g_curLen;
+  g_curLen += body;
+  g_stats.records++;
+  return p;
+}
+
+static void put24(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+}
+
+bool Recorder_start(Stream &out, int32_t deviceId, bool startTask, bool compress, uint32_t imuWindow_us) {
+  if (g_session != 0) return false;
+
+  g_out = &out;
+  g_compress = compress;
+  g_imuWindow_us = imuWindow_us;
+  memset(g_imuSum, 0, sizeof(g_imuSum));
+  g_imuCount = 0;
+  g_imuStart_us = g_imuLast_us = 0;
+  memset(&g_stats, 0, sizeof(g_stats));
+  portENTER_CRITICAL(&g_mux);
+  for (uint8_t i = 0; i < RECORDER_BUFFERS; i++) g_free[i] = i;
+  g_freeCount = RECORDER_BUFFERS;
+  g_fullHead = 0;
+  g_fullCount = 0;
+  portEXIT_CRITICAL(&g_mux);
+  g_cur = -1;
+  g_gap = 0;
+
+  uint8_t header[SESSION_FILE_HEADER_SIZE];
+  uint16_t version = SESSION_VERSION;
+  uint16_t headerBytes = SESSION_FILE_HEADER_SIZE;
+  uint32_t startMs = millis();
+  memcpy(header + 0, SESSION_MAGIC, 4);
+  memcpy(header + 4, &version, 2);
+  memcpy(header + 6, &headerBytes, 2);
+  memcpy(header + 8, &deviceId, 4);
+  memcpy(header + 12, &startMs, 4);
+  if (g_out->write(header, sizeof(header)) != sizeof(header)) return false;
+  g_stats.bytes = sizeof(header);
+  g_stats.rawBytes = sizeof(header);
+
+  if (startTask && !g_task) {
+    xTaskCreatePinnedToCore(recorderTask, "recorder", TASK_STACK, nullptr, TASK_PRIORITY, &g_task, 0);
+  }
+
+  g_session = ++g_sessionCount;
+  return true;
+}
+
+void Recorder_stop() {
+  if (g_session == 0) return;
+  closeChunk();
+  g_session = 0;
+
+  // Drain; the writer task may be in the middle of a chunk
+  for (;;) {
+    Recorder_service();
+    portENTER_CRITICAL(&g_mux);
+    bool done = (g_fullCount == 0 && !g_serviceBusy);
+    portEXIT_CRITICAL(&g_mux);
+    if (done) break;
+    delay(1);
+  }
+  g_out->flush();
+}
+
+uint32_t Recorder_session() {
+  return g_session;
+}
+
+uint32_t Recorder_chunkSession() {
+  return g_writingSession;
+}
+
+void Recorder_restartHeaders() {
+  portENTER_CRITICAL(&g_mux);
+  if (g_session != 0) g_session = ++g_sessionCount;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void Recorder_ppgHeader(uint32_t t_us, const SessionPpgHeader &h) {
+  uint8_t *p = beginRecord(SESSION_REC_PPG_HEADER, 0, t_us, sizeof(h));
+  if (p) memcpy(p, &h, sizeof(h));
+}
+
+void Recorder_ppg(uint32_t t_us, uint32_t period_us, uint8_t queued, const uint32_t *red, const uint32_t *ir,
+                  uint8_t count) {
+  if (count == 0) return;
+  if (count > SESSION_PPG_MAX_BATCH) count = SESSION_PPG_MAX_BATCH;
+  uint8_t *p = beginRecord(SESSION_REC_PPG, count, t_us, Session_bodySize(SESSION_REC_PPG, count));
+  if (!p) return;
+  memcpy(p, &period_us, 4);
+  p[4] = queued;
+  p[5] = 0;
+  p += 6;
+  for (uint8_t i = 0; i < count; i++, p += 6) {
+    put24(p, red[i]);
+    put24(p + 3, ir[i]);
+  }
+}
+
+void Recorder_imuHeader(uint32_t t_us, const GyroCalibration &cal) {
+  SessionImuHeader h = {cal.sensitivity, cal.biasRoll_dps, cal.biasPitch_dps, cal.biasYaw_dps};
+  uint8_t *p = beginRecord(SESSION_REC_IMU_HEADER, 0, t_us, sizeof(h));
+  if (p) memcpy(p, &h, sizeof(h));
+}
+
+// Average of the samples since the last IMU record, stamped with the newest
+static void writeImuAverage() {
+  int16_t avg[3];
+  for (int i = 0; i < 3; i++) avg[i] = (int16_t)lroundf((float)g_imuSum[i] / g_imuCount);
+  memset(g_imuSum, 0, sizeof(g_imuSum));
+  g_imuCount = 0;
+  g_imuStart_us = g_imuLast_us;
+  uint8_t *p = beginRecord(SESSION_REC_IMU, 0, g_imuLast_us, 6);
+  if (p) memcpy(p, avg, 6);
+}
+
+void Recorder_imu(uint32_t t_us, const int16_t raw[3]) {
+  if (g_imuWindow_us == 0) {
+    uint8_t *p = beginRecord(SESSION_REC_IMU, 0, t_us, 6);
+    if (p) memcpy(p, raw, 6);
+    return;
+  }
+  if (g_session == 0) return;
+
+  // Rate x time sums the same over the average as over the samples, so the
+  // replayed angles match; write it before the next sample would overrun
+  // the window
+  for (int i = 0; i < 3; i++) g_imuSum[i] += raw[i];
+  g_imuCount++;
+  const uint32_t step = t_us - g_imuLast_us;
+  g_imuLast_us = t_us;
+  if (g_imuCount < UINT8_MAX && (t_us - g_imuStart_us) + step <= g_imuWindow_us) return;
+  writeImuAverage();
+}
+
+void Recorder_imuHeld(uint32_t t_us) {
+  if (g_imuCount > 0) writeImuAverage();
+  beginRecord(SESSION_REC_IMU_HELD, 0, t_us, 0);
+}
+
+void Recorder_fix(uint32_t t_us, float lat, float lon, float east_m, float north_m) {
+  uint8_t *p = beginRecord(SESSION_REC_FIX, 0, t_us, 16);
+  if (!p) return;
+  memcpy(p + 0, &lat, 4);
+  memcpy(p + 4, &lon, 4);
+  memcpy(p + 8, &east_m, 4);
+  memcpy(p + 12, &north_m, 4);
+}
+
+void Recorder_event(uint32_t t_us, SessionEventKind kind, float value) {
+  uint8_t *p = beginRecord(SESSION_REC_EVENT, kind, t_us, 4);
+  if (p) memcpy(p, &value, 4);
+}
+
+size_t Recorder_service() {
+  size_t total = 0;
+  for (;;) {
+    portENTER_CRITICAL(&g_mux);
+    if (g_serviceBusy || g_fullCount == 0) {
+      portEXIT_CRITICAL(&g_mux);
+      break;
+    }
+    uint8_t idx = g_full[g_fullHead];
+    g_serviceBusy = true;
+    portEXIT_CRITICAL(&g_mux);
+
+    uint8_t *chunk = g_buf[idx];
+    uint16_t payload, records;
+    memcpy(&payload, chunk + 2, 2);
+    memcpy(&records, chunk + 4, 2);
+    const size_t rawLen = SESSION_CHUNK_HEADER_SIZE + payload;
+
+    // Coded copy when it is smaller; the chunk header is the same but for
+    // the sync word and the payload size
+    uint32_t start = micros();
+    size_t coded = 0;
+    if (g_compress) {
+      coded = Session_compress(chunk + SESSION_CHUNK_HEADER_SIZE, payload, records,
+                               g_coded + SESSION_CHUNK_HEADER_SIZE, RECORDER_CHUNK_BYTES - SESSION_CHUNK_HEADER_SIZE);
+    }
+    if (coded > 0) {
+      uint16_t sync = SESSION_CHUNK_SYNC_RICE;
+      uint16_t codedLen = (uint16_t)coded;
+      memcpy(g_coded, chunk, SESSION_CHUNK_HEADER_SIZE);
+      memcpy(g_coded + 0, &sync, 2);
+      memcpy(g_coded + 2, &codedLen, 2);
+      chunk = g_coded;
+      payload = codedLen;
+    }
+    uint32_t codeTook = micros() - start;
+    uint16_t crc = Session_crc16(chunk + SESSION_CHUNK_HEADER_SIZE, payload);
+    memcpy(chunk + 6, &crc, 2);
+
+    const size_t len = SESSION_CHUNK_HEADER_SIZE + payload;
+    g_writingSession = g_chunkSession[idx];
+    start = micros();
+    size_t written = g_out->write(chunk, len);
+    uint32_t took = micros() - start;
+
+    portENTER_CRITICAL(&g_mux);
+    g_fullHead = (g_fullHead + 1) % RECORDER_BUFFERS;
+    g_fullCount--;
+    g_free[g_freeCount++] = idx;
+    g_serviceBusy = false;
+    g_stats.chunks++;
+    g_stats.bytes += written;
+    g_stats.rawBytes += rawLen;
+    if (coded > 0) g_stats.coded++;
+    g_stats.code_us += codeTook;
+    g_stats.write_us += took;
+    if (took > g_stats.maxWrite_us) g_stats.maxWrite_us = took;
+    portEXIT_CRITICAL(&g_mux);
+
+    total += written;
+  }
+  return total;
+}
+
+void Recorder_getStats(RecorderStats &out) {
+  portENTER_CRITICAL(&g_mux);
+  out = g_stats;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void Recorder_printStats() {
+  RecorderStats st;
+  Recorder_getStats(st);
+  Serial.printf("[Rec] %s | %lu records (%lu dropped) | %lu chunks, %.1f KB | queue max %u/%u | write max %.1f ms\n",
+                g_session ? "recording" : "idle", (unsigned long)st.records, (unsigned long)st.dropped,
+                (unsigned long)st.chunks, st.bytes / 1024.0f, st.maxQueued, RECORDER_BUFFERS,
+                st.maxWrite_us / 1000.0f);
+  if (st.chunks == 0) return;
+  // Throughput while the writer is busy: what the storage and the coder sustain
+  const float busy_s = (st.write_us + st.code_us) / 1e6f;
+  Serial.printf("[Rec] %lu/%lu chunks coded, ratio %.2f (%.1f KB raw) | coding %.1f ms/chunk | "
+                "sustained %.0f KB/s raw\n",
+                (unsigned long)st.coded, (unsigned long)st.chunks, st.bytes > 0 ? (float)st.rawBytes / st.bytes : 0.0f,
+                st.rawBytes / 1024.0f, st.code_us / 1000.0f / st.chunks,
+                busy_s > 0 ? st.rawBytes / 1024.0f / busy_s : 0.0f);
+}
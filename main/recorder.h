@@ -0,0 +1,81 @@
+#pragma once
+#include <Arduino.h>
+#include "session_format.h"
+#include "gyro_module.h"
+
+// Raw sensor session recorder (format in session_format.h).
+//
+// The sensor modules call the Recorder_* hooks from the loop task with the
+// raw values they are about to process; the hooks only copy into a RAM chunk
+// and return (no-ops while not recording). Full chunks are handed to a
+// low-priority writer task that puts them on the output stream (a LittleFS
+// file on the device). If the writer falls behind and no chunk buffer is
+// free, records are dropped and the gap is logged as an event.
+//
+// Modules write their per-stream header when Recorder_session() changes:
+// compare it against the session number they last wrote a header for.
+//
+// With compress set, the writer task codes each chunk (session_codec.h)
+// before writing it and keeps the plain chunk if coding does not shrink it;
+// the hooks cost the same either way.
+//
+// With an IMU window, gyro samples are averaged over up to imuWindow_us and
+// written as one IMU record: the integrated angles are kept, rate peaks
+// shorter than the window are spread over it. Keep the window under the
+// 100 ms gap Gyro_integrate() treats as a break.
+
+#define RECORDER_CHUNK_BYTES 1024  // chunk header included
+#define RECORDER_BUFFERS 8         // chunks in RAM: ~6-8 s at full PPG + IMU rate
+
+struct RecorderStats {
+  uint32_t records;
+  uint32_t dropped;       // records lost with no free chunk buffer
+  uint32_t chunks;        // written to the stream
+  uint32_t bytes;         // written to the stream, file header included
+  uint32_t rawBytes;      // the same before coding
+  uint32_t coded;         // chunks written coded
+  uint64_t code_us;       // writer time spent coding
+  uint64_t write_us;      // writer time spent in stream writes
+  uint8_t maxQueued;      // most full chunks waiting for the writer
+  uint32_t maxWrite_us;   // longest single chunk write
+};
+
+// Start a session on `out` (file header is written right away). startTask=
+// false leaves the writing to the caller (Recorder_service()), e.g. on the host.
+// imuWindow_us = 0 records every IMU sample.
+bool Recorder_start(Stream &out, int32_t deviceId, bool startTask = true, bool compress = false,
+                    uint32_t imuWindow_us = 0);
+
+// Close the partial chunk and write everything out. The stream stays open.
+void Recorder_stop();
+
+// Current session number, 0 while not recording.
+uint32_t Recorder_session();
+
+// Give the session a new number so the modules write their headers again,
+// e.g. when the output moves on to a new file. Safe from the writer task.
+// The open chunk is closed at the next record, so every chunk belongs to
+// one session number.
+void Recorder_restartHeaders();
+
+// Session number the chunk being written was recorded in; for the output
+// stream's write(), to put a new file's start at the first chunk with the
+// headers.
+uint32_t Recorder_chunkSession();
+
+// ======= Hooks (loop task) =======
+void Recorder_ppgHeader(uint32_t t_us, const SessionPpgHeader &h);
+void Recorder_ppg(uint32_t t_us, uint32_t period_us, uint8_t queued, const uint32_t *red, const uint32_t *ir,
+                  uint8_t count);
+void Recorder_imuHeader(uint32_t t_us, const GyroCalibration &cal);
+void Recorder_imu(uint32_t t_us, const int16_t raw[3]);
+void Recorder_imuHeld(uint32_t t_us);
+void Recorder_fix(uint32_t t_us, float lat, float lon, float east_m, float north_m);
+void Recorder_event(uint32_t t_us, SessionEventKind kind, float value);
+
+// Write the chunks that are full. Returns bytes written. Called by the
+// writer task.
+size_t Recorder_service();
+
+void Recorder_getStats(RecorderStats &out);
+void Recorder_printStats();
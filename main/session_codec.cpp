@@ -0,0 +1,367 @@
+#include "session_codec.h"
+#include <string.h>
+#include "session_format.h"
+
+static const uint8_t TYPE_BITS = 4;
+static const uint8_t MAX_K = 24;
+static const uint16_t CTX_RESET = 64;     // halve a context's history after this many values
+static const uint32_t CTX_CLAMP = 1u << 20;
+
+// ======= Bit I/O (LSB first) =======
+
+struct BitWriter {
+  uint8_t *p;
+  uint8_t *end;
+  uint64_t acc;
+  int n;
+  bool ok;
+
+  void put(uint32_t v, int bits) {  // bits <= 32
+    if (bits < 32) v &= (1u << bits) - 1;
+    acc |= (uint64_t)v << n;
+    n += bits;
+    while (n >= 8) {
+      if (p == end) {
+        ok = false;
+        n = 0;
+        acc = 0;
+        return;
+      }
+      *p++ = (uint8_t)acc;
+      acc >>= 8;
+      n -= 8;
+    }
+  }
+
+  void finish() {
+    if (n > 0) put(0, 8 - n);
+  }
+};
+
+struct BitReader {
+  const uint8_t *p;
+  const uint8_t *end;
+  uint64_t acc;
+  int n;
+  bool ok;
+
+  void fill() {
+    while (n <= 56 && p < end) {
+      acc |= (uint64_t)*p++ << n;
+      n += 8;
+    }
+  }
+
+  uint32_t get(int bits) {
+    if (n < bits) fill();
+    if (n < bits) {
+      ok = false;
+      return 0;
+    }
+    uint32_t v = bits < 32 ? (uint32_t)acc & ((1u << bits) - 1) : (uint32_t)acc;
+    acc >>= bits;
+    n -= bits;
+    return v;
+  }
+
+  // Unary run of ones up to SESSION_RICE_ESCAPE; the terminating zero is
+  // consumed, except after a full escape run (it has none)
+  uint32_t unary() {
+    fill();
+    uint64_t inv = ~acc;
+    int q = inv ? __builtin_ctzll(inv) : 64;
+    if (q >= SESSION_RICE_ESCAPE) q = SESSION_RICE_ESCAPE;
+    int used = q < SESSION_RICE_ESCAPE ? q + 1 : q;
+    if (used > n) {
+      ok = false;
+      return 0;
+    }
+    acc >>= used;
+    n -= used;
+    return (uint32_t)q;
+  }
+};
+
+// ======= Model =======
+
+struct RiceCtx {
+  uint32_t a;  // sum of recent values
+  uint16_t n;  // count of recent values
+
+  uint8_t k() const {
+    uint8_t k = 0;
+    while (k < MAX_K && ((uint32_t)n << k) < a) k++;
+    return k;
+  }
+
+  void update(uint32_t v) {
+    a += v < CTX_CLAMP ? v : CTX_CLAMP;
+    if (++n >= CTX_RESET) {
+      a >>= 1;
+      n >>= 1;
+    }
+  }
+};
+
+static const int TYPES = SESSION_REC_TIME + 1;
+
+struct Model {
+  RiceCtx time[TYPES];
+  uint64_t tPrev[TYPES];  // clock of the previous record of each type
+  uint64_t dPrev[TYPES];  // interval before that
+  RiceCtx count, period, queued, red, ir, imu[3], fix[4];
+  uint8_t prevCount;
+  uint32_t prevPeriod;
+  bool havePpg;
+  uint32_t prevRed, prevIr;
+  int16_t prevImu[3];
+  uint32_t prevFix[4];
+
+  void reset() {
+    memset(this, 0, sizeof(*this));
+    RiceCtx *all[] = {&count, &period, &queued, &red, &ir, &imu[0], &imu[1], &imu[2],
+                      &fix[0], &fix[1], &fix[2], &fix[3]};
+    for (RiceCtx *c : all) *c = {4, 1};
+    for (RiceCtx &c : time) c = {4, 1};
+  }
+};
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void putRice(BitWriter &w, RiceCtx &c, uint32_t v) {
+  const uint8_t k = c.k();
+  const uint32_t q = v >> k;
+  if (q < SESSION_RICE_ESCAPE) {
+    w.put((1u << q) - 1, (int)q + 1);  // q ones and a zero
+    w.put(v, k);
+  } else {
+    w.put((1u << SESSION_RICE_ESCAPE) - 1, SESSION_RICE_ESCAPE);
+    w.put(v, 32);
+  }
+  c.update(v);
+}
+
+static uint32_t getRice(BitReader &r, RiceCtx &c) {
+  const uint8_t k = c.k();
+  const uint32_t q = r.unary();
+  uint32_t v = q < SESSION_RICE_ESCAPE ? (q << k) | r.get(k) : r.get(32);
+  c.update(v);
+  return v;
+}
+
+static void putBytes(BitWriter &w, const uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; i++) w.put(p[i], 8);
+}
+
+static void getBytes(BitReader &r, uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; i++) p[i] = (uint8_t)r.get(8);
+}
+
+static inline uint32_t get24(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static inline void put24(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+}
+
+// ======= Encode =======
+
+size_t Session_compress(const uint8_t *payload, size_t len, uint16_t records, uint8_t *out, size_t cap) {
+  static Model m;  // writer task only; ~300 B kept off its stack
+  m.reset();
+  if (cap > len) cap = len;  // no point in a coded form that is not smaller
+  BitWriter w = {out, out + cap, 0, 0, true};
+  uint64_t clock = 0;
+  size_t pos = 0;
+
+  for (uint16_t i = 0; i < records && w.ok; i++) {
+    if (pos + SESSION_RECORD_HEADER_SIZE > len) return 0;
+    const uint8_t type = payload[pos];
+    const uint8_t count = payload[pos + 1];
+    uint16_t dt;
+    memcpy(&dt, payload + pos + 2, 2);
+    pos += SESSION_RECORD_HEADER_SIZE;
+    const int body = Session_bodySize(type, count);
+    if (body < 0 || pos + body > len) return 0;
+    const uint8_t *b = payload + pos;
+    pos += body;
+
+    w.put(type, TYPE_BITS);
+    const uint64_t t = clock + dt;
+    const uint64_t interval = t - m.tPrev[type];
+    const int64_t residual = (int64_t)(interval - m.dPrev[type]);
+    if (residual > INT32_MAX || residual < INT32_MIN) return 0;
+    putRice(w, m.time[type], zigzag((int32_t)residual));
+    m.dPrev[type] = interval;
+    m.tPrev[type] = t;
+    clock = t;
+
+    switch (type) {
+      case SESSION_REC_PPG: {
+        uint32_t period;
+        memcpy(&period, b, 4);
+        const uint8_t queued = b[4];
+        if (count == 0 || count > SESSION_PPG_MAX_BATCH || b[5] != 0) return 0;
+        putRice(w, m.count, zigzag((int32_t)count - m.prevCount));
+        putRice(w, m.period, zigzag((int32_t)(period - m.prevPeriod)));
+        putRice(w, m.queued, zigzag((int32_t)queued - count));
+        m.prevCount = count;
+        m.prevPeriod = period;
+        for (uint8_t s = 0; s < count; s++) {
+          const uint32_t red = get24(b + 6 + 6 * s);
+          const uint32_t ir = get24(b + 9 + 6 * s);
+          if (m.havePpg) {
+            putRice(w, m.red, zigzag((int32_t)red - (int32_t)m.prevRed));
+            putRice(w, m.ir, zigzag((int32_t)ir - (int32_t)m.prevIr));
+          } else {
+            w.put(red, 24);
+            w.put(ir, 24);
+            m.havePpg = true;
+          }
+          m.prevRed = red;
+          m.prevIr = ir;
+        }
+        break;
+      }
+      case SESSION_REC_IMU:
+        if (count != 0) return 0;
+        for (int a = 0; a < 3; a++) {
+          int16_t v;
+          memcpy(&v, b + 2 * a, 2);
+          putRice(w, m.imu[a], zigzag((int32_t)v - m.prevImu[a]));
+          m.prevImu[a] = v;
+        }
+        break;
+      case SESSION_REC_FIX:
+        if (count != 0) return 0;
+        for (int f = 0; f < 4; f++) {
+          uint32_t bits;
+          memcpy(&bits, b + 4 * f, 4);
+          putRice(w, m.fix[f], zigzag((int32_t)(bits - m.prevFix[f])));
+          m.prevFix[f] = bits;
+        }
+        break;
+      case SESSION_REC_EVENT:
+        w.put(count, 8);
+        putBytes(w, b, 4);
+        break;
+      case SESSION_REC_TIME: {
+        if (count != 0) return 0;
+        uint32_t longDt;
+        memcpy(&longDt, b, 4);
+        w.put(longDt, 32);
+        clock += longDt;
+        break;
+      }
+      default:  // headers, IMU_HELD
+        if (count != 0) return 0;
+        putBytes(w, b, body);
+        break;
+    }
+  }
+  if (pos != len) return 0;
+  w.finish();
+  if (!w.ok) return 0;
+  const size_t coded = (size_t)(w.p - out);
+  return coded < len ? coded : 0;
+}
+
+// ======= Decode =======
+
+size_t Session_decompress(const uint8_t *in, size_t len, uint16_t records, uint8_t *out, size_t cap) {
+  static Model m;
+  m.reset();
+  BitReader r = {in, in + len, 0, 0, true};
+  uint64_t clock = 0;
+  size_t pos = 0;
+
+  for (uint16_t i = 0; i < records; i++) {
+    const uint8_t type = (uint8_t)r.get(TYPE_BITS);
+    if (!r.ok || type == 0 || type >= TYPES) return 0;
+
+    const uint64_t interval = m.dPrev[type] + (int64_t)unzigzag(getRice(r, m.time[type]));
+    const uint64_t t = m.tPrev[type] + interval;
+    if (t < clock || t - clock > 0xFFFF) return 0;
+    const uint16_t dt = (uint16_t)(t - clock);
+    m.dPrev[type] = interval;
+    m.tPrev[type] = t;
+    clock = t;
+
+    uint8_t count = 0;
+    if (type == SESSION_REC_PPG) {
+      count = (uint8_t)(m.prevCount + unzigzag(getRice(r, m.count)));
+      if (count == 0 || count > SESSION_PPG_MAX_BATCH) return 0;
+      m.prevCount = count;
+    } else if (type == SESSION_REC_EVENT) {
+      count = (uint8_t)r.get(8);
+    }
+    const int body = Session_bodySize(type, count);
+    if (!r.ok || pos + SESSION_RECORD_HEADER_SIZE + body > cap) return 0;
+    uint8_t *p = out + pos;
+    p[0] = type;
+    p[1] = count;
+    memcpy(p + 2, &dt, 2);
+    uint8_t *b = p + SESSION_RECORD_HEADER_SIZE;
+    pos += SESSION_RECORD_HEADER_SIZE + body;
+
+    switch (type) {
+      case SESSION_REC_PPG: {
+        const uint32_t period = m.prevPeriod + (uint32_t)unzigzag(getRice(r, m.period));
+        memcpy(b, &period, 4);
+        b[4] = (uint8_t)(count + unzigzag(getRice(r, m.queued)));
+        b[5] = 0;
+        m.prevPeriod = period;
+        for (uint8_t s = 0; s < count; s++) {
+          uint32_t red, ir;
+          if (m.havePpg) {
+            red = (uint32_t)((int32_t)m.prevRed + unzigzag(getRice(r, m.red)));
+            ir = (uint32_t)((int32_t)m.prevIr + unzigzag(getRice(r, m.ir)));
+          } else {
+            red = r.get(24);
+            ir = r.get(24);
+            m.havePpg = true;
+          }
+          put24(b + 6 + 6 * s, red);
+          put24(b + 9 + 6 * s, ir);
+          m.prevRed = red;
+          m.prevIr = ir;
+        }
+        break;
+      }
+      case SESSION_REC_IMU:
+        for (int a = 0; a < 3; a++) {
+          int16_t v = (int16_t)(m.prevImu[a] + unzigzag(getRice(r, m.imu[a])));
+          memcpy(b + 2 * a, &v, 2);
+          m.prevImu[a] = v;
+        }
+        break;
+      case SESSION_REC_FIX:
+        for (int f = 0; f < 4; f++) {
+          uint32_t bits = m.prevFix[f] + (uint32_t)unzigzag(getRice(r, m.fix[f]));
+          memcpy(b + 4 * f, &bits, 4);
+          m.prevFix[f] = bits;
+        }
+        break;
+      case SESSION_REC_TIME: {
+        uint32_t longDt = r.get(32);
+        memcpy(b, &longDt, 4);
+        clock += longDt;
+        break;
+      }
+      default:  // headers, EVENT, IMU_HELD
+        getBytes(r, b, body);
+        break;
+    }
+    if (!r.ok) return 0;
+  }
+  return pos;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw sensor session file, written by the recorder (recorder.h) and read by
+// tools/session_replay.cpp. Little-endian, no padding between fields.
+//
+//   file   = header chunk*
+//   header = "ASES" [version:u16] [header_bytes:u16] [device_id:i32] [start_ms:u32]
+//   chunk  = [sync:u16 = 0x4353] [payload_bytes:u16] [records:u16] [crc16:u16]
+//            [t0_us:u64] payload
+//          | [sync:u16 = 0x5243] [coded_bytes:u16] [records:u16] [crc16:u16]
+//            [t0_us:u64] coded payload (session_codec.h, version 2)
+//   record = [type:u8] [count:u8] [dt_us:u16] body
+//
+// t0_us is the device's esp_timer time of the chunk's first record; dt_us is
+// the time since the previous record in the chunk (the first one has 0). A
+// gap over 65535 us is carried by a SESSION_REC_TIME record just before.
+// Every chunk is self-contained, so a reader can skip a corrupt one (CRC-16/
+// CCITT over the payload as stored, coded or not) and resync on the next sync
+// word. Version 2 files may mix coded and plain chunks; version 1 has only
+// plain ones.
+//
+// Records are stored in the order the firmware processed them, not sorted
+// by sample time: replaying them in file order feeds the services exactly
+// what they saw on the device.
+//
+// Bodies by type (count is type specific):
+//   PPG_HEADER  count 0   SessionPpgHeader (also written whenever LED/ADC
+//                         settings change; the replay treats it as a
+//                         discontinuity)
+//   PPG         count n   [period_us:u32] [queued:u8] [0:u8] n * [red:u24] [ir:u24]
+//                         one FIFO drain; sample i was taken at
+//                         t - (queued - 1 - i) * period_us
+//   IMU_HEADER  count 0   SessionImuHeader
+//   IMU         count 0   [x:i16] [y:i16] [z:i16] raw gyro counts as read
+//   IMU_HELD    count 0   (none) gyro in standby, rates reported as zero
+//   FIX         count 0   [lat:f32] [lon:f32] [east_m:f32] [north_m:f32]
+//   EVENT       count k   [value:f32], k = SessionEventKind
+//   TIME        count 0   [dt_us:u32] added to the clock before the next record
+
+#define SESSION_MAGIC "ASES"
+#define SESSION_VERSION 2
+#define SESSION_VERSION_MIN 1      // oldest version readers still accept
+#define SESSION_FILE_HEADER_SIZE 16
+#define SESSION_CHUNK_SYNC 0x4353
+#define SESSION_CHUNK_SYNC_RICE 0x5243
+#define SESSION_CHUNK_HEADER_SIZE 16
+#define SESSION_RECORD_HEADER_SIZE 4
+#define SESSION_PPG_MAX_BATCH 32   // MAX30102 FIFO depth
+
+enum SessionRecordType : uint8_t {
+  SESSION_REC_PPG_HEADER = 1,
+  SESSION_REC_PPG = 2,
+  SESSION_REC_IMU_HEADER = 3,
+  SESSION_REC_IMU = 4,
+  SESSION_REC_IMU_HELD = 5,
+  SESSION_REC_FIX = 6,
+  SESSION_REC_EVENT = 7,
+  SESSION_REC_TIME = 8,
+};
+
+enum SessionEventKind : uint8_t {
+  SESSION_EVT_TEMPERATURE = 1,  // value: die temperature, °C
+  SESSION_EVT_HR_RESET = 2,     // HeartRate_Service::reset() (double press)
+  SESSION_EVT_IMU_RESUME = 3,   // gyro back from standby, integration timing restarts
+  SESSION_EVT_GAP = 4,          // value: records dropped because the writer fell behind
+};
+
+struct SessionPpgHeader {
+  float rate_sps;       // effective samples per second after FIFO averaging
+  uint8_t sampleRate;   // MAX30102_SAMPLE_RATE_*
+  uint8_t fifoAverage;
+  uint8_t adcRange;
+  uint8_t pulseWidth;
+  uint8_t redCurrent;
+  uint8_t irCurrent;
+  uint8_t motionCancel; // 1 = adaptive filter enabled
+  uint8_t reserved;
+};
+
+struct SessionImuHeader {
+  float sensitivity;    // LSB per deg/s
+  float biasRoll_dps;
+  float biasPitch_dps;
+  float biasYaw_dps;
+};
+
+// Body size of a record, or -1 for an unknown type.
+static inline int Session_bodySize(uint8_t type, uint8_t count) {
+  switch (type) {
+    case SESSION_REC_PPG_HEADER: return (int)sizeof(SessionPpgHeader);
+    case SESSION_REC_PPG:        return 6 + 6 * count;
+    case SESSION_REC_IMU_HEADER: return (int)sizeof(SessionImuHeader);
+    case SESSION_REC_IMU:        return 6;
+    case SESSION_REC_IMU_HELD:   return 0;
+    case SESSION_REC_FIX:        return 16;
+    case SESSION_REC_EVENT:      return 4;
+    case SESSION_REC_TIME:       return 4;
+    default:                     return -1;
+  }
+}
+
+static inline uint16_t Session_crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
@@ -0,0 +1,290 @@
+#include "uplink.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "profiler.h"
+
+static const uint32_t TASK_STACK = 3072;
+static const UBaseType_t TASK_PRIORITY = 3;  // above loop() (1)
+static const uint8_t KIND_COUNT = 5;
+
+struct AlertSlot {
+  bool active;
+  uint8_t kind;
+  uint8_t attempts;
+  uint16_t seq;
+  uint32_t eventMs;
+  uint32_t nextSend;
+};
+
+static bool g_inited = false;
+static bool g_log = true;
+static Stream *g_link = nullptr;
+static int32_t g_id = 0;
+static uint16_t g_boot = 0;
+static TaskHandle_t g_task = nullptr;
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Shared state (g_mux)
+static float g_lat = 0.0f, g_lon = 0.0f;
+static uint8_t g_hr = 0, g_risk = 0;
+static AlertSlot g_alerts[UPLINK_MAX_ALERTS];
+static uint16_t g_nextSeq = 1;
+static bool g_haveRaised[KIND_COUNT];
+static uint32_t g_lastRaise[KIND_COUNT];
+static uint8_t g_telemetry[UPLINK_FRAME_SIZE];
+static bool g_telemetryPending = false;
+static uint8_t g_coach[UPLINK_COACH_FRAME_SIZE];
+static bool g_coachPending = false;
+static volatile bool g_writing = false;
+static UplinkStats g_stats;
+
+static size_t putBytes(uint8_t *buf, size_t off, const void *src, size_t n) {
+  memcpy(buf + off, src, n);
+  return off + n;
+}
+
+static size_t putTrailer(uint8_t *buf, size_t off) {
+  buf[off++] = 0x00;
+  buf[off++] = 0xFF;
+  buf[off++] = 0x00;
+  return off;
+}
+
+// Caller holds g_mux
+static size_t buildEvent(uint8_t *buf, const AlertSlot &s, uint32_t now) {
+  size_t off = 0;
+  buf[off++] = (uint8_t)'e';
+  off = putBytes(buf, off, &g_id, sizeof(g_id));
+  off = putBytes(buf, off, &g_boot, sizeof(g_boot));
+  off = putBytes(buf, off, &s.seq, sizeof(s.seq));
+  buf[off++] = s.kind;
+  buf[off++] = s.attempts;
+  off = putBytes(buf, off, &s.eventMs, sizeof(s.eventMs));
+  off = putBytes(buf, off, &now, sizeof(now));
+  off = putBytes(buf, off, &g_lat, sizeof(g_lat));
+  off = putBytes(buf, off, &g_lon, sizeof(g_lon));
+  buf[off++] = g_hr;
+  buf[off++] = g_risk;
+  return putTrailer(buf, off);
+}
+
+static void uplinkTask(void *) {
+  for (;;) {
+    uint32_t wait = Uplink_service(millis());
+    ulTaskNotifyTake(pdTRUE, wait == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+  }
+}
+
+static void wake() {
+  if (g_task) xTaskNotifyGive(g_task);
+}
+
+void Uplink_init(Stream &link, int32_t deviceId, uint16_t bootId, bool serialLogging, bool startTask) {
+  if (g_inited) return;
+  g_inited = true;
+  g_log = serialLogging;
+  g_link = &link;
+  g_id = deviceId;
+  g_boot = bootId;
+  memset(g_alerts, 0, sizeof(g_alerts));
+  g_nextSeq = 1;
+  memset(g_haveRaised, 0, sizeof(g_haveRaised));
+  g_telemetryPending = g_coachPending = false;
+  memset(&g_stats, 0, sizeof(g_stats));
+
+  if (startTask) {
+    xTaskCreatePinnedToCore(uplinkTask, "uplink", TASK_STACK, nullptr, TASK_PRIORITY, &g_task, 1);
+  }
+
+  if (g_log) {
+    Serial.println(F("[Uplink] Init"));
+  }
+}
+
+void Uplink_end() {
+  if (!g_inited) return;
+  if (g_task) {
+    vTaskDelete(g_task);
+    g_task = nullptr;
+  }
+  g_inited = false;
+  g_writing = false;
+}
+
+void Uplink_setStatus(float lat, float lon, uint8_t hr, uint8_t risk) {
+  portENTER_CRITICAL(&g_mux);
+  g_lat = lat;
+  g_lon = lon;
+  g_hr = hr;
+  g_risk = risk;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void Uplink_sendTelemetry(bool alert) {
+  if (!g_inited) return;
+
+  portENTER_CRITICAL(&g_mux);
+  if (g_telemetryPending) g_stats.telemetryReplaced++;
+  size_t off = 0;
+  g_telemetry[off++] = (uint8_t)(alert ? 'a' : 'd');  // 'a' = alert, 'd' = data
+  off = putBytes(g_telemetry, off, &g_lat, sizeof(g_lat));
+  off = putBytes(g_telemetry, off, &g_lon, sizeof(g_lon));
+  g_telemetry[off++] = g_hr;
+  g_telemetry[off++] = g_risk;
+  off = putBytes(g_telemetry, off, &g_id, sizeof(g_id));
+  putTrailer(g_telemetry, off);
+  g_telemetryPending = true;
+  portEXIT_CRITICAL(&g_mux);
+
+  wake();
+}
+
+void Uplink_sendCoach(const UplinkCoachSummary &c) {
+  if (!g_inited) return;
+
+  portENTER_CRITICAL(&g_mux);
+  size_t off = 0;
+  g_coach[off++] = (uint8_t)'c';
+  off = putBytes(g_coach, off, &g_id, sizeof(g_id));
+  off = putBytes(g_coach, off, &c.elapsed_min, sizeof(c.elapsed_min));
+  g_coach[off++] = c.hrRest;
+  g_coach[off++] = c.hrMax;
+  g_coach[off++] = c.hrMedian;
+  off = putBytes(g_coach, off, c.zone_10s, sizeof(c.zone_10s));
+  off = putBytes(g_coach, off, &c.trimp, sizeof(c.trimp));
+  off = putBytes(g_coach, off, &c.acute_x10, sizeof(c.acute_x10));
+  off = putBytes(g_coach, off, &c.chronic_x10, sizeof(c.chronic_x10));
+  putTrailer(g_coach, off);
+  g_coachPending = true;
+  portEXIT_CRITICAL(&g_mux);
+
+  wake();
+}
+
+bool Uplink_raiseAlert(UplinkAlertKind kind, uint32_t eventMs) {
+  if (!g_inited || kind >= KIND_COUNT) return false;
+
+  bool accepted = false;
+  portENTER_CRITICAL(&g_mux);
+  if (g_haveRaised[kind] && eventMs - g_lastRaise[kind] < UPLINK_HOLDOFF_MS) {
+    g_stats.suppressed++;
+  } else {
+    for (int i = 0; i < UPLINK_MAX_ALERTS; i++) {
+      AlertSlot &s = g_alerts[i];
+      if (s.active) continue;
+      s.active = true;
+      s.kind = kind;
+      s.attempts = 0;
+      s.seq = g_nextSeq++;
+      s.eventMs = eventMs;
+      s.nextSend = eventMs;  // due right away
+      g_haveRaised[kind] = true;
+      g_lastRaise[kind] = eventMs;
+      g_stats.raised++;
+      accepted = true;
+      break;
+    }
+    if (!accepted) g_stats.dropped++;
+  }
+  portEXIT_CRITICAL(&g_mux);
+
+  if (accepted) wake();
+  return accepted;
+}
+
+uint32_t Uplink_service(uint32_t now) {
+  if (!g_inited) return UINT32_MAX;
+
+  uint8_t frame[UPLINK_EVENT_FRAME_SIZE];
+  const uint32_t start = millis();
+  const uint32_t base = now;
+  for (;;) {
+    size_t len = 0;
+    now = base + (millis() - start); // writes below take frame airtime
+
+
+    portENTER_CRITICAL(&g_mux);
+    // Most overdue alert first, then telemetry, then the coach summary
+    int due = -1;
+    for (int i = 0; i < UPLINK_MAX_ALERTS; i++) {
+      const AlertSlot &s = g_alerts[i];
+      if (!s.active || (int32_t)(now - s.nextSend) < 0) continue;
+      if (due < 0 || (int32_t)(s.nextSend - g_alerts[due].nextSend) < 0) due = i;
+    }
+
+    if (due >= 0) {
+      AlertSlot &s = g_alerts[due];
+      len = buildEvent(frame, s, now);
+      if (s.attempts == 0) {
+        g_stats.lastQueue_ms = now - s.eventMs;
+        if (g_stats.lastQueue_ms > g_stats.maxQueue_ms) g_stats.maxQueue_ms = g_stats.lastQueue_ms;
+        if (g_telemetryPending) g_stats.preempted++;
+      }
+      s.attempts++;
+      if (s.attempts >= UPLINK_ALERT_COPIES) {
+        s.active = false;
+      } else {
+        s.nextSend = now + (UPLINK_RETRY_MS << (s.attempts - 1));
+      }
+      g_stats.alertFrames++;
+    } else if (g_telemetryPending) {
+      memcpy(frame, g_telemetry, UPLINK_FRAME_SIZE);
+      len = UPLINK_FRAME_SIZE;
+      g_telemetryPending = false;
+      g_stats.telemetrySent++;
+    } else if (g_coachPending) {
+      memcpy(frame, g_coach, UPLINK_COACH_FRAME_SIZE);
+      len = UPLINK_COACH_FRAME_SIZE;
+      g_coachPending = false;
+      g_stats.coachSent++;
+    }
+    g_writing = (len > 0);
+    portEXIT_CRITICAL(&g_mux);
+
+    if (len == 0) break;
+
+    // One frame at a time, drained before the next is picked: an alert raised
+    // meanwhile waits for at most one frame on the wire
+    {
+      PROF_SCOPE("uplink write");
+      g_link->write(frame, len);
+      g_link->flush();
+    }
+  }
+
+  uint32_t wait = UINT32_MAX;
+  portENTER_CRITICAL(&g_mux);
+  for (int i = 0; i < UPLINK_MAX_ALERTS; i++) {
+    const AlertSlot &s = g_alerts[i];
+    if (s.active) wait = min(wait, (uint32_t)max((int32_t)0, (int32_t)(s.nextSend - now)));
+  }
+  g_writing = false;
+  portEXIT_CRITICAL(&g_mux);
+  return wait;
+}
+
+bool Uplink_busy() {
+  bool busy = g_writing;
+  portENTER_CRITICAL(&g_mux);
+  busy = busy || g_telemetryPending || g_coachPending;
+  for (int i = 0; i < UPLINK_MAX_ALERTS; i++) busy = busy || g_alerts[i].active;
+  portEXIT_CRITICAL(&g_mux);
+  return busy;
+}
+
+void Uplink_getStats(UplinkStats &out) {
+  portENTER_CRITICAL(&g_mux);
+  out = g_stats;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void Uplink_printStats() {
+  UplinkStats s;
+  Uplink_getStats(s);
+  Serial.printf("[Uplink] alerts %lu raised, %lu suppressed, %lu dropped, %lu frames, %lu preempted | "
+                "queue %lu last / %lu max ms | telemetry %lu sent, %lu replaced | coach %lu sent\n",
+                (unsigned long)s.raised, (unsigned long)s.suppressed, (unsigned long)s.dropped,
+                (unsigned long)s.alertFrames, (unsigned long)s.preempted,
+                (unsigned long)s.lastQueue_ms, (unsigned long)s.maxQueue_ms,
+                (unsigned long)s.telemetrySent, (unsigned long)s.telemetryReplaced, (unsigned long)s.coachSent);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <Arduino.h>
+
+// Satellite uplink: telemetry frames plus a priority path for alert events.
+//
+// Telemetry ('a'/'d', 18 bytes) is a single "latest" slot: a frame that has
+// not gone out yet is replaced by the newer one. Alert events ('e', 32 bytes)
+// are queued separately, always go out before pending telemetry, and are
+// repeated a bounded number of times since the link has no acknowledgement.
+//
+// Event frame, little-endian:
+//   ['e'] [id:i32] [boot:u16] [seq:u16] [kind:u8] [attempt:u8] [event_ms:u32] [sent_ms:u32]
+//   [lat:f32] [lon:f32] [hr:u8] [risk:u8] [0x00 0xFF 0x00]
+// event_ms and sent_ms are device millis(); the ground side estimates the
+// device clock offset from sent_ms to turn event_ms into trigger-to-receipt
+// latency. seq restarts at 1 and millis() at 0 on every reset, so boot (a
+// random number per power-up) tells the ground that a new run of event
+// numbers and a new clock began.
+//
+// Coach summary ('c', 29 bytes) is a second "latest" slot, sent after any
+// pending telemetry:
+//   ['c'] [id:i32] [elapsed_min:u16] [hr_rest:u8] [hr_max:u8] [hr_median:u8]
+//   [zone_10s:u16 x5] [trimp:u16] [acute_x10:u16] [chronic_x10:u16] [0x00 0xFF 0x00]
+// zone_10s is time in zones 1-5 in 10 s units; acute/chronic are decayed
+// training load in TRIMP per hour x10 (CoachStats_Service.h). HR fields are
+// the limits the zones use, 0 if unknown.
+
+#define UPLINK_FRAME_SIZE 18
+#define UPLINK_EVENT_FRAME_SIZE 32
+#define UPLINK_COACH_FRAME_SIZE 29
+#define UPLINK_COACH_ZONES 5
+#define UPLINK_MAX_ALERTS 4      // alert events in flight
+#define UPLINK_ALERT_COPIES 3    // transmissions per alert event
+#define UPLINK_RETRY_MS 1500     // gap before the first repeat, doubled after each
+#define UPLINK_HOLDOFF_MS 10000  // same kind raised again within this is one event
+
+enum UplinkAlertKind : uint8_t {
+  UPLINK_ALERT_SOS = 1,   // SOS button long press
+  UPLINK_ALERT_FALL = 2,  // gyro rate spike
+  UPLINK_ALERT_RISK = 3,  // risk score over the alert threshold
+  UPLINK_ALERT_OFF_COURSE = 4,  // left the loaded course (course_monitor.h)
+};
+
+struct UplinkCoachSummary {
+  uint16_t elapsed_min;
+  uint8_t hrRest;
+  uint8_t hrMax;
+  uint8_t hrMedian;
+  uint16_t zone_10s[UPLINK_COACH_ZONES];
+  uint16_t trimp;
+  uint16_t acute_x10;
+  uint16_t chronic_x10;
+};
+
+struct UplinkStats {
+  uint32_t raised;             // alert events accepted
+  uint32_t suppressed;         // raised again within the holdoff
+  uint32_t dropped;            // no free alert slot
+  uint32_t alertFrames;        // event frames written, repeats included
+  uint32_t preempted;          // times an alert went ahead of pending telemetry
+  uint32_t telemetrySent;
+  uint32_t telemetryReplaced;  // superseded before it went out
+  uint32_t coachSent;
+  uint32_t lastQueue_ms;       // event trigger to first transmission
+  uint32_t maxQueue_ms;
+};
+
+// Start the uplink on an already opened link port. bootId is carried by every
+// event frame and must differ between power-ups (esp_random()). startTask=false
+// leaves the scheduling to the caller (Uplink_service()), e.g. on the host.
+void Uplink_init(Stream &link, int32_t deviceId, uint16_t bootId, bool serialLogging = true, bool startTask = true);
+
+// Stop the uplink and drop what has not gone out, as a reset would.
+void Uplink_end();
+
+// Latest position and vitals, copied into telemetry and alert frames.
+void Uplink_setStatus(float lat, float lon, uint8_t hr, uint8_t risk);
+
+// Queue a telemetry frame ('a' if alert, else 'd') from the latest status.
+void Uplink_sendTelemetry(bool alert);
+
+// Queue a coach summary frame; replaces one that has not gone out yet.
+void Uplink_sendCoach(const UplinkCoachSummary &s);
+
+// Raise an alert event that happened at eventMs (millis()). Safe from any task.
+// Returns false if it was suppressed or dropped.
+bool Uplink_raiseAlert(UplinkAlertKind kind, uint32_t eventMs);
+
+// Transmit whatever is due at `now`. Returns ms until the next repeat is due,
+// or UINT32_MAX if nothing is scheduled. Called by the uplink task.
+uint32_t Uplink_service(uint32_t now);
+
+// True while frames are pending or repeats are scheduled (keep the UART awake).
+bool Uplink_busy();
+
+void Uplink_getStats(UplinkStats &out);
+void Uplink_printStats();
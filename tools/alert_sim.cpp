@@ -0,0 +1,294 @@
+// Alert traffic check for the alert engine (main/alert_engine.cpp).
+// Drives the engine and the firmware uplink scheduler on a virtual clock with
+// a synthetic race: gyro rates with frequent bumps and two real falls, a risk
+// score that hovers around the alert level for a while before a real episode,
+// and one off-course excursion. At minute 36 the device resets (event numbers
+// and millis() start over) and the athlete sends an SOS 20 s later. From
+// minute 44 the athlete rests (REST profile: gyro asleep, IMU read every
+// 500 ms) and collapses at minute 45, seen only by the accelerometer. The ground
+// side counts events as ingest does, through AlertTracker. The same inputs
+// also go through the previous logic (one gyro sample over 100 dps or a risk
+// edge raises an alert, the alert flag holds until the next report) for
+// comparison.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -Iground -o alert_sim tools/alert_sim.cpp
+//           main/alert_engine.cpp main/alert_state.cpp main/uplink.cpp main/profiler.cpp ground/frame.cpp
+//           ground/AlertTracker.cpp main/gyro_integrate.cpp
+// Run:    ./alert_sim [--minutes <m>] [--seed <n>]
+// Exit status is non-zero if a real alert was missed or raised late, or the
+// SOS after the reset was lost or its latency misjudged, or the collapse at
+// rest was not raised.
+
+#include <Arduino.h>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "AlertTracker.h"
+#include "RiskScore_Service.h"
+#include "alert_engine.h"
+#include "frame.h"
+#include "gyro_module.h"
+#include "uplink.h"
+
+static const int32_t DEVICE_ID = 1234;
+static const uint32_t IMU_MS = 20;      // ACTIVE profile
+static const uint32_t REPORT_MS = 5000;
+static const uint32_t FALL_MS = 400;     // rotation of a real fall
+static const uint32_t MAX_RAISE_MS = 100; // real alert trigger to uplink, at most
+static const uint32_t REST_IMU_MS = 500; // REST profile
+static const uint32_t ACC_CYCLE_MS = 200; // accelerometer sample period while the gyro sleeps
+
+// Decodes what the uplink writes, as the ground would see it with a clean link
+class GroundSink : public Stream {
+public:
+  using Stream::write;
+  size_t write(uint8_t b) override {
+    AthleteFrame f;
+    if (_parser.push(b, f)) frames.push_back(f);
+    return 1;
+  }
+  std::vector<AthleteFrame> frames;
+
+private:
+  FrameParser _parser;
+};
+
+struct Counts {
+  uint32_t events[5];   // by UplinkAlertKind
+  uint32_t alertReports;
+  uint32_t flips;       // 'a' <-> 'd' changes between consecutive reports
+};
+
+int main(int argc, char **argv) {
+  double minutes = 60;
+  unsigned seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--minutes")) minutes = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--seed")) seed = (unsigned)atoi(argv[i + 1]);
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (minutes < 60) minutes = 60; // the scripted episodes run to minute 55
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+  GroundSink ground;
+  AlertTracker tracker;
+  host_setMicros(1000000);
+  const uint32_t t0 = millis();
+  Uplink_init(ground, DEVICE_ID, /*bootId=*/0x1111, /*serialLogging=*/false, /*startTask=*/false);
+  Alert_init(/*serialLogging=*/false);
+
+  // Script, ms from the start
+  const uint32_t falls[2] = {15 * 60000, 40 * 60000};
+  const uint32_t ackAt = falls[0] + 60000; // the first faller presses "OK"; the second does not
+  const uint32_t hoverFrom = 20 * 60000, hoverTo = 30 * 60000;   // risk flaps around the threshold
+  const uint32_t riskFrom = 50 * 60000, riskTo = 55 * 60000;     // real risk episode
+  const uint32_t offFrom = 32 * 60000, offTo = 34 * 60000;       // off course (already debounced)
+  const uint32_t resetAt = 36 * 60000, sosAt = resetAt + 20000;   // device reset, then SOS
+  const uint32_t restFrom = 44 * 60000, restTo = 47 * 60000;     // REST profile
+  const uint32_t collapse = 45 * 60000;                          // wrist turns 80 deg in 400 ms
+  const uint32_t end = (uint32_t)(minutes * 60000.0);
+
+  // Device millis(): starts over (after a second of boot) at the reset.
+  // The ground clock is t0 + t throughout.
+  auto deviceMs = [&](uint32_t t) { return t < resetAt ? t0 + t : 1000 + (t - resetAt); };
+
+  Counts prev = {}, now = {};
+  uint32_t prevHold[5] = {0};
+  bool prevHave[5] = {false};
+  bool prevAlert = false, prevRisk = false, prevLastA = false, newLastA = false;
+  uint32_t raiseMs[2] = {UINT32_MAX, UINT32_MAX};
+  double sosLatency_ms = -1;
+  bool collapseRaised = false;
+  int16_t lastAcc[3] = {0, 0, 0};
+  uint32_t lastAccT = 0;
+  bool haveAcc = false;
+  uint32_t nextBump = 8000;
+  uint32_t bumpLeft = 0;
+  float bumpRate = 0;
+  float riskScore = 40;
+
+  // Old logic: each trigger goes to the uplink, which folds repeats of a kind within its holdoff
+  auto prevRaise = [&](UplinkAlertKind kind, uint32_t t) {
+    if (prevHave[kind] && t - prevHold[kind] < UPLINK_HOLDOFF_MS) return;
+    prevHave[kind] = true;
+    prevHold[kind] = t;
+    prev.events[kind]++;
+  };
+
+  for (uint32_t t = 0; t < end; t += IMU_MS) {
+    const uint32_t ms = deviceMs(t);
+    host_setMicros((uint64_t)ms * 1000);
+
+    // Reset: the firmware starts from scratch, with a new boot id
+    if (t == resetAt) {
+      Uplink_end();
+      Uplink_init(ground, DEVICE_ID, /*bootId=*/0x2222, /*serialLogging=*/false, /*startTask=*/false);
+      Alert_init(/*serialLogging=*/false);
+      memset(prevHave, 0, sizeof(prevHave));
+    }
+    if (t == sosAt) {
+      prevRaise(UPLINK_ALERT_SOS, ms);
+      Uplink_raiseAlert(UPLINK_ALERT_SOS, ms);  // as the button does
+      Alert_latchSOS();
+    }
+
+    // REST: the gyro sleeps; the accelerometer's tilt rate feeds the fall
+    // condition (main.ino) each IMU reading. The old logic sees zero rates.
+    const bool resting = t >= restFrom && t < restTo;
+    if (resting) {
+      if (t % REST_IMU_MS == 0) {
+        // Gravity in the sensor frame at the last accelerometer cycle
+        const uint32_t sampled = t - t % ACC_CYCLE_MS;
+        const double turn = 80.0 * constrain((double)sampled - collapse, 0.0, 400.0) / 400.0 * PI / 180.0;
+        int16_t acc[3] = {(int16_t)(300 * noise(rng)), (int16_t)(16384 * sin(turn) + 100 * noise(rng)),
+                          (int16_t)(16384 * cos(turn) + 100 * noise(rng))};
+        if (haveAcc) {
+          const uint32_t span = max(t - lastAccT, ACC_CYCLE_MS);
+          Alert_update(ALERT_COND_FALL, Gyro_tiltAngle(lastAcc, acc) * 1000.0f / span, ms, span);
+        }
+        memcpy(lastAcc, acc, sizeof(acc));
+        lastAccT = t;
+        haveAcc = true;
+      }
+    }
+
+    // Gyro: running noise, short bumps, real falls then lying still
+    float rate = (float)fabs(15.0 * noise(rng));
+    if (t >= nextBump) {
+      bumpLeft = uni(rng) < 0.6 ? 1 : 2; // one or two samples
+      bumpRate = (float)(110 + 140 * uni(rng));
+      nextBump = t + 1000 + (uint32_t)(-8000.0 * log(1.0 - uni(rng)));
+    }
+    if (bumpLeft > 0) {
+      rate = bumpRate;
+      bumpLeft--;
+    }
+    for (uint32_t f : falls) {
+      if (t >= f && t < f + FALL_MS) rate = (float)(180 + 120 * uni(rng));
+      else if (t >= f + FALL_MS && t < f + 30000) rate = (float)fabs(2.0 * noise(rng));
+    }
+    if (resting) rate = 0;
+    if (rate > 100) {
+      prevAlert = true;
+      prevRaise(UPLINK_ALERT_FALL, ms);
+    }
+    if (!resting) Alert_update(ALERT_COND_FALL, rate, ms);
+
+    // Risk score, updated every loop pass
+    float target = 40;
+    if (t >= hoverFrom && t < hoverTo) target = 69;
+    if (t >= riskFrom && t < riskTo) target = 82;
+    riskScore += 0.002f * (target - riskScore) + (float)(0.3 * noise(rng));
+    const uint8_t score = (uint8_t)constrain(riskScore, 0.0f, 100.0f);
+    const bool riskAlert = score >= RISK_ALERT_THRESHOLD;
+    if (riskAlert) {
+      prevAlert = true;
+      if (!prevRisk) prevRaise(UPLINK_ALERT_RISK, ms);
+    }
+    prevRisk = riskAlert;
+    Alert_update(ALERT_COND_RISK, score, ms);
+
+    // Off course, once a second as the fixes come in
+    if (t % 1000 == 0) {
+      const bool off = t >= offFrom && t < offTo;
+      if (off && t == offFrom) {
+        prevAlert = true;
+        prevRaise(UPLINK_ALERT_OFF_COURSE, ms);
+      }
+      Alert_update(ALERT_COND_OFF_COURSE, off ? 1.0f : 0.0f, ms);
+    }
+
+    if (t == ackAt) Alert_acknowledge();
+    Alert_service(ms);
+
+    if (t % REPORT_MS == 0) {
+      if (prevAlert) prev.alertReports++;
+      if (t > 0 && prevAlert != prevLastA) prev.flips++;
+      prevLastA = prevAlert;
+      prevAlert = false;
+
+      const bool a = Alert_active();
+      if (a) now.alertReports++;
+      if (t > 0 && a != newLastA) now.flips++;
+      newLastA = a;
+      Uplink_setStatus(42.7f, 23.3f, 150, score);
+      Uplink_sendTelemetry(a);
+    }
+    Uplink_service(ms);
+
+    // Events as ingest records them; first fall event after each real fall
+    for (const AthleteFrame &f : ground.frames) {
+      AlertReceipt r;
+      if (f.type != 'e' || !tracker.onFrame(f, t0 + t, r)) continue;
+      now.events[f.kind < 5 ? f.kind : 0]++;
+      for (int k = 0; k < 2; k++) {
+        if (f.kind == UPLINK_ALERT_FALL && raiseMs[k] == UINT32_MAX && f.eventMs >= deviceMs(falls[k]) &&
+            f.eventMs < deviceMs(falls[k]) + FALL_MS) {
+          raiseMs[k] = (uint32_t)r.queue_ms;
+        }
+      }
+      if (f.kind == UPLINK_ALERT_SOS && f.eventMs == deviceMs(sosAt)) sosLatency_ms = r.latency_ms;
+      if (f.kind == UPLINK_ALERT_FALL && f.eventMs + REST_IMU_MS >= deviceMs(collapse) &&
+          f.eventMs < deviceMs(collapse) + 400 && r.queue_ms <= REST_IMU_MS + MAX_RAISE_MS) {
+        collapseRaised = true;
+      }
+    }
+    ground.frames.clear();
+  }
+
+  AlertEngineStats es;
+  Alert_getStats(es);
+  const uint32_t reports = end / REPORT_MS;
+  auto total = [](const Counts &c) { return c.events[1] + c.events[2] + c.events[3] + c.events[4]; };
+  printf("%.0f min, %u reports: 2 real falls, 1 real risk episode, 1 off-course excursion, a reset, an SOS, "
+         "a collapse at rest\n", minutes, reports);
+  printf("  previous: %3u alert events (SOS %u, fall %u, risk %u, off-course %u), %4u 'a' reports, %4u a/d flips\n",
+         total(prev), prev.events[UPLINK_ALERT_SOS], prev.events[UPLINK_ALERT_FALL], prev.events[UPLINK_ALERT_RISK],
+         prev.events[UPLINK_ALERT_OFF_COURSE], prev.alertReports, prev.flips);
+  printf("  engine:   %3u alert events (SOS %u, fall %u, risk %u, off-course %u), %4u 'a' reports, %4u a/d flips\n",
+         total(now), now.events[UPLINK_ALERT_SOS], now.events[UPLINK_ALERT_FALL], now.events[UPLINK_ALERT_RISK],
+         now.events[UPLINK_ALERT_OFF_COURSE], now.alertReports, now.flips);
+  printf("  engine: %u short excursions ignored, %u deferred (max %u ms), fall raised after %u / %u ms\n",
+         es.ignored, es.deferred, es.maxDefer_ms, raiseMs[0], raiseMs[1]);
+  printf("  ground: %u events, %u repeats, %u device resets, SOS after the reset %s (latency %.0f ms), "
+         "collapse at rest %s\n",
+         tracker.stats().events, tracker.stats().duplicates, tracker.stats().reboots,
+         sosLatency_ms < 0 ? "lost" : "received", sosLatency_ms, collapseRaised ? "raised" : "missed");
+
+  // Checks
+  bool ok = true;
+  for (int k = 0; k < 2; k++) {
+    if (raiseMs[k] > MAX_RAISE_MS) {
+      printf("FAIL: real fall %d not raised within %u ms\n", k + 1, MAX_RAISE_MS);
+      ok = false;
+    }
+  }
+  if (now.events[UPLINK_ALERT_RISK] < 1 || now.events[UPLINK_ALERT_OFF_COURSE] != 1) {
+    printf("FAIL: risk or off-course episode missing\n");
+    ok = false;
+  }
+  if (sosLatency_ms < 0 || sosLatency_ms > MAX_RAISE_MS + 100) {
+    printf("FAIL: SOS after the device reset lost or its latency misjudged\n");
+    ok = false;
+  }
+  if (!collapseRaised) {
+    printf("FAIL: collapse while resting (gyro asleep) not raised\n");
+    ok = false;
+  }
+  if (!newLastA) {
+    printf("FAIL: unacknowledged fall no longer reported as an alert\n");
+    ok = false;
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
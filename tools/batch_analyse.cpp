@@ -0,0 +1,462 @@
+// Offline batch analyser for recorded raw sessions.
+// Runs the firmware signal chain (tools/session_pipeline.h: HeartRate_Service,
+// motion cancellation, gyro integration, risk score, alert engine) over many sessions in
+// parallel, one independent Pipeline per session, and writes every session's
+// HR / SpO2 / quality / risk series and events into one columnar file.
+//
+// Inputs are memory-mapped and decoded in place. Sessions are sharded over a
+// work-stealing pool: each worker owns a deque, seeded largest session first,
+// and steals from the back of another worker's deque when its own runs dry, so
+// a few long sessions do not leave the other cores idle at the end.
+// Throughput (samples per second of wall time) is reported so DSP changes can
+// be tracked for performance regressions.
+//
+// Build:  g++ -O2 -std=c++17 -pthread -DPROFILING_ENABLED=0 -Itools/host -Imain -o batch_analyse
+//           tools/batch_analyse.cpp tools/session_pipeline.cpp main/HeartRate_Service.cpp
+//           main/MotionCancel_Service.cpp main/RiskScore_Service.cpp main/gyro_integrate.cpp main/profiler.cpp
+//           main/session_codec.cpp main/alert_state.cpp
+// Run:    ./batch_analyse --out race.llc [--threads <n>] [--interval <ms>] <session.bin | dir>...
+//         ./batch_analyse --dump race.llc [<device id>]
+//
+// Output (little-endian), sessions in input order:
+//   header  "LLCOLS1\0" [sessions:u32] [interval_ms:u32] [index_offset:u64] [0:u64]
+//   data    per session, each column 8-byte aligned:
+//             t_ms:u32[rows] hr:f32[rows] spo2:f32[rows] quality:f32[rows]
+//             flags:u8[rows] (bit0 finger, bit1 valid) risk:u8[rows]
+//             ev_t_ms:u32[events] ev_kind:u8[events] ev_value:f32[events]
+//   index   per session: ColumnIndex (below)
+// t_ms is session time from the first record; event kinds are
+// PipelineEventKind.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "profiler.h"
+#include "session_pipeline.h"
+
+#if PROFILING_ENABLED
+#error "build with -DPROFILING_ENABLED=0: the profiler table is shared and not thread-safe"
+#endif
+
+static const char COLUMN_MAGIC[8] = {'L', 'L', 'C', 'O', 'L', 'S', '1', 0};
+
+enum Column {
+  COL_T, COL_HR, COL_SPO2, COL_QUALITY, COL_FLAGS, COL_RISK,
+  COL_EV_T, COL_EV_KIND, COL_EV_VALUE,
+  COLUMN_COUNT
+};
+
+struct ColumnIndex {
+  int32_t deviceId;
+  uint32_t startMs;      // device millis() when recording started
+  uint32_t rows;
+  uint32_t events;
+  uint32_t ppgSamples;
+  uint32_t status;       // 0 ok, 1 unreadable
+  uint64_t offset[COLUMN_COUNT];
+};
+
+// ======= Per-session result =======
+
+class ColumnSink : public PipelineSink {
+public:
+  void onStart(uint64_t t0_us) override { _t0_us = t0_us; }
+
+  void onSample(const PipelineSample &s) override {
+    t.push_back((uint32_t)((s.t_us - _t0_us) / 1000));
+    hr.push_back(s.hr.heartRate);
+    spo2.push_back(s.hr.spO2);
+    quality.push_back(s.hr.signalQuality);
+    flags.push_back((uint8_t)((s.hr.fingerDetected ? 1 : 0) | (s.hr.validReading ? 2 : 0)));
+    risk.push_back(s.risk.score);
+  }
+
+  void onEvent(uint64_t t_us, PipelineEventKind kind, float value) override {
+    evT.push_back((uint32_t)((t_us - _t0_us) / 1000));
+    evKind.push_back(kind);
+    evValue.push_back(value);
+  }
+
+  std::vector<uint32_t> t;
+  std::vector<float> hr, spo2, quality;
+  std::vector<uint8_t> flags, risk;
+  std::vector<uint32_t> evT;
+  std::vector<uint8_t> evKind;
+  std::vector<float> evValue;
+
+private:
+  uint64_t _t0_us = 0;
+};
+
+struct Job {
+  std::string path;
+  size_t bytes = 0;
+  bool done = false;
+  bool ok = false;
+  SessionInfo info;
+  PipelineCounts counts;
+  double session_s = 0;
+  ColumnSink *sink = nullptr;
+};
+
+static bool runSession(Job &job, uint32_t interval_ms) {
+  int fd = open(job.path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    perror(job.path.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    fprintf(stderr, "%s: empty\n", job.path.c_str());
+    return false;
+  }
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(job.path.c_str());
+    return false;
+  }
+  madvise(map, len, MADV_SEQUENTIAL);
+
+  job.sink = new ColumnSink();
+  Pipeline pl(*job.sink, interval_ms, true);
+  char err[128];
+  bool ok = Session_replay((const uint8_t *)map, len, pl, job.info, err, sizeof(err));
+  munmap(map, len);
+  if (!ok) {
+    fprintf(stderr, "%s: %s\n", job.path.c_str(), err);
+    return false;
+  }
+  job.counts = pl.counts;
+  job.session_s = (job.info.lastT_us - job.info.firstT_us) / 1e6;
+  return true;
+}
+
+// ======= Work-stealing pool =======
+
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(size_t workers) : _queues(workers), _steals(workers, 0), _ran(workers, 0) {}
+
+  void seed(size_t worker, size_t item) { _queues[worker].items.push_back(item); }
+
+  // Own work from the front, otherwise the back of someone else's
+  bool next(size_t worker, size_t &item) {
+    {
+      Queue &q = _queues[worker];
+      std::lock_guard<std::mutex> lock(q.m);
+      if (!q.items.empty()) {
+        item = q.items.front();
+        q.items.pop_front();
+        _ran[worker]++;
+        return true;
+      }
+    }
+    for (size_t k = 1; k < _queues.size(); k++) {
+      Queue &victim = _queues[(worker + k) % _queues.size()];
+      std::lock_guard<std::mutex> lock(victim.m);
+      if (!victim.items.empty()) {
+        item = victim.items.back();
+        victim.items.pop_back();
+        _steals[worker]++;
+        _ran[worker]++;
+        return true;
+      }
+    }
+    return false; // nothing is ever added after seeding: all work is taken
+  }
+
+  size_t steals(size_t worker) const { return _steals[worker]; }
+  size_t ran(size_t worker) const { return _ran[worker]; }
+
+private:
+  struct Queue {
+    std::mutex m;
+    std::deque<size_t> items;
+  };
+  std::vector<Queue> _queues;
+  std::vector<size_t> _steals, _ran;
+};
+
+// ======= Output =======
+
+class ColumnWriter {
+public:
+  bool open(const char *path, uint32_t sessions, uint32_t interval_ms) {
+    _f = fopen(path, "wb");
+    if (!_f) {
+      perror(path);
+      return false;
+    }
+    _index.resize(sessions);
+    uint64_t zero = 0;
+    put(COLUMN_MAGIC, 8);
+    put(&sessions, 4);
+    put(&interval_ms, 4);
+    put(&zero, 8); // index offset, patched in close()
+    put(&zero, 8);
+    return true;
+  }
+
+  void write(uint32_t slot, const Job &job) {
+    ColumnIndex &ix = _index[slot];
+    memset(&ix, 0, sizeof(ix));
+    ix.status = job.ok ? 0 : 1;
+    if (!job.ok) return;
+    const ColumnSink &s = *job.sink;
+    ix.deviceId = job.info.deviceId;
+    ix.startMs = job.info.startMs;
+    ix.rows = (uint32_t)s.t.size();
+    ix.events = (uint32_t)s.evT.size();
+    ix.ppgSamples = job.counts.ppgSamples;
+    ix.offset[COL_T] = column(s.t);
+    ix.offset[COL_HR] = column(s.hr);
+    ix.offset[COL_SPO2] = column(s.spo2);
+    ix.offset[COL_QUALITY] = column(s.quality);
+    ix.offset[COL_FLAGS] = column(s.flags);
+    ix.offset[COL_RISK] = column(s.risk);
+    ix.offset[COL_EV_T] = column(s.evT);
+    ix.offset[COL_EV_KIND] = column(s.evKind);
+    ix.offset[COL_EV_VALUE] = column(s.evValue);
+  }
+
+  bool close() {
+    align();
+    uint64_t indexOffset = _pos;
+    put(_index.data(), _index.size() * sizeof(ColumnIndex));
+    bool ok = fseek(_f, 16, SEEK_SET) == 0 && fwrite(&indexOffset, 8, 1, _f) == 1;
+    ok = (fclose(_f) == 0) && ok && !_failed;
+    return ok;
+  }
+
+  uint64_t bytes() const { return _pos; }
+
+private:
+  void put(const void *p, size_t n) {
+    if (n && fwrite(p, 1, n, _f) != n) _failed = true;
+    _pos += n;
+  }
+
+  void align() {
+    static const uint8_t PAD[8] = {0};
+    put(PAD, (8 - (_pos & 7)) & 7);
+  }
+
+  template <class T> uint64_t column(const std::vector<T> &v) {
+    align();
+    uint64_t off = _pos;
+    put(v.data(), v.size() * sizeof(T));
+    return off;
+  }
+
+  FILE *_f = nullptr;
+  uint64_t _pos = 0;
+  bool _failed = false;
+  std::vector<ColumnIndex> _index;
+};
+
+// ======= Dump =======
+
+static int dumpFile(const char *path, bool one, int32_t id) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    return 1;
+  }
+  size_t len = (size_t)st.st_size;
+  const uint8_t *base = len ? (const uint8_t *)mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+  close(fd);
+  if (!base || base == MAP_FAILED || len < 32 || memcmp(base, COLUMN_MAGIC, 8) != 0) {
+    fprintf(stderr, "%s: not a column file\n", path);
+    return 1;
+  }
+  uint32_t sessions, interval;
+  uint64_t indexOffset;
+  memcpy(&sessions, base + 8, 4);
+  memcpy(&interval, base + 12, 4);
+  memcpy(&indexOffset, base + 16, 8);
+  if (indexOffset + (uint64_t)sessions * sizeof(ColumnIndex) > len) {
+    fprintf(stderr, "%s: truncated\n", path);
+    return 1;
+  }
+  const ColumnIndex *index = (const ColumnIndex *)(base + indexOffset);
+
+  if (!one) printf("# device rows events ppg_samples hr_mean risk_max\n");
+  for (uint32_t i = 0; i < sessions; i++) {
+    const ColumnIndex &ix = index[i];
+    if (ix.status != 0 || (one && ix.deviceId != id)) continue;
+    const uint32_t *t = (const uint32_t *)(base + ix.offset[COL_T]);
+    const float *hr = (const float *)(base + ix.offset[COL_HR]);
+    const float *spo2 = (const float *)(base + ix.offset[COL_SPO2]);
+    const float *quality = (const float *)(base + ix.offset[COL_QUALITY]);
+    const uint8_t *flags = base + ix.offset[COL_FLAGS];
+    const uint8_t *risk = base + ix.offset[COL_RISK];
+
+    if (!one) {
+      double sum = 0;
+      uint32_t valid = 0;
+      uint8_t riskMax = 0;
+      for (uint32_t r = 0; r < ix.rows; r++) {
+        if (flags[r] & 2) {
+          sum += hr[r];
+          valid++;
+        }
+        riskMax = max(riskMax, risk[r]);
+      }
+      printf("%d %u %u %u %.1f %u\n", ix.deviceId, ix.rows, ix.events, ix.ppgSamples, valid ? sum / valid : 0.0,
+             riskMax);
+      continue;
+    }
+
+    printf("# device %d: t_ms hr spo2 quality flags risk\n", ix.deviceId);
+    for (uint32_t r = 0; r < ix.rows; r++) {
+      printf("%u %.2f %.2f %.1f %u %u\n", t[r], hr[r], spo2[r], quality[r], flags[r], risk[r]);
+    }
+    const uint32_t *evT = (const uint32_t *)(base + ix.offset[COL_EV_T]);
+    const uint8_t *evKind = base + ix.offset[COL_EV_KIND];
+    const float *evValue = (const float *)(base + ix.offset[COL_EV_VALUE]);
+    for (uint32_t e = 0; e < ix.events; e++) printf("# event %u kind %u value %.2f\n", evT[e], evKind[e], evValue[e]);
+  }
+  munmap((void *)base, len);
+  return 0;
+}
+
+// ======= Main =======
+
+static void addInput(const char *path, std::vector<Job> &jobs) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    perror(path);
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    Job j;
+    j.path = path;
+    j.bytes = (size_t)st.st_size;
+    jobs.push_back(j);
+    return;
+  }
+  DIR *d = opendir(path);
+  if (!d) return;
+  std::vector<std::string> names;
+  while (struct dirent *e = readdir(d)) {
+    size_t n = strlen(e->d_name);
+    if (n > 4 && strcmp(e->d_name + n - 4, ".bin") == 0) names.push_back(e->d_name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  for (const std::string &name : names) addInput((std::string(path) + "/" + name).c_str(), jobs);
+}
+
+int main(int argc, char **argv) {
+  const char *out = nullptr;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t interval_ms = 1000;
+  std::vector<Job> jobs;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--dump") && i + 1 < argc) {
+      return dumpFile(argv[i + 1], i + 2 < argc, i + 2 < argc ? atoi(argv[i + 2]) : 0);
+    } else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = (unsigned)max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--interval") && i + 1 < argc) interval_ms = (uint32_t)atoi(argv[++i]);
+    else if (argv[i][0] != '-') addInput(argv[i], jobs);
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (!out || jobs.empty() || interval_ms == 0) {
+    fprintf(stderr, "usage: %s --out <file.llc> [--threads n] [--interval ms] <session.bin | dir>...\n"
+                    "       %s --dump <file.llc> [device id]\n", argv[0], argv[0]);
+    return 2;
+  }
+  threads = (unsigned)std::min<size_t>(threads, jobs.size());
+
+  ColumnWriter writer;
+  if (!writer.open(out, (uint32_t)jobs.size(), interval_ms)) return 1;
+
+  // Largest first, dealt round-robin: long sessions start early and the
+  // small ones fill in (and get stolen) at the end
+  std::vector<size_t> order(jobs.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].bytes > jobs[b].bytes; });
+  WorkStealingPool pool(threads);
+  for (size_t i = 0; i < order.size(); i++) pool.seed(i % threads, order[i]);
+
+  // Results are written in input order as soon as the next one is done
+  std::mutex writeMutex;
+  size_t nextWrite = 0;
+  auto finished = [&](size_t idx) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    jobs[idx].done = true;
+    while (nextWrite < jobs.size() && jobs[nextWrite].done) {
+      Job &j = jobs[nextWrite];
+      writer.write((uint32_t)nextWrite, j);
+      delete j.sink;
+      j.sink = nullptr;
+      nextWrite++;
+    }
+  };
+
+  auto wallStart = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < threads; w++) {
+    workers.emplace_back([&, w]() {
+      size_t idx;
+      while (pool.next(w, idx)) {
+        jobs[idx].ok = runSession(jobs[idx], interval_ms);
+        finished(idx);
+      }
+    });
+  }
+  for (std::thread &t : workers) t.join();
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  if (!writer.close()) {
+    fprintf(stderr, "%s: write failed\n", out);
+    return 1;
+  }
+
+  uint64_t ppg = 0, imu = 0, inputBytes = 0;
+  double session_s = 0;
+  uint32_t failed = 0, damaged = 0;
+  for (const Job &j : jobs) {
+    inputBytes += j.bytes;
+    if (!j.ok) {
+      failed++;
+      continue;
+    }
+    ppg += j.counts.ppgSamples;
+    imu += j.counts.imu + j.counts.imuHeld;
+    session_s += j.session_s;
+    if (j.info.crcErrors || j.info.badChunks || j.info.truncated) damaged++;
+  }
+
+  fprintf(stderr, "%zu sessions (%u unreadable, %u damaged), %.1f h of data, %.1f MB in, %.1f MB out\n", jobs.size(),
+          failed, damaged, session_s / 3600.0, inputBytes / 1e6, writer.bytes() / 1e6);
+  fprintf(stderr, "%u threads, %.3f s wall\n", threads, wall_s);
+  for (unsigned w = 0; w < threads; w++) {
+    fprintf(stderr, "  worker %u: %zu sessions, %zu stolen\n", w, pool.ran(w), pool.steals(w));
+  }
+  fprintf(stderr, "throughput: %.0f PPG samples/s, %.0f gyro samples/s, %.0fx real time, %.1f MB/s\n",
+          wall_s > 0 ? ppg / wall_s : 0.0, wall_s > 0 ? imu / wall_s : 0.0, wall_s > 0 ? session_s / wall_s : 0.0,
+          wall_s > 0 ? inputBytes / 1e6 / wall_s : 0.0);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,476 @@
+// Black-box ring reader (main/blackbox.h).
+// Lists the segment files pulled off a device and cuts a time window out of
+// them into one plain session file that session_replay and batch_analyse
+// read like any other recording. Coded chunks (main/session_codec.h) are
+// decoded, records outside the window dropped, and the PPG and IMU headers in
+// force at the start of the window put in front, so the window replays on its
+// own even when it starts in the middle of a segment.
+//
+// Device time restarts at every boot. Segments are grouped into runs of
+// increasing time (a segment starting before the previous one ended begins a
+// new run); windows are taken from one run, the newest unless --run says
+// otherwise.
+//
+// --bench codes every chunk of a session file again and reports the ratio
+// and coding speed on this machine, with a round-trip check.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -o blackbox_extract tools/blackbox_extract.cpp
+//           main/session_codec.cpp
+// Run:    ./blackbox_extract --list <segment.ses | dir>...
+//         ./blackbox_extract --out window.bin [--last <min> | --from <s> --to <s>] [--run <n>]
+//           <segment.ses | dir>...
+//         ./blackbox_extract --bench <session.bin>
+// --from/--to are seconds of device time, as --list prints them.
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "recorder.h"
+#include "session_codec.h"
+#include "session_format.h"
+
+template <typename T>
+static T get(const uint8_t *p) {
+  T v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+// ======= Reading =======
+
+struct Record {
+  uint64_t t_us;
+  uint32_t body;    // offset into Ring::bodies
+  uint8_t type;
+  uint8_t count;
+  uint8_t len;
+};
+
+struct Chunk {
+  uint64_t t0_us;
+  uint16_t records;
+  std::vector<uint8_t> payload;  // plain
+  size_t storedBytes;            // as in the file, header included
+  bool coded;
+};
+
+struct Segment {
+  std::string path;
+  uint8_t header[SESSION_FILE_HEADER_SIZE];
+  int32_t deviceId = 0;
+  uint32_t chunks = 0, coded = 0, crcErrors = 0, badChunks = 0;
+  size_t bytes = 0, plainBytes = 0;
+  uint64_t firstT_us = 0, lastT_us = 0;
+  uint32_t records = 0;
+  int run = 0;
+};
+
+struct Ring {
+  std::vector<Segment> segments;
+  std::vector<Record> records;   // in file order
+  std::vector<int> recordRun;    // run of each record
+  std::vector<uint8_t> bodies;
+};
+
+// Chunks of one session image; coded ones decoded. False without a file header.
+static bool readChunks(const std::vector<uint8_t> &data, Segment &seg, std::vector<Chunk> &chunks) {
+  if (data.size() < SESSION_FILE_HEADER_SIZE || memcmp(data.data(), SESSION_MAGIC, 4) != 0) return false;
+  const uint16_t version = get<uint16_t>(data.data() + 4);
+  if (version < SESSION_VERSION_MIN || version > SESSION_VERSION) return false;
+  memcpy(seg.header, data.data(), SESSION_FILE_HEADER_SIZE);
+  seg.deviceId = get<int32_t>(data.data() + 8);
+  seg.bytes = data.size();
+
+  size_t pos = get<uint16_t>(data.data() + 6);
+  while (pos + SESSION_CHUNK_HEADER_SIZE <= data.size()) {
+    const uint8_t *c = data.data() + pos;
+    const uint16_t sync = get<uint16_t>(c);
+    if (sync != SESSION_CHUNK_SYNC && sync != SESSION_CHUNK_SYNC_RICE) {
+      pos++;
+      continue;
+    }
+    const uint16_t stored = get<uint16_t>(c + 2);
+    if (pos + SESSION_CHUNK_HEADER_SIZE + stored > data.size()) break;  // cut off at power loss
+    const uint8_t *body = c + SESSION_CHUNK_HEADER_SIZE;
+    if (Session_crc16(body, stored) != get<uint16_t>(c + 6)) {
+      seg.crcErrors++;
+      pos++;
+      continue;
+    }
+    Chunk ch;
+    ch.t0_us = get<uint64_t>(c + 8);
+    ch.records = get<uint16_t>(c + 4);
+    ch.storedBytes = SESSION_CHUNK_HEADER_SIZE + stored;
+    ch.coded = sync == SESSION_CHUNK_SYNC_RICE;
+    if (ch.coded) {
+      ch.payload.resize(0xFFFF);
+      ch.payload.resize(Session_decompress(body, stored, ch.records, ch.payload.data(), ch.payload.size()));
+    } else {
+      ch.payload.assign(body, body + stored);
+    }
+    pos += ch.storedBytes;
+    seg.chunks++;
+    seg.coded += ch.coded;
+    if (ch.payload.empty()) {
+      seg.badChunks++;
+      continue;
+    }
+    seg.plainBytes += SESSION_CHUNK_HEADER_SIZE + ch.payload.size();
+    chunks.push_back(std::move(ch));
+  }
+  seg.plainBytes += SESSION_FILE_HEADER_SIZE;
+  return true;
+}
+
+// Records of a plain chunk with absolute times; TIME records are folded in
+static bool addRecords(const Chunk &ch, Segment &seg, Ring &ring) {
+  const uint8_t *p = ch.payload.data();
+  const size_t len = ch.payload.size();
+  uint64_t t = ch.t0_us;
+  size_t off = 0;
+  for (uint16_t r = 0; r < ch.records; r++) {
+    if (off + SESSION_RECORD_HEADER_SIZE > len) return false;
+    const uint8_t type = p[off], count = p[off + 1];
+    t += get<uint16_t>(p + off + 2);
+    const int body = Session_bodySize(type, count);
+    off += SESSION_RECORD_HEADER_SIZE;
+    if (body < 0 || off + body > len) return false;
+    if (type == SESSION_REC_TIME) {
+      t += get<uint32_t>(p + off);
+    } else {
+      ring.records.push_back(Record{t, (uint32_t)ring.bodies.size(), type, count, (uint8_t)body});
+      ring.bodies.insert(ring.bodies.end(), p + off, p + off + body);
+      if (seg.records == 0) seg.firstT_us = t;
+      seg.lastT_us = t;
+      seg.records++;
+    }
+    off += body;
+  }
+  return off == len;
+}
+
+static void addInput(const char *path, std::vector<std::string> &paths) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    perror(path);
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    paths.push_back(path);
+    return;
+  }
+  DIR *d = opendir(path);
+  if (!d) return;
+  std::vector<std::string> names;
+  while (struct dirent *e = readdir(d)) {
+    size_t n = strlen(e->d_name);
+    if (n > 4 && strcmp(e->d_name + n - 4, ".ses") == 0) names.push_back(e->d_name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());  // zero-padded sequence numbers
+  for (const std::string &name : names) paths.push_back(std::string(path) + "/" + name);
+}
+
+static bool loadRing(const std::vector<std::string> &paths, Ring &ring) {
+  int run = 0;
+  for (const std::string &path : paths) {
+    std::vector<uint8_t> data;
+    if (!readFile(path.c_str(), data)) continue;
+    Segment seg;
+    seg.path = path;
+    std::vector<Chunk> chunks;
+    if (!readChunks(data, seg, chunks)) {
+      fprintf(stderr, "%s: not a session file\n", path.c_str());
+      continue;
+    }
+    for (const Chunk &ch : chunks) {
+      if (!addRecords(ch, seg, ring)) seg.badChunks++;
+    }
+    if (seg.records == 0) continue;
+    if (!ring.segments.empty()) {
+      const Segment &prev = ring.segments.back();
+      if (seg.firstT_us < prev.lastT_us || seg.deviceId != prev.deviceId) run++;
+    }
+    seg.run = run;
+    ring.recordRun.resize(ring.records.size(), run);
+    ring.segments.push_back(seg);
+  }
+  return !ring.segments.empty();
+}
+
+// ======= Writing =======
+
+// Plain chunks, split the way the recorder splits them
+class ChunkWriter {
+public:
+  explicit ChunkWriter(FILE *f) : _f(f) {}
+
+  void add(uint64_t t, uint8_t type, uint8_t count, const uint8_t *body, size_t len) {
+    const size_t need = SESSION_RECORD_HEADER_SIZE + len;
+    if (_open) {
+      if (t < _last) t = _last;
+      const uint64_t dt = t - _last;
+      const size_t extra = dt > 0xFFFF ? SESSION_RECORD_HEADER_SIZE + 4 : 0;
+      if (dt > UINT32_MAX || _len + extra + need > RECORDER_CHUNK_BYTES) close();
+    }
+    if (!_open) {
+      _open = true;
+      _t0 = _last = t;
+      _len = SESSION_CHUNK_HEADER_SIZE;
+      _records = 0;
+    }
+    uint64_t dt = t - _last;
+    if (dt > 0xFFFF) {
+      const uint32_t longDt = (uint32_t)dt;
+      put(SESSION_REC_TIME, 0, 0, (const uint8_t *)&longDt, 4);
+      dt = 0;
+    }
+    put(type, count, (uint16_t)dt, body, len);
+    _last = t;
+  }
+
+  void close() {
+    if (!_open) return;
+    const uint16_t sync = SESSION_CHUNK_SYNC;
+    const uint16_t payload = (uint16_t)(_len - SESSION_CHUNK_HEADER_SIZE);
+    const uint16_t crc = Session_crc16(_buf + SESSION_CHUNK_HEADER_SIZE, payload);
+    memcpy(_buf + 0, &sync, 2);
+    memcpy(_buf + 2, &payload, 2);
+    memcpy(_buf + 4, &_records, 2);
+    memcpy(_buf + 6, &crc, 2);
+    memcpy(_buf + 8, &_t0, 8);
+    fwrite(_buf, 1, _len, _f);
+    chunks++;
+    _open = false;
+  }
+
+  uint32_t chunks = 0;
+
+private:
+  void put(uint8_t type, uint8_t count, uint16_t dt, const uint8_t *body, size_t len) {
+    uint8_t *p = _buf + _len;
+    p[0] = type;
+    p[1] = count;
+    memcpy(p + 2, &dt, 2);
+    memcpy(p + SESSION_RECORD_HEADER_SIZE, body, len);
+    _len += SESSION_RECORD_HEADER_SIZE + len;
+    _records++;
+  }
+
+  FILE *_f;
+  uint8_t _buf[RECORDER_CHUNK_BYTES];
+  size_t _len = 0;
+  uint16_t _records = 0;
+  uint64_t _t0 = 0, _last = 0;
+  bool _open = false;
+};
+
+static int extract(const Ring &ring, const char *outPath, int run, double lastMin, double from_s, double to_s) {
+  // Time span of the run
+  const Segment *first = nullptr;
+  uint64_t runEnd = 0;
+  for (const Segment &s : ring.segments) {
+    if (s.run != run) continue;
+    if (!first) first = &s;
+    runEnd = s.lastT_us;
+  }
+  if (!first) {
+    fprintf(stderr, "no run %d\n", run);
+    return 1;
+  }
+  uint64_t from = 0, to = UINT64_MAX;
+  if (lastMin > 0) {
+    const uint64_t span = (uint64_t)(lastMin * 60e6);
+    from = runEnd > span ? runEnd - span : 0;
+  }
+  if (from_s >= 0) from = (uint64_t)(from_s * 1e6);
+  if (to_s >= 0) to = (uint64_t)(to_s * 1e6);
+
+  FILE *f = fopen(outPath, "wb");
+  if (!f) {
+    perror(outPath);
+    return 1;
+  }
+  uint8_t header[SESSION_FILE_HEADER_SIZE];
+  memcpy(header, first->header, sizeof(header));
+  const uint16_t version = SESSION_VERSION;
+  memcpy(header + 4, &version, 2);
+  fwrite(header, 1, sizeof(header), f);
+
+  // Stream headers in force at the window start go first
+  const Record *ppgHeader = nullptr, *imuHeader = nullptr;
+  ChunkWriter out(f);
+  bool started = false;
+  uint32_t records = 0;
+  uint64_t firstT = 0, lastT = 0;
+  for (size_t i = 0; i < ring.records.size(); i++) {
+    const Record &r = ring.records[i];
+    if (ring.recordRun[i] != run) continue;
+    if (r.t_us < from) {
+      if (r.type == SESSION_REC_PPG_HEADER) ppgHeader = &r;
+      if (r.type == SESSION_REC_IMU_HEADER) imuHeader = &r;
+      continue;
+    }
+    if (r.t_us > to) continue;
+    if (!started) {
+      started = true;
+      firstT = r.t_us;
+      for (const Record *h : {ppgHeader, imuHeader}) {
+        if (h) out.add(r.t_us, h->type, h->count, ring.bodies.data() + h->body, h->len);
+      }
+    }
+    out.add(r.t_us, r.type, r.count, ring.bodies.data() + r.body, r.len);
+    lastT = r.t_us;
+    records++;
+  }
+  out.close();
+  fclose(f);
+  if (!started) {
+    fprintf(stderr, "no records in the window\n");
+    return 1;
+  }
+  fprintf(stderr, "%s: run %d, %.3f - %.3f s (%.1f s), %u records in %u chunks\n", outPath, run, firstT / 1e6,
+          lastT / 1e6, (lastT - firstT) / 1e6, records, out.chunks);
+  return 0;
+}
+
+static void list(const Ring &ring) {
+  printf("# run segment device from_s to_s records chunks coded bytes plain_bytes ratio crc_errors bad\n");
+  size_t bytes = 0, plain = 0;
+  for (const Segment &s : ring.segments) {
+    const char *slash = strrchr(s.path.c_str(), '/');
+    printf("%d %s %d %.3f %.3f %u %u %u %zu %zu %.2f %u %u\n", s.run, slash ? slash + 1 : s.path.c_str(),
+           s.deviceId, s.firstT_us / 1e6, s.lastT_us / 1e6, s.records, s.chunks, s.coded, s.bytes, s.plainBytes,
+           (double)s.plainBytes / s.bytes, s.crcErrors, s.badChunks);
+    bytes += s.bytes;
+    plain += s.plainBytes;
+  }
+  if (bytes > 0) {
+    fprintf(stderr, "%zu segments, %zu bytes (%zu plain, ratio %.2f)\n", ring.segments.size(), bytes, plain,
+            (double)plain / bytes);
+  }
+}
+
+// ======= Bench =======
+
+static int bench(const char *path) {
+  std::vector<uint8_t> data;
+  if (!readFile(path, data)) return 1;
+  Segment seg;
+  std::vector<Chunk> chunks;
+  if (!readChunks(data, seg, chunks) || chunks.empty()) {
+    fprintf(stderr, "%s: no session chunks\n", path);
+    return 1;
+  }
+
+  size_t plain = 0, coded = 0, stored = 0;
+  std::vector<std::vector<uint8_t>> codedChunks(chunks.size());
+  static uint8_t buf[0xFFFF], back[0xFFFF];
+  for (size_t i = 0; i < chunks.size(); i++) {
+    const Chunk &ch = chunks[i];
+    size_t n = Session_compress(ch.payload.data(), ch.payload.size(), ch.records, buf, sizeof(buf));
+    codedChunks[i].assign(buf, buf + n);
+    plain += SESSION_CHUNK_HEADER_SIZE + ch.payload.size();
+    coded += SESSION_CHUNK_HEADER_SIZE + (n > 0 ? n : ch.payload.size());
+    stored += n > 0;
+
+    if (n > 0) {
+      size_t len = Session_decompress(buf, n, ch.records, back, sizeof(back));
+      if (len != ch.payload.size() || memcmp(back, ch.payload.data(), len) != 0) {
+        fprintf(stderr, "FAIL: chunk %zu does not round-trip\n", i);
+        return 1;
+      }
+    }
+  }
+
+  // Repeat until each direction has run for a while
+  auto timeIt = [&](bool decode) {
+    size_t reps = 0;
+    double s = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+      for (size_t i = 0; i < chunks.size(); i++) {
+        const Chunk &ch = chunks[i];
+        if (decode) {
+          if (!codedChunks[i].empty()) {
+            Session_decompress(codedChunks[i].data(), codedChunks[i].size(), ch.records, buf, sizeof(buf));
+          }
+        } else {
+          Session_compress(ch.payload.data(), ch.payload.size(), ch.records, buf, sizeof(buf));
+        }
+      }
+      reps++;
+      s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (s < 0.5);
+    return plain * reps / s / 1e6;
+  };
+  const double encode = timeIt(false), decode = timeIt(true);
+
+  printf("%s: %zu chunks (%zu coded), %zu -> %zu bytes, ratio %.2f\n", path, chunks.size(), stored, plain, coded,
+         (double)plain / coded);
+  printf("encode %.1f MB/s, decode %.1f MB/s (plain bytes), %.1f us per %u-byte chunk to encode\n", encode, decode,
+         RECORDER_CHUNK_BYTES / encode, RECORDER_CHUNK_BYTES);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths;
+  const char *outPath = nullptr, *benchPath = nullptr;
+  bool listOnly = false;
+  double lastMin = 0, from_s = -1, to_s = -1;
+  int run = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--list")) listOnly = true;
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc) outPath = argv[++i];
+    else if (!strcmp(argv[i], "--bench") && i + 1 < argc) benchPath = argv[++i];
+    else if (!strcmp(argv[i], "--last") && i + 1 < argc) lastMin = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--from") && i + 1 < argc) from_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--to") && i + 1 < argc) to_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--run") && i + 1 < argc) run = atoi(argv[++i]);
+    else if (argv[i][0] != '-') addInput(argv[i], paths);
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (benchPath) return bench(benchPath);
+  if (paths.empty() || (!listOnly && !outPath)) {
+    fprintf(stderr, "usage: %s --list <segment.ses | dir>...\n"
+                    "       %s --out <window.bin> [--last min | --from s --to s] [--run n] <segment.ses | dir>...\n"
+                    "       %s --bench <session.bin>\n",
+            argv[0], argv[0], argv[0]);
+    return 2;
+  }
+
+  Ring ring;
+  if (!loadRing(paths, ring)) {
+    fprintf(stderr, "no records\n");
+    return 1;
+  }
+  if (listOnly) {
+    list(ring);
+    return 0;
+  }
+  return extract(ring, outPath, run >= 0 ? run : ring.segments.back().run, lastMin, from_s, to_s);
+}
@@ -0,0 +1,128 @@
+// Coach Mode check for CoachStats_Service (main/CoachStats_Service.cpp).
+//   p2          P² estimates of the 5th, 50th and 99th percentile of random
+//               HR-like streams against the exact sorted quantiles
+//   rolling     RollingQuantile follows a level change within two windows
+//   steady      60 min running at a steady 155 bpm: no resting readings, so
+//               the rest limit stays on the profile value
+//   pre-start   10 min standing at ~62 bpm, then the same run: the rest
+//               estimate comes from the standing readings and holds
+//   aid-station running with a 5 min stop while HR recovers: readings before
+//               the athlete has settled are not resting readings
+// Readings come once a second on a virtual clock.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -o coach_check tools/coach_check.cpp main/CoachStats_Service.cpp
+// Run:    ./coach_check
+// Exit status is non-zero if a scenario fails.
+
+#include <Arduino.h>
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "CoachStats_Service.h"
+
+static const float PROFILE_REST = 60;
+static const float PROFILE_MAX = 190;
+
+struct Segment {
+  float seconds;
+  float speed_mps;
+  float hrFrom;   // HR approaches hrTo exponentially
+  float hrTo;
+  float hrTau_s;
+};
+
+static bool g_ok = true;
+
+static void expect(bool cond, const char *what) {
+  if (!cond) {
+    printf("FAIL: %s\n", what);
+    g_ok = false;
+  }
+}
+
+static void checkP2(const char *name, std::vector<float> &values) {
+  static const float P[] = {0.05f, 0.5f, 0.99f};
+  P2Quantile est[3];
+  for (int k = 0; k < 3; k++) est[k].begin(P[k]);
+  for (float v : values) {
+    for (int k = 0; k < 3; k++) est[k].add(v);
+  }
+  std::sort(values.begin(), values.end());
+  printf("p2 %-10s", name);
+  for (int k = 0; k < 3; k++) {
+    const float exact = values[(size_t)(P[k] * (values.size() - 1) + 0.5f)];
+    const float err = fabsf(est[k].value() - exact);
+    printf("  p%02.0f %6.2f (exact %6.2f)", P[k] * 100, est[k].value(), exact);
+    if (err > 1.0f) g_ok = false;
+  }
+  printf("\n");
+}
+
+static CoachSummary run(const char *name, const Segment *segs, size_t n) {
+  CoachStats_Service coach;
+  coach.setHeartRateLimits(PROFILE_REST, PROFILE_MAX);
+  coach.begin();
+  std::mt19937 rng(7);
+  std::normal_distribution<float> noise(0.0f, 1.5f);
+  uint32_t t = 1000;
+  for (size_t s = 0; s < n; s++) {
+    const Segment &g = segs[s];
+    const uint32_t start = t, end = t + (uint32_t)(g.seconds * 1000);
+    for (; t < end; t += COACH_SAMPLE_MS) {
+      const float el = (t - start) * 0.001f;
+      HeartRateData hr = {};
+      hr.heartRate = g.hrTo + (g.hrFrom - g.hrTo) * expf(-el / g.hrTau_s) + noise(rng);
+      hr.fingerDetected = true;
+      hr.validReading = true;
+      hr.signalQuality = 80;
+      // Arm swing while running, a little fidgeting while standing
+      const float motion = g.speed_mps > 0 ? 150.0f : 10.0f;
+      coach.update(hr, g.speed_mps, motion, t);
+    }
+  }
+  const CoachSummary &s = coach.getSummary();
+  printf("%-12s rest %5.1f (estimate %5.1f) max %5.1f median %5.1f | zones", name, s.hrRest, s.hrRestEstimate,
+         s.hrMax, s.hrMedian);
+  for (int z = 1; z <= COACH_ZONES; z++) printf(" %4.1f", s.zone_ms[z] / 60000.0f);
+  printf(" min | TRIMP %.1f\n", s.trimp);
+  return s;
+}
+
+int main() {
+  std::mt19937 rng(1);
+  std::vector<float> values;
+  std::normal_distribution<float> normal(150.0f, 12.0f);
+  for (int i = 0; i < 20000; i++) values.push_back(normal(rng));
+  checkP2("normal", values);
+  values.clear();
+  std::uniform_real_distribution<float> uniform(60.0f, 190.0f);
+  for (int i = 0; i < 20000; i++) values.push_back(uniform(rng));
+  checkP2("uniform", values);
+  expect(g_ok, "P2 estimate further than 1 bpm from the exact quantile");
+
+  RollingQuantile rq;
+  rq.begin(0.5f, 1000);
+  for (int i = 0; i < 1000; i++) rq.add(80.0f + (i % 11));
+  for (int i = 0; i < 2000; i++) rq.add(150.0f + (i % 11));
+  printf("rolling      median %.1f after a step from 85 to 155\n", rq.value());
+  expect(fabsf(rq.value() - 155.0f) < 1.0f, "rolling quantile did not follow the level change");
+
+  const Segment steady[] = {{3600, 3.0, 155, 155, 1}};
+  CoachSummary s = run("steady", steady, 1);
+  expect(s.hrRest == PROFILE_REST && isnan(s.hrRestEstimate), "rest estimated from exercise readings");
+  expect(s.zone_ms[3] > 50 * 60000, "steady 155 bpm (73 % of reserve) not in zone 3");
+
+  const Segment preStart[] = {{600, 0.0, 62, 62, 1}, {3600, 3.0, 62, 155, 60}};
+  s = run("pre-start", preStart, 2);
+  expect(fabsf(s.hrRest - 60) < 3, "rest estimate not from the standing readings");
+
+  const Segment aid[] = {{1800, 3.0, 155, 155, 1}, {300, 0.0, 155, 100, 40}, {1800, 3.0, 100, 155, 40}};
+  s = run("aid-station", aid, 3);
+  expect(s.hrRest == PROFILE_REST, "rest estimated from a short stop");
+
+  printf("%s\n", g_ok ? "OK" : "FAILED");
+  return g_ok ? 0 : 1;
+}
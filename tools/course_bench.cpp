@@ -0,0 +1,257 @@
+// Course monitor bench.
+// Loads a course (or builds a synthetic one), checks the grid index against a
+// scan of every segment on random fixes around the course, times both, and
+// walks a simulated athlete along the course with GPS noise and a detour to
+// show the off-course hysteresis and the progress tracking.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -o course_bench tools/course_bench.cpp
+//           main/course_monitor.cpp main/geo_local.cpp main/profiler.cpp
+// Run:    ./course_bench course.csv [--fixes <n>]
+//         ./course_bench --synth <km> [--fixes <n>] [--seed <n>]
+//
+// course.csv is the file the device loads from flash: one "lat,lon" per line.
+// The synthetic course winds about, then runs out and back along the same
+// road a few metres apart, where only progress tells the two legs apart.
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "course_monitor.h"
+#include "geo_local.h"
+#include "profiler.h"
+
+static const double LAT0 = 45.8326;
+static const double LON0 = 6.8652;
+
+class FileStream : public Stream {
+public:
+  explicit FileStream(FILE *f) : _f(f) {}
+  using Stream::write;
+  size_t write(uint8_t) override { return 0; }
+  int read() override { return fgetc(_f); }
+
+private:
+  FILE *_f;
+};
+
+// Course in metres east/north of LAT0/LON0
+struct Path {
+  std::vector<double> e, n;
+  void add(double pe, double pn) {
+    e.push_back(pe);
+    n.push_back(pn);
+  }
+};
+
+static void synthesize(Path &p, double km, std::mt19937 &rng) {
+  std::normal_distribution<double> turn(0.0, 0.08);
+  const double step = 10.0;
+  const double spur = 0.2 * km * 1000.0;
+  const int winding = (int)((km * 1000.0 - 2 * spur) / step);
+  double e = 0, n = 0, heading = 0.3, rate = 0;
+  p.add(e, n);
+  for (int i = 0; i < winding; i++) {
+    rate = 0.9 * rate + turn(rng) * 0.3;
+    heading += rate;
+    e += step * cos(heading);
+    n += step * sin(heading);
+    p.add(e, n);
+  }
+
+  // Out and back: 6 m apart, like the two sides of a road
+  const double se = cos(heading), sn = sin(heading);
+  const double oe = -sn * 6.0, on = se * 6.0;
+  const int legs = (int)(spur / step);
+  for (int i = 1; i <= legs; i++) p.add(e + se * step * i, n + sn * step * i);
+  for (int i = legs; i >= 0; i--) p.add(e + se * step * i + oe, n + sn * step * i + on);
+}
+
+// Course points in the frame of the first one, as Course_load() uses
+static bool loadCsv(const char *path, Path &p, GeoFrame &frame) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  bool first = true;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    double lat, lon;
+    if (sscanf(line, "%lf,%lf", &lat, &lon) != 2) continue;
+    if (first) Geo_frame(frame, lat, lon);
+    first = false;
+    double e, n;
+    Geo_toLocal(frame, lat, lon, e, n);
+    p.add(e, n);
+  }
+  fclose(f);
+  return p.e.size() >= 2;
+}
+
+// (Re)load the course and clear the monitor state
+static void loadPath(const Path &p, const GeoFrame &frame) {
+  std::vector<double> lat(p.e.size()), lon(p.e.size());
+  for (size_t i = 0; i < p.e.size(); i++) Geo_toLatLon(frame, p.e[i], p.n[i], lat[i], lon[i]);
+  Course_loadPoints(lat.data(), lon.data(), lat.size());
+}
+
+static double nowSeconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv) {
+  const char *csv = nullptr;
+  double km = 42.2;
+  long fixes = 200000;
+  uint32_t seed = 7;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--synth") && i + 1 < argc) km = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--fixes") && i + 1 < argc) fixes = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atol(argv[++i]);
+    else if (argv[i][0] != '-') csv = argv[i];
+    else {
+      fprintf(stderr, "usage: %s [course.csv | --synth km] [--fixes n] [--seed n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  Path path;
+  GeoFrame frame;
+  Geo_frame(frame, LAT0, LON0);
+  if (csv) {
+    if (!loadCsv(csv, path, frame)) {
+      fprintf(stderr, "%s: not a usable course\n", csv);
+      return 1;
+    }
+    // Course_load() reads the file exactly as the device does
+    FILE *f = fopen(csv, "r");
+    FileStream in(f);
+    bool ok = Course_load(in);
+    fclose(f);
+    if (!ok) {
+      fprintf(stderr, "%s: not a usable course\n", csv);
+      return 1;
+    }
+  } else {
+    synthesize(path, km, rng);
+    loadPath(path, frame);
+  }
+  Course_printInfo();
+
+  // ---- Index against brute force on random fixes near the course ----
+  std::vector<double> fixLat(fixes), fixLon(fixes);
+  std::uniform_int_distribution<size_t> pick(0, path.e.size() - 1);
+  std::normal_distribution<double> off(0.0, COURSE_INDEX_RADIUS_M);
+  for (long i = 0; i < fixes; i++) {
+    size_t k = pick(rng);
+    Geo_toLatLon(frame, path.e[k] + off(rng), path.n[k] + off(rng), fixLat[i], fixLon[i]);
+  }
+
+  long near = 0, mismatches = 0;
+  double t0 = nowSeconds();
+  std::vector<float> indexed(fixes);
+  for (long i = 0; i < fixes; i++) indexed[i] = Course_update(fixLat[i], fixLon[i]).distance_m;
+  double tIndex = nowSeconds() - t0;
+  t0 = nowSeconds();
+  std::vector<float> brute(fixes);
+  for (long i = 0; i < fixes; i++) brute[i] = Course_distanceBrute(fixLat[i], fixLon[i], nullptr);
+  double tBrute = nowSeconds() - t0;
+  for (long i = 0; i < fixes; i++) {
+    if (brute[i] <= COURSE_INDEX_RADIUS_M) {
+      near++;
+      if (indexed[i] != brute[i]) mismatches++;
+    } else if (indexed[i] != INFINITY) {
+      mismatches++;
+    }
+  }
+  printf("index check: %ld fixes, %ld within %.0f m, %ld mismatches\n", fixes, near, COURSE_INDEX_RADIUS_M,
+         mismatches);
+  printf("per fix:     indexed %.2f us, all segments %.2f us (%.0fx)\n", 1e6 * tIndex / fixes,
+         1e6 * tBrute / fixes, tBrute / tIndex);
+
+  // ---- Athlete along the course: 1 fix/s, 4 m GPS noise, one detour ----
+  CourseInfo ci;
+  Course_getInfo(ci);
+  loadPath(path, frame);
+
+  std::normal_distribution<double> gps(0.0, 4.0);
+  const double speed = 3.5;
+  const double detourAt = 0.3 * ci.length_m;
+  const double detourOut = 60, detourStay = 90; // seconds walking away, then off course
+  const double detourDist = 150;
+
+  int offEvents = 0, onEvents = 0, falseAlarms = 0;
+  double maxProgressErr = 0, firstOff = -1, backOn = -1;
+  long checked = 0, wrongLeg = 0;
+  size_t seg = 0;
+  double segStart = 0, along = 0, t = 0;
+  double detourT = -1;
+  while (seg + 1 < path.e.size()) {
+    // Position on the course at 'along'
+    double de = path.e[seg + 1] - path.e[seg], dn = path.n[seg + 1] - path.n[seg];
+    double len = sqrt(de * de + dn * dn);
+    if (along - segStart > len) {
+      segStart += len;
+      seg++;
+      continue;
+    }
+    double f = len > 0 ? (along - segStart) / len : 0;
+    double e = path.e[seg] + f * de, n = path.n[seg] + f * dn;
+
+    // Detour: walk off at right angles, wait, walk back; progress stalls.
+    // On the way back the fix can pass other parts of the course, so progress
+    // is only checked again a while after rejoining.
+    double away = 0;
+    bool inDetour = false, settling = false;
+    if (detourT < 0 && along >= detourAt) detourT = t;
+    if (detourT >= 0) {
+      double dt = t - detourT;
+      if (dt < detourOut) away = detourDist * dt / detourOut;
+      else if (dt < detourOut + detourStay) away = detourDist;
+      else if (dt < 2 * detourOut + detourStay) away = detourDist * (2 * detourOut + detourStay - dt) / detourOut;
+      inDetour = dt < 2 * detourOut + detourStay;
+      settling = dt < 2 * detourOut + detourStay + 120;
+    }
+    if (len > 0) {
+      e += -dn / len * away;
+      n += de / len * away;
+    }
+
+    double lat, lon;
+    Geo_toLatLon(frame, e + gps(rng), n + gps(rng), lat, lon);
+    const CourseStatus &cs = Course_update(lat, lon);
+    if (cs.changed) {
+      if (cs.offCourse) {
+        offEvents++;
+        if (!inDetour) falseAlarms++;
+        if (firstOff < 0) firstOff = t - detourT;
+      } else {
+        onEvents++;
+        if (backOn < 0 && detourT >= 0) backOn = t - detourT;
+      }
+    }
+    if (!settling && !cs.offCourse) {
+      double err = fabs(cs.progress_m - along);
+      if (err > maxProgressErr) maxProgressErr = err;
+      if (err > 2 * COURSE_AMBIGUITY_M) wrongLeg++;
+      checked++;
+    }
+
+    t += 1.0;
+    if (!inDetour) along += speed;
+  }
+  printf("athlete:     %.1f km in %.0f min, detour of %.0f m at %.1f km\n", ci.length_m / 1000.0, t / 60.0,
+         detourDist, detourAt / 1000.0);
+  printf("             off-course events %d (false %d), back on %d | off after %.0f s, back after %.0f s\n",
+         offEvents, falseAlarms, onEvents, firstOff, backOn);
+  printf("             progress outside the detour: max error %.1f m, %ld of %ld fixes over %.0f m\n",
+         maxProgressErr, wrongLeg, checked, 2 * COURSE_AMBIGUITY_M);
+
+  Prof_print();
+  return mismatches == 0 && falseAlarms == 0 && offEvents >= 1 ? 0 : 1;
+}
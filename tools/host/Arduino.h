@@ -0,0 +1,105 @@
+// Minimal Arduino/ESP32 stand-in for building firmware services on Linux.
+// Only what the host tools in tools/ need: timing, math helpers, Stream,
+// Serial and the ESP cycle counter.
+//
+// Time is virtual and per thread: millis()/micros() return whatever the tool
+// set with host_setMicros(), so replays are deterministic and several can run
+// in parallel. ESP.getCycleCount() is a real 1 GHz (ns) counter so cycle
+// measurements in the services read as nanoseconds on the host.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PI 3.14159265358979
+#define TWO_PI 6.28318530717958
+#define HEX 16
+#define DEC 10
+#define F(x) x
+#define IRAM_ATTR
+
+// ======= Virtual clock =======
+inline thread_local uint64_t host_now_us = 0;
+
+inline void host_setMicros(uint64_t us) { host_now_us = us; }
+inline void host_advanceMicros(uint64_t us) { host_now_us += us; }
+
+inline unsigned long millis() { return (unsigned long)(host_now_us / 1000); }
+inline unsigned long micros() { return (unsigned long)host_now_us; }
+inline void delay(unsigned long ms) { host_now_us += (uint64_t)ms * 1000; }
+inline void delayMicroseconds(unsigned int us) { host_now_us += us; }
+inline int64_t esp_timer_get_time() { return (int64_t)host_now_us; }
+
+template <class T> T constrain(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+// ======= ESP cycle counter =======
+struct HostEsp {
+  uint32_t getCycleCount() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  uint32_t getCpuFreqMHz() { return 1000; }
+};
+inline HostEsp ESP;
+
+// ======= Streams =======
+class Stream {
+public:
+  virtual ~Stream() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len && write(buf[n])) n++;
+    return n;
+  }
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  virtual void flush() {}
+};
+
+// ======= Serial (stdout) =======
+struct HostSerial : public Stream {
+  void begin(unsigned long) {}
+  explicit operator bool() const { return true; }
+
+  using Stream::write;
+  size_t write(uint8_t b) override { return fputc(b, stdout) == EOF ? 0 : 1; }
+
+  size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+  size_t print(char c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+  size_t print(long v, int base = DEC) { return base == HEX ? printf("%lX", v) : printf("%ld", v); }
+  size_t print(unsigned long v, int base = DEC) { return base == HEX ? printf("%lX", v) : printf("%lu", v); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(uint8_t v, int base = DEC) { return print((unsigned long)v, base); }
+
+  template <class T> size_t println(T v) { return print(v) + println(); }
+  template <class T> size_t println(T v, int fmt) { return print(v, fmt) + println(); }
+  size_t println() { return print('\n'); }
+
+  size_t printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n > 0 ? (size_t)n : 0;
+  }
+
+  void flush() override { fflush(stdout); }
+};
+inline HostSerial Serial;
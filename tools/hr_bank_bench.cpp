@@ -0,0 +1,233 @@
+// Multi-channel heart-rate bench.
+// Runs the same synthetic PPG for many channels through one HeartRate_Service
+// per channel and through HeartRateBank (ground/HeartRateBank.h) with each
+// window-statistics kernel the CPU supports, checks that every reading is
+// bit-identical, and reports the cost per channel-sample.
+//
+// Build:  g++ -O2 -std=c++17 -DPROFILING_ENABLED=0 -Itools/host -Imain -Iground -o hr_bank_bench
+//           tools/hr_bank_bench.cpp main/HeartRate_Service.cpp main/profiler.cpp ground/HeartRateBank.cpp
+// Run:    ./hr_bank_bench [--channels n] [--seconds s] [--seed n]
+//
+// Channels differ in heart rate, perfusion, DC level and noise; some have no
+// finger on the sensor. Every channel also sees front-end retunes
+// (markDiscontinuity), temperature updates and the occasional reset, at
+// channel-specific times, so the bank's channels do not stay in step.
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "HeartRateBank.h"
+#include "HeartRate_Service.h"
+
+static_assert(HRB_WINDOW == HR_BUFFER_SIZE, "HeartRateBank window differs from HeartRate_Service");
+static_assert(HRB_FINGER_THRESHOLD == HR_FINGER_THRESHOLD, "finger threshold differs");
+
+static const uint32_t SAMPLE_MS = 10; // 100 sps, as on the device
+static const uint32_t CHECK_EVERY = 50;
+
+enum SynthEvent : uint8_t { EVT_NONE, EVT_DISCONTINUITY, EVT_TEMPERATURE, EVT_RESET };
+
+// Deterministic per-channel PPG; restart() replays the same stream
+class Synth {
+public:
+  Synth(size_t channels, uint32_t seed) : _seed(seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    _ch.resize(channels);
+    for (Chan &c : _ch) {
+      c.fHeart = (45.0f + 140.0f * u(rng)) / 60.0f;
+      c.dcIr = u(rng) < 0.1f ? 20000.0f + 20000.0f * u(rng) : 60000.0f + 120000.0f * u(rng);
+      c.dcRed = c.dcIr * (0.6f + 0.3f * u(rng));
+      c.acIr = 0.02f + 0.10f * u(rng);
+      c.acRed = c.acIr * (0.4f + 0.5f * u(rng));
+      c.noise = 50.0f + 600.0f * u(rng);
+      c.retuneEvery = 1500 + (uint32_t)(4000 * u(rng));
+      c.tempEvery = 800 + (uint32_t)(400 * u(rng));
+      c.phase0 = 6.2832f * u(rng);
+    }
+    restart();
+  }
+
+  void restart() {
+    for (size_t i = 0; i < _ch.size(); i++) _ch[i].state = _seed * 2654435761u + (uint32_t)i * 40503u + 1;
+  }
+
+  // Sample n of every channel; events[ch] says what happens before it
+  void step(uint32_t n, uint32_t *red, uint32_t *ir, uint8_t *events, float *temperature) {
+    const float t = n * (SAMPLE_MS / 1000.0f);
+    for (size_t i = 0; i < _ch.size(); i++) {
+      Chan &c = _ch[i];
+      const float ph = 6.2832f * c.fHeart * t + c.phase0;
+      const float pulse = sinf(ph) + 0.35f * sinf(2.0f * ph + 1.0f);
+      ir[i] = (uint32_t)(c.dcIr * (1.0f + c.acIr * pulse) + c.noise * noise(c));
+      red[i] = (uint32_t)(c.dcRed * (1.0f + c.acRed * pulse) + c.noise * noise(c));
+
+      events[i] = EVT_NONE;
+      if (n > 0 && n % c.retuneEvery == 0) events[i] = EVT_DISCONTINUITY;
+      else if (n % c.tempEvery == 0) {
+        events[i] = EVT_TEMPERATURE;
+        temperature[i] = 15.0f + 0.01f * (n % 2000) + 3.0f * noise(c);
+      } else if (n > 0 && n % (c.retuneEvery * 7 + 13) == 0) {
+        events[i] = EVT_RESET;
+      }
+    }
+  }
+
+private:
+  struct Chan {
+    float fHeart, dcIr, dcRed, acIr, acRed, noise, phase0;
+    uint32_t retuneEvery, tempEvery;
+    uint32_t state;
+  };
+
+  // Cheap deterministic noise in [-1, 1)
+  static float noise(Chan &c) {
+    c.state ^= c.state << 13;
+    c.state ^= c.state >> 17;
+    c.state ^= c.state << 5;
+    return (c.state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+  }
+
+  uint32_t _seed;
+  std::vector<Chan> _ch;
+};
+
+struct Inputs {
+  std::vector<uint32_t> red, ir;
+  std::vector<uint8_t> events;
+  std::vector<float> temperature;
+  explicit Inputs(size_t n) : red(n), ir(n), events(n), temperature(n) {}
+};
+
+static bool sameReading(const HeartRateData &a, const HeartRateReading &b) {
+  return memcmp(&a.heartRate, &b.heartRate, sizeof(float)) == 0 && memcmp(&a.spO2, &b.spO2, sizeof(float)) == 0 &&
+         memcmp(&a.signalQuality, &b.signalQuality, sizeof(float)) == 0 && a.fingerDetected == b.fingerDetected &&
+         a.validReading == b.validReading && a.lastBeatTime == b.lastBeatTime;
+}
+
+int main(int argc, char **argv) {
+  size_t channels = 2048;
+  float seconds = 60.0f;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--channels") && i + 1 < argc) channels = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--channels n] [--seconds s] [--seed n]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (channels == 0) channels = 1;
+  const uint32_t steps = (uint32_t)(seconds * 1000.0f / SAMPLE_MS);
+  const uint32_t checks = steps / CHECK_EVERY;
+
+  Synth synth(channels, seed);
+  Inputs in(channels);
+  typedef std::chrono::steady_clock Clock;
+
+  // Reference: one scalar service per channel
+  std::vector<HeartRate_Service> ref(channels);
+  for (HeartRate_Service &s : ref) s.begin();
+  std::vector<HeartRateData> expected((size_t)checks * channels);
+  double refSeconds = 0.0;
+  uint32_t beats = 0, valid = 0;
+  for (uint32_t n = 0; n < steps; n++) {
+    synth.step(n, in.red.data(), in.ir.data(), in.events.data(), in.temperature.data());
+    host_setMicros((uint64_t)(n + 1) * SAMPLE_MS * 1000);
+    Clock::time_point t0 = Clock::now();
+    for (size_t c = 0; c < channels; c++) {
+      HeartRate_Service &s = ref[c];
+      switch (in.events[c]) {
+        case EVT_DISCONTINUITY:
+          s.markDiscontinuity();
+          break;
+        case EVT_TEMPERATURE:
+          s.setTemperature(in.temperature[c]);
+          break;
+        case EVT_RESET:
+          s.reset();
+          break;
+      }
+      s.addSample(in.red[c], in.ir[c]);
+    }
+    refSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+    if ((n + 1) % CHECK_EVERY == 0 && (n + 1) / CHECK_EVERY <= checks) {
+      HeartRateData *row = &expected[(size_t)((n + 1) / CHECK_EVERY - 1) * channels];
+      for (size_t c = 0; c < channels; c++) {
+        row[c] = ref[c].getReadings();
+        if (row[c].validReading) valid++;
+        if (row[c].heartRate > 0) beats++;
+      }
+    }
+  }
+  ref.clear();
+
+  const double samples = (double)steps * channels;
+  printf("hr_bank_bench: %zu channels x %.0f s at %u sps (%.1fM channel-samples)\n", channels, seconds,
+         1000 / SAMPLE_MS, samples / 1e6);
+  printf("  checks: %u x %zu readings, %.0f%% valid, %.0f%% with a heart rate\n", checks, channels,
+         checks ? 100.0 * valid / ((double)checks * channels) : 0.0,
+         checks ? 100.0 * beats / ((double)checks * channels) : 0.0);
+  printf("  %-22s %8.1f ns/sample  %6.2fx\n", "HeartRate_Service x n", refSeconds * 1e9 / samples, 1.0);
+
+  bool ok = true;
+  const HeartRateKernel kernels[] = {HRB_KERNEL_SCALAR, HRB_KERNEL_SSE41, HRB_KERNEL_AVX2};
+  for (HeartRateKernel k : kernels) {
+    char name[32];
+    snprintf(name, sizeof(name), "HeartRateBank %s", HeartRateBank::kernelName(k));
+    if (!HeartRateBank::kernelSupported(k)) {
+      printf("  %-22s not supported by this CPU\n", name);
+      continue;
+    }
+
+    HeartRateBank bank(channels);
+    bank.setKernel(k);
+    synth.restart();
+    double bankSeconds = 0.0;
+    size_t mismatches = 0;
+    for (uint32_t n = 0; n < steps; n++) {
+      synth.step(n, in.red.data(), in.ir.data(), in.events.data(), in.temperature.data());
+      Clock::time_point t0 = Clock::now();
+      for (size_t c = 0; c < channels; c++) {
+        switch (in.events[c]) {
+          case EVT_DISCONTINUITY:
+            bank.markDiscontinuity(c);
+            break;
+          case EVT_TEMPERATURE:
+            bank.setTemperature(c, in.temperature[c]);
+            break;
+          case EVT_RESET:
+            bank.reset(c);
+            break;
+        }
+      }
+      bank.addSamples((n + 1) * SAMPLE_MS, in.red.data(), in.ir.data());
+      bankSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+
+      if ((n + 1) % CHECK_EVERY == 0 && (n + 1) / CHECK_EVERY <= checks) {
+        const HeartRateData *row = &expected[(size_t)((n + 1) / CHECK_EVERY - 1) * channels];
+        for (size_t c = 0; c < channels; c++) {
+          HeartRateReading r = bank.reading(c);
+          if (sameReading(row[c], r)) continue;
+          if (mismatches++ < 5) {
+            fprintf(stderr, "  %s: channel %zu at %u ms: hr %.9g/%.9g spo2 %.9g/%.9g q %.9g/%.9g beat %u/%u\n", name,
+                    c, (n + 1) * SAMPLE_MS, row[c].heartRate, r.heartRate, row[c].spO2, r.spO2,
+                    row[c].signalQuality, r.signalQuality, row[c].lastBeatTime, r.lastBeatTime);
+          }
+        }
+      }
+    }
+    printf("  %-22s %8.1f ns/sample  %6.2fx  %s\n", name, bankSeconds * 1e9 / samples, refSeconds / bankSeconds,
+           mismatches ? "MISMATCH" : "identical");
+    if (mismatches) {
+      printf("    %zu of %zu readings differ\n", mismatches, (size_t)checks * channels);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+// Alert path check against a satellite link stand-in.
+// Runs the firmware uplink scheduler (main/uplink.cpp) on a virtual clock and
+// feeds its bytes, through a lossy, high-latency link model, into the ground
+// parser and AlertTracker used by ingest. Checks that alerts pre-empt
+// telemetry, arrive exactly once unless every copy was lost, and that the
+// ground latency estimate tracks the true trigger-to-receipt latency.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -Iground -o link_sim tools/link_sim.cpp
+//           main/uplink.cpp main/profiler.cpp ground/frame.cpp ground/AlertTracker.cpp
+// Run:    ./link_sim [--minutes <m>] [--loss <p>] [--delay <ms>] [--jitter <ms>] [--seed <n>]
+// Exit status is non-zero if a check fails.
+
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "AlertTracker.h"
+#include "frame.h"
+#include "uplink.h"
+
+static const int32_t DEVICE_ID = 1234;
+static const double CLOCK_OFFSET_MS = 86400123.4; // ground minus device clock
+static const double BYTE_MS = 10.0 * 1000.0 / ALERT_LINK_BAUD;
+
+struct InFlight {
+  double arrival_ms; // ground clock
+  std::vector<uint8_t> bytes;
+};
+
+// UART + satellite hop. write() collects one frame; flush() blocks for its
+// airtime (advancing the device clock, like HardwareSerial::flush()) and then
+// hands it to the link, which drops it or delivers it after a random delay.
+class LinkStandIn : public Stream {
+public:
+  LinkStandIn(std::mt19937 &rng, double loss, double delay_ms, double jitter_ms)
+      : _rng(rng), _loss(loss), _delay(delay_ms), _jitter(jitter_ms > 0 ? jitter_ms : 1.0) {}
+
+  using Stream::write;
+  size_t write(uint8_t b) override {
+    _pending.push_back(b);
+    return 1;
+  }
+
+  void flush() override {
+    if (_pending.empty()) return;
+    host_advanceMicros((uint64_t)(_pending.size() * BYTE_MS * 1000.0));
+    framesSent++;
+    if (std::uniform_real_distribution<double>(0, 1)(_rng) < _loss) {
+      framesLost++;
+    } else {
+      double transit = _delay + std::exponential_distribution<double>(1.0 / _jitter)(_rng);
+      inFlight.push_back(InFlight{millis() + CLOCK_OFFSET_MS + transit, _pending});
+    }
+    _pending.clear();
+  }
+
+  std::vector<InFlight> inFlight;
+  uint32_t framesSent = 0;
+  uint32_t framesLost = 0;
+
+private:
+  std::mt19937 &_rng;
+  double _loss;
+  double _delay;
+  double _jitter;
+  std::vector<uint8_t> _pending;
+};
+
+struct Raised {
+  uint32_t eventMs;
+  uint8_t kind;
+  bool received;
+  double trueLatency_ms;
+  double estLatency_ms;
+  uint32_t queue_ms;
+};
+
+int main(int argc, char **argv) {
+  double minutes = 30, loss = 0.2, delay = 600, jitter = 900;
+  unsigned seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--minutes")) minutes = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--loss")) loss = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--delay")) delay = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--jitter")) jitter = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--seed")) seed = (unsigned)atoi(argv[i + 1]);
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  LinkStandIn link(rng, loss, delay, jitter);
+  host_setMicros(1000000);
+  Uplink_init(link, DEVICE_ID, /*bootId=*/1, /*serialLogging=*/false, /*startTask=*/false);
+
+  FrameParser parser;
+  AlertTracker tracker(delay); // the constant part of the transit is configured, as in ingest
+  std::map<uint32_t, Raised> raised; // by eventMs
+  uint32_t telemetryReceived = 0, alertFramesReceived = 0, duplicateEvents = 0;
+
+  const uint32_t endMs = millis() + (uint32_t)(minutes * 60000.0);
+  uint32_t nextTelemetry = millis();
+  std::exponential_distribution<double> alertGap(1.0 / 20000.0);
+  uint32_t nextAlert = millis() + (uint32_t)alertGap(rng);
+  uint32_t nextService = millis();
+  uint32_t simMs = millis();
+
+  // Run until the end plus enough time for the last repeats to land
+  while (simMs < endMs + 20000) {
+    // Device side at simMs; flush() inside Uplink_service() may push the
+    // device clock ahead, in which case events simply see the delay
+    if (millis() < simMs) host_setMicros((uint64_t)simMs * 1000);
+
+    if (simMs < endMs && simMs >= nextAlert) {
+      uint8_t kind = (uint8_t)std::uniform_int_distribution<int>(UPLINK_ALERT_SOS, UPLINK_ALERT_RISK)(rng);
+      if (Uplink_raiseAlert((UplinkAlertKind)kind, nextAlert)) {
+        raised[nextAlert] = Raised{nextAlert, kind, false, 0, 0, 0};
+        nextService = simMs;
+      }
+      nextAlert += 1 + (uint32_t)alertGap(rng);
+    }
+    if (simMs < endMs && simMs >= nextTelemetry) {
+      Uplink_setStatus(42.7f, 23.3f, 140, 35);
+      Uplink_sendTelemetry(false);
+      nextTelemetry += 1000;
+      nextService = simMs;
+    }
+    if (simMs >= nextService) {
+      uint32_t wait = Uplink_service(millis());
+      nextService = wait == UINT32_MAX ? UINT32_MAX : millis() + wait;
+    }
+
+    // Ground side: deliver frames that have arrived by now (ground clock)
+    double groundMs = simMs + CLOCK_OFFSET_MS;
+    for (size_t i = 0; i < link.inFlight.size();) {
+      InFlight &f = link.inFlight[i];
+      if (f.arrival_ms > groundMs) {
+        i++;
+        continue;
+      }
+      AthleteFrame frame;
+      for (uint8_t b : f.bytes) {
+        if (!parser.push(b, frame)) continue;
+        if (frame.type != 'e') {
+          telemetryReceived++;
+          continue;
+        }
+        alertFramesReceived++;
+        AlertReceipt r;
+        if (!tracker.onFrame(frame, f.arrival_ms, r)) continue;
+        auto it = raised.find(frame.eventMs);
+        if (it == raised.end()) continue;
+        if (it->second.received) duplicateEvents++;
+        it->second.received = true;
+        it->second.trueLatency_ms = f.arrival_ms - (frame.eventMs + CLOCK_OFFSET_MS);
+        it->second.estLatency_ms = r.latency_ms;
+        it->second.queue_ms = (uint32_t)r.queue_ms;
+      }
+      link.inFlight.erase(link.inFlight.begin() + i);
+    }
+
+    simMs++;
+  }
+
+  // Results
+  UplinkStats st;
+  Uplink_getStats(st);
+  uint32_t received = 0;
+  double sumErr = 0, maxErr = 0, sumTrue = 0, maxTrue = 0;
+  uint32_t maxQueue = 0;
+  for (const auto &kv : raised) {
+    const Raised &r = kv.second;
+    if (!r.received) continue;
+    received++;
+    double err = r.estLatency_ms - r.trueLatency_ms;
+    sumErr += fabs(err);
+    maxErr = max(maxErr, fabs(err));
+    sumTrue += r.trueLatency_ms;
+    maxTrue = max(maxTrue, r.trueLatency_ms);
+    maxQueue = max(maxQueue, r.queue_ms);
+  }
+
+  const double allCopiesLost = pow(loss, UPLINK_ALERT_COPIES);
+  printf("link: %.0f%% loss, %.0f ms + exp(%.0f ms) transit, %u frames sent, %u lost\n", loss * 100, delay, jitter,
+         link.framesSent, link.framesLost);
+  printf("device: %u alerts raised, %u suppressed, %u frames, %u preempted telemetry, queue max %u ms\n",
+         st.raised, st.suppressed, st.alertFrames, st.preempted, st.maxQueue_ms);
+  printf("ground: %u/%zu alerts received (expected loss %.2f%%), %u telemetry frames, %u alert frames\n", received,
+         raised.size(), allCopiesLost * 100, telemetryReceived, alertFramesReceived);
+  if (received > 0) {
+    printf("latency: true avg %.0f / max %.0f ms, estimate error avg %.0f / max %.0f ms\n", sumTrue / received,
+           maxTrue, sumErr / received, maxErr);
+  }
+
+  // Checks
+  int failures = 0;
+  const uint32_t queueBound = (uint32_t)(UPLINK_EVENT_FRAME_SIZE * BYTE_MS) + 2;
+  if (st.maxQueue_ms > queueBound) {
+    printf("FAIL: alert waited %u ms on the device (bound %u ms: one frame on the wire)\n", st.maxQueue_ms, queueBound);
+    failures++;
+  }
+  if (duplicateEvents > 0) {
+    printf("FAIL: %u alert events reported more than once\n", duplicateEvents);
+    failures++;
+  }
+  uint32_t missing = (uint32_t)raised.size() - received;
+  double expectedMissing = allCopiesLost * raised.size();
+  if (missing > 3 * expectedMissing + 2) {
+    printf("FAIL: %u alerts missing, expected about %.1f\n", missing, expectedMissing);
+    failures++;
+  }
+  // The estimate is only off by how much faster the fastest copy seen was
+  // than the path delay floor: on the order of the jitter, not more
+  if (received > 0 && sumErr / received > jitter) {
+    printf("FAIL: latency estimate off by %.0f ms on average\n", sumErr / received);
+    failures++;
+  }
+  printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+// Motion-artifact filter bench.
+// Replays recorded PPG + gyro samples through MotionCancel_Service and
+// HeartRate_Service, with and without the filter, and reports the heart rate
+// each path produces (beat detection and the spectral estimator) plus the
+// filter cost per sample.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -o mc_bench tools/mc_bench.cpp
+//           main/MotionCancel_Service.cpp main/HeartRate_Service.cpp main/SpectralHR_Service.cpp main/profiler.cpp
+// Run:    ./mc_bench run.csv [--ref-bpm <bpm>] [--drain <ms>]
+//         ./mc_bench --synth <seconds> [--bpm <bpm>] [--cadence <spm>] [--rate <sps>] [--drain <ms>]
+//
+// --drain processes the PPG samples in bursts every <ms> as HR_step does
+// with the sensor FIFO, each stamped with its own sample time, while gyro
+// readings arrive as they are taken: the oldest sample of a burst must still
+// find its reference in the filter's gyro history (MC_REF_HISTORY).
+//
+// CSV input, one PPG sample per line (header lines are skipped):
+//   t_ms,red,ir[,roll_dps,pitch_dps,yaw_dps]
+// Rows that carry gyro columns also feed the filter a motion reference.
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "HeartRate_Service.h"
+#include "MotionCancel_Service.h"
+#include "SpectralHR_Service.h"
+#include "profiler.h"
+
+struct Row {
+  uint32_t t_ms;
+  uint32_t red;
+  uint32_t ir;
+  bool hasGyro;
+  float rate[3];
+};
+
+static bool loadCsv(const char *path, std::vector<Row> &rows) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    Row r;
+    unsigned long t, red, ir;
+    int n = sscanf(line, "%lu,%lu,%lu,%f,%f,%f", &t, &red, &ir, &r.rate[0], &r.rate[1], &r.rate[2]);
+    if (n < 3) continue;
+    r.t_ms = (uint32_t)t;
+    r.red = (uint32_t)red;
+    r.ir = (uint32_t)ir;
+    r.hasGyro = (n == 6);
+    rows.push_back(r);
+  }
+  fclose(f);
+  return true;
+}
+
+// Wrist PPG while running: cardiac pulse plus an arm-swing artifact that is a
+// (delayed, filtered) linear function of the gyro rates, plus noise.
+static void synthesize(std::vector<Row> &rows, float seconds, float bpm, float cadence, float sps) {
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  const float fHeart = bpm / 60.0f;
+  const float fSwing = cadence / 120.0f; // one arm swing per two steps
+  const int count = (int)(seconds * sps);
+  float lagged[3] = {0, 0, 0};
+
+  for (int i = 0; i < count; i++) {
+    float t = i / sps;
+    Row r;
+    r.t_ms = (uint32_t)(t * 1000.0f);
+    r.hasGyro = true;
+    r.rate[0] = 180.0f * sinf(2 * PI * fSwing * t) + 3.0f * noise(rng);
+    r.rate[1] = 60.0f * sinf(2 * PI * 2 * fSwing * t + 0.7f) + 3.0f * noise(rng);
+    r.rate[2] = 40.0f * cosf(2 * PI * fSwing * t) + 3.0f * noise(rng);
+
+    // Tissue responds with some lag: first-order low-pass of the rates
+    for (int c = 0; c < 3; c++) lagged[c] += (r.rate[c] - lagged[c]) * 0.3f;
+
+    float pulse = sinf(2 * PI * fHeart * t) + 0.35f * sinf(4 * PI * fHeart * t + 1.0f);
+    float motion = 40.0f * lagged[0] + 60.0f * lagged[1] - 30.0f * lagged[2];
+    float ir = 80000.0f + 6000.0f * pulse + motion + 150.0f * noise(rng);
+    float red = 60000.0f + 3500.0f * pulse + 0.8f * motion + 150.0f * noise(rng);
+    r.ir = (uint32_t)max(0.0f, ir);
+    r.red = (uint32_t)max(0.0f, red);
+    rows.push_back(r);
+  }
+}
+
+struct EstimateResult {
+  std::vector<float> perSecond;
+  float meanAbsError = 0;
+  int validSeconds = 0;
+
+  void add(float bpm, float refBpm) {
+    perSecond.push_back(bpm);
+    if (refBpm > 0 && bpm > 0) {
+      meanAbsError += fabsf(bpm - refBpm);
+      validSeconds++;
+    }
+  }
+  void finish() {
+    if (validSeconds > 0) meanAbsError /= validSeconds;
+  }
+};
+
+struct PathResult {
+  EstimateResult peaks;
+  EstimateResult spectral;
+};
+
+static PathResult replay(const std::vector<Row> &rows, bool filter, float refBpm, float sps, uint32_t drainMs,
+                         double &nsPerSample, uint32_t &maxCycles, uint32_t &referenced) {
+  HeartRate_Service hr;
+  MotionCancel_Service mc;
+  SpectralHR_Service spectral;
+  hr.begin();
+  mc.begin();
+  mc.setEnabled(filter);
+  spectral.begin(sps);
+
+  PathResult res;
+
+  uint32_t nextSecond = 1000;
+  uint32_t nextDrain = drainMs;
+  std::vector<const Row *> pending;
+  double totalNs = 0;
+  for (const Row &r : rows) {
+    host_setMicros((uint64_t)r.t_ms * 1000);
+    if (r.hasGyro) mc.addReference(micros(), r.rate[0], r.rate[1], r.rate[2]);
+
+    // Samples wait in the FIFO until the next drain
+    pending.push_back(&r);
+    if (drainMs == 0 || r.t_ms >= nextDrain) {
+      nextDrain += drainMs;
+      for (const Row *p : pending) {
+        uint32_t red = p->red, ir = p->ir;
+        auto start = std::chrono::steady_clock::now();
+        mc.process(p->t_ms * 1000, red, ir);
+        totalNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        hr.addSample(red, ir, p->t_ms);
+        spectral.addSample(ir);
+      }
+      pending.clear();
+      spectral.update(r.t_ms);
+    }
+
+    if (r.t_ms >= nextSecond) {
+      nextSecond += 1000;
+      res.peaks.add(hr.getReadings().heartRate, refBpm);
+      SpectralHRData s = spectral.getReadings();
+      res.spectral.add(s.validReading ? s.heartRate : 0.0f, refBpm);
+    }
+  }
+  res.peaks.finish();
+  res.spectral.finish();
+  nsPerSample = rows.empty() ? 0 : totalNs / rows.size();
+  maxCycles = mc.getMaxCycles();
+  referenced = mc.getReferencedCount();
+  return res;
+}
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  float synthSeconds = 0, bpm = 72, cadence = 170, sps = 25, refBpm = 0;
+  uint32_t drainMs = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--synth") && i + 1 < argc) synthSeconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--bpm") && i + 1 < argc) bpm = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--cadence") && i + 1 < argc) cadence = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--rate") && i + 1 < argc) sps = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--ref-bpm") && i + 1 < argc) refBpm = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--drain") && i + 1 < argc) drainMs = atoi(argv[++i]);
+    else if (argv[i][0] != '-') path = argv[i];
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  std::vector<Row> rows;
+  if (synthSeconds > 0) {
+    synthesize(rows, synthSeconds, bpm, cadence, sps);
+    refBpm = bpm;
+  } else if (!path || !loadCsv(path, rows)) {
+    fprintf(stderr,
+            "usage: %s <run.csv> [--ref-bpm bpm] | --synth <s> [--bpm b] [--cadence spm] [--rate sps] "
+            "[--drain ms]\n",
+            argv[0]);
+    return 2;
+  }
+  if (rows.empty()) {
+    fprintf(stderr, "no samples\n");
+    return 1;
+  }
+
+  // Input rate for the spectral estimator's decimation
+  float rate = sps;
+  if (synthSeconds <= 0 && rows.size() > 1 && rows.back().t_ms > rows.front().t_ms) {
+    rate = (rows.size() - 1) * 1000.0f / (rows.back().t_ms - rows.front().t_ms);
+  }
+
+  double nsRaw, nsFiltered;
+  uint32_t maxRaw, maxFiltered, refRaw, refFiltered;
+  PathResult raw = replay(rows, false, refBpm, rate, drainMs, nsRaw, maxRaw, refRaw);
+  PathResult filtered = replay(rows, true, refBpm, rate, drainMs, nsFiltered, maxFiltered, refFiltered);
+
+  printf("%zu samples, %.1f s", rows.size(), rows.back().t_ms / 1000.0);
+  if (drainMs > 0) printf(", drained every %u ms", drainMs);
+  printf("\n");
+  printf("         --- peaks ---------   --- spectral ------\n");
+  printf("  t(s)   raw bpm  filtered bpm  raw bpm  filtered bpm\n");
+  for (size_t i = 0; i < raw.peaks.perSecond.size(); i++) {
+    printf("%6zu %9.1f %13.1f %8.1f %13.1f\n", i + 1, raw.peaks.perSecond[i], filtered.peaks.perSecond[i],
+           raw.spectral.perSecond[i], filtered.spectral.perSecond[i]);
+  }
+  if (refBpm > 0) {
+    printf("mean |error| vs %.0f bpm:\n", refBpm);
+    printf("  peaks:    raw %.1f (%d s), filtered %.1f (%d s)\n", raw.peaks.meanAbsError, raw.peaks.validSeconds,
+           filtered.peaks.meanAbsError, filtered.peaks.validSeconds);
+    printf("  spectral: raw %.1f (%d s), filtered %.1f (%d s)\n", raw.spectral.meanAbsError,
+           raw.spectral.validSeconds, filtered.spectral.meanAbsError, filtered.spectral.validSeconds);
+  }
+  printf("filter cost: %.0f ns/sample avg, %u ns max (bypass %.0f ns/sample)\n", nsFiltered, maxFiltered, nsRaw);
+  printf("motion reference found for %u of %zu samples (gyro history %d readings)\n", refFiltered, rows.size(),
+         (int)MC_REF_HISTORY);
+  Prof_print();
+  return 0;
+}
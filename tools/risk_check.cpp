@@ -0,0 +1,111 @@
+// Risk score check for RiskScore_Service (main/RiskScore_Service.cpp).
+// Runs scripted scenarios on a virtual clock, one vitals update every 200 ms
+// and one position fix a second, and checks the score against what an
+// organiser would expect:
+//   stop-and-go   run at 3 m/s and 150 bpm, stop at an aid station for 5 min
+//                 while HR recovers to 95, run on: no alert at any point
+//   standing      10 min standing still at 95 bpm: no heat risk
+//   drift         steady 3 m/s while HR creeps from 150 to 185 bpm over
+//                 25 min (cardiac drift): heat risk must reach alert level
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -o risk_check tools/risk_check.cpp main/RiskScore_Service.cpp
+// Run:    ./risk_check [--trace]
+// Exit status is non-zero if a scenario fails.
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RiskScore_Service.h"
+
+static const uint32_t UPDATE_MS = 200;
+static const uint32_t FIX_MS = 1000;
+
+struct Segment {
+  float seconds;
+  float speed_mps;
+  float hrFrom;     // HR moves from hrFrom towards hrTo
+  float hrTo;
+  float hrTau_s;    // exponential approach; 0 = linear over the segment
+};
+
+struct Result {
+  uint8_t maxScore;
+  uint8_t maxHeat;
+  uint8_t lastHeat;
+  uint32_t alertMs;
+};
+
+static bool g_trace = false;
+
+static Result run(const char *name, const Segment *segs, size_t n) {
+  RiskScore_Service risk;
+  risk.begin();
+  Result r = {0, 0, 0, 0};
+  uint32_t t = 1000;
+  double east = 0;
+  uint32_t nextFix = t;
+  for (size_t s = 0; s < n; s++) {
+    const Segment &g = segs[s];
+    const uint32_t start = t, end = t + (uint32_t)(g.seconds * 1000);
+    for (; t < end; t += UPDATE_MS) {
+      const float el = (t - start) * 0.001f;
+      const float hr = g.hrTau_s > 0 ? g.hrTo + (g.hrFrom - g.hrTo) * expf(-el / g.hrTau_s)
+                                     : g.hrFrom + (g.hrTo - g.hrFrom) * el / g.seconds;
+      if (t >= nextFix) {
+        east += g.speed_mps * FIX_MS * 0.001;
+        risk.addFix(t, east, 0, NAN);
+        nextFix += FIX_MS;
+      }
+      RiskInput in = {t, hr, 97, 80, 5, 5, NAN};
+      const RiskScore &rs = risk.update(in);
+      r.maxScore = max(r.maxScore, rs.score);
+      r.maxHeat = max(r.maxHeat, rs.heat);
+      r.lastHeat = rs.heat;
+      if (rs.alert) r.alertMs += UPDATE_MS;
+      if (g_trace && (t - 1000) % 10000 == 0) {
+        printf("  %-13s %6.0f s  v %.1f  hr %5.1f  score %3u heat %3u exertion %3u\n", name, (t - 1000) * 0.001,
+               risk.getSpeed(), hr, rs.score, rs.heat, rs.exertion);
+      }
+    }
+  }
+  printf("%-13s max score %3u, max heat %3u, final heat %3u, %5.1f s in alert\n", name, r.maxScore, r.maxHeat,
+         r.lastHeat, r.alertMs * 0.001);
+  return r;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--trace")) g_trace = true;
+  }
+  bool ok = true;
+
+  const Segment stopAndGo[] = {
+    {600, 3.0, 150, 150, 0},
+    {300, 0.0, 150, 95, 40},   // aid station: HR recovers
+    {600, 3.0, 95, 150, 30},
+  };
+  Result r = run("stop-and-go", stopAndGo, 3);
+  if (r.alertMs > 0 || r.maxHeat >= 30) {
+    printf("FAIL: stopping raised heat risk\n");
+    ok = false;
+  }
+
+  const Segment standing[] = {{600, 0.0, 95, 95, 0}};
+  r = run("standing", standing, 1);
+  if (r.maxHeat > 0) {
+    printf("FAIL: heat risk while standing still\n");
+    ok = false;
+  }
+
+  const Segment drift[] = {{1500, 3.0, 150, 185, 0}};
+  r = run("drift", drift, 1);
+  if (r.lastHeat < RISK_ALERT_THRESHOLD) {
+    printf("FAIL: cardiac drift not flagged\n");
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,303 @@
+#include "session_pipeline.h"
+
+#include <string.h>
+
+#include "session_codec.h"
+
+Pipeline::Pipeline(PipelineSink &sink, uint32_t interval_ms, bool motionCancel)
+    : _sink(sink), _interval_ms(interval_ms), _mcAllowed(motionCancel) {
+  _hr.begin();
+  _mc.begin();
+  _mc.setEnabled(motionCancel);
+  _risk.begin();
+  _alerts.begin(raiseAlert, this);
+  memset(&_ppg, 0, sizeof(_ppg));
+  _havePpg = false;
+  _cal = GyroCalibration{65.5f, 0.0f, 0.0f, 0.0f};
+  _haveCal = false;
+  _gyro = GyroIntegrator{0.0f, 0.0f, 0};
+  memset(&_g, 0, sizeof(_g));
+  _temperature = NAN;
+  _lat = _lon = 0.0f;
+  _started = false;
+  _t0_us = _now_us = _nextSample_us = 0;
+}
+
+void Pipeline::at(uint64_t t_us) {
+  if (!_started) {
+    _started = true;
+    _t0_us = t_us;
+    _nextSample_us = t_us + (uint64_t)_interval_ms * 1000;
+    _sink.onStart(t_us);
+  }
+  while (t_us >= _nextSample_us) {
+    emitSample(_nextSample_us);
+    _nextSample_us += (uint64_t)_interval_ms * 1000;
+  }
+  _now_us = t_us;
+  host_setMicros(t_us);
+}
+
+void Pipeline::emitSample(uint64_t t_us) {
+  PipelineSample s;
+  s.t_us = t_us;
+  s.hr = _hr.getReadings();
+  s.gyro = _g;
+  s.risk = _risk.getScore();
+  s.lat = _lat;
+  s.lon = _lon;
+  _sink.onSample(s);
+}
+
+void Pipeline::finish(uint64_t t_us) {
+  if (_started) at(t_us);
+}
+
+void Pipeline::ppgHeader(const SessionPpgHeader &h) {
+  counts.ppgHeaders++;
+  if (_havePpg) {
+    SessionPpgHeader a = _ppg, b = h;
+    a.motionCancel = b.motionCancel = 0;
+    // HR_setMotionCancel() only resets the filter; LED/ADC changes are a
+    // discontinuity for the HR service as well
+    if (memcmp(&a, &b, sizeof(a)) != 0) {
+      _hr.markDiscontinuity();
+      _sink.onEvent(_now_us, PIPE_EVT_PPG_RETUNE, h.irCurrent);
+    }
+    _mc.reset();
+  }
+  _mc.setEnabled(_mcAllowed && h.motionCancel);
+  _ppg = h;
+  _havePpg = true;
+}
+
+void Pipeline::ppg(uint32_t t_us, uint32_t period_us, uint8_t queued, const uint32_t *red, const uint32_t *ir,
+                   uint8_t n) {
+  counts.ppgBatches++;
+  for (uint8_t i = 0; i < n; i++) {
+    uint32_t r = red[i], x = ir[i];
+    const uint32_t age = (uint32_t)(queued - 1 - i) * period_us;
+    _mc.process(t_us - age, r, x);
+    _hr.addSample(r, x, millis() - age / 1000); // as HR_step() stamps them
+  }
+  counts.ppgSamples += n;
+}
+
+void Pipeline::imuHeader(const SessionImuHeader &h) {
+  _cal = GyroCalibration{h.sensitivity, h.biasRoll_dps, h.biasPitch_dps, h.biasYaw_dps};
+  _haveCal = true;
+}
+
+void Pipeline::imu(uint32_t t_us, const int16_t raw[3]) {
+  counts.imu++;
+  if (!_haveCal) return;
+  Gyro_integrate(_gyro, _cal, raw, t_us, _g);
+  _mc.addReference(_g.t_us, _g.rollRate_dps, _g.pitchRate_dps, _g.yawRate_dps);
+  loopPass();
+}
+
+void Pipeline::imuHeld(uint32_t t_us) {
+  counts.imuHeld++;
+  _g.roll_deg = _gyro.roll_deg;
+  _g.pitch_deg = _gyro.pitch_deg;
+  _g.rollRate_dps = _g.pitchRate_dps = _g.yawRate_dps = 0.0f;
+  _g.t_us = t_us;
+  _mc.addReference(_g.t_us, 0.0f, 0.0f, 0.0f);
+  loopPass();
+}
+
+// What loop() does with a gyro reading: fall condition, then the risk update
+// and its condition, then the deferred events
+void Pipeline::loopPass() {
+  const uint32_t ms = millis();
+
+  _alerts.update(ALERT_COND_FALL, max(fabsf(_g.rollRate_dps), fabsf(_g.pitchRate_dps)), ms);
+
+  HeartRateData hr = _hr.getReadings();
+  RiskInput in;
+  in.timestamp = ms;
+  in.heartRate = hr.validReading ? hr.heartRate : 0;
+  in.spO2 = hr.validReading ? hr.spO2 : 0;
+  in.signalQuality = hr.signalQuality;
+  in.rollRate_dps = _g.rollRate_dps;
+  in.pitchRate_dps = _g.pitchRate_dps;
+  in.temperature = _temperature;
+  const RiskScore &rs = _risk.update(in);
+  _alerts.update(ALERT_COND_RISK, rs.score, ms);
+
+  _alerts.service(ms);
+}
+
+// Where the device hands an event to the uplink: it always has room here, so
+// only the engine's dwell, interval and rate limit decide what goes out
+bool Pipeline::raiseAlert(UplinkAlertKind kind, uint32_t eventMs, void *ctx) {
+  Pipeline &pl = *(Pipeline *)ctx;
+  const uint64_t t_us = pl._now_us - (uint64_t)(millis() - eventMs) * 1000;
+  if (kind == UPLINK_ALERT_FALL) {
+    pl._sink.onEvent(t_us, PIPE_EVT_FALL, max(fabsf(pl._g.rollRate_dps), fabsf(pl._g.pitchRate_dps)));
+  } else if (kind == UPLINK_ALERT_RISK) {
+    pl._sink.onEvent(t_us, PIPE_EVT_RISK_ALERT, pl._risk.getScore().score);
+  }
+  return true;
+}
+
+void Pipeline::fix(float lat, float lon, float east_m, float north_m) {
+  counts.fixes++;
+  _lat = lat;
+  _lon = lon;
+  _risk.addFix(millis(), east_m, north_m, NAN);
+}
+
+void Pipeline::event(uint8_t kind, float value) {
+  counts.events++;
+  switch (kind) {
+    case SESSION_EVT_TEMPERATURE:
+      _temperature = value;
+      _hr.setTemperature(value);
+      break;
+    case SESSION_EVT_HR_RESET:
+      _hr.reset();
+      _sink.onEvent(_now_us, PIPE_EVT_HR_RESET, 0.0f);
+      break;
+    case SESSION_EVT_IMU_RESUME:
+      _gyro.last_us = 0;
+      break;
+    case SESSION_EVT_GAP:
+      // Records are missing: nothing after this lines up with before
+      counts.gaps += (uint32_t)value;
+      _hr.markDiscontinuity();
+      _mc.reset();
+      _gyro.last_us = 0;
+      _sink.onEvent(_now_us, PIPE_EVT_GAP, value);
+      break;
+  }
+}
+
+// ======= Decoding =======
+
+static uint32_t get24(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+template <class T> static T get(const uint8_t *p) {
+  T v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// One chunk payload; false if it is malformed
+static bool replayChunk(const uint8_t *p, size_t len, uint16_t records, uint64_t t, Pipeline &pl, SessionInfo &info) {
+  size_t off = 0;
+  for (uint16_t r = 0; r < records; r++) {
+    if (off + SESSION_RECORD_HEADER_SIZE > len) return false;
+    uint8_t type = p[off], count = p[off + 1];
+    uint16_t dt = get<uint16_t>(p + off + 2);
+    int body = Session_bodySize(type, count);
+    off += SESSION_RECORD_HEADER_SIZE;
+    if (body < 0 || off + body > len) return false;
+    const uint8_t *b = p + off;
+    off += body;
+    info.records++;
+
+    t += dt;
+    if (type == SESSION_REC_TIME) {
+      t += get<uint32_t>(b);
+      continue;
+    }
+    if (!pl.started()) info.firstT_us = t;
+    pl.at(t);
+    info.lastT_us = t;
+    const uint32_t t32 = (uint32_t)t;
+
+    switch (type) {
+      case SESSION_REC_PPG_HEADER:
+        pl.ppgHeader(get<SessionPpgHeader>(b));
+        break;
+      case SESSION_REC_PPG: {
+        uint32_t red[SESSION_PPG_MAX_BATCH], ir[SESSION_PPG_MAX_BATCH];
+        uint8_t n = count < SESSION_PPG_MAX_BATCH ? count : SESSION_PPG_MAX_BATCH;
+        for (uint8_t i = 0; i < n; i++) {
+          red[i] = get24(b + 6 + 6 * i);
+          ir[i] = get24(b + 6 + 6 * i + 3);
+        }
+        pl.ppg(t32, get<uint32_t>(b), b[4], red, ir, n);
+        break;
+      }
+      case SESSION_REC_IMU_HEADER:
+        pl.imuHeader(get<SessionImuHeader>(b));
+        break;
+      case SESSION_REC_IMU: {
+        int16_t raw[3] = {get<int16_t>(b), get<int16_t>(b + 2), get<int16_t>(b + 4)};
+        pl.imu(t32, raw);
+        break;
+      }
+      case SESSION_REC_IMU_HELD:
+        pl.imuHeld(t32);
+        break;
+      case SESSION_REC_FIX:
+        pl.fix(get<float>(b), get<float>(b + 4), get<float>(b + 8), get<float>(b + 12));
+        break;
+      case SESSION_REC_EVENT:
+        pl.event(count, get<float>(b));
+        break;
+    }
+  }
+  return off == len;
+}
+
+bool Session_replay(const uint8_t *data, size_t len, Pipeline &pl, SessionInfo &info, char *err, size_t errLen) {
+  // File header, possibly after console text
+  size_t pos = 0;
+  while (pos + SESSION_FILE_HEADER_SIZE <= len && memcmp(data + pos, SESSION_MAGIC, 4) != 0) pos++;
+  if (pos + SESSION_FILE_HEADER_SIZE > len) {
+    snprintf(err, errLen, "no session header");
+    return false;
+  }
+  uint16_t version = get<uint16_t>(data + pos + 4);
+  uint16_t headerBytes = get<uint16_t>(data + pos + 6);
+  if (version < SESSION_VERSION_MIN || version > SESSION_VERSION) {
+    snprintf(err, errLen, "session version %u, expected %u-%u", version, SESSION_VERSION_MIN, SESSION_VERSION);
+    return false;
+  }
+  info.deviceId = get<int32_t>(data + pos + 8);
+  info.startMs = get<uint32_t>(data + pos + 12);
+  info.skippedBytes = pos;
+  pos += headerBytes;
+
+  static thread_local uint8_t plain[0xFFFF];
+  while (pos + SESSION_CHUNK_HEADER_SIZE <= len) {
+    const uint8_t *c = data + pos;
+    const uint16_t sync = get<uint16_t>(c);
+    if (sync != SESSION_CHUNK_SYNC && (sync != SESSION_CHUNK_SYNC_RICE || version < 2)) {
+      pos++;
+      info.skippedBytes++;
+      continue;
+    }
+    uint16_t payload = get<uint16_t>(c + 2);
+    if (pos + SESSION_CHUNK_HEADER_SIZE + payload > len) {
+      info.truncated = true;
+      break;
+    }
+    const uint8_t *body = c + SESSION_CHUNK_HEADER_SIZE;
+    if (Session_crc16(body, payload) != get<uint16_t>(c + 6)) {
+      // Not a chunk after all, or a damaged one: look for the next sync word
+      info.crcErrors++;
+      pos++;
+      info.skippedBytes++;
+      continue;
+    }
+    const uint16_t records = get<uint16_t>(c + 4);
+    size_t plainLen = payload;
+    if (sync == SESSION_CHUNK_SYNC_RICE) {
+      plainLen = Session_decompress(body, payload, records, plain, sizeof(plain));
+      body = plain;
+    }
+    if (plainLen == 0 || !replayChunk(body, plainLen, records, get<uint64_t>(c + 8), pl, info)) info.badChunks++;
+    info.coded += sync == SESSION_CHUNK_SYNC_RICE;
+    info.chunks++;
+    pos += SESSION_CHUNK_HEADER_SIZE + payload;
+  }
+  info.skippedBytes += len - pos;
+  pl.finish(info.lastT_us);
+  return true;
+}
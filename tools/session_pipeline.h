@@ -0,0 +1,126 @@
+// Firmware signal chain over a recorded session (main/session_format.h),
+// shared by the host tools that replay sessions.
+//
+// Records are decoded in file order and, on the calling thread's virtual
+// clock, fed through the same code the device runs: MotionCancel_Service and
+// HeartRate_Service for the PPG stream, Gyro_integrate() for the raw gyro
+// counts, then RiskScore_Service and the fall and risk conditions of the
+// alert engine (alert_engine.h) once per gyro reading (one loop() pass on the
+// device). A sink receives a sample at a fixed interval of session time plus
+// the alert events the device would have raised and the other events the
+// loop acted on.
+//
+// One Pipeline per session; instances share nothing, so sessions can run on
+// separate threads.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HeartRate_Service.h"
+#include "MotionCancel_Service.h"
+#include "RiskScore_Service.h"
+#include "alert_engine.h"
+#include "gyro_module.h"
+#include "session_format.h"
+
+enum PipelineEventKind : uint8_t {
+  PIPE_EVT_RISK_ALERT = 1,   // value: risk score when raised; t: trigger time
+  PIPE_EVT_FALL = 2,         // value: max(|roll|, |pitch|) rate in deg/s when raised; t: trigger time
+  PIPE_EVT_HR_RESET = 3,
+  PIPE_EVT_PPG_RETUNE = 4,   // LED/ADC settings changed (value: new IR current code)
+  PIPE_EVT_GAP = 5,          // value: records lost on the device
+};
+
+struct PipelineSample {
+  uint64_t t_us;             // session time (device esp_timer)
+  HeartRateData hr;
+  GyroReading gyro;
+  RiskScore risk;
+  float lat;
+  float lon;
+};
+
+class PipelineSink {
+public:
+  virtual ~PipelineSink() {}
+  virtual void onStart(uint64_t t0_us) { (void)t0_us; }
+  virtual void onSample(const PipelineSample &s) = 0;
+  virtual void onEvent(uint64_t t_us, PipelineEventKind kind, float value) {
+    (void)t_us;
+    (void)kind;
+    (void)value;
+  }
+};
+
+struct PipelineCounts {
+  uint32_t ppgBatches = 0, ppgSamples = 0, ppgHeaders = 0;
+  uint32_t imu = 0, imuHeld = 0, fixes = 0, events = 0, gaps = 0;
+};
+
+class Pipeline {
+public:
+  Pipeline(PipelineSink &sink, uint32_t interval_ms, bool motionCancel);
+
+  // Every record: emit the samples due before it, then set the clock
+  void at(uint64_t t_us);
+
+  void ppgHeader(const SessionPpgHeader &h);
+  void ppg(uint32_t t_us, uint32_t period_us, uint8_t queued, const uint32_t *red, const uint32_t *ir, uint8_t n);
+  void imuHeader(const SessionImuHeader &h);
+  void imu(uint32_t t_us, const int16_t raw[3]);
+  void imuHeld(uint32_t t_us);
+  void fix(float lat, float lon, float east_m, float north_m);
+  void event(uint8_t kind, float value);
+
+  // Emit the samples due up to t_us (the last record's time)
+  void finish(uint64_t t_us);
+
+  bool started() const { return _started; }
+  uint64_t startTime() const { return _t0_us; }
+
+  PipelineCounts counts;
+
+private:
+  void loopPass();
+  void emitSample(uint64_t t_us);
+  static bool raiseAlert(UplinkAlertKind kind, uint32_t eventMs, void *ctx);
+
+  PipelineSink &_sink;
+  uint32_t _interval_ms;
+  bool _mcAllowed;
+  HeartRate_Service _hr;
+  MotionCancel_Service _mc;
+  RiskScore_Service _risk;
+  AlertEngine _alerts;
+  SessionPpgHeader _ppg;
+  bool _havePpg;
+  GyroCalibration _cal;
+  bool _haveCal;
+  GyroIntegrator _gyro;
+  GyroReading _g;
+  float _temperature;
+  float _lat, _lon;
+  bool _started;
+  uint64_t _t0_us;
+  uint64_t _now_us;
+  uint64_t _nextSample_us;
+};
+
+struct SessionInfo {
+  int32_t deviceId = 0;
+  uint32_t startMs = 0;
+  uint64_t firstT_us = 0;
+  uint64_t lastT_us = 0;
+  uint32_t chunks = 0, records = 0;
+  uint32_t crcErrors = 0, badChunks = 0;
+  uint32_t coded = 0;        // chunks stored with session_codec.h
+  size_t skippedBytes = 0;
+  bool truncated = false;
+};
+
+// Decode a whole session image (file contents, possibly with console text
+// around it) into `pl`. Returns false, with a message in `err`, if there is
+// no usable file header.
+bool Session_replay(const uint8_t *data, size_t len, Pipeline &pl, SessionInfo &info, char *err, size_t errLen);
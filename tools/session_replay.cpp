@@ -0,0 +1,310 @@
+// Raw sensor session replay.
+// Reads a session written by the on-device recorder (main/recorder.h, format
+// in main/session_format.h) and feeds it, in the recorded order and on a
+// virtual clock set to the recorded timestamps, through the same code the
+// firmware runs (tools/session_pipeline.h): PPG through MotionCancel_Service
+// and HeartRate_Service, raw gyro counts through Gyro_integrate(), the risk
+// score and the fall and risk alert conditions. Output is plain text at a
+// fixed interval of session time, with events as comment lines (alerts at
+// their trigger time), so runs are deterministic and two firmware versions
+// can be compared with diff. Statistics go to stderr.
+//
+// The services start cold at the beginning of the file, so the first seconds
+// can differ from what the device reported if it had been running before the
+// recording started.
+//
+// Build:  g++ -O2 -std=c++17 -Itools/host -Imain -o session_replay tools/session_replay.cpp
+//           tools/session_pipeline.cpp main/HeartRate_Service.cpp main/MotionCancel_Service.cpp
+//           main/RiskScore_Service.cpp main/gyro_integrate.cpp main/recorder.cpp main/profiler.cpp
+//           main/session_codec.cpp main/alert_state.cpp
+// Run:    ./session_replay session.bin [--interval <ms>] [--no-motion-cancel] > run.txt
+//         ./session_replay --synth <seconds> [--device <id>] [--compress] [--imu-window <ms>] session.bin > live.txt
+// --synth records a synthetic run through the recorder and prints what the
+// live pipeline computed; replaying the file must print the same. --compress
+// records with chunk coding on, as the black box does (main/blackbox.h);
+// --imu-window 90 also averages the gyro like it, and the replayed angles
+// then trail the live ones by up to that window.
+// The synthetic pulse runs at 120 + id % 60 bpm; --synth exits non-zero if
+// the mean of the valid readings after warm-up is further than SYNTH_HR_TOL
+// from that. Pulses a little under 9 samples per beat (about 167-171 bpm at
+// 25 Hz) still read low: the three-point peak detector misses beats there.
+//
+// A "rec dump" capture from the serial console can be replayed as is: text
+// before the file header and after the last chunk is skipped.
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "recorder.h"
+#include "session_pipeline.h"
+
+// Fixed-interval text, one line per sample; events as comment lines
+class TextSink : public PipelineSink {
+public:
+  void onStart(uint64_t t0_us) override {
+    _t0_us = t0_us;
+    printf("# t_s hr_bpm spo2 quality finger valid roll_deg pitch_deg risk lat lon\n");
+  }
+
+  void onSample(const PipelineSample &s) override {
+    printf("%.3f %.2f %.2f %.1f %d %d %.4f %.4f %u %.7f %.7f\n", (s.t_us - _t0_us) / 1e6, s.hr.heartRate,
+           s.hr.spO2, s.hr.signalQuality, s.hr.fingerDetected ? 1 : 0, s.hr.validReading ? 1 : 0, s.gyro.roll_deg,
+           s.gyro.pitch_deg, s.risk.score, s.lat, s.lon);
+    if (s.hr.validReading && s.t_us - _t0_us >= SYNTH_WARMUP_US) {
+      _hrSum += s.hr.heartRate;
+      _hrCount++;
+    }
+  }
+
+  // Mean of the valid HR readings after warm-up, 0 if none
+  double meanHeartRate() const { return _hrCount ? _hrSum / _hrCount : 0.0; }
+
+  void onEvent(uint64_t t_us, PipelineEventKind kind, float value) override {
+    static const char *NAMES[] = {"?", "risk-alert", "fall", "hr-reset", "ppg-retune", "gap"};
+    printf("# %.6f %s %.2f\n", (t_us - _t0_us) / 1e6, kind <= PIPE_EVT_GAP ? NAMES[kind] : NAMES[0], value);
+  }
+
+private:
+  static const uint64_t SYNTH_WARMUP_US = 10000000;
+  uint64_t _t0_us = 0;
+  double _hrSum = 0;
+  uint32_t _hrCount = 0;
+};
+
+static const double SYNTH_HR_TOL = 2.0; // bpm
+
+static int replayFile(const char *path, uint32_t interval_ms, bool motionCancel) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(f);
+
+  TextSink sink;
+  Pipeline pl(sink, interval_ms, motionCancel);
+  SessionInfo info;
+  char err[128];
+  auto wallStart = std::chrono::steady_clock::now();
+  if (!Session_replay(data.data(), data.size(), pl, info, err, sizeof(err))) {
+    fprintf(stderr, "%s: %s\n", path, err);
+    return 1;
+  }
+
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double session_s = (info.lastT_us - info.firstT_us) / 1e6;
+  const PipelineCounts &pc = pl.counts;
+  fprintf(stderr, "device %d, started at %u ms, %.1f s of data\n", info.deviceId, info.startMs, session_s);
+  fprintf(stderr, "%u chunks, %u records | %u PPG samples in %u batches, %u PPG headers | %u gyro (%u held) | %u fixes"
+                  " | %u events, %u records lost on the device\n",
+          info.chunks, info.records, pc.ppgSamples, pc.ppgBatches, pc.ppgHeaders, pc.imu, pc.imuHeld, pc.fixes,
+          pc.events, pc.gaps);
+  if (info.coded) fprintf(stderr, "%u of %u chunks coded, %zu bytes\n", info.coded, info.chunks, data.size());
+  if (info.crcErrors || info.badChunks || info.truncated) {
+    fprintf(stderr, "%u CRC errors, %u malformed chunks%s\n", info.crcErrors, info.badChunks,
+            info.truncated ? ", last chunk truncated" : "");
+  }
+  if (info.skippedBytes) fprintf(stderr, "%zu bytes outside chunks skipped\n", info.skippedBytes);
+  fprintf(stderr, "replayed in %.3f s (%.0fx real time)\n", wall_s, wall_s > 0 ? session_s / wall_s : 0.0);
+  return 0;
+}
+
+// ======= Synthetic session =======
+
+class FileStream : public Stream {
+public:
+  explicit FileStream(FILE *f) : _f(f) {}
+  using Stream::write;
+  size_t write(uint8_t b) override { return fputc(b, _f) == EOF ? 0 : 1; }
+  size_t write(const uint8_t *buf, size_t len) override { return fwrite(buf, 1, len, _f); }
+  void flush() override { fflush(_f); }
+
+private:
+  FILE *_f;
+};
+
+// A run with arm swing, a few seconds of gyro standby (forcing long gaps
+// between records) and an AGC-style LED change, recorded through the real
+// recorder while the same pipeline processes it live.
+static int synthesize(const char *path, float seconds, uint32_t interval_ms, int32_t deviceId, bool compress,
+                      uint32_t imuWindow_ms) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  FileStream out(f);
+  host_setMicros(5000000);
+  Recorder_start(out, deviceId, /*startTask=*/false, compress, imuWindow_ms * 1000);
+  TextSink sink;
+  Pipeline pl(sink, interval_ms, true);
+
+  std::mt19937 rng((uint32_t)deviceId);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  const GyroCalibration cal = {65.5f, 1.2f, -0.7f, 0.3f};
+  const float sps = 25.0f, fHeart = (120 + deviceId % 60) / 60.0f, fSwing = 170.0f / 120.0f;
+  const uint32_t period_us = (uint32_t)(1000000.0f / sps);
+  const uint64_t start = 5000000, end = start + (uint64_t)(seconds * 1e6);
+  const uint64_t standbyFrom = start + (uint64_t)(seconds * 0.5e6), standbyTo = standbyFrom + 4000000;
+
+  SessionPpgHeader ppg = {sps, 1, 4, 2, 3, 0x24, 0x24, 1, 0};
+  float lagged[3] = {0, 0, 0}, rate[3] = {0, 0, 0};
+  uint32_t red[SESSION_PPG_MAX_BATCH], ir[SESSION_PPG_MAX_BATCH];
+  uint8_t pending = 0;
+  bool standby = false, retuned = false;
+  uint64_t nextPpg = start, nextDrain = start + 200000, nextImu = start, nextFix = start, nextTemp = start;
+
+  uint64_t last = start;
+  auto emit = [&](uint64_t t) {
+    host_setMicros(t);
+    pl.at(t);
+    last = t;
+  };
+  emit(start);
+  Recorder_ppgHeader((uint32_t)start, ppg);
+  pl.ppgHeader(ppg);
+  Recorder_imuHeader((uint32_t)start, cal);
+  pl.imuHeader(SessionImuHeader{cal.sensitivity, cal.biasRoll_dps, cal.biasPitch_dps, cal.biasYaw_dps});
+
+  for (uint64_t t = start; t < end; t += 1000) {
+    host_setMicros(t);
+    float ts = (t - start) / 1e6f;
+    for (int c = 0; c < 3; c++) lagged[c] += (rate[c] - lagged[c]) * 0.02f;
+
+    // Sensor FIFO fills at the sample rate
+    if (t >= nextPpg) {
+      nextPpg += period_us;
+      float pulse = sinf(2 * PI * fHeart * ts) + 0.35f * sinf(4 * PI * fHeart * ts + 1.0f);
+      float motion = 40.0f * lagged[0] + 60.0f * lagged[1] - 30.0f * lagged[2];
+      float gain = retuned ? 1.3f : 1.0f;
+      if (pending < SESSION_PPG_MAX_BATCH) {
+        ir[pending] = (uint32_t)max(0.0f, gain * (80000.0f + 6000.0f * pulse) + motion + 150.0f * noise(rng));
+        red[pending] = (uint32_t)max(0.0f, gain * (60000.0f + 3500.0f * pulse) + 0.8f * motion + 150.0f * noise(rng));
+        pending++;
+      }
+    }
+
+    // loop(): HR_step drains the FIFO every 200 ms (stopped in standby)
+    if (t >= nextDrain) {
+      nextDrain += 200000;
+      if (!standby && pending > 0) {
+        emit(t);
+        Recorder_ppg((uint32_t)t, period_us, pending, red, ir, pending);
+        pl.ppg((uint32_t)t, period_us, pending, red, ir, pending);
+      }
+      pending = 0;
+      if (!retuned && t >= start + (uint64_t)(seconds * 0.25e6)) {
+        retuned = true;
+        ppg.irCurrent = 0x30;
+        ppg.redCurrent = 0x30;
+        emit(t);
+        Recorder_ppgHeader((uint32_t)t, ppg);
+        pl.ppgHeader(ppg);
+      }
+    }
+
+    // Gyro_step: 50 Hz, 5 Hz held readings in standby
+    if (t >= nextImu) {
+      rate[0] = 180.0f * sinf(2 * PI * fSwing * ts) + 3.0f * noise(rng);
+      rate[1] = 60.0f * sinf(2 * PI * 2 * fSwing * ts + 0.7f) + 3.0f * noise(rng);
+      rate[2] = 40.0f * cosf(2 * PI * fSwing * ts) + 3.0f * noise(rng);
+      bool nowStandby = t >= standbyFrom && t < standbyTo;
+      if (standby && !nowStandby) {
+        emit(t);
+        Recorder_event((uint32_t)t, SESSION_EVT_IMU_RESUME, 0.0f);
+        pl.event(SESSION_EVT_IMU_RESUME, 0.0f);
+      }
+      standby = nowStandby;
+      emit(t);
+      if (standby) {
+        Recorder_imuHeld((uint32_t)t);
+        pl.imuHeld((uint32_t)t);
+        nextImu += 200000;
+      } else {
+        // Counts as read: Y and Z are mounted inverted
+        int16_t raw[3] = {(int16_t)lroundf((rate[0] + cal.biasRoll_dps) * cal.sensitivity),
+                          (int16_t)lroundf(-(rate[1] + cal.biasPitch_dps) * cal.sensitivity),
+                          (int16_t)lroundf(-(rate[2] + cal.biasYaw_dps) * cal.sensitivity)};
+        Recorder_imu((uint32_t)t, raw);
+        pl.imu((uint32_t)t, raw);
+        nextImu += 20000;
+      }
+    }
+
+    if (t >= nextFix) {
+      nextFix += 1000000;
+      float east = 100.0f * cosf(ts / 40.0f), north = 70.0f * sinf(ts / 40.0f);
+      float lat = 42.6977f + north / 111320.0f, lon = 23.3219f + east / 81800.0f;
+      emit(t);
+      Recorder_fix((uint32_t)t, lat, lon, east, north);
+      pl.fix(lat, lon, east, north);
+    }
+
+    if (t >= nextTemp) {
+      nextTemp += 5000000;
+      float celsius = 31.0f + 0.1f * noise(rng);
+      emit(t);
+      Recorder_event((uint32_t)t, SESSION_EVT_TEMPERATURE, celsius);
+      pl.event(SESSION_EVT_TEMPERATURE, celsius);
+    }
+
+    Recorder_service();
+  }
+
+  Recorder_stop();
+  fclose(f);
+  pl.finish(last);
+
+  RecorderStats st;
+  Recorder_getStats(st);
+  fprintf(stderr, "recorded %.0f s: %u records, %u dropped, %u chunks, %u bytes, queue max %u\n", seconds,
+          st.records, st.dropped, st.chunks, st.bytes, st.maxQueued);
+  if (compress) {
+    fprintf(stderr, "coded %u of %u chunks: %u -> %u bytes (ratio %.2f), %.1f us/chunk\n", st.coded, st.chunks,
+            st.rawBytes, st.bytes, (double)st.rawBytes / st.bytes, st.chunks ? (double)st.code_us / st.chunks : 0.0);
+  }
+
+  // Beats are timed per sample, so a burst drain must not bias the rate
+  const double trueHr = fHeart * 60.0, meanHr = sink.meanHeartRate();
+  const bool ok = fabs(meanHr - trueHr) <= SYNTH_HR_TOL;
+  fprintf(stderr, "heart rate: true %.1f bpm, mean reading %.2f bpm: %s\n", trueHr, meanHr, ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  uint32_t interval_ms = 1000;
+  float synthSeconds = 0;
+  int32_t deviceId = 1234;
+  bool motionCancel = true;
+  bool compress = false;
+  uint32_t imuWindow_ms = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--interval") && i + 1 < argc) interval_ms = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--synth") && i + 1 < argc) synthSeconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--device") && i + 1 < argc) deviceId = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--no-motion-cancel")) motionCancel = false;
+    else if (!strcmp(argv[i], "--compress")) compress = true;
+    else if (!strcmp(argv[i], "--imu-window") && i + 1 < argc) imuWindow_ms = (uint32_t)atoi(argv[++i]);
+    else if (argv[i][0] != '-') path = argv[i];
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (!path || interval_ms == 0) {
+    fprintf(stderr, "usage: %s <session.bin> [--interval ms] [--no-motion-cancel] | --synth <s> [--device id] [--compress] [--imu-window ms] <session.bin>\n",
+            argv[0]);
+    return 2;
+  }
+  return synthSeconds > 0 ? synthesize(path, synthSeconds, interval_ms, deviceId, compress, imuWindow_ms) : replayFile(path, interval_ms, motionCancel);
+}